@@ -0,0 +1,252 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "kwin_wayland_test.h"
+
+#include "abstract_client.h"
+#include "composite.h"
+#include "effectloader.h"
+#include "effects.h"
+#include "platform.h"
+#include "wayland_server.h"
+#include "workspace.h"
+
+#include "effect_builtins.h"
+
+#include <KConfigGroup>
+#include <KSycoca>
+
+#include <KWayland/Client/surface.h>
+#include <KWayland/Client/xdgshell.h>
+
+#include <QDBusConnection>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <QDBusUnixFileDescriptor>
+#include <QDir>
+#include <QStandardPaths>
+#include <QtConcurrent>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace KWin;
+using namespace KWayland::Client;
+
+static const QString s_socketName = QStringLiteral("wayland_test_effects_screenshot-0");
+
+class ScreenShotTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+    void cleanup();
+
+    void testMemfd();
+    void benchmarkCaptureScreen_data();
+    void benchmarkCaptureScreen();
+
+private:
+    QImage captureScreenToPipe(const QString &name);
+    QImage captureScreenToMemfd(const QString &name);
+
+    QDBusConnection m_bus = QDBusConnection(QString());
+};
+
+void ScreenShotTest::initTestCase()
+{
+    qRegisterMetaType<KWin::AbstractClient *>();
+    QSignalSpy applicationStartedSpy(kwinApp(), &Application::started);
+    QVERIFY(applicationStartedSpy.isValid());
+    kwinApp()->platform()->setInitialWindowSize(QSize(1280, 1024));
+    QVERIFY(waylandServer()->init(s_socketName));
+
+    auto config = KSharedConfig::openConfig(QString(), KConfig::SimpleConfig);
+    KConfigGroup plugins(config, QStringLiteral("Plugins"));
+    ScriptedEffectLoader loader;
+    const auto builtinNames = BuiltInEffects::availableEffectNames() << loader.listOfKnownEffects();
+    for (const QString &name : builtinNames) {
+        plugins.writeEntry(name + QStringLiteral("Enabled"), false);
+    }
+    config->sync();
+    kwinApp()->setConfig(config);
+
+    // The screenshot interface is restricted to the applications that ask for it.
+    const QString applicationsPath = QStandardPaths::writableLocation(QStandardPaths::ApplicationsLocation);
+    QVERIFY(QDir().mkpath(applicationsPath));
+    QFile desktopFile(applicationsPath + QStringLiteral("/org.kde.kwin.screenshottest.desktop"));
+    QVERIFY(desktopFile.open(QIODevice::WriteOnly));
+    desktopFile.write("[Desktop Entry]\n"
+                      "Type=Application\n"
+                      "Name=KWin screenshot test\n"
+                      "Exec=" + QCoreApplication::applicationFilePath().toUtf8() + "\n"
+                      "X-KDE-DBUS-Restricted-Interfaces=org.kde.KWin.ScreenShot2\n");
+    desktopFile.close();
+    KSycoca::self()->ensureCacheValid();
+
+    qputenv("KWIN_COMPOSE", QByteArrayLiteral("O2"));
+    kwinApp()->start();
+    QVERIFY(applicationStartedSpy.wait());
+    QVERIFY(Compositor::self());
+    waylandServer()->initWorkspace();
+
+    // A connection of its own, so that the calls go through the bus like those of any client.
+    m_bus = QDBusConnection::connectToBus(QDBusConnection::SessionBus, QStringLiteral("screenshot-test"));
+    QVERIFY(m_bus.isConnected());
+}
+
+void ScreenShotTest::init()
+{
+    QVERIFY(Test::setupWaylandConnection());
+
+    auto effectsImpl = static_cast<EffectsHandlerImpl *>(effects);
+    QVERIFY(effectsImpl->loadEffect(BuiltInEffects::nameForEffect(BuiltInEffect::ScreenShot)));
+}
+
+void ScreenShotTest::cleanup()
+{
+    auto effectsImpl = static_cast<EffectsHandlerImpl *>(effects);
+    effectsImpl->unloadAllEffects();
+    QVERIFY(effectsImpl->loadedEffects().isEmpty());
+
+    Test::destroyWaylandConnection();
+}
+
+static QDBusMessage captureScreenMessage(const QString &method)
+{
+    return QDBusMessage::createMethodCall(QStringLiteral("org.kde.KWin.ScreenShot2"),
+                                          QStringLiteral("/org/kde/KWin/ScreenShot2"),
+                                          QStringLiteral("org.kde.KWin.ScreenShot2"),
+                                          method);
+}
+
+static QDBusPendingReply<QVariantMap> waitForReply(const QDBusPendingCall &call)
+{
+    QDBusPendingCallWatcher watcher(call);
+    QSignalSpy finishedSpy(&watcher, &QDBusPendingCallWatcher::finished);
+    if (!watcher.isFinished()) {
+        finishedSpy.wait();
+    }
+    return watcher.reply();
+}
+
+static QImage imageFromResults(const QVariantMap &results, const uchar *data)
+{
+    const QImage image(data, results.value(QStringLiteral("width")).toUInt(),
+                       results.value(QStringLiteral("height")).toUInt(),
+                       results.value(QStringLiteral("stride")).toUInt(),
+                       QImage::Format(results.value(QStringLiteral("format")).toUInt()));
+    return image.copy();
+}
+
+QImage ScreenShotTest::captureScreenToPipe(const QString &name)
+{
+    int pipeFds[2];
+    if (pipe2(pipeFds, O_CLOEXEC) != 0) {
+        return QImage();
+    }
+
+    QDBusMessage message = captureScreenMessage(QStringLiteral("CaptureScreen"));
+    message << name << QVariantMap() << QVariant::fromValue(QDBusUnixFileDescriptor(pipeFds[1]));
+    const QDBusPendingCall call = m_bus.asyncCall(message);
+    close(pipeFds[1]);
+
+    QFuture<QByteArray> data = QtConcurrent::run([](int fileDescriptor) {
+        QFile file;
+        file.open(fileDescriptor, QIODevice::ReadOnly, QFileDevice::AutoCloseHandle);
+        return file.readAll();
+    }, pipeFds[0]);
+
+    const QDBusPendingReply<QVariantMap> reply = waitForReply(call);
+    if (reply.isError()) {
+        qWarning() << reply.error();
+        return QImage();
+    }
+    data.waitForFinished();
+    return imageFromResults(reply.value(), reinterpret_cast<const uchar *>(data.result().constData()));
+}
+
+QImage ScreenShotTest::captureScreenToMemfd(const QString &name)
+{
+    QDBusMessage message = captureScreenMessage(QStringLiteral("CaptureScreenToMemfd"));
+    message << name << QVariantMap();
+
+    const QDBusPendingReply<QVariantMap> reply = waitForReply(m_bus.asyncCall(message));
+    if (reply.isError()) {
+        qWarning() << reply.error();
+        return QImage();
+    }
+
+    const QVariantMap results = reply.value();
+    const QDBusUnixFileDescriptor fileDescriptor = results.value(QStringLiteral("fd")).value<QDBusUnixFileDescriptor>();
+    if (!fileDescriptor.isValid()) {
+        return QImage();
+    }
+
+    const size_t size = results.value(QStringLiteral("stride")).toUInt() * results.value(QStringLiteral("height")).toUInt();
+    void *data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fileDescriptor.fileDescriptor(), 0);
+    if (data == MAP_FAILED) {
+        return QImage();
+    }
+    const QImage image = imageFromResults(results, static_cast<const uchar *>(data));
+    munmap(data, size);
+    return image;
+}
+
+void ScreenShotTest::testMemfd()
+{
+    // This test verifies that a screenshot in a memfd has the same content as a screenshot
+    // written to a pipe.
+    QScopedPointer<Surface> surface(Test::createSurface());
+    QScopedPointer<XdgShellSurface> shellSurface(Test::createXdgShellStableSurface(surface.data()));
+    AbstractClient *client = Test::renderAndWaitForShown(surface.data(), QSize(100, 50), Qt::blue);
+    QVERIFY(client);
+    client->move(QPoint(200, 100));
+
+    const QString name = effects->screens().first()->name();
+    const QImage pipeImage = captureScreenToPipe(name);
+    QCOMPARE(pipeImage.size(), QSize(1280, 1024));
+    const QImage memfdImage = captureScreenToMemfd(name);
+    QCOMPARE(memfdImage.size(), QSize(1280, 1024));
+
+    // the window shows up the right way up
+    QCOMPARE(memfdImage.pixelColor(210, 110), QColor(Qt::blue));
+    QCOMPARE(memfdImage.pixelColor(310, 160), pipeImage.pixelColor(310, 160));
+    QVERIFY(memfdImage.pixelColor(310, 160) != QColor(Qt::blue));
+
+    QCOMPARE(memfdImage.convertToFormat(QImage::Format_ARGB32), pipeImage.convertToFormat(QImage::Format_ARGB32));
+}
+
+void ScreenShotTest::benchmarkCaptureScreen_data()
+{
+    QTest::addColumn<bool>("memfd");
+
+    QTest::addRow("pipe") << false;
+    QTest::addRow("memfd") << true;
+}
+
+void ScreenShotTest::benchmarkCaptureScreen()
+{
+    // This benchmark measures the round trip of a screenshot of a 1280x1024 screen, from the
+    // request until the client has the pixels.
+    QFETCH(bool, memfd);
+
+    const QString name = effects->screens().first()->name();
+    QImage image;
+    QBENCHMARK {
+        image = memfd ? captureScreenToMemfd(name) : captureScreenToPipe(name);
+    }
+    QCOMPARE(image.size(), QSize(1280, 1024));
+}
+
+WAYLANDTEST_MAIN(ScreenShotTest)
+#include "screenshot_test.moc"
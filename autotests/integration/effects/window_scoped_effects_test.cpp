@@ -0,0 +1,322 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "kwin_wayland_test.h"
+#include "abstract_client.h"
+#include "composite.h"
+#include "deleted.h"
+#include "effect_builtins.h"
+#include "effectloader.h"
+#include "effects.h"
+#include "platform.h"
+#include "wayland_server.h"
+#include "workspace.h"
+
+#include <KConfigGroup>
+
+#include <KWayland/Client/surface.h>
+#include <KWayland/Client/xdgshell.h>
+
+#include <functional>
+
+using namespace KWayland::Client;
+using namespace std::chrono_literals;
+
+namespace KWin
+{
+
+static const QString s_socketName = QStringLiteral("wayland_test_effects_window_scoped-0");
+
+/**
+ * Passes every call on, like the fake effect plugin, and counts the windows it was asked to
+ * paint.
+ */
+class CountingEffect : public Effect
+{
+    Q_OBJECT
+public:
+    CountingEffect(bool windowScoped, int chainPosition)
+        : m_chainPosition(chainPosition)
+    {
+        setWindowScoped(windowScoped);
+    }
+
+    int requestedEffectChainPosition() const override
+    {
+        return m_chainPosition;
+    }
+
+    void prePaintWindow(EffectWindow *w, WindowPrePaintData &data, std::chrono::milliseconds presentTime) override
+    {
+        if (recording) {
+            prePainted << w;
+        }
+        effects->prePaintWindow(w, data, presentTime);
+    }
+
+    void postPaintWindow(EffectWindow *w) override
+    {
+        if (recording) {
+            postPainted << w;
+        }
+        if (postPaintHook) {
+            postPaintHook(w);
+        }
+        effects->postPaintWindow(w);
+    }
+
+    using Effect::addAffectedWindow;
+    using Effect::removeAffectedWindow;
+    using Effect::setWindowScoped;
+
+    QVector<EffectWindow *> prePainted;
+    QVector<EffectWindow *> postPainted;
+    std::function<void(EffectWindow *)> postPaintHook;
+    bool recording = true;
+
+private:
+    int m_chainPosition;
+};
+
+class WindowScopedEffectsTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+    void cleanup();
+    void testChainPerWindow();
+    void testNestedPaint();
+    void benchmarkWindowChain_data();
+    void benchmarkWindowChain();
+
+private:
+    CountingEffect *loadEffect(bool windowScoped, int chainPosition = 0);
+    EffectWindow *createWindow();
+    void paintWindows();
+
+    QVector<Surface *> m_surfaces;
+    QVector<XdgShellSurface *> m_shellSurfaces;
+    QVector<EffectWindow *> m_windows;
+};
+
+void WindowScopedEffectsTest::initTestCase()
+{
+    qRegisterMetaType<KWin::AbstractClient *>();
+    qRegisterMetaType<KWin::Deleted *>();
+    qRegisterMetaType<KWin::Effect *>();
+    QSignalSpy applicationStartedSpy(kwinApp(), &Application::started);
+    QVERIFY(applicationStartedSpy.isValid());
+    kwinApp()->platform()->setInitialWindowSize(QSize(1280, 1024));
+    QVERIFY(waylandServer()->init(s_socketName));
+
+    // disable all effects - only the effects of this test should be in the chains
+    ScriptedEffectLoader loader;
+    auto config = KSharedConfig::openConfig(QString(), KConfig::SimpleConfig);
+    KConfigGroup plugins(config, QStringLiteral("Plugins"));
+    const auto builtinNames = BuiltInEffects::availableEffectNames() << loader.listOfKnownEffects();
+    for (const QString &name : builtinNames) {
+        plugins.writeEntry(name + QStringLiteral("Enabled"), false);
+    }
+    config->sync();
+    kwinApp()->setConfig(config);
+
+    qputenv("KWIN_COMPOSE", QByteArrayLiteral("O2"));
+    kwinApp()->start();
+    QVERIFY(applicationStartedSpy.wait());
+    QVERIFY(Compositor::self());
+    waylandServer()->initWorkspace();
+}
+
+void WindowScopedEffectsTest::init()
+{
+    QVERIFY(Test::setupWaylandConnection());
+}
+
+void WindowScopedEffectsTest::cleanup()
+{
+    auto effectsImpl = static_cast<EffectsHandlerImpl *>(effects);
+    effectsImpl->unloadAllEffects();
+    QVERIFY(effectsImpl->loadedEffects().isEmpty());
+
+    m_windows.clear();
+    qDeleteAll(m_shellSurfaces);
+    m_shellSurfaces.clear();
+    qDeleteAll(m_surfaces);
+    m_surfaces.clear();
+    Test::destroyWaylandConnection();
+}
+
+CountingEffect *WindowScopedEffectsTest::loadEffect(bool windowScoped, int chainPosition)
+{
+    auto effect = new CountingEffect(windowScoped, chainPosition);
+    // the effect loader is private API, inject the effect the same way the scripted effects test does
+    const auto children = effects->children();
+    for (QObject *child : children) {
+        if (qstrcmp(child->metaObject()->className(), "KWin::EffectLoader") != 0) {
+            continue;
+        }
+        const QString name = QStringLiteral("countingEffect%1").arg(quintptr(effect));
+        QMetaObject::invokeMethod(child, "effectLoaded", Q_ARG(KWin::Effect *, effect), Q_ARG(QString, name));
+        break;
+    }
+    return effect;
+}
+
+EffectWindow *WindowScopedEffectsTest::createWindow()
+{
+    Surface *surface = Test::createSurface();
+    XdgShellSurface *shellSurface = Test::createXdgShellStableSurface(surface, surface);
+    m_surfaces << surface;
+    m_shellSurfaces << shellSurface;
+    AbstractClient *client = Test::renderAndWaitForShown(surface, QSize(100, 50), Qt::blue);
+    if (!client) {
+        return nullptr;
+    }
+    m_windows << client->effectWindow();
+    return client->effectWindow();
+}
+
+void WindowScopedEffectsTest::paintWindows()
+{
+    // The event loop is not entered, so no frame of the compositor gets in between.
+    static_cast<EffectsHandlerImpl *>(effects)->startPaint();
+    for (EffectWindow *w : qAsConst(m_windows)) {
+        WindowPrePaintData data;
+        data.mask = 0;
+        effects->prePaintWindow(w, data, 0ms);
+    }
+    for (EffectWindow *w : qAsConst(m_windows)) {
+        effects->postPaintWindow(w);
+    }
+}
+
+void WindowScopedEffectsTest::testChainPerWindow()
+{
+    // This test verifies that a window scoped effect only gets to paint the windows that it has
+    // subscribed to, while other effects keep getting all windows.
+    EffectWindow *first = createWindow();
+    QVERIFY(first);
+    EffectWindow *second = createWindow();
+    QVERIFY(second);
+    EffectWindow *third = createWindow();
+    QVERIFY(third);
+
+    CountingEffect *global = loadEffect(false);
+    CountingEffect *scoped = loadEffect(true);
+    QVERIFY(!global->isWindowScoped());
+    QVERIFY(scoped->isWindowScoped());
+
+    paintWindows();
+    QCOMPARE(global->prePainted, m_windows);
+    QCOMPARE(global->postPainted, m_windows);
+    QVERIFY(scoped->prePainted.isEmpty());
+    QVERIFY(scoped->postPainted.isEmpty());
+
+    scoped->addAffectedWindow(second);
+    global->prePainted.clear();
+    global->postPainted.clear();
+    paintWindows();
+    QCOMPARE(global->prePainted, m_windows);
+    QCOMPARE(scoped->prePainted, QVector<EffectWindow *>{second});
+    QCOMPARE(scoped->postPainted, QVector<EffectWindow *>{second});
+
+    // subscribing a non-scoped effect changes nothing
+    global->addAffectedWindow(first);
+    global->prePainted.clear();
+    scoped->prePainted.clear();
+    paintWindows();
+    QCOMPARE(global->prePainted, m_windows);
+    QCOMPARE(scoped->prePainted, QVector<EffectWindow *>{second});
+
+    scoped->removeAffectedWindow(second);
+    scoped->prePainted.clear();
+    paintWindows();
+    QVERIFY(scoped->prePainted.isEmpty());
+
+    // an effect that stops being window scoped is back in every chain
+    scoped->setWindowScoped(false);
+    QVERIFY(!scoped->isWindowScoped());
+    paintWindows();
+    QCOMPARE(scoped->prePainted, m_windows);
+}
+
+void WindowScopedEffectsTest::testNestedPaint()
+{
+    // This test verifies that painting another window from within a window's chain doesn't
+    // disturb the chain of the outer window.
+    EffectWindow *first = createWindow();
+    QVERIFY(first);
+    EffectWindow *second = createWindow();
+    QVERIFY(second);
+
+    CountingEffect *outer = loadEffect(false, 0);
+    CountingEffect *scoped = loadEffect(true, 1);
+    CountingEffect *inner = loadEffect(false, 2);
+    scoped->addAffectedWindow(second);
+
+    // emulate an effect that paints a thumbnail of the second window from within the chain
+    // of the first window
+    outer->postPaintHook = [first, second](EffectWindow *w) {
+        if (w == first) {
+            effects->postPaintWindow(second);
+        }
+    };
+
+    static_cast<EffectsHandlerImpl *>(effects)->startPaint();
+    effects->postPaintWindow(first);
+    QCOMPARE(outer->postPainted, (QVector<EffectWindow *>{first, second}));
+    QCOMPARE(scoped->postPainted, QVector<EffectWindow *>{second});
+    QCOMPARE(inner->postPainted, (QVector<EffectWindow *>{second, first}));
+
+    const auto statistics = static_cast<EffectsHandlerImpl *>(effects)->windowChainStatistics();
+    QCOMPARE(statistics.windowScopedEffects, 1);
+    QCOMPARE(statistics.windowsWithOwnChain, 1);
+}
+
+void WindowScopedEffectsTest::benchmarkWindowChain_data()
+{
+    QTest::addColumn<int>("effectCount");
+    QTest::addColumn<bool>("windowScoped");
+
+    QTest::addRow("5 effects, global chain") << 5 << false;
+    QTest::addRow("5 effects, window scoped") << 5 << true;
+    QTest::addRow("20 effects, global chain") << 20 << false;
+    QTest::addRow("20 effects, window scoped") << 20 << true;
+}
+
+void WindowScopedEffectsTest::benchmarkWindowChain()
+{
+    // This benchmark measures the cost of running the window paint chains of 50 windows while
+    // every effect animates a single window, as for example scripted effects do.
+    QFETCH(int, effectCount);
+    QFETCH(bool, windowScoped);
+
+    for (int i = 0; i < 50; ++i) {
+        QVERIFY(createWindow());
+    }
+    for (int i = 0; i < effectCount; ++i) {
+        CountingEffect *effect = loadEffect(windowScoped);
+        effect->addAffectedWindow(m_windows.at(i % m_windows.count()));
+        effect->recording = false;
+    }
+
+    QBENCHMARK {
+        paintWindows();
+    }
+
+    const auto statistics = static_cast<EffectsHandlerImpl *>(effects)->windowChainStatistics();
+    qInfo() << "chain dispatches:" << statistics.chainDispatches
+            << "calls:" << statistics.effectCalls
+            << "skipped effects:" << statistics.skippedEffects;
+}
+
+}
+
+WAYLANDTEST_MAIN(KWin::WindowScopedEffectsTest)
+#include "window_scoped_effects_test.moc"
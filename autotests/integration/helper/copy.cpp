@@ -8,24 +8,37 @@
 */
 #include <QClipboard>
 #include <QGuiApplication>
+#include <QMimeData>
 #include <QPainter>
 #include <QRasterWindow>
 #include <QTimer>
 
+// A large selection is put into the clipboard with this mime type, see paste.cpp
+static const QString s_largeMimeType = QStringLiteral("application/x-kwin-test-selection");
+
+static char selectionByte(int offset)
+{
+    return char((offset * 7 + offset / 4096) & 0xff);
+}
+
 class Window : public QRasterWindow
 {
     Q_OBJECT
 public:
-    explicit Window();
+    explicit Window(int largeSize);
     ~Window() override;
 
 protected:
     void paintEvent(QPaintEvent *event) override;
     void focusInEvent(QFocusEvent *event) override;
+
+private:
+    int m_largeSize;
 };
 
-Window::Window()
+Window::Window(int largeSize)
     : QRasterWindow()
+    , m_largeSize(largeSize)
 {
 }
 
@@ -42,15 +55,27 @@ void Window::focusInEvent(QFocusEvent *event)
 {
     QRasterWindow::focusInEvent(event);
     // TODO: make it work without singleshot
-    QTimer::singleShot(100,[] {
-        qApp->clipboard()->setText(QStringLiteral("test"));
+    QTimer::singleShot(100, [this] {
+        if (!m_largeSize) {
+            qApp->clipboard()->setText(QStringLiteral("test"));
+            return;
+        }
+        QByteArray data(m_largeSize, Qt::Uninitialized);
+        for (int i = 0; i < m_largeSize; ++i) {
+            data[i] = selectionByte(i);
+        }
+        QMimeData *mimeData = new QMimeData;
+        mimeData->setData(s_largeMimeType, data);
+        qApp->clipboard()->setMimeData(mimeData);
     });
 }
 
 int main(int argc, char *argv[])
 {
     QGuiApplication app(argc, argv);
-    QScopedPointer<Window> w(new Window);
+    // the size of a large selection in MiB can be passed as an argument
+    const int largeSize = app.arguments().value(1).toInt() * 1024 * 1024;
+    QScopedPointer<Window> w(new Window(largeSize));
     w->setGeometry(QRect(0, 0, 100, 200));
     w->show();
 
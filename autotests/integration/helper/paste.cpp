@@ -8,10 +8,19 @@
 */
 #include <QClipboard>
 #include <QGuiApplication>
+#include <QMimeData>
 #include <QPainter>
 #include <QRasterWindow>
 #include <QTimer>
 
+// A large selection is put into the clipboard with this mime type, see copy.cpp
+static const QString s_largeMimeType = QStringLiteral("application/x-kwin-test-selection");
+
+static char selectionByte(int offset)
+{
+    return char((offset * 7 + offset / 4096) & 0xff);
+}
+
 class Window : public QRasterWindow
 {
     Q_OBJECT
@@ -40,11 +49,28 @@ void Window::paintEvent(QPaintEvent *event)
 int main(int argc, char *argv[])
 {
     QGuiApplication app(argc, argv);
+    // the size of a large selection in MiB can be passed as an argument
+    const int largeSize = app.arguments().value(1).toInt() * 1024 * 1024;
     QObject::connect(app.clipboard(), &QClipboard::changed, &app,
-        [] {
-            if (qApp->clipboard()->text() == QLatin1String("test")) {
-                QTimer::singleShot(100, qApp, &QCoreApplication::quit);
+        [largeSize] {
+            if (!largeSize) {
+                if (qApp->clipboard()->text() == QLatin1String("test")) {
+                    QTimer::singleShot(100, qApp, &QCoreApplication::quit);
+                }
+                return;
+            }
+            const QMimeData *mimeData = qApp->clipboard()->mimeData();
+            if (!mimeData || !mimeData->hasFormat(s_largeMimeType)) {
+                return;
+            }
+            const QByteArray data = mimeData->data(s_largeMimeType);
+            bool intact = data.size() == largeSize;
+            for (int i = 0; i < data.size() && intact; ++i) {
+                intact = data[i] == selectionByte(i);
             }
+            QTimer::singleShot(100, qApp, [intact] {
+                QCoreApplication::exit(intact ? 0 : 1);
+            });
         }
     );
     QScopedPointer<Window> w(new Window);
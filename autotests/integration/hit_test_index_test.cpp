@@ -0,0 +1,260 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "kwin_wayland_test.h"
+#include "abstract_client.h"
+#include "deleted.h"
+#include "input.h"
+#include "platform.h"
+#include "screens.h"
+#include "virtualdesktops.h"
+#include "wayland_server.h"
+#include "workspace.h"
+
+#include <KWayland/Client/surface.h>
+#include <KWayland/Client/xdgshell.h>
+
+using namespace KWayland::Client;
+
+namespace KWin
+{
+
+static const QString s_socketName = QStringLiteral("wayland_test_kwin_hit_test_index-0");
+
+class HitTestIndexTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+    void cleanup();
+    void testMatchesStackingOrder();
+    void testIncrementalMove();
+    void benchmarkFindToplevel_data();
+    void benchmarkFindToplevel();
+
+private:
+    AbstractClient *createWindow(const QSize &size);
+    void verifyAllPoints();
+
+    QVector<Surface *> m_surfaces;
+    QVector<XdgShellSurface *> m_shellSurfaces;
+};
+
+void HitTestIndexTest::initTestCase()
+{
+    qRegisterMetaType<KWin::AbstractClient *>();
+    qRegisterMetaType<KWin::Deleted *>();
+    QSignalSpy applicationStartedSpy(kwinApp(), &Application::started);
+    QVERIFY(applicationStartedSpy.isValid());
+    kwinApp()->platform()->setInitialWindowSize(QSize(1280, 1024));
+    QVERIFY(waylandServer()->init(s_socketName));
+    QMetaObject::invokeMethod(kwinApp()->platform(), "setVirtualOutputs", Qt::DirectConnection, Q_ARG(int, 2));
+
+    kwinApp()->start();
+    QVERIFY(applicationStartedSpy.wait());
+    QCOMPARE(screens()->count(), 2);
+    waylandServer()->initWorkspace();
+}
+
+void HitTestIndexTest::init()
+{
+    VirtualDesktopManager::self()->setCount(2);
+    VirtualDesktopManager::self()->setCurrent(VirtualDesktopManager::self()->desktops().first());
+    QVERIFY(Test::setupWaylandConnection());
+}
+
+void HitTestIndexTest::cleanup()
+{
+    qDeleteAll(m_shellSurfaces);
+    m_shellSurfaces.clear();
+    qDeleteAll(m_surfaces);
+    m_surfaces.clear();
+    Test::destroyWaylandConnection();
+
+    VirtualDesktopManager::self()->setCount(1);
+}
+
+AbstractClient *HitTestIndexTest::createWindow(const QSize &size)
+{
+    Surface *surface = Test::createSurface();
+    XdgShellSurface *shellSurface = Test::createXdgShellStableSurface(surface, surface);
+    m_surfaces << surface;
+    m_shellSurfaces << shellSurface;
+    return Test::renderAndWaitForShown(surface, size, Qt::blue);
+}
+
+static Toplevel *findToplevelLinear(const QPoint &pos)
+{
+    // This is how the window under the pointer was found before the hit test index.
+    const QList<Toplevel *> &stacking = workspace()->stackingOrder();
+    for (auto it = stacking.crbegin(); it != stacking.crend(); ++it) {
+        Toplevel *t = *it;
+        if (t->isDeleted()) {
+            continue;
+        }
+        if (AbstractClient *c = qobject_cast<AbstractClient *>(t)) {
+            if (!c->isOnCurrentActivity() || !c->isOnCurrentDesktop() || c->isMinimized() || c->isHiddenInternal()) {
+                continue;
+            }
+        }
+        if (!t->readyForPainting()) {
+            continue;
+        }
+        if (t->hitTest(pos)) {
+            return t;
+        }
+    }
+    return nullptr;
+}
+
+void HitTestIndexTest::verifyAllPoints()
+{
+    const QRect bounds = screens()->geometry();
+    for (int y = bounds.top() - 20; y <= bounds.bottom() + 20; y += 23) {
+        for (int x = bounds.left() - 20; x <= bounds.right() + 20; x += 23) {
+            const QPoint pos(x, y);
+            QCOMPARE(input()->findManagedToplevel(pos), findToplevelLinear(pos));
+        }
+    }
+}
+
+void HitTestIndexTest::testMatchesStackingOrder()
+{
+    // This test verifies that the hit test index finds the same windows as walking the stacking
+    // order, also after the windows have been moved, restacked, minimized or sent to another
+    // virtual desktop.
+    QVector<AbstractClient *> clients;
+    for (int i = 0; i < 8; ++i) {
+        AbstractClient *client = createWindow(QSize(300, 200));
+        QVERIFY(client);
+        client->move(QPoint(150 * i, 100 * i));
+        clients << client;
+    }
+    verifyAllPoints();
+
+    // Move a window across a screen edge and a cell boundary.
+    clients[2]->move(QPoint(1200, 900));
+    verifyAllPoints();
+
+    // Raise a window that is covered by others.
+    workspace()->raiseClient(clients[1]);
+    verifyAllPoints();
+
+    workspace()->lowerClient(clients[6]);
+    verifyAllPoints();
+
+    clients[3]->minimize();
+    verifyAllPoints();
+    clients[3]->unminimize();
+    verifyAllPoints();
+
+    // Send windows to another virtual desktop and follow them.
+    VirtualDesktop *desktop = VirtualDesktopManager::self()->desktops().at(1);
+    clients[4]->setDesktop(desktop->x11DesktopNumber());
+    clients[5]->setDesktop(desktop->x11DesktopNumber());
+    verifyAllPoints();
+    VirtualDesktopManager::self()->setCurrent(desktop);
+    verifyAllPoints();
+    VirtualDesktopManager::self()->setCurrent(VirtualDesktopManager::self()->desktops().first());
+    verifyAllPoints();
+
+    // Resize a window, the new geometry takes effect once the client has committed a buffer.
+    QSignalSpy frameGeometryChangedSpy(clients[0], &AbstractClient::frameGeometryChanged);
+    QVERIFY(frameGeometryChangedSpy.isValid());
+    Test::render(m_surfaces[0], QSize(600, 500), Qt::red);
+    QVERIFY(frameGeometryChangedSpy.wait());
+    verifyAllPoints();
+
+    // Close a window.
+    QSignalSpy windowClosedSpy(clients[7], &AbstractClient::windowClosed);
+    QVERIFY(windowClosedSpy.isValid());
+    delete m_shellSurfaces.takeLast();
+    delete m_surfaces.takeLast();
+    QVERIFY(windowClosedSpy.wait());
+    verifyAllPoints();
+}
+
+void HitTestIndexTest::testIncrementalMove()
+{
+    // This test verifies that the index stays correct while a window is moved in small steps,
+    // like during an interactive move, which only updates the cells the window left and entered.
+    QVector<AbstractClient *> clients;
+    for (int i = 0; i < 4; ++i) {
+        AbstractClient *client = createWindow(QSize(300, 200));
+        QVERIFY(client);
+        client->move(QPoint(300 * i, 250 * i));
+        clients << client;
+    }
+    verifyAllPoints();
+
+    // Drag a window in the middle of the stacking order over the others and across the screens.
+    workspace()->raiseClient(clients[1]);
+    workspace()->raiseClient(clients[2]);
+    verifyAllPoints();
+    for (int step = 0; step < 12; ++step) {
+        clients[1]->move(QPoint(-100 + 230 * step, 70 * step));
+        verifyAllPoints();
+    }
+
+    // Hide and show the dragged window while it is away from its original cells.
+    clients[1]->minimize();
+    verifyAllPoints();
+    clients[1]->move(QPoint(500, 400));
+    clients[1]->unminimize();
+    verifyAllPoints();
+}
+
+void HitTestIndexTest::benchmarkFindToplevel_data()
+{
+    QTest::addColumn<int>("windowCount");
+    QTest::addColumn<bool>("linear");
+
+    QTest::addRow("10 windows, stacking order") << 10 << true;
+    QTest::addRow("10 windows, index") << 10 << false;
+    QTest::addRow("100 windows, stacking order") << 100 << true;
+    QTest::addRow("100 windows, index") << 100 << false;
+}
+
+void HitTestIndexTest::benchmarkFindToplevel()
+{
+    // This benchmark measures the cost of finding the window under the pointer while it moves
+    // across both screens. Half of the windows are on another virtual desktop.
+    QFETCH(int, windowCount);
+    QFETCH(bool, linear);
+
+    VirtualDesktop *otherDesktop = VirtualDesktopManager::self()->desktops().at(1);
+    for (int i = 0; i < windowCount; ++i) {
+        AbstractClient *client = createWindow(QSize(400, 300));
+        QVERIFY(client);
+        client->move(QPoint((i * 211) % 2200, (i * 97) % 750));
+        if (i % 2) {
+            client->setDesktop(otherDesktop->x11DesktopNumber());
+        }
+    }
+
+    QVector<QPoint> path;
+    for (int i = 0; i < 1000; ++i) {
+        path << QPoint((i * 37) % 2560, (i * 13) % 1024);
+    }
+
+    QBENCHMARK {
+        for (const QPoint &pos : qAsConst(path)) {
+            if (linear) {
+                findToplevelLinear(pos);
+            } else {
+                input()->findManagedToplevel(pos);
+            }
+        }
+    }
+}
+
+}
+
+WAYLANDTEST_MAIN(KWin::HitTestIndexTest)
+#include "hit_test_index_test.moc"
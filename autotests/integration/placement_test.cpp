@@ -12,6 +12,7 @@
 #include "kwin_wayland_test.h"
 #include "platform.h"
 #include "screens.h"
+#include "virtualdesktops.h"
 #include "wayland_server.h"
 #include "workspace.h"
 
@@ -45,6 +46,9 @@ private Q_SLOTS:
     void initTestCase();
 
     void testPlaceSmart();
+    void testPlaceSmartOverlapping();
+    void benchmarkPlaceSmart_data();
+    void benchmarkPlaceSmart();
     void testPlaceZeroCornered();
     void testPlaceMaximized();
     void testPlaceMaximizedLeavesFullscreen();
@@ -62,8 +66,139 @@ private:
      * event.
      */
     PlaceWindowResult createAndPlaceWindow(const QSize &defaultSize, QObject *parent);
+    /*
+     * Create count windows of various sizes with the lifespan of parent, every fifth
+     * window is kept above and every seventh window is kept below.
+     */
+    QVector<AbstractClient *> createWindows(int count, QObject *parent);
 };
 
+/*
+ * Smart placement as it was implemented before it got an index of the windows, it walks
+ * over the stacking order for every candidate position.
+ */
+static QPoint referencePlaceSmart(AbstractClient *c, const QRect &area)
+{
+    auto isIrrelevant = [c](const AbstractClient *client, int desktop) {
+        return !client || client == c || !client->isShown(false) || !client->isOnDesktop(desktop)
+            || !client->isOnCurrentActivity() || client->isDesktop();
+    };
+
+    const int none = 0, h_wrong = -1, w_wrong = -2; // overlap types
+    long int overlap, min_overlap = 0;
+    int x_optimal, y_optimal;
+    int possible;
+    int desktop = c->desktop() == 0 || c->isOnAllDesktops() ? VirtualDesktopManager::self()->current() : c->desktop();
+
+    int cxl, cxr, cyt, cyb;
+    int xl, xr, yt, yb;
+    int basket;
+
+    int x = area.left();
+    int y = area.top();
+    x_optimal = x; y_optimal = y;
+
+    int ch = c->height() - 1;
+    int cw = c->width() - 1;
+
+    bool first_pass = true;
+
+    do {
+        if (y + ch > area.bottom() && ch < area.height()) {
+            overlap = h_wrong;
+        } else if (x + cw > area.right()) {
+            overlap = w_wrong;
+        } else {
+            overlap = none;
+
+            cxl = x; cxr = x + cw;
+            cyt = y; cyb = y + ch;
+            for (Toplevel *toplevel : workspace()->stackingOrder()) {
+                AbstractClient *client = qobject_cast<AbstractClient *>(toplevel);
+                if (isIrrelevant(client, desktop)) {
+                    continue;
+                }
+                xl = client->x(); yt = client->y();
+                xr = xl + client->width(); yb = yt + client->height();
+
+                if ((cxl < xr) && (cxr > xl) && (cyt < yb) && (cyb > yt)) {
+                    xl = qMax(cxl, xl); xr = qMin(cxr, xr);
+                    yt = qMax(cyt, yt); yb = qMin(cyb, yb);
+                    if (client->keepAbove())
+                        overlap += 16 * (xr - xl) * (yb - yt);
+                    else if (client->keepBelow() && !client->isDock())
+                        overlap += 0;
+                    else
+                        overlap += (xr - xl) * (yb - yt);
+                }
+            }
+        }
+
+        if (overlap == none) {
+            x_optimal = x;
+            y_optimal = y;
+            break;
+        }
+
+        if (first_pass) {
+            first_pass = false;
+            min_overlap = overlap;
+        } else if (overlap >= none && overlap < min_overlap) {
+            min_overlap = overlap;
+            x_optimal = x;
+            y_optimal = y;
+        }
+
+        if (overlap > none) {
+            possible = area.right();
+            if (possible - cw > x) possible -= cw;
+
+            for (Toplevel *toplevel : workspace()->stackingOrder()) {
+                AbstractClient *client = qobject_cast<AbstractClient *>(toplevel);
+                if (isIrrelevant(client, desktop)) {
+                    continue;
+                }
+                xl = client->x(); yt = client->y();
+                xr = xl + client->width(); yb = yt + client->height();
+
+                if ((y < yb) && (yt < ch + y)) {
+                    if ((xr > x) && (possible > xr)) possible = xr;
+
+                    basket = xl - cw;
+                    if ((basket > x) && (possible > basket)) possible = basket;
+                }
+            }
+            x = possible;
+        } else if (overlap == w_wrong) {
+            x = area.left();
+            possible = area.bottom();
+
+            if (possible - ch > y) possible -= ch;
+
+            for (Toplevel *toplevel : workspace()->stackingOrder()) {
+                AbstractClient *client = qobject_cast<AbstractClient *>(toplevel);
+                if (isIrrelevant(client, desktop)) {
+                    continue;
+                }
+                xl = client->x(); yt = client->y();
+                xr = xl + client->width(); yb = yt + client->height();
+
+                if ((yb > y) && (possible > yb)) possible = yb;
+
+                basket = yt - ch;
+                if ((basket > y) && (possible > basket)) possible = basket;
+            }
+            y = possible;
+        }
+    } while ((overlap != none) && (overlap != h_wrong) && (y < area.bottom()));
+
+    if (ch >= area.height()) {
+        y_optimal = area.top();
+    }
+
+    return QPoint(x_optimal, y_optimal);
+}
+
 void TestPlacement::init()
 {
     QVERIFY(Test::setupWaylandConnection(Test::AdditionalWaylandInterface::XdgDecoration |
@@ -132,6 +267,32 @@ PlaceWindowResult TestPlacement::createAndPlaceWindow(const QSize &defaultSize,
     return rc;
 }
 
+QVector<AbstractClient *> TestPlacement::createWindows(int count, QObject *parent)
+{
+    static const QSize sizes[] = {
+        QSize(600, 500), QSize(320, 240), QSize(97, 411), QSize(800, 120), QSize(250, 250),
+        QSize(33, 57), QSize(1000, 300), QSize(410, 640), QSize(150, 90), QSize(700, 700),
+        QSize(64, 900),
+    };
+
+    QVector<AbstractClient *> clients;
+    for (int i = 0; i < count; i++) {
+        Surface *surface = Test::createSurface(parent);
+        Test::createXdgShellStableSurface(surface, surface);
+        AbstractClient *client = Test::renderAndWaitForShown(surface, sizes[i % 11], Qt::red);
+        if (!client) {
+            return {};
+        }
+        if (i % 5 == 0) {
+            client->setKeepAbove(true);
+        } else if (i % 7 == 0) {
+            client->setKeepBelow(true);
+        }
+        clients << client;
+    }
+    return clients;
+}
+
 void TestPlacement::testPlaceSmart()
 {
     setPlacementPolicy(Placement::Smart);
@@ -154,6 +315,57 @@ void TestPlacement::testPlaceSmart()
     }
 }
 
+void TestPlacement::testPlaceSmartOverlapping()
+{
+    // This test verifies that smart placement puts windows at the same positions as the
+    // previous implementation did, when the screen is crowded and windows have to overlap.
+    setPlacementPolicy(Placement::Smart);
+
+    QScopedPointer<QObject> testParent(new QObject);
+    const QVector<AbstractClient *> clients = createWindows(60, testParent.data());
+    QCOMPARE(clients.count(), 60);
+
+    const QRect area = screens()->geometry(0);
+    for (AbstractClient *client : clients) {
+        const QPoint expected = referencePlaceSmart(client, area);
+        Placement::self()->placeSmart(client, area);
+        QCOMPARE(client->pos(), expected);
+    }
+}
+
+void TestPlacement::benchmarkPlaceSmart_data()
+{
+    QTest::addColumn<int>("windowCount");
+    QTest::addColumn<bool>("useReference");
+
+    QTest::addRow("50 windows, reference") << 50 << true;
+    QTest::addRow("50 windows, index") << 50 << false;
+    QTest::addRow("500 windows, reference") << 500 << true;
+    QTest::addRow("500 windows, index") << 500 << false;
+}
+
+void TestPlacement::benchmarkPlaceSmart()
+{
+    // This benchmark measures placing a window on a screen that is crowded with windows.
+    QFETCH(int, windowCount);
+    QFETCH(bool, useReference);
+    setPlacementPolicy(Placement::Smart);
+
+    QScopedPointer<QObject> testParent(new QObject);
+    const QVector<AbstractClient *> clients = createWindows(windowCount + 1, testParent.data());
+    QCOMPARE(clients.count(), windowCount + 1);
+
+    AbstractClient *client = clients.last();
+    const QRect area = screens()->geometry(0);
+    QBENCHMARK {
+        if (useReference) {
+            client->move(referencePlaceSmart(client, area));
+        } else {
+            Placement::self()->placeSmart(client, area);
+        }
+    }
+}
+
 void TestPlacement::testPlaceZeroCornered()
 {
     setPlacementPolicy(Placement::ZeroCornered);
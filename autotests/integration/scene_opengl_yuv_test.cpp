@@ -0,0 +1,265 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "kwin_wayland_test.h"
+#include "composite.h"
+#include "effect_builtins.h"
+#include "effectloader.h"
+#include "effects.h"
+#include "platform.h"
+#include "scene.h"
+#include "wayland_server.h"
+
+#include <kwinglplatform.h>
+#include <kwinglutils.h>
+
+#include <KConfigGroup>
+
+#include <QRandomGenerator>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace KWin;
+static const QString s_socketName = QStringLiteral("wayland_test_kwin_scene_opengl_yuv-0");
+
+static const int s_width = 32;
+static const int s_height = 16;
+
+// The conversion of a YUV pixel to an RGB one as the standards define it, without the
+// shortcuts of yuvToRgbMatrix().
+static QRgb referenceRgb(int y, int u, int v, YuvColorSpace colorSpace, YuvRange range)
+{
+    const double kr = colorSpace == YuvColorSpace::Bt709 ? 0.2126 : 0.299;
+    const double kb = colorSpace == YuvColorSpace::Bt709 ? 0.0722 : 0.114;
+    const double kg = 1.0 - kr - kb;
+
+    double luma, cb, cr;
+    if (range == YuvRange::Limited) {
+        luma = (y - 16) / 219.0;
+        cb = (u - 128) / 224.0;
+        cr = (v - 128) / 224.0;
+    } else {
+        luma = y / 255.0;
+        cb = (u - 128) / 255.0;
+        cr = (v - 128) / 255.0;
+    }
+
+    const double r = luma + 2.0 * (1.0 - kr) * cr;
+    const double g = luma - 2.0 * kb * (1.0 - kb) / kg * cb - 2.0 * kr * (1.0 - kr) / kg * cr;
+    const double b = luma + 2.0 * (1.0 - kb) * cb;
+    auto toByte = [](double value) {
+        return int(std::lround(qBound(0.0, value, 1.0) * 255.0));
+    };
+    return qRgb(toByte(r), toByte(g), toByte(b));
+}
+
+static GLTexture *createPlane(GLenum internalFormat, GLenum format, int width, int height, const QByteArray &data)
+{
+    GLTexture *texture = new GLTexture(internalFormat, width, height);
+    texture->setFilter(GL_NEAREST);
+    texture->setWrapMode(GL_CLAMP_TO_EDGE);
+    texture->bind();
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, GL_UNSIGNED_BYTE, data.constData());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    texture->unbind();
+    return texture;
+}
+
+class SceneOpenGLYuvTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void testConversion_data();
+    void testConversion();
+};
+
+void SceneOpenGLYuvTest::initTestCase()
+{
+    QSignalSpy applicationStartedSpy(kwinApp(), &Application::started);
+    QVERIFY(applicationStartedSpy.isValid());
+    kwinApp()->platform()->setInitialWindowSize(QSize(1280, 1024));
+    QVERIFY(waylandServer()->init(s_socketName));
+
+    // disable all effects - we don't want to have it interact with the rendering
+    auto config = KSharedConfig::openConfig(QString(), KConfig::SimpleConfig);
+    KConfigGroup plugins(config, QStringLiteral("Plugins"));
+    ScriptedEffectLoader loader;
+    const auto builtinNames = BuiltInEffects::availableEffectNames() << loader.listOfKnownEffects();
+    for (QString name : builtinNames) {
+        plugins.writeEntry(name + QStringLiteral("Enabled"), false);
+    }
+    config->sync();
+    kwinApp()->setConfig(config);
+
+    qputenv("XCURSOR_THEME", QByteArrayLiteral("DMZ-White"));
+    qputenv("XCURSOR_SIZE", QByteArrayLiteral("24"));
+    qputenv("KWIN_COMPOSE", QByteArrayLiteral("O2"));
+
+    kwinApp()->start();
+    QVERIFY(applicationStartedSpy.wait());
+    QVERIFY(Compositor::self());
+    QCOMPARE(Compositor::self()->scene()->compositingType(), KWin::OpenGL2Compositing);
+}
+
+void SceneOpenGLYuvTest::testConversion_data()
+{
+    QTest::addColumn<int>("traits");
+    QTest::addColumn<int>("colorSpace");
+    QTest::addColumn<int>("range");
+
+    const struct {
+        const char *name;
+        ShaderTrait trait;
+    } layouts[] = {
+        {"semi-planar", ShaderTrait::YuvSemiPlanar},
+        {"planar", ShaderTrait::YuvPlanar},
+        {"packed", ShaderTrait::YuvPacked},
+    };
+    for (const auto &layout : layouts) {
+        const int traits = int(ShaderTrait::MapTexture | layout.trait);
+        QTest::addRow("%s/bt601/limited", layout.name) << traits << int(YuvColorSpace::Bt601) << int(YuvRange::Limited);
+        QTest::addRow("%s/bt601/full", layout.name) << traits << int(YuvColorSpace::Bt601) << int(YuvRange::Full);
+        QTest::addRow("%s/bt709/limited", layout.name) << traits << int(YuvColorSpace::Bt709) << int(YuvRange::Limited);
+        QTest::addRow("%s/bt709/full", layout.name) << traits << int(YuvColorSpace::Bt709) << int(YuvRange::Full);
+    }
+}
+
+void SceneOpenGLYuvTest::testConversion()
+{
+    // This test verifies that the YUV shader traits convert every pixel of the planes like
+    // the standards do, within the rounding of 8 bit textures.
+    QFETCH(int, traits);
+    QFETCH(int, colorSpace);
+    QFETCH(int, range);
+    const ShaderTraits shaderTraits = ShaderTraits(traits);
+    const YuvColorSpace yuvColorSpace = YuvColorSpace(colorSpace);
+    const YuvRange yuvRange = YuvRange(range);
+
+    QVERIFY(Compositor::self()->scene()->makeOpenGLContextCurrent());
+    if (GLPlatform::instance()->isGLES()) {
+        QSKIP("The test reads the render target back with desktop OpenGL");
+    }
+    if (!GLTexture::supportsFormatRG() || !GLRenderTarget::supported()) {
+        QSKIP("The YUV shader traits need RG textures and render targets");
+    }
+
+    // Random samples cover the whole 8 bit range, including the values outside of the
+    // limited range that have to be clamped.
+    QRandomGenerator random(colorSpace * 2 + range);
+    auto randomBytes = [&random](int count) {
+        QByteArray bytes(count, Qt::Uninitialized);
+        for (int i = 0; i < count; ++i) {
+            bytes[i] = char(random.bounded(256));
+        }
+        return bytes;
+    };
+
+    // The chroma planes have half the width of the luma, and half the height except for the
+    // packed layout. The shaders sample them with nearest filtering here, so every pixel has
+    // the chroma of the sample that covers it.
+    const QByteArray luma = randomBytes(s_width * s_height);
+    const int chromaHeight = (shaderTraits & ShaderTrait::YuvPacked) ? s_height : s_height / 2;
+    const QByteArray u = randomBytes(s_width / 2 * chromaHeight);
+    const QByteArray v = randomBytes(s_width / 2 * chromaHeight);
+    auto chromaIndex = [chromaHeight](int x, int y) {
+        return y * chromaHeight / s_height * (s_width / 2) + x / 2;
+    };
+
+    QVector<GLTexture *> planes;
+    if (shaderTraits & ShaderTrait::YuvSemiPlanar) {
+        QByteArray uv(u.size() * 2, Qt::Uninitialized);
+        for (int i = 0; i < u.size(); ++i) {
+            uv[2 * i] = u[i];
+            uv[2 * i + 1] = v[i];
+        }
+        planes << createPlane(GL_R8, GL_RED, s_width, s_height, luma)
+               << createPlane(GL_RG8, GL_RG, s_width / 2, chromaHeight, uv);
+    } else if (shaderTraits & ShaderTrait::YuvPlanar) {
+        planes << createPlane(GL_R8, GL_RED, s_width, s_height, luma)
+               << createPlane(GL_R8, GL_RED, s_width / 2, chromaHeight, u)
+               << createPlane(GL_R8, GL_RED, s_width / 2, chromaHeight, v);
+    } else {
+        // YUYV, the same buffer is bound as the luma in the red channel and as the chroma
+        // in the green and alpha channels.
+        QByteArray yuyv(luma.size() * 2, Qt::Uninitialized);
+        for (int i = 0; i < luma.size(); ++i) {
+            yuyv[2 * i] = luma[i];
+            yuyv[2 * i + 1] = (i % 2) ? v[i / 2] : u[i / 2];
+        }
+        planes << createPlane(GL_RG8, GL_RG, s_width, s_height, yuyv)
+               << createPlane(GL_RGBA8, GL_RGBA, s_width / 2, s_height, yuyv);
+    }
+
+    GLTexture target(GL_RGBA8, s_width, s_height);
+    GLRenderTarget renderTarget(target);
+    QVERIFY(renderTarget.valid());
+    GLRenderTarget::pushRenderTarget(&renderTarget);
+
+    QMatrix4x4 mvp;
+    mvp.ortho(0, 1, 0, 1, -1, 1);
+    GLShader *shader = ShaderManager::instance()->pushShader(shaderTraits);
+    QVERIFY(shader->isValid());
+    shader->setUniform(GLShader::ModelViewProjectionMatrix, mvp);
+    shader->setUniform(GLShader::YuvToRgbMatrix, yuvToRgbMatrix(yuvColorSpace, yuvRange));
+
+    for (int i = planes.count() - 1; i >= 0; --i) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        planes[i]->bind();
+    }
+
+    const float coordinates[] = {
+        1.0, 0.0,
+        0.0, 0.0,
+        0.0, 1.0,
+        0.0, 1.0,
+        1.0, 1.0,
+        1.0, 0.0,
+    };
+    GLVertexBuffer *vbo = GLVertexBuffer::streamingBuffer();
+    vbo->reset();
+    vbo->setData(6, 2, coordinates, coordinates);
+    vbo->render(GL_TRIANGLES);
+
+    for (int i = planes.count() - 1; i >= 0; --i) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        planes[i]->unbind();
+    }
+    ShaderManager::instance()->popShader();
+    GLRenderTarget::popRenderTarget();
+
+    // The rows of the image are read back bottom-up, like the planes were uploaded.
+    const QImage image = target.toImage();
+    qDeleteAll(planes);
+    QCOMPARE(image.size(), QSize(s_width, s_height));
+
+    int maximumError = 0;
+    for (int y = 0; y < s_height; ++y) {
+        for (int x = 0; x < s_width; ++x) {
+            const int index = chromaIndex(x, y);
+            const QRgb expected = referenceRgb(quint8(luma[y * s_width + x]), quint8(u[index]), quint8(v[index]),
+                                               yuvColorSpace, yuvRange);
+            const QRgb actual = image.pixel(x, y);
+            maximumError = std::max({maximumError,
+                                     std::abs(qRed(actual) - qRed(expected)),
+                                     std::abs(qGreen(actual) - qGreen(expected)),
+                                     std::abs(qBlue(actual) - qBlue(expected))});
+            if (maximumError > 2) {
+                QFAIL(qPrintable(QStringLiteral("pixel %1,%2 is %3, expected %4")
+                                     .arg(x).arg(y)
+                                     .arg(actual, 8, 16, QLatin1Char('0'))
+                                     .arg(expected, 8, 16, QLatin1Char('0'))));
+            }
+        }
+    }
+}
+
+WAYLANDTEST_MAIN(SceneOpenGLYuvTest)
+#include "scene_opengl_yuv_test.moc"
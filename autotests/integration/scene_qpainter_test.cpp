@@ -22,9 +22,13 @@
 #include <KWayland/Client/seat.h>
 #include <KWayland/Client/surface.h>
 #include <KWayland/Client/pointer.h>
+#include <KWayland/Client/registry.h>
+#include <KWayland/Client/shm_pool.h>
 #include <KWaylandServer/buffer_interface.h>
 #include <KWaylandServer/surface_interface.h>
 
+#include <QElapsedTimer>
+#include <QFile>
 #include <QPainter>
 
 #include <netwm.h>
@@ -45,6 +49,10 @@ private Q_SLOTS:
     void testWindowScaled();
     void testCompositorRestart();
     void testX11Window();
+    void testWindowBufferDestroyed();
+    void benchmarkWindowUpdates();
+    void benchmarkPixelsTouched_data();
+    void benchmarkPixelsTouched();
 };
 
 void SceneQPainterTest::cleanup()
@@ -362,5 +370,252 @@ void SceneQPainterTest::testX11Window()
     c.reset();
 }
 
+void SceneQPainterTest::testWindowBufferDestroyed()
+{
+    // this test verifies that a window is still rendered after the client destroyed the buffer
+    // that's attached to it, the scene paints straight from the client buffer otherwise
+    KWin::Cursors::self()->mouse()->setPos(400, 400);
+    using namespace KWayland::Client;
+    QVERIFY(Test::setupWaylandConnection());
+    QScopedPointer<Surface> s(Test::createSurface());
+    QScopedPointer<XdgShellSurface> ss(Test::createXdgShellStableSurface(s.data()));
+    AbstractClient *client = Test::renderAndWaitForShown(s.data(), QSize(200, 300), Qt::blue);
+    QVERIFY(client);
+
+    // use a separate pool, destroying it destroys all of its buffers
+    Registry *registry = Test::waylandRegistry();
+    const Registry::AnnouncedInterface shm = registry->interface(Registry::Interface::Shm);
+    QScopedPointer<ShmPool> shmPool(registry->createShmPool(shm.name, shm.version));
+    QVERIFY(shmPool->isValid());
+
+    QImage img(QSize(200, 300), QImage::Format_ARGB32_Premultiplied);
+    img.fill(Qt::red);
+    QSignalSpy committedSpy(client->surface(), &KWaylandServer::SurfaceInterface::committed);
+    QVERIFY(committedSpy.isValid());
+    s->attachBuffer(shmPool->createBuffer(img));
+    s->damage(QRect(QPoint(0, 0), img.size()));
+    s->commit(Surface::CommitFlag::None);
+    QVERIFY(committedSpy.wait());
+    KWaylandServer::BufferInterface *buffer = client->surface()->buffer();
+    QVERIFY(buffer);
+
+    auto scene = KWin::Compositor::self()->scene();
+    QVERIFY(scene);
+    QSignalSpy frameRenderedSpy(scene, &Scene::frameRendered);
+    QVERIFY(frameRenderedSpy.isValid());
+    QVERIFY(frameRenderedSpy.wait());
+
+    QImage referenceImage(QSize(1280, 1024), QImage::Format_RGB32);
+    referenceImage.fill(Qt::black);
+    QPainter painter(&referenceImage);
+    painter.fillRect(0, 0, 200, 300, Qt::red);
+    auto cursor = Cursors::self()->mouse();
+    const QImage cursorImage = cursor->image();
+    QVERIFY(!cursorImage.isNull());
+    painter.drawImage(QPoint(400, 400) - cursor->hotspot(), cursorImage);
+    QCOMPARE(referenceImage, *scene->qpainterRenderBuffer(0));
+
+    // now destroy the buffer while it's still attached
+    QSignalSpy bufferDestroyedSpy(buffer, &KWaylandServer::BufferInterface::aboutToBeDestroyed);
+    QVERIFY(bufferDestroyedSpy.isValid());
+    shmPool.reset();
+    Test::flushWaylandConnection();
+    QVERIFY(bufferDestroyedSpy.wait());
+
+    // the window should look the same
+    KWin::Compositor::self()->addRepaintFull();
+    QVERIFY(frameRenderedSpy.wait());
+    QCOMPARE(referenceImage, *scene->qpainterRenderBuffer(0));
+}
+
+static qint64 anonymousMemoryUsage()
+{
+    // Shared memory buffers are accounted in RssShmem, so RssAnon only grows if the
+    // compositor makes copies of them.
+    QFile file(QStringLiteral("/proc/self/status"));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    while (!file.atEnd()) {
+        const QByteArray line = file.readLine();
+        if (line.startsWith("RssAnon:")) {
+            return line.mid(8).trimmed().split(' ').first().toLongLong() * 1024;
+        }
+    }
+    return -1;
+}
+
+void SceneQPainterTest::benchmarkWindowUpdates()
+{
+    // this test measures the cost of a client committing a new 4K buffer for every frame
+    using namespace KWayland::Client;
+    QVERIFY(Test::setupWaylandConnection());
+    QScopedPointer<Surface> s(Test::createSurface());
+    QScopedPointer<XdgShellSurface> ss(Test::createXdgShellStableSurface(s.data()));
+    QVERIFY(Test::renderAndWaitForShown(s.data(), QSize(3840, 2160), Qt::blue));
+
+    // the buffers are filled only once, so the client side doesn't show up in the results
+    const QSize size(3840, 2160);
+    QVector<Buffer::Ptr> buffers;
+    for (const QColor &color : {Qt::red, Qt::green, Qt::blue}) {
+        QImage img(size, QImage::Format_ARGB32_Premultiplied);
+        img.fill(color);
+        Buffer::Ptr buffer = Test::waylandShmPool()->createBuffer(img);
+        QVERIFY(buffer);
+        buffer.toStrongRef()->setUsed(true);
+        buffers << buffer;
+    }
+
+    auto scene = KWin::Compositor::self()->scene();
+    QVERIFY(scene);
+    QSignalSpy frameRenderedSpy(scene, &Scene::frameRendered);
+    QVERIFY(frameRenderedSpy.isValid());
+
+    const qint64 memoryUsageBefore = anonymousMemoryUsage();
+    qint64 frameCount = 0;
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK {
+        s->attachBuffer(buffers[frameCount % buffers.count()]);
+        s->damage(QRect(QPoint(0, 0), size));
+        s->commit(Surface::CommitFlag::None);
+        QVERIFY(frameRenderedSpy.wait());
+        frameCount++;
+    }
+    const qint64 elapsed = timer.nsecsElapsed();
+    const qint64 memoryUsageAfter = anonymousMemoryUsage();
+
+    qInfo("%.1f frames/s, %.1f MB/s of client buffers, %.1f MB of anonymous memory added",
+          frameCount / (elapsed / 1e9),
+          frameCount * size.width() * size.height() * 4 / 1048576.0 / (elapsed / 1e9),
+          (memoryUsageAfter - memoryUsageBefore) / 1048576.0);
+
+    for (const Buffer::Ptr &buffer : buffers) {
+        if (auto b = buffer.toStrongRef()) {
+            b->setUsed(false);
+        }
+    }
+}
+
+enum class Workload {
+    Idle,
+    PointerMotion,
+    TextCaret,
+    Video,
+    WindowRedraw,
+};
+Q_DECLARE_METATYPE(Workload)
+
+void SceneQPainterTest::benchmarkPixelsTouched_data()
+{
+    QTest::addColumn<Workload>("workload");
+    QTest::addColumn<bool>("fullRepaint");
+
+    QTest::addRow("idle") << Workload::Idle << false;
+    QTest::addRow("pointer motion") << Workload::PointerMotion << false;
+    QTest::addRow("text caret") << Workload::TextCaret << false;
+    QTest::addRow("video") << Workload::Video << false;
+    QTest::addRow("window redraw") << Workload::WindowRedraw << false;
+    QTest::addRow("full repaint") << Workload::Idle << true;
+}
+
+void SceneQPainterTest::benchmarkPixelsTouched()
+{
+    // this test reports how many pixels of the back buffer are written to per frame
+    // before a frame is rendered, the back buffer is filled with a sentinel color, every pixel
+    // that doesn't have that color afterwards has been painted; the untouched pixels are
+    // restored after counting them so the next frame starts with the correct contents
+    QFETCH(Workload, workload);
+    QFETCH(bool, fullRepaint);
+
+    KWin::Cursors::self()->mouse()->setPos(640, 512);
+    using namespace KWayland::Client;
+    QVERIFY(Test::setupWaylandConnection());
+    QScopedPointer<Surface> s(Test::createSurface());
+    QScopedPointer<XdgShellSurface> ss(Test::createXdgShellStableSurface(s.data()));
+    QImage img(QSize(800, 600), QImage::Format_ARGB32_Premultiplied);
+    img.fill(Qt::blue);
+    QVERIFY(Test::renderAndWaitForShown(s.data(), img.size(), Qt::blue));
+
+    auto scene = KWin::Compositor::self()->scene();
+    QVERIFY(scene);
+    QSignalSpy frameRenderedSpy(scene, &Scene::frameRendered);
+    QVERIFY(frameRenderedSpy.isValid());
+    KWin::Compositor::self()->addRepaintFull();
+    QVERIFY(frameRenderedSpy.wait());
+
+    const QRgb sentinel = qRgb(0x13, 0x57, 0x9b);
+    const int frameCount = 30;
+    qint64 touchedPixels = 0;
+
+    for (int frame = 0; frame < frameCount; ++frame) {
+        QImage *buffer = scene->qpainterRenderBuffer(0);
+        const QImage contents = buffer->copy();
+        buffer->fill(sentinel);
+
+        switch (workload) {
+        case Workload::Idle:
+            break;
+        case Workload::PointerMotion:
+            KWin::Cursors::self()->mouse()->setPos(640 + frame % 2, 512 + frame % 2);
+            break;
+        case Workload::TextCaret: {
+            const QRect caret(120, 80, 2, 16);
+            QPainter painter(&img);
+            painter.fillRect(caret, frame % 2 ? Qt::blue : Qt::white);
+            painter.end();
+            s->attachBuffer(Test::waylandShmPool()->createBuffer(img));
+            s->damage(caret);
+            s->commit(Surface::CommitFlag::None);
+            break;
+        }
+        case Workload::Video: {
+            const QRect video(200, 150, 480, 270);
+            QPainter painter(&img);
+            painter.fillRect(video, QColor::fromHsv(frame * 12, 255, 255));
+            painter.end();
+            s->attachBuffer(Test::waylandShmPool()->createBuffer(img));
+            s->damage(video);
+            s->commit(Surface::CommitFlag::None);
+            break;
+        }
+        case Workload::WindowRedraw:
+            img.fill(frame % 2 ? Qt::blue : Qt::green);
+            Test::render(s.data(), img);
+            break;
+        }
+        if (fullRepaint) {
+            KWin::Compositor::self()->addRepaintFull();
+        } else if (workload == Workload::Idle) {
+            // still make the compositor render a frame
+            KWin::Compositor::self()->addRepaint(QRect(0, 0, 1, 1));
+        }
+        QVERIFY(frameRenderedSpy.wait());
+
+        buffer = scene->qpainterRenderBuffer(0);
+        QCOMPARE(buffer->size(), contents.size());
+        for (int y = 0; y < buffer->height(); ++y) {
+            QRgb *line = reinterpret_cast<QRgb *>(buffer->scanLine(y));
+            const QRgb *oldLine = reinterpret_cast<const QRgb *>(contents.constScanLine(y));
+            for (int x = 0; x < buffer->width(); ++x) {
+                if (line[x] == sentinel) {
+                    line[x] = oldLine[x];
+                } else {
+                    touchedPixels++;
+                }
+            }
+        }
+    }
+
+    const qint64 screenPixels = qint64(scene->qpainterRenderBuffer(0)->width()) * scene->qpainterRenderBuffer(0)->height();
+    const qreal pixelsPerFrame = qreal(touchedPixels) / frameCount;
+    qInfo("%.0f pixels touched per frame, %.2f%% of the screen", pixelsPerFrame, 100 * pixelsPerFrame / screenPixels);
+    if (fullRepaint) {
+        QCOMPARE(touchedPixels, screenPixels * frameCount);
+    } else {
+        QVERIFY(touchedPixels < screenPixels * frameCount / 2);
+    }
+}
+
 WAYLANDTEST_MAIN(SceneQPainterTest)
 #include "scene_qpainter_test.moc"
@@ -544,6 +544,11 @@ ShmPool *waylandShmPool()
     return s_waylandConnection.shm;
 }
 
+Registry *waylandRegistry()
+{
+    return s_waylandConnection.registry;
+}
+
 Seat *waylandSeat()
 {
     return s_waylandConnection.seat;
@@ -0,0 +1,190 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "kwin_wayland_test.h"
+#include "x11client.h"
+#include "composite.h"
+#include "deleted.h"
+#include "effects.h"
+#include "platform.h"
+#include "wayland_server.h"
+#include "workspace.h"
+
+#include <xcb/xcb_icccm.h>
+
+using namespace KWin;
+static const QString s_socketName = QStringLiteral("wayland_test_x11_window_lookup-0");
+
+class X11WindowLookupTest : public QObject
+{
+Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+    void cleanup();
+
+    void testFindClient();
+    void benchmarkEventDispatch_data();
+    void benchmarkEventDispatch();
+};
+
+void X11WindowLookupTest::initTestCase()
+{
+    qRegisterMetaType<KWin::Deleted*>();
+    qRegisterMetaType<KWin::AbstractClient*>();
+    QSignalSpy applicationStartedSpy(kwinApp(), &Application::started);
+    QVERIFY(applicationStartedSpy.isValid());
+    kwinApp()->platform()->setInitialWindowSize(QSize(1280, 1024));
+    QVERIFY(waylandServer()->init(s_socketName));
+    kwinApp()->setConfig(KSharedConfig::openConfig(QString(), KConfig::SimpleConfig));
+
+    kwinApp()->start();
+    QVERIFY(applicationStartedSpy.wait());
+    QVERIFY(KWin::Compositor::self());
+    waylandServer()->initWorkspace();
+}
+
+void X11WindowLookupTest::init()
+{
+    QVERIFY(Test::setupWaylandConnection());
+}
+
+void X11WindowLookupTest::cleanup()
+{
+    Test::destroyWaylandConnection();
+}
+
+struct XcbConnectionDeleter
+{
+    static inline void cleanup(xcb_connection_t *pointer)
+    {
+        xcb_disconnect(pointer);
+    }
+};
+
+static xcb_window_t createWindow(xcb_connection_t *c, const QRect &windowGeometry)
+{
+    xcb_window_t w = xcb_generate_id(c);
+    xcb_create_window(c, XCB_COPY_FROM_PARENT, w, rootWindow(),
+                      windowGeometry.x(),
+                      windowGeometry.y(),
+                      windowGeometry.width(),
+                      windowGeometry.height(),
+                      0, XCB_WINDOW_CLASS_INPUT_OUTPUT, XCB_COPY_FROM_PARENT, 0, nullptr);
+    xcb_size_hints_t hints;
+    memset(&hints, 0, sizeof(hints));
+    xcb_icccm_size_hints_set_position(&hints, 1, windowGeometry.x(), windowGeometry.y());
+    xcb_icccm_size_hints_set_size(&hints, 1, windowGeometry.width(), windowGeometry.height());
+    xcb_icccm_set_wm_normal_hints(c, w, &hints);
+    xcb_map_window(c, w);
+    return w;
+}
+
+void X11WindowLookupTest::testFindClient()
+{
+    // This test verifies that a managed client can be looked up by all of its window ids
+    // and by its internal id, and that it can't be found anymore once it's gone.
+    QScopedPointer<xcb_connection_t, XcbConnectionDeleter> c(xcb_connect(nullptr, nullptr));
+    QVERIFY(!xcb_connection_has_error(c.data()));
+    const xcb_window_t w = createWindow(c.data(), QRect(0, 0, 100, 200));
+    xcb_flush(c.data());
+
+    QSignalSpy windowCreatedSpy(workspace(), &Workspace::clientAdded);
+    QVERIFY(windowCreatedSpy.isValid());
+    QVERIFY(windowCreatedSpy.wait());
+    X11Client *client = windowCreatedSpy.last().first().value<X11Client *>();
+    QVERIFY(client);
+    QCOMPARE(client->window(), w);
+
+    const xcb_window_t wrapper = client->wrapperId();
+    const xcb_window_t frame = client->frameId();
+    const xcb_window_t input = client->inputId();
+    const QUuid internalId = client->internalId();
+
+    QCOMPARE(workspace()->findClient(Predicate::WindowMatch, w), client);
+    QCOMPARE(workspace()->findClient(Predicate::WrapperIdMatch, wrapper), client);
+    QCOMPARE(workspace()->findClient(Predicate::FrameIdMatch, frame), client);
+    if (input != XCB_WINDOW_NONE) {
+        QCOMPARE(workspace()->findClient(Predicate::InputIdMatch, input), client);
+    }
+    QCOMPARE(workspace()->findClient(Predicate::WindowMatch, frame), nullptr);
+    QCOMPARE(workspace()->findClient(Predicate::WindowMatch, XCB_WINDOW_NONE), nullptr);
+    QCOMPARE(workspace()->findToplevel(internalId), static_cast<Toplevel *>(client));
+    QCOMPARE(workspace()->findUnmanaged(w), nullptr);
+    QCOMPARE(effects->findWindow(w), client->effectWindow());
+    QCOMPARE(effects->findWindow(internalId), client->effectWindow());
+
+    // Destroy the test window.
+    xcb_destroy_window(c.data(), w);
+    xcb_flush(c.data());
+    QVERIFY(Test::waitForWindowDestroyed(client));
+
+    QCOMPARE(workspace()->findClient(Predicate::WindowMatch, w), nullptr);
+    QCOMPARE(workspace()->findClient(Predicate::WrapperIdMatch, wrapper), nullptr);
+    QCOMPARE(workspace()->findClient(Predicate::FrameIdMatch, frame), nullptr);
+    if (input != XCB_WINDOW_NONE) {
+        QCOMPARE(workspace()->findClient(Predicate::InputIdMatch, input), nullptr);
+    }
+    QCOMPARE(workspace()->findToplevel(internalId), nullptr);
+}
+
+void X11WindowLookupTest::benchmarkEventDispatch_data()
+{
+    QTest::addColumn<int>("windowCount");
+
+    QTest::addRow("1 window") << 1;
+    QTest::addRow("10 windows") << 10;
+    QTest::addRow("100 windows") << 100;
+    QTest::addRow("300 windows") << 300;
+}
+
+void X11WindowLookupTest::benchmarkEventDispatch()
+{
+    // This test measures how long it takes to dispatch an X11 event depending on the number
+    // of managed clients. The lookup cost should not grow with the number of clients.
+    QFETCH(int, windowCount);
+
+    QScopedPointer<xcb_connection_t, XcbConnectionDeleter> c(xcb_connect(nullptr, nullptr));
+    QVERIFY(!xcb_connection_has_error(c.data()));
+
+    QSignalSpy windowCreatedSpy(workspace(), &Workspace::clientAdded);
+    QVERIFY(windowCreatedSpy.isValid());
+    for (int i = 0; i < windowCount; ++i) {
+        createWindow(c.data(), QRect(i % 100, i % 100, 100, 100));
+    }
+    xcb_flush(c.data());
+    while (windowCreatedSpy.count() < windowCount) {
+        QVERIFY(windowCreatedSpy.wait());
+    }
+    X11Client *client = windowCreatedSpy.last().first().value<X11Client *>();
+    QVERIFY(client);
+
+    // The window is never created, so every lookup in workspaceEvent() has to fail, which
+    // used to be the worst case as all clients had to be visited for each predicate.
+    xcb_configure_notify_event_t event = {};
+    event.response_type = XCB_CONFIGURE_NOTIFY;
+    event.event = xcb_generate_id(c.data());
+    event.window = event.event;
+
+    QBENCHMARK {
+        workspace()->workspaceEvent(reinterpret_cast<xcb_generic_event_t *>(&event));
+        QCOMPARE(workspace()->findClient(Predicate::FrameIdMatch, client->frameId()), client);
+        QCOMPARE(workspace()->findToplevel(client->internalId()), static_cast<Toplevel *>(client));
+    }
+
+    // Destroy all test windows before the next run.
+    QSignalSpy windowRemovedSpy(workspace(), &Workspace::clientRemoved);
+    QVERIFY(windowRemovedSpy.isValid());
+    c.reset();
+    while (windowRemovedSpy.count() < windowCount) {
+        QVERIFY(windowRemovedSpy.wait());
+    }
+}
+
+WAYLANDTEST_MAIN(X11WindowLookupTest)
+#include "x11_window_lookup_test.moc"
@@ -131,6 +131,9 @@ private Q_SLOTS:
     void testInactiveOpacityForceTemporarily();
 
     void testMatchAfterNameChange();
+    void testMatchAfterTitleChange();
+    void benchmarkFind_data();
+    void benchmarkFind();
 };
 
 void TestXdgShellClientRules::initTestCase()
@@ -4212,5 +4215,123 @@ void TestXdgShellClientRules::testMatchAfterNameChange()
     QCOMPARE(c->keepAbove(), true);
 }
 
+void TestXdgShellClientRules::testMatchAfterTitleChange()
+{
+    KSharedConfig::Ptr config = KSharedConfig::openConfig(QString(), KConfig::SimpleConfig);
+    config->group("General").writeEntry("count", 2);
+
+    KConfigGroup group = config->group("1");
+    group.writeEntry("above", true);
+    group.writeEntry("aboverule", int(Rules::Force));
+    group.writeEntry("title", "^Document .* - Foo$");
+    group.writeEntry("titlematch", int(Rules::RegExpMatch));
+    group.sync();
+
+    group = config->group("2");
+    group.writeEntry("skiptaskbar", true);
+    group.writeEntry("skiptaskbarrule", int(Rules::Force));
+    group.writeEntry("wmclass", "org.kde.foo");
+    group.writeEntry("wmclasscomplete", false);
+    group.writeEntry("wmclassmatch", int(Rules::ExactMatch));
+    group.sync();
+
+    RuleBook::self()->setConfig(config);
+    workspace()->slotReconfigure();
+
+    AbstractClient *client;
+    Surface *surface;
+    XdgShellSurface *shellSurface;
+    std::tie(client, surface, shellSurface) = createWindow("org.kde.foo");
+    QVERIFY(client);
+    QCOMPARE(client->keepAbove(), false);
+    QCOMPARE(client->skipTaskbar(), true);
+
+    // A title that doesn't match leaves the rules alone.
+    QSignalSpy captionChangedSpy(client, &AbstractClient::captionChanged);
+    QVERIFY(captionChangedSpy.isValid());
+    shellSurface->setTitle(QStringLiteral("Bar"));
+    QVERIFY(captionChangedSpy.wait());
+    QCoreApplication::processEvents();
+    QCOMPARE(client->keepAbove(), false);
+    QCOMPARE(client->skipTaskbar(), true);
+
+    // Once the title matches, the title rule has to be applied, the other one still applies.
+    shellSurface->setTitle(QStringLiteral("Document 1 - Foo"));
+    QVERIFY(captionChangedSpy.wait());
+    QTRY_COMPARE(client->keepAbove(), true);
+    QCOMPARE(client->skipTaskbar(), true);
+
+    delete shellSurface;
+    delete surface;
+    QVERIFY(Test::waitForWindowDestroyed(client));
+}
+
+void TestXdgShellClientRules::benchmarkFind_data()
+{
+    QTest::addColumn<bool>("titleChange");
+
+    QTest::addRow("find") << false;
+    QTest::addRow("title change") << true;
+}
+
+void TestXdgShellClientRules::benchmarkFind()
+{
+    // This benchmark measures how fast the rules of a window are looked up in a large rule
+    // book, as it happens when a window is mapped or when its title changes.
+    QFETCH(bool, titleChange);
+
+    const int ruleCount = 200;
+    KSharedConfig::Ptr config = KSharedConfig::openConfig(QString(), KConfig::SimpleConfig);
+    config->group("General").writeEntry("count", ruleCount);
+    for (int i = 0; i < ruleCount; ++i) {
+        KConfigGroup group = config->group(QString::number(i + 1));
+        group.writeEntry("desktop", 1);
+        group.writeEntry("desktoprule", int(Rules::Force));
+        switch (i % 5) {
+        case 0:
+        case 1:
+        case 2:
+            group.writeEntry("wmclass", QStringLiteral("org.kde.app%1").arg(i));
+            group.writeEntry("wmclassmatch", int(Rules::ExactMatch));
+            break;
+        case 3:
+            group.writeEntry("wmclass", QStringLiteral("^org\\.kde\\.tool%1$").arg(i));
+            group.writeEntry("wmclassmatch", int(Rules::RegExpMatch));
+            break;
+        case 4:
+            group.writeEntry("title", QStringLiteral("^Document %1 .* - [A-Z][a-z]+$").arg(i));
+            group.writeEntry("titlematch", int(Rules::RegExpMatch));
+            break;
+        }
+    }
+    config->sync();
+
+    RuleBook::self()->setConfig(config);
+    workspace()->slotReconfigure();
+
+    AbstractClient *client;
+    Surface *surface;
+    XdgShellSurface *shellSurface;
+    std::tie(client, surface, shellSurface) = createWindow("org.kde.app42");
+    QVERIFY(client);
+    QSignalSpy captionChangedSpy(client, &AbstractClient::captionChanged);
+    QVERIFY(captionChangedSpy.isValid());
+    shellSurface->setTitle(QStringLiteral("Document 42 - Writer"));
+    QVERIFY(captionChangedSpy.wait());
+
+    WindowRules rules = RuleBook::self()->find(client, true);
+    QBENCHMARK {
+        if (titleChange) {
+            RuleBook::self()->updateTitleRules(client, &rules);
+        } else {
+            rules = RuleBook::self()->find(client, true);
+        }
+    }
+
+    delete shellSurface;
+    delete surface;
+    QVERIFY(Test::waitForWindowDestroyed(client));
+}
+
 WAYLANDTEST_MAIN(TestXdgShellClientRules)
 #include "xdgshellclient_rules_test.moc"
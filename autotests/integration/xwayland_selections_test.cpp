@@ -17,6 +17,7 @@
 
 #include <KWaylandServer/datadevice_interface.h>
 
+#include <QFile>
 #include <QProcess>
 #include <QProcessEnvironment>
 
@@ -24,6 +25,22 @@ using namespace KWin;
 
 static const QString s_socketName = QStringLiteral("wayland_test_kwin_xwayland_selections-0");
 
+// The peak resident set size of the compositor, in KiB.
+static qint64 peakMemory()
+{
+    QFile status(QStringLiteral("/proc/self/status"));
+    if (!status.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    const QList<QByteArray> lines = status.readAll().split('\n');
+    for (const QByteArray &line : lines) {
+        if (line.startsWith("VmHWM:")) {
+            return line.mid(6).simplified().split(' ').first().toLongLong();
+        }
+    }
+    return -1;
+}
+
 class XwaylandSelectionsTest : public QObject
 {
     Q_OBJECT
@@ -86,14 +103,24 @@ void XwaylandSelectionsTest::testSync_data()
 {
     QTest::addColumn<QString>("copyPlatform");
     QTest::addColumn<QString>("pastePlatform");
+    QTest::addColumn<int>("size");
 
-    QTest::newRow("x11->wayland") << QStringLiteral("xcb") << QStringLiteral("wayland");
-    QTest::newRow("wayland->x11") << QStringLiteral("wayland") << QStringLiteral("xcb");
+    QTest::newRow("x11->wayland") << QStringLiteral("xcb") << QStringLiteral("wayland") << 0;
+    QTest::newRow("wayland->x11") << QStringLiteral("wayland") << QStringLiteral("xcb") << 0;
+    QTest::newRow("x11->wayland, 512 MiB") << QStringLiteral("xcb") << QStringLiteral("wayland") << 512;
+    QTest::newRow("wayland->x11, 512 MiB") << QStringLiteral("wayland") << QStringLiteral("xcb") << 512;
 }
 
 void XwaylandSelectionsTest::testSync()
 {
     // this test verifies the syncing of X11 to Wayland clipboard
+    // A large selection is transferred in chunks, the compositor only keeps a few of them at
+    // a time and stops reading from the source while the requestor hasn't taken them. So the
+    // peak memory of the compositor must not grow by anything close to the selection size.
+    QFETCH(int, size);
+    const QStringList arguments = size ? QStringList{QString::number(size)} : QStringList();
+    const qint64 peakBefore = peakMemory();
+
     const QString copy = QFINDTESTDATA(QStringLiteral("copy"));
     QVERIFY(!copy.isEmpty());
     const QString paste = QFINDTESTDATA(QStringLiteral("paste"));
@@ -114,6 +141,7 @@ void XwaylandSelectionsTest::testSync()
     m_copyProcess->setProcessEnvironment(environment);
     m_copyProcess->setProcessChannelMode(QProcess::ForwardedChannels);
     m_copyProcess->setProgram(copy);
+    m_copyProcess->setArguments(arguments);
     m_copyProcess->start();
     QVERIFY(m_copyProcess->waitForStarted());
 
@@ -144,6 +172,7 @@ void XwaylandSelectionsTest::testSync()
     m_pasteProcess->setProcessEnvironment(environment);
     m_pasteProcess->setProcessChannelMode(QProcess::ForwardedChannels);
     m_pasteProcess->setProgram(paste);
+    m_pasteProcess->setArguments(arguments);
     m_pasteProcess->start();
     QVERIFY(m_pasteProcess->waitForStarted());
 
@@ -160,8 +189,11 @@ void XwaylandSelectionsTest::testSync()
         QVERIFY(clientActivatedSpy.wait());
     }
     QTRY_COMPARE(workspace()->activeClient(), pasteClient);
-    QVERIFY(finishedSpy.wait());
+    QVERIFY(finishedSpy.wait(size ? 120000 : 5000));
     QCOMPARE(finishedSpy.first().first().toInt(), 0);
+    if (size && peakBefore != -1) {
+        QVERIFY(peakMemory() - peakBefore < 64 * 1024);
+    }
     delete m_pasteProcess;
     m_pasteProcess = nullptr;
     delete m_copyProcess;
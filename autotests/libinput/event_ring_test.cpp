@@ -0,0 +1,270 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "mock_libinput.h"
+
+#include "libinput/device.h"
+#include "libinput/eventring.h"
+#include "libinput/events.h"
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QSocketNotifier>
+#include <QThread>
+#include <QtTest>
+
+#include <algorithm>
+#include <poll.h>
+
+using namespace KWin::LibInput;
+
+class TestLibinputEventRing : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void init();
+    void cleanup();
+
+    void testPushPop();
+    void testOverflow();
+    void testWakeup();
+    void testConcurrent();
+    void benchmarkSustainedInput_data();
+    void benchmarkSustainedInput();
+
+private:
+    Event *createMotionEvent(quint64 timeMicroseconds = 0);
+
+    libinput_device *m_nativeDevice = nullptr;
+    Device *m_device = nullptr;
+};
+
+void TestLibinputEventRing::init()
+{
+    m_nativeDevice = new libinput_device;
+    m_nativeDevice->pointer = true;
+    m_device = new Device(m_nativeDevice);
+}
+
+void TestLibinputEventRing::cleanup()
+{
+    delete m_device;
+    m_device = nullptr;
+
+    delete m_nativeDevice;
+    m_nativeDevice = nullptr;
+}
+
+Event *TestLibinputEventRing::createMotionEvent(quint64 timeMicroseconds)
+{
+    libinput_event_pointer *nativeEvent = new libinput_event_pointer;
+    nativeEvent->type = LIBINPUT_EVENT_POINTER_MOTION;
+    nativeEvent->device = m_nativeDevice;
+    nativeEvent->delta = QSizeF(1, 2);
+    nativeEvent->timeMicroseconds = timeMicroseconds;
+    return Event::create(nativeEvent);
+}
+
+static bool isReadable(int fd)
+{
+    pollfd pfd = {fd, POLLIN, 0};
+    return poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLIN);
+}
+
+void TestLibinputEventRing::testPushPop()
+{
+    EventRing ring(8);
+    QCOMPARE(ring.capacity(), 8);
+    QVERIFY(!ring.peek());
+    QVERIFY(!ring.pop());
+
+    // Wrap around a couple of times, the order must be kept.
+    for (int round = 0; round < 3; ++round) {
+        QVector<Event *> events;
+        for (int i = 0; i < 5; ++i) {
+            events << createMotionEvent(i + 1);
+            QVERIFY(ring.push(events.last()));
+        }
+        for (Event *event : qAsConst(events)) {
+            QCOMPARE(ring.peek(), event);
+            QScopedPointer<Event> popped(ring.pop());
+            QCOMPARE(popped.data(), event);
+        }
+        QVERIFY(!ring.pop());
+    }
+    QVERIFY(!ring.takeOverflow());
+
+    // Events that are left in the ring are destroyed along with it.
+    QVERIFY(ring.push(createMotionEvent()));
+}
+
+void TestLibinputEventRing::testOverflow()
+{
+    EventRing ring(4);
+    for (int i = 0; i < 4; ++i) {
+        QVERIFY(ring.push(createMotionEvent()));
+    }
+    QScopedPointer<Event> event(createMotionEvent());
+    QVERIFY(!ring.push(event.data()));
+    QVERIFY(ring.takeOverflow());
+    QVERIFY(!ring.takeOverflow());
+
+    delete ring.pop();
+    QVERIFY(ring.push(event.take()));
+}
+
+void TestLibinputEventRing::testWakeup()
+{
+    EventRing ring;
+    QVERIFY(ring.fileDescriptor() != -1);
+    QVERIFY(!isReadable(ring.fileDescriptor()));
+
+    QVERIFY(ring.push(createMotionEvent()));
+    QVERIFY(!isReadable(ring.fileDescriptor()));
+    ring.notify();
+    ring.notify();
+    QVERIFY(isReadable(ring.fileDescriptor()));
+
+    ring.acknowledge();
+    QVERIFY(!isReadable(ring.fileDescriptor()));
+    delete ring.pop();
+}
+
+void TestLibinputEventRing::testConcurrent()
+{
+    // This test verifies that events pushed from another thread arrive in order.
+    const int eventCount = 100000;
+    EventRing ring(64);
+
+    QScopedPointer<QThread> producer(QThread::create([this, &ring, eventCount] {
+        for (int i = 1; i <= eventCount; ++i) {
+            Event *event = createMotionEvent(i);
+            while (!ring.push(event)) {
+                QThread::yieldCurrentThread();
+            }
+            ring.notify();
+        }
+    }));
+    producer->start();
+
+    quint64 expected = 1;
+    while (expected <= quint64(eventCount)) {
+        if (Event *event = ring.pop()) {
+            QScopedPointer<PointerEvent> pe(static_cast<PointerEvent *>(event));
+            QCOMPARE(pe->timeMicroseconds(), expected);
+            ++expected;
+        } else {
+            QThread::yieldCurrentThread();
+        }
+    }
+    QVERIFY(producer->wait());
+    QVERIFY(!ring.pop());
+}
+
+void TestLibinputEventRing::benchmarkSustainedInput_data()
+{
+    QTest::addColumn<bool>("ring");
+
+    QTest::addRow("mutex queue") << false;
+    QTest::addRow("event ring") << true;
+}
+
+void TestLibinputEventRing::benchmarkSustainedInput()
+{
+    // This benchmark feeds relative motion at 8 kHz from a producer thread, and it reports the
+    // time between an event being read and it being processed on the main thread. The mutex
+    // queue row mimics how events were passed before the event ring.
+    QFETCH(bool, ring);
+
+    const int eventCount = 8000;
+    const qint64 interval = 125000; // nanoseconds
+
+    EventRing eventRing;
+    QMutex mutex(QMutex::Recursive);
+    QVector<Event *> queue;
+
+    QVector<qint64> latencies;
+    latencies.reserve(eventCount);
+    int batchCount = 0;
+
+    QElapsedTimer clock;
+    clock.start();
+
+    auto processEvent = [&](Event *event) {
+        QScopedPointer<PointerEvent> pe(static_cast<PointerEvent *>(event));
+        latencies << clock.nsecsElapsed() / 1000 - qint64(pe->timeMicroseconds());
+    };
+
+    QObject consumer;
+    auto drainQueue = [&] {
+        QMutexLocker locker(&mutex);
+        while (!queue.isEmpty()) {
+            processEvent(queue.takeFirst());
+        }
+        batchCount++;
+    };
+    auto drainRing = [&] {
+        eventRing.acknowledge();
+        while (Event *event = eventRing.pop()) {
+            processEvent(event);
+            // motion events queued behind this one are merged into it
+            while (Event *next = eventRing.peek()) {
+                if (next->type() != LIBINPUT_EVENT_POINTER_MOTION) {
+                    break;
+                }
+                processEvent(eventRing.pop());
+            }
+        }
+        batchCount++;
+    };
+
+    QSocketNotifier notifier(eventRing.fileDescriptor(), QSocketNotifier::Read);
+    connect(&notifier, &QSocketNotifier::activated, &consumer, drainRing);
+
+    QScopedPointer<QThread> producer(QThread::create([&] {
+        for (int i = 0; i < eventCount; ++i) {
+            // Wait for the next sample, sleeping is too coarse for 8 kHz.
+            const qint64 due = (i + 1) * interval;
+            while (clock.nsecsElapsed() < due) {
+            }
+            Event *event = createMotionEvent(clock.nsecsElapsed() / 1000);
+            if (ring) {
+                while (!eventRing.push(event)) {
+                    QThread::yieldCurrentThread();
+                }
+                eventRing.notify();
+            } else {
+                QMutexLocker locker(&mutex);
+                const bool wasEmpty = queue.isEmpty();
+                queue << event;
+                if (wasEmpty) {
+                    QMetaObject::invokeMethod(&consumer, drainQueue, Qt::QueuedConnection);
+                }
+            }
+        }
+    }));
+
+    QBENCHMARK_ONCE {
+        producer->start();
+        while (latencies.count() < eventCount) {
+            QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+        }
+        QVERIFY(producer->wait());
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](qreal p) {
+        return latencies.at(qMin(latencies.count() - 1, int(latencies.count() * p)));
+    };
+    qInfo("latency in us: p50 %lld, p90 %lld, p99 %lld, p99.9 %lld, max %lld; %d wakeups for %d events",
+          percentile(0.5), percentile(0.9), percentile(0.99), percentile(0.999), latencies.last(),
+          batchCount, eventCount);
+}
+
+QTEST_GUILESS_MAIN(TestLibinputEventRing)
+#include "event_ring_test.moc"
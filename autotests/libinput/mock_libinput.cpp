@@ -559,6 +559,9 @@ uint32_t libinput_event_pointer_get_time(struct libinput_event_pointer *event)
 
 uint64_t libinput_event_pointer_get_time_usec(struct libinput_event_pointer *event)
 {
+    if (event->timeMicroseconds) {
+        return event->timeMicroseconds;
+    }
     return quint64(event->time * 1000);
 }
 
@@ -125,6 +125,8 @@ struct libinput_event_pointer : libinput_event {
     libinput_pointer_axis_source axisSource = {};
     QSizeF delta;
     QPointF absolutePos;
+    // if not set, derived from the time in milliseconds
+    quint64 timeMicroseconds = 0;
 };
 
 struct libinput_event_touch : libinput_event {
@@ -0,0 +1,406 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include <kwineffects.h>
+
+#include <QMatrix4x4>
+#include <QTest>
+#include <QtMath>
+
+#include <memory>
+
+#ifndef GL_TRIANGLES
+#  define GL_TRIANGLES      0x0004
+#endif
+
+#ifndef GL_QUADS
+#  define GL_QUADS          0x0007
+#endif
+
+Q_DECLARE_METATYPE(KWin::WindowQuadList)
+
+using namespace KWin;
+
+class WindowQuadArrayTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void testConversion();
+    void testMakeGrid_data();
+    void testMakeGrid();
+    void testMakeRegularGrid_data();
+    void testMakeRegularGrid();
+    void testSplit_data();
+    void testSplit();
+    void testTranslateAndScale();
+    void testMakeInterleavedArrays_data();
+    void testMakeInterleavedArrays();
+
+    void benchmarkMakeRegularGrid_data();
+    void benchmarkMakeRegularGrid();
+    void benchmarkMakeGrid_data();
+    void benchmarkMakeGrid();
+    void benchmarkTranslate_data();
+    void benchmarkTranslate();
+    void benchmarkMakeInterleavedArrays_data();
+    void benchmarkMakeInterleavedArrays();
+};
+
+static WindowQuad makeQuad(const QRectF &r, WindowQuadType type = WindowQuadContents, bool uvSwapped = false)
+{
+    // Texture coordinates are normalized and flipped, like those of a window
+    // with a y-inverted texture.
+    WindowQuad quad(type);
+    quad[0] = WindowVertex(r.x(), r.y(), r.x() / 1000, 1 - r.y() / 1000);
+    quad[1] = WindowVertex(r.x() + r.width(), r.y(), (r.x() + r.width()) / 1000, 1 - r.y() / 1000);
+    quad[2] = WindowVertex(r.x() + r.width(), r.y() + r.height(), (r.x() + r.width()) / 1000, 1 - (r.y() + r.height()) / 1000);
+    quad[3] = WindowVertex(r.x(), r.y() + r.height(), r.x() / 1000, 1 - (r.y() + r.height()) / 1000);
+    quad.setUVAxisSwapped(uvSwapped);
+    return quad;
+}
+
+static WindowQuadList makeWindow(const QRectF &geometry, bool uvSwapped = false)
+{
+    // A decorated window, the decoration consists of four quads around the contents.
+    const int border = 4;
+    const int titleBar = 30;
+    WindowQuadList quads;
+    quads << makeQuad(QRectF(geometry.x(), geometry.y(), geometry.width(), titleBar), WindowQuadDecoration);
+    quads << makeQuad(QRectF(geometry.x(), geometry.y() + titleBar, border, geometry.height() - titleBar - border), WindowQuadDecoration);
+    quads << makeQuad(QRectF(geometry.right() - border, geometry.y() + titleBar, border, geometry.height() - titleBar - border), WindowQuadDecoration);
+    quads << makeQuad(QRectF(geometry.x(), geometry.bottom() - border, geometry.width(), border), WindowQuadDecoration);
+    quads << makeQuad(geometry.adjusted(border, titleBar, -border, -border), WindowQuadContents, uvSwapped);
+    return quads;
+}
+
+static bool fuzzyCompare(double a, double b)
+{
+    // The array stores floats, allow for their precision.
+    return qAbs(a - b) <= 1e-3 * qMax(1.0, qAbs(a));
+}
+
+static void compareQuads(const WindowQuadList &actual, const WindowQuadList &expected)
+{
+    QCOMPARE(actual.count(), expected.count());
+    for (int i = 0; i < actual.count(); ++i) {
+        QCOMPARE(actual[i].type(), expected[i].type());
+        QCOMPARE(actual[i].id(), expected[i].id());
+        QCOMPARE(actual[i].uvAxisSwapped(), expected[i].uvAxisSwapped());
+        for (int j = 0; j < 4; ++j) {
+            const WindowVertex &a = actual[i][j];
+            const WindowVertex &e = expected[i][j];
+            QVERIFY2(fuzzyCompare(a.x(), e.x()) && fuzzyCompare(a.y(), e.y())
+                         && fuzzyCompare(a.originalX(), e.originalX()) && fuzzyCompare(a.originalY(), e.originalY())
+                         && fuzzyCompare(a.textureX(), e.textureX()) && fuzzyCompare(a.textureY(), e.textureY()),
+                     qPrintable(QStringLiteral("quad %1, vertex %2").arg(i).arg(j)));
+        }
+    }
+}
+
+// WindowQuadList::makeGrid() and makeRegularGrid() use WindowQuadArray, so the grids are
+// checked against this double precision implementation with WindowQuad::makeSubQuad().
+static WindowQuadList referenceGrid(const WindowQuadList &quads, double xIncrement, double yIncrement, bool regular)
+{
+    if (quads.isEmpty()) {
+        return quads;
+    }
+    double left = quads.first().left();
+    double right = quads.first().right();
+    double top = quads.first().top();
+    double bottom = quads.first().bottom();
+    for (const WindowQuad &quad : quads) {
+        left = qMin(left, quad.left());
+        right = qMax(right, quad.right());
+        top = qMin(top, quad.top());
+        bottom = qMax(bottom, quad.bottom());
+    }
+    if (regular) {
+        xIncrement = (right - left) / xIncrement;
+        yIncrement = (bottom - top) / yIncrement;
+    }
+
+    WindowQuadList ret;
+    for (const WindowQuad &quad : quads) {
+        if (quad.left() == quad.right() || quad.top() == quad.bottom()) {
+            ret.append(quad);
+            continue;
+        }
+        const double xBegin = left + qFloor((quad.left() - left) / xIncrement) * xIncrement;
+        const double yBegin = top + qFloor((quad.top() - top) / yIncrement) * yIncrement;
+        for (double y = yBegin; y < quad.bottom(); y += yIncrement) {
+            for (double x = xBegin; x < quad.right(); x += xIncrement) {
+                ret.append(quad.makeSubQuad(qMax(x, quad.left()), qMax(y, quad.top()),
+                                            qMin(quad.right(), x + xIncrement), qMin(quad.bottom(), y + yIncrement)));
+            }
+        }
+    }
+    return ret;
+}
+
+void WindowQuadArrayTest::testConversion()
+{
+    WindowQuadList list = makeWindow(QRectF(10, 20, 300, 200), true);
+    list[1][2].move(17, 23);
+
+    const WindowQuadArray array(list);
+    QCOMPARE(array.count(), list.count());
+    QCOMPARE(array.type(0), WindowQuadDecoration);
+    QCOMPARE(array.type(4), WindowQuadContents);
+    QVERIFY(array.uvAxisSwapped(4));
+    QCOMPARE(array.x()[4 * 1 + 2], 17.0f);
+    QCOMPARE(array.originalX()[4 * 1 + 2], 14.0f);
+    compareQuads(array.toList(), list);
+
+    WindowQuadArray copy = array;
+    copy.clear();
+    QVERIFY(copy.isEmpty());
+    QCOMPARE(array.count(), list.count());
+
+    // reserving memory doesn't add quads
+    WindowQuadArray reserved;
+    reserved.reserve(100);
+    QVERIFY(reserved.isEmpty());
+    reserved.append(list.first());
+    QCOMPARE(reserved.count(), 1);
+    compareQuads(reserved.toList(), WindowQuadList() << list.first());
+}
+
+void WindowQuadArrayTest::testMakeGrid_data()
+{
+    QTest::addColumn<WindowQuadList>("quads");
+    QTest::addColumn<int>("quadSize");
+
+    QTest::addRow("empty") << WindowQuadList() << 10;
+    QTest::addRow("quadSizeTooLarge") << (WindowQuadList() << makeQuad(QRectF(0, 0, 10, 10))) << 10;
+    QTest::addRow("irregularGrid") << (WindowQuadList() << makeQuad(QRectF(0, 0, 10, 10)) << makeQuad(QRectF(0, 10, 4, 3))) << 4;
+    QTest::addRow("window") << makeWindow(QRectF(100, 50, 640, 480)) << 100;
+    QTest::addRow("swapped") << makeWindow(QRectF(100, 50, 640, 480), true) << 75;
+    QTest::addRow("empty quad") << (WindowQuadList() << makeQuad(QRectF(10, 10, 0, 20))) << 5;
+}
+
+void WindowQuadArrayTest::testMakeGrid()
+{
+    QFETCH(WindowQuadList, quads);
+    QFETCH(int, quadSize);
+    const WindowQuadList expected = referenceGrid(quads, quadSize, quadSize, false);
+    compareQuads(WindowQuadArray(quads).makeGrid(quadSize).toList(), expected);
+    compareQuads(quads.makeGrid(quadSize), expected);
+}
+
+void WindowQuadArrayTest::testMakeRegularGrid_data()
+{
+    QTest::addColumn<WindowQuadList>("quads");
+    QTest::addColumn<int>("xSubdivisions");
+    QTest::addColumn<int>("ySubdivisions");
+
+    QTest::addRow("empty") << WindowQuadList() << 1 << 1;
+    QTest::addRow("noSplit") << (WindowQuadList() << makeQuad(QRectF(0, 0, 10, 10))) << 1 << 1;
+    QTest::addRow("multipleQuads") << (WindowQuadList() << makeQuad(QRectF(0, 0, 10, 10)) << makeQuad(QRectF(0, 10, 4, 2))) << 2 << 4;
+    QTest::addRow("window") << makeWindow(QRectF(100, 50, 640, 480)) << 16 << 16;
+    QTest::addRow("swapped") << makeWindow(QRectF(100, 50, 640, 480), true) << 7 << 3;
+}
+
+void WindowQuadArrayTest::testMakeRegularGrid()
+{
+    QFETCH(WindowQuadList, quads);
+    QFETCH(int, xSubdivisions);
+    QFETCH(int, ySubdivisions);
+    const WindowQuadList expected = referenceGrid(quads, xSubdivisions, ySubdivisions, true);
+    compareQuads(WindowQuadArray(quads).makeRegularGrid(xSubdivisions, ySubdivisions).toList(), expected);
+    compareQuads(quads.makeRegularGrid(xSubdivisions, ySubdivisions), expected);
+}
+
+void WindowQuadArrayTest::testSplit_data()
+{
+    QTest::addColumn<bool>("swapped");
+    QTest::addColumn<double>("x");
+    QTest::addColumn<double>("y");
+
+    QTest::addRow("inside") << false << 250.0 << 300.0;
+    QTest::addRow("inside swapped") << true << 250.0 << 300.0;
+    QTest::addRow("on edge") << false << 104.0 << 80.0;
+    QTest::addRow("outside") << false << 50.0 << 1000.0;
+}
+
+void WindowQuadArrayTest::testSplit()
+{
+    QFETCH(bool, swapped);
+    QFETCH(double, x);
+    QFETCH(double, y);
+
+    const WindowQuadList quads = makeWindow(QRectF(100, 50, 640, 480), swapped);
+    const WindowQuadArray array(quads);
+    compareQuads(array.splitAtX(x).toList(), quads.splitAtX(x));
+    compareQuads(array.splitAtY(y).toList(), quads.splitAtY(y));
+    compareQuads(array.splitAtX(x).splitAtY(y).toList(), quads.splitAtX(x).splitAtY(y));
+}
+
+void WindowQuadArrayTest::testTranslateAndScale()
+{
+    WindowQuadList quads = makeWindow(QRectF(100, 50, 640, 480)).makeRegularGrid(5, 5);
+    WindowQuadArray array(quads);
+    array.translate(-100, -50);
+    array.scale(0.5, 2);
+
+    for (WindowQuad &quad : quads) {
+        for (int j = 0; j < 4; ++j) {
+            quad[j].move((quad[j].x() - 100) * 0.5, (quad[j].y() - 50) * 2);
+        }
+    }
+    compareQuads(array.toList(), quads);
+}
+
+void WindowQuadArrayTest::testMakeInterleavedArrays_data()
+{
+    QTest::addColumn<uint>("type");
+    QTest::addColumn<int>("verticesPerQuad");
+    QTest::addColumn<int>("offset");
+
+    QTest::addRow("quads") << uint(GL_QUADS) << 4 << 0;
+    QTest::addRow("quads unaligned") << uint(GL_QUADS) << 4 << 1;
+    QTest::addRow("triangles") << uint(GL_TRIANGLES) << 6 << 0;
+    QTest::addRow("triangles unaligned") << uint(GL_TRIANGLES) << 6 << 1;
+}
+
+void WindowQuadArrayTest::testMakeInterleavedArrays()
+{
+    QFETCH(uint, type);
+    QFETCH(int, verticesPerQuad);
+    QFETCH(int, offset);
+
+    WindowQuadList quads = makeWindow(QRectF(100, 50, 640, 480)).makeRegularGrid(4, 3);
+    quads[3][1].move(600, 70);
+
+    QMatrix4x4 textureMatrix;
+    textureMatrix.scale(2, -1);
+    textureMatrix.translate(0.5, -1);
+
+    // GLVertex2D is four floats, an offset of one float makes the buffer unaligned.
+    const int count = quads.count() * verticesPerQuad;
+    std::unique_ptr<float[]> actualBuffer(new float[4 * (count + 1)]);
+    std::unique_ptr<float[]> expectedBuffer(new float[4 * (count + 1)]);
+    GLVertex2D *actual = reinterpret_cast<GLVertex2D *>(actualBuffer.get() + offset);
+    GLVertex2D *expected = reinterpret_cast<GLVertex2D *>(expectedBuffer.get() + offset);
+
+    WindowQuadArray(quads).makeInterleavedArrays(type, actual, textureMatrix);
+    quads.makeInterleavedArrays(type, expected, textureMatrix);
+
+    for (int i = 0; i < count; ++i) {
+        QCOMPARE(actual[i].position, expected[i].position);
+        QVERIFY(fuzzyCompare(actual[i].texcoord.x(), expected[i].texcoord.x()));
+        QVERIFY(fuzzyCompare(actual[i].texcoord.y(), expected[i].texcoord.y()));
+    }
+}
+
+void WindowQuadArrayTest::benchmarkMakeRegularGrid_data()
+{
+    QTest::addColumn<bool>("array");
+
+    QTest::addRow("WindowQuadList") << false;
+    QTest::addRow("WindowQuadArray") << true;
+}
+
+void WindowQuadArrayTest::benchmarkMakeRegularGrid()
+{
+    // This benchmark measures how fast a maximized window on a 4K screen is subdivided, as
+    // e.g. the magic lamp effect does every frame.
+    QFETCH(bool, array);
+    const WindowQuadList quads = makeWindow(QRectF(0, 0, 3840, 2160));
+
+    if (array) {
+        const WindowQuadArray quadArray(quads);
+        QBENCHMARK {
+            const WindowQuadArray grid = quadArray.makeRegularGrid(100, 100);
+            Q_UNUSED(grid)
+        }
+    } else {
+        QBENCHMARK {
+            const WindowQuadList grid = quads.makeRegularGrid(100, 100);
+            Q_UNUSED(grid)
+        }
+    }
+}
+
+void WindowQuadArrayTest::benchmarkMakeGrid_data()
+{
+    benchmarkMakeRegularGrid_data();
+}
+
+void WindowQuadArrayTest::benchmarkMakeGrid()
+{
+    QFETCH(bool, array);
+    const WindowQuadList quads = makeWindow(QRectF(0, 0, 3840, 2160));
+
+    if (array) {
+        const WindowQuadArray quadArray(quads);
+        QBENCHMARK {
+            const WindowQuadArray grid = quadArray.makeGrid(40);
+            Q_UNUSED(grid)
+        }
+    } else {
+        QBENCHMARK {
+            const WindowQuadList grid = quads.makeGrid(40);
+            Q_UNUSED(grid)
+        }
+    }
+}
+
+void WindowQuadArrayTest::benchmarkTranslate_data()
+{
+    benchmarkMakeRegularGrid_data();
+}
+
+void WindowQuadArrayTest::benchmarkTranslate()
+{
+    QFETCH(bool, array);
+    WindowQuadList quads = makeWindow(QRectF(0, 0, 3840, 2160)).makeRegularGrid(100, 100);
+
+    if (array) {
+        WindowQuadArray quadArray(quads);
+        QBENCHMARK {
+            quadArray.translate(0.5, -0.5);
+            quadArray.scale(1.001, 0.999);
+        }
+    } else {
+        QBENCHMARK {
+            for (WindowQuad &quad : quads) {
+                for (int j = 0; j < 4; ++j) {
+                    quad[j].move((quad[j].x() + 0.5) * 1.001, (quad[j].y() - 0.5) * 0.999);
+                }
+            }
+        }
+    }
+}
+
+void WindowQuadArrayTest::benchmarkMakeInterleavedArrays_data()
+{
+    benchmarkMakeRegularGrid_data();
+}
+
+void WindowQuadArrayTest::benchmarkMakeInterleavedArrays()
+{
+    QFETCH(bool, array);
+    const WindowQuadList quads = makeWindow(QRectF(0, 0, 3840, 2160)).makeRegularGrid(100, 100);
+    const WindowQuadArray quadArray(quads);
+    QVector<GLVertex2D> vertices(quads.count() * 6);
+    const QMatrix4x4 textureMatrix;
+
+    if (array) {
+        QBENCHMARK {
+            quadArray.makeInterleavedArrays(GL_TRIANGLES, vertices.data(), textureMatrix);
+        }
+    } else {
+        QBENCHMARK {
+            quads.makeInterleavedArrays(GL_TRIANGLES, vertices.data(), textureMatrix);
+        }
+    }
+}
+
+QTEST_MAIN(WindowQuadArrayTest)
+
+#include "windowquadarraytest.moc"
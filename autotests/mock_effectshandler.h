@@ -288,6 +288,22 @@ public:
         Q_UNUSED(screenId)
         return nullptr;
     }
+    void setEffectWindowScoped(KWin::Effect *effect, bool scoped) override {
+        Q_UNUSED(effect)
+        Q_UNUSED(scoped)
+    }
+    bool isEffectWindowScoped(const KWin::Effect *effect) const override {
+        Q_UNUSED(effect)
+        return false;
+    }
+    void addAffectedWindow(KWin::Effect *effect, KWin::EffectWindow *w) override {
+        Q_UNUSED(effect)
+        Q_UNUSED(w)
+    }
+    void removeAffectedWindow(KWin::Effect *effect, KWin::EffectWindow *w) override {
+        Q_UNUSED(effect)
+        Q_UNUSED(w)
+    }
 
 private:
     bool m_animationsSuported = true;
@@ -0,0 +1,82 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <QTest>
+
+#include "damagejournal.h"
+
+using namespace KWin;
+
+class DamageJournalTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testAccumulate_data();
+    void testAccumulate();
+    void testCapacity();
+    void testClear();
+};
+
+static const QRegion s_fallback(0, 0, 1920, 1080);
+
+void DamageJournalTest::testAccumulate_data()
+{
+    QTest::addColumn<int>("bufferAge");
+    QTest::addColumn<QRegion>("expected");
+
+    QTest::addRow("undefined contents") << 0 << s_fallback;
+    QTest::addRow("previous frame") << 1 << QRegion();
+    QTest::addRow("double buffering") << 2 << QRegion(20, 0, 10, 10);
+    QTest::addRow("triple buffering") << 3 << (QRegion(20, 0, 10, 10) | QRegion(10, 0, 10, 10));
+    QTest::addRow("all frames") << 4 << QRegion(0, 0, 30, 10);
+    QTest::addRow("too old") << 5 << s_fallback;
+}
+
+void DamageJournalTest::testAccumulate()
+{
+    QFETCH(int, bufferAge);
+    QFETCH(QRegion, expected);
+
+    DamageJournal journal;
+    journal.add(QRegion(0, 0, 10, 10));
+    journal.add(QRegion(10, 0, 10, 10));
+    journal.add(QRegion(20, 0, 10, 10));
+
+    QCOMPARE(journal.accumulate(bufferAge, s_fallback), expected);
+}
+
+void DamageJournalTest::testCapacity()
+{
+    DamageJournal journal;
+    journal.setCapacity(2);
+    QCOMPARE(journal.capacity(), 2);
+
+    journal.add(QRegion(0, 0, 10, 10));
+    journal.add(QRegion(10, 0, 10, 10));
+    journal.add(QRegion(20, 0, 10, 10));
+
+    // The damage of the first frame has been dropped.
+    QCOMPARE(journal.accumulate(3, s_fallback), QRegion(10, 0, 20, 10));
+    QCOMPARE(journal.accumulate(4, s_fallback), s_fallback);
+}
+
+void DamageJournalTest::testClear()
+{
+    DamageJournal journal;
+    journal.add(QRegion(0, 0, 10, 10));
+    QCOMPARE(journal.accumulate(2, s_fallback), QRegion(0, 0, 10, 10));
+
+    journal.clear();
+    QCOMPARE(journal.accumulate(1, s_fallback), QRegion());
+    QCOMPARE(journal.accumulate(2, s_fallback), s_fallback);
+}
+
+QTEST_GUILESS_MAIN(DamageJournalTest)
+#include "test_damagejournal.moc"
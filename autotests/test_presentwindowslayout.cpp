@@ -0,0 +1,149 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "effects/presentwindows/presentwindowslayout.h"
+
+#include <QTest>
+
+using namespace KWin;
+
+static const QRect s_area(0, 0, 1920, 1080);
+
+// Windows of various sizes spread over the screen, as they are after smart placement ran out
+// of space. The same count always gives the same windows.
+static QVector<QRect> makeGeometries(int count)
+{
+    quint32 seed = 1;
+    auto random = [&seed](int max) {
+        seed = seed * 1103515245 + 12345;
+        return int((seed >> 16) % max);
+    };
+    QVector<QRect> geometries;
+    for (int i = 0; i < count; ++i) {
+        geometries << QRect(random(1400), random(700), 200 + random(500), 150 + random(400));
+    }
+    return geometries;
+}
+
+class PresentWindowsLayoutTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void testNatural_data();
+    void testNatural();
+    void testClosest();
+    void testKompose();
+    void benchmarkLayout_data();
+    void benchmarkLayout();
+};
+
+void PresentWindowsLayoutTest::testNatural_data()
+{
+    QTest::addColumn<int>("windowCount");
+    QTest::addColumn<bool>("fillGaps");
+
+    QTest::addRow("1 window") << 1 << true;
+    QTest::addRow("10 windows") << 10 << true;
+    QTest::addRow("10 windows, no gap filling") << 10 << false;
+    QTest::addRow("50 windows") << 50 << true;
+    QTest::addRow("160 windows") << 160 << true;
+}
+
+void PresentWindowsLayoutTest::testNatural()
+{
+    // This test verifies that the natural layout gives the same result every time, keeps
+    // the windows inside the area and doesn't let them overlap.
+    QFETCH(int, windowCount);
+    QFETCH(bool, fillGaps);
+
+    PresentWindowsLayout layout(makeGeometries(windowCount), s_area);
+    layout.setFillGaps(fillGaps);
+    const QVector<QRect> targets = layout.natural();
+    QCOMPARE(targets.count(), windowCount);
+    QCOMPARE(layout.natural(), targets);
+
+    for (int i = 0; i < targets.count(); ++i) {
+        QVERIFY(!targets[i].isEmpty());
+        QVERIFY(s_area.contains(targets[i]));
+        for (int j = i + 1; j < targets.count(); ++j) {
+            QVERIFY2(!targets[i].intersects(targets[j]), qPrintable(QStringLiteral("%1 and %2").arg(i).arg(j)));
+        }
+    }
+}
+
+void PresentWindowsLayoutTest::testClosest()
+{
+    // This test verifies that every window gets a slot of its own in the regular grid.
+    const QVector<QRect> geometries = makeGeometries(10);
+    int columns = 0;
+    int rows = 0;
+    const QVector<QRect> targets = PresentWindowsLayout(geometries, s_area).closest(&columns, &rows);
+    QCOMPARE(columns, 4);
+    QCOMPARE(rows, 3);
+    QCOMPARE(targets.count(), geometries.count());
+
+    const int slotWidth = s_area.width() / columns;
+    const int slotHeight = s_area.height() / rows;
+    QVector<int> usedSlots;
+    for (const QRect &target : targets) {
+        QVERIFY(!target.isEmpty());
+        const int slot = target.center().y() / slotHeight * columns + target.center().x() / slotWidth;
+        QVERIFY(!usedSlots.contains(slot));
+        usedSlots << slot;
+    }
+}
+
+void PresentWindowsLayoutTest::testKompose()
+{
+    // This test verifies that the flexible grid fills its rows from left to right.
+    const QVector<QRect> targets = PresentWindowsLayout(makeGeometries(10), s_area).kompose();
+    QCOMPARE(targets.count(), 10);
+    // 1920x1080 gives 4 columns and 3 rows
+    for (int i = 0; i < targets.count(); ++i) {
+        QVERIFY(!targets[i].isEmpty());
+        if (i % 4 != 0) {
+            QVERIFY(targets[i].left() > targets[i - 1].left());
+        }
+    }
+}
+
+void PresentWindowsLayoutTest::benchmarkLayout_data()
+{
+    QTest::addColumn<QString>("mode");
+    QTest::addColumn<int>("windowCount");
+
+    for (const QString &mode : {QStringLiteral("natural"), QStringLiteral("closest"), QStringLiteral("kompose")}) {
+        for (int windowCount : {10, 40, 80, 160}) {
+            QTest::addRow("%s, %d windows", qPrintable(mode), windowCount) << mode << windowCount;
+        }
+    }
+}
+
+void PresentWindowsLayoutTest::benchmarkLayout()
+{
+    // This benchmark measures laying out many windows in the modes of the present windows effect.
+    QFETCH(QString, mode);
+    QFETCH(int, windowCount);
+
+    const PresentWindowsLayout layout(makeGeometries(windowCount), s_area);
+    QVector<QRect> targets;
+    QBENCHMARK {
+        if (mode == QLatin1String("natural")) {
+            targets = layout.natural();
+        } else if (mode == QLatin1String("closest")) {
+            targets = layout.closest();
+        } else {
+            targets = layout.kompose();
+        }
+    }
+    QCOMPARE(targets.count(), windowCount);
+}
+
+QTEST_MAIN(PresentWindowsLayoutTest)
+#include "test_presentwindowslayout.moc"
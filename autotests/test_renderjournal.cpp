@@ -0,0 +1,139 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <QTest>
+
+#include "renderjournal.h"
+
+using namespace KWin;
+
+class RenderJournalTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testEmpty();
+    void testPercentiles();
+    void testRecentWindow();
+    void testRingBufferWraps();
+    void testExponentialAverage();
+    void testGpuRenderTime();
+    void testSpikyTrace();
+};
+
+void RenderJournalTest::testEmpty()
+{
+    RenderJournal journal;
+    QCOMPARE(journal.minimum(), std::chrono::nanoseconds::zero());
+    QCOMPARE(journal.maximum(), std::chrono::nanoseconds::zero());
+    QCOMPARE(journal.average(), std::chrono::nanoseconds::zero());
+    QCOMPARE(journal.percentile(0.99), std::chrono::nanoseconds::zero());
+    QCOMPARE(journal.exponentialAverage(), std::chrono::nanoseconds::zero());
+}
+
+void RenderJournalTest::testPercentiles()
+{
+    // Replay the render times from 1 to 100 milliseconds in a scrambled order.
+    RenderJournal journal;
+    for (int i = 0; i < 100; ++i) {
+        journal.add(std::chrono::milliseconds((i * 37) % 100 + 1));
+    }
+
+    QCOMPARE(journal.percentile(0), std::chrono::milliseconds(1));
+    QCOMPARE(journal.percentile(0.5), std::chrono::milliseconds(50));
+    QCOMPARE(journal.percentile(0.9), std::chrono::milliseconds(90));
+    QCOMPARE(journal.percentile(0.99), std::chrono::milliseconds(99));
+    QCOMPARE(journal.percentile(1), std::chrono::milliseconds(100));
+}
+
+void RenderJournalTest::testRecentWindow()
+{
+    // The minimum, the maximum, and the average only consider the 15 most recent frames.
+    RenderJournal journal;
+    journal.add(std::chrono::milliseconds(100));
+    for (int i = 0; i < 15; ++i) {
+        journal.add(std::chrono::milliseconds(i + 1));
+    }
+
+    QCOMPARE(journal.minimum(), std::chrono::milliseconds(1));
+    QCOMPARE(journal.maximum(), std::chrono::milliseconds(15));
+    QCOMPARE(journal.average(), std::chrono::milliseconds(8));
+    QCOMPARE(journal.percentile(1), std::chrono::milliseconds(100));
+}
+
+void RenderJournalTest::testRingBufferWraps()
+{
+    RenderJournal journal;
+    for (int i = 0; i < 1000; ++i) {
+        journal.add(std::chrono::milliseconds(10));
+    }
+    QCOMPARE(journal.percentile(0.99), std::chrono::milliseconds(10));
+
+    // Once the journal is full, the oldest samples are overwritten.
+    for (int i = 0; i < 128; ++i) {
+        journal.add(std::chrono::milliseconds(1));
+    }
+    QCOMPARE(journal.percentile(0.99), std::chrono::milliseconds(1));
+    QCOMPARE(journal.maximum(), std::chrono::milliseconds(1));
+}
+
+void RenderJournalTest::testExponentialAverage()
+{
+    RenderJournal journal;
+    for (int i = 0; i < 50; ++i) {
+        journal.add(std::chrono::milliseconds(5));
+    }
+    QCOMPARE(journal.exponentialAverage(), std::chrono::milliseconds(5));
+
+    // The estimate must follow a step in the render time gradually.
+    std::chrono::nanoseconds previous = journal.exponentialAverage();
+    for (int i = 0; i < 50; ++i) {
+        journal.add(std::chrono::milliseconds(10));
+        QVERIFY(journal.exponentialAverage() > previous);
+        QVERIFY(journal.exponentialAverage() <= std::chrono::milliseconds(10));
+        previous = journal.exponentialAverage();
+    }
+    QVERIFY(std::chrono::milliseconds(10) - journal.exponentialAverage() < std::chrono::microseconds(10));
+}
+
+void RenderJournalTest::testGpuRenderTime()
+{
+    RenderJournal journal;
+    for (int i = 0; i < 20; ++i) {
+        journal.add(std::chrono::milliseconds(2));
+    }
+    QCOMPARE(journal.maximum(), std::chrono::milliseconds(2));
+
+    // If the GPU is the bottleneck, its timings must be used for the estimates.
+    for (int i = 0; i < 20; ++i) {
+        journal.addGpuRenderTime(std::chrono::milliseconds(5));
+    }
+    QCOMPARE(journal.minimum(), std::chrono::milliseconds(5));
+    QCOMPARE(journal.maximum(), std::chrono::milliseconds(5));
+    QCOMPARE(journal.average(), std::chrono::milliseconds(5));
+    QCOMPARE(journal.percentile(0.5), std::chrono::milliseconds(5));
+    QCOMPARE(journal.exponentialAverage(), std::chrono::milliseconds(5));
+}
+
+void RenderJournalTest::testSpikyTrace()
+{
+    // Every 20th frame takes considerably longer to render, e.g. due to a shader compilation.
+    RenderJournal journal;
+    for (int i = 0; i < 120; ++i) {
+        journal.add(i % 20 == 19 ? std::chrono::milliseconds(8) : std::chrono::milliseconds(2));
+    }
+
+    QCOMPARE(journal.percentile(0.5), std::chrono::milliseconds(2));
+    QCOMPARE(journal.percentile(0.9), std::chrono::milliseconds(2));
+    QCOMPARE(journal.percentile(0.99), std::chrono::milliseconds(8));
+    QVERIFY(journal.exponentialAverage() < std::chrono::milliseconds(8));
+}
+
+QTEST_GUILESS_MAIN(RenderJournalTest)
+#include "test_renderjournal.moc"
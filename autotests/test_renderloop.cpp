@@ -0,0 +1,148 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <QSignalSpy>
+#include <QTest>
+
+#include "renderloop.h"
+#include "renderloop_p.h"
+
+#include <random>
+
+using namespace KWin;
+
+struct SchedulerStatistics
+{
+    qreal missedFrameRate = 0;
+    std::chrono::nanoseconds inputLatency = std::chrono::nanoseconds::zero();
+};
+
+/**
+ * Drives the scheduler of a render loop with a fake monotonic clock. The vblanks occur
+ * at a constant interval, just like the ones produced by the SoftwareVsyncMonitor, and
+ * every frame is presented at the first vblank after it has been rendered.
+ */
+static SchedulerStatistics simulate(int refreshRate, LatencyPolicy latencyPolicy)
+{
+    RenderLoop renderLoop;
+    renderLoop.setRefreshRate(refreshRate);
+
+    RenderLoopPrivate *renderLoopPrivate = RenderLoopPrivate::get(&renderLoop);
+    const std::chrono::nanoseconds vblankInterval = renderLoopPrivate->vblankInterval();
+
+    // Use a fixed seed so the synthetic render time trace is the same for every policy.
+    std::mt19937 generator(42);
+
+    const int frameCount = 1000;
+    int missedFrameCount = 0;
+    std::chrono::nanoseconds totalInputLatency = std::chrono::nanoseconds::zero();
+
+    std::chrono::nanoseconds currentTime = vblankInterval;
+    std::chrono::nanoseconds previousRenderTimestamp = std::chrono::nanoseconds::zero();
+
+    for (int i = 0; i < frameCount; ++i) {
+        const std::chrono::nanoseconds renderTimestamp =
+            renderLoopPrivate->computeNextRenderTimestamp(currentTime, latencyPolicy, RenderTimeEstimatorMaximum);
+        const std::chrono::nanoseconds expectedPresentationTimestamp =
+            renderLoopPrivate->nextPresentationTimestamp;
+
+        // Most frames take between 1 and 2 milliseconds, with an occasional spike.
+        std::chrono::nanoseconds renderTime = std::chrono::microseconds(1000 + generator() % 1000);
+        if (generator() % 100 == 0) {
+            renderTime += std::chrono::microseconds(generator() % 3000);
+        }
+
+        const std::chrono::nanoseconds renderEndTimestamp = renderTimestamp + renderTime;
+        const std::chrono::nanoseconds presentationTimestamp = renderEndTimestamp
+                + (vblankInterval - renderEndTimestamp % vblankInterval) % vblankInterval;
+        if (presentationTimestamp > expectedPresentationTimestamp) {
+            missedFrameCount++;
+        }
+
+        // The input event that is handled by this frame arrived sometime after the
+        // previous compositing cycle had started.
+        const std::chrono::nanoseconds inputTimestamp = previousRenderTimestamp
+                + std::chrono::nanoseconds(generator() % (renderTimestamp - previousRenderTimestamp).count());
+        totalInputLatency += presentationTimestamp - inputTimestamp;
+
+        renderLoopPrivate->renderJournal.add(renderTime);
+        renderLoopPrivate->pendingFrameCount++;
+        renderLoopPrivate->notifyFrameCompleted(presentationTimestamp);
+
+        previousRenderTimestamp = renderTimestamp;
+        currentTime = presentationTimestamp + std::chrono::microseconds(50);
+    }
+
+    SchedulerStatistics statistics;
+    statistics.missedFrameRate = qreal(missedFrameCount) / frameCount;
+    statistics.inputLatency = totalInputLatency / frameCount;
+    return statistics;
+}
+
+class RenderLoopTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testAdaptiveScheduler_data();
+    void testAdaptiveScheduler();
+    void testTimerPrecision();
+};
+
+void RenderLoopTest::testAdaptiveScheduler_data()
+{
+    QTest::addColumn<int>("refreshRate");
+
+    QTest::addRow("60Hz") << 60000;
+    QTest::addRow("144Hz") << 144000;
+    QTest::addRow("165Hz") << 165000;
+    QTest::addRow("240Hz") << 240000;
+}
+
+void RenderLoopTest::testAdaptiveScheduler()
+{
+    QFETCH(int, refreshRate);
+
+    const SchedulerStatistics fixed = simulate(refreshRate, LatencyMedium);
+    const SchedulerStatistics adaptive = simulate(refreshRate, LatencyAdaptive);
+
+    // The adaptive scheduler must keep up with the render time spikes...
+    QVERIFY(adaptive.missedFrameRate <= 0.02);
+    // ...while showing the result of user input sooner than the fixed policy.
+    QVERIFY(adaptive.inputLatency < fixed.inputLatency);
+}
+
+void RenderLoopTest::testTimerPrecision()
+{
+    RenderLoopTimer timer;
+    QSignalSpy timeoutSpy(&timer, &RenderLoopTimer::timeout);
+    QVERIFY(timeoutSpy.isValid());
+
+    const std::chrono::nanoseconds deadline =
+        std::chrono::steady_clock::now().time_since_epoch() + std::chrono::microseconds(2500);
+    timer.start(deadline);
+    QVERIFY(timer.isActive());
+    QVERIFY(timeoutSpy.wait());
+    QVERIFY(!timer.isActive());
+
+    // The timer must never fire before the deadline.
+    QVERIFY(std::chrono::steady_clock::now().time_since_epoch() >= deadline);
+
+    // An expired deadline fires as soon as possible.
+    timer.start(std::chrono::nanoseconds::zero());
+    QVERIFY(timeoutSpy.wait());
+    QCOMPARE(timeoutSpy.count(), 2);
+
+    timer.start(deadline + std::chrono::seconds(10));
+    timer.stop();
+    QVERIFY(!timer.isActive());
+}
+
+QTEST_GUILESS_MAIN(RenderLoopTest)
+#include "test_renderloop.moc"
@@ -0,0 +1,229 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <QPainter>
+#include <QTest>
+
+#include "plugins/scenes/qpainter/scratchbufferpool.h"
+
+#include <cstdlib>
+#include <new>
+
+using namespace KWin;
+
+// Counts the heap allocations made with operator new, QImage and QPainter allocate their
+// private data that way.
+static int s_allocationCount = 0;
+
+void *operator new(std::size_t size)
+{
+    ++s_allocationCount;
+    if (void *pointer = std::malloc(size)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+enum class OpacityMode {
+    TemporaryImage,
+    PainterOpacity,
+    ScratchBuffer,
+};
+
+Q_DECLARE_METATYPE(OpacityMode)
+
+struct TestWindow
+{
+    QRect frameGeometry;
+    QRect visibleGeometry;
+    QImage shadow;
+    QImage decoration;
+    QImage contents;
+};
+
+static void renderWindow(QPainter *painter, const TestWindow &window)
+{
+    const QPoint shadowOffset = window.visibleGeometry.topLeft() - window.frameGeometry.topLeft();
+    painter->drawImage(shadowOffset, window.shadow);
+    painter->drawImage(QPoint(0, 0), window.decoration);
+    painter->drawImage(QPoint(0, window.decoration.height()), window.contents);
+}
+
+class ScratchBufferPoolTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testReuse();
+    void testGrow();
+    void testInUse();
+    void testEndFrame();
+    void benchmarkTranslucentWindows_data();
+    void benchmarkTranslucentWindows();
+};
+
+void ScratchBufferPoolTest::testReuse()
+{
+    ScratchBufferPool pool;
+    QImage first = pool.acquire(QSize(100, 50));
+    QCOMPARE(first.size(), QSize(100, 50));
+    QCOMPARE(first.format(), QImage::Format_ARGB32_Premultiplied);
+    QCOMPARE(first.pixel(99, 49), qRgba(0, 0, 0, 0));
+    const uchar *bits = first.constBits();
+    first.fill(Qt::red);
+    pool.release(first);
+
+    // A smaller buffer fits into the released one, and it's cleared again.
+    const QImage second = pool.acquire(QSize(90, 40));
+    QCOMPARE(second.size(), QSize(90, 40));
+    QCOMPARE(second.constBits(), bits);
+    QCOMPARE(second.pixel(0, 0), qRgba(0, 0, 0, 0));
+    QCOMPARE(pool.bufferCount(), 1);
+}
+
+void ScratchBufferPoolTest::testGrow()
+{
+    ScratchBufferPool pool;
+    pool.release(pool.acquire(QSize(100, 50)));
+
+    // A buffer that is too small is replaced rather than kept around.
+    const QImage image = pool.acquire(QSize(300, 200));
+    QCOMPARE(image.size(), QSize(300, 200));
+    QCOMPARE(pool.bufferCount(), 1);
+
+    QVERIFY(pool.acquire(QSize()).isNull());
+}
+
+void ScratchBufferPoolTest::testInUse()
+{
+    ScratchBufferPool pool;
+    const QImage first = pool.acquire(QSize(100, 50));
+    const QImage second = pool.acquire(QSize(100, 50));
+    QVERIFY(first.constBits() != second.constBits());
+    QCOMPARE(pool.bufferCount(), 2);
+
+    // Buffers that are in use are handed out again once the frame ends.
+    pool.endFrame();
+    const QImage third = pool.acquire(QSize(100, 50));
+    QVERIFY(third.constBits() == first.constBits() || third.constBits() == second.constBits());
+    QCOMPARE(pool.bufferCount(), 2);
+}
+
+void ScratchBufferPoolTest::testEndFrame()
+{
+    ScratchBufferPool pool;
+    pool.acquire(QSize(100, 50));
+    pool.acquire(QSize(100, 50));
+    pool.endFrame();
+    QCOMPARE(pool.bufferCount(), 2);
+
+    pool.acquire(QSize(100, 50));
+    pool.endFrame();
+    QCOMPARE(pool.bufferCount(), 1);
+
+    pool.endFrame();
+    QCOMPARE(pool.bufferCount(), 0);
+}
+
+void ScratchBufferPoolTest::benchmarkTranslucentWindows_data()
+{
+    QTest::addColumn<OpacityMode>("mode");
+
+    QTest::addRow("temporary image") << OpacityMode::TemporaryImage;
+    QTest::addRow("painter opacity") << OpacityMode::PainterOpacity;
+    QTest::addRow("scratch buffer") << OpacityMode::ScratchBuffer;
+}
+
+void ScratchBufferPoolTest::benchmarkTranslucentWindows()
+{
+    // This benchmark paints 20 translucent windows the way the QPainter scene does, with a
+    // temporary image per window as before, with the painter opacity, and with the offscreen
+    // pass that is still used for windows with subsurfaces.
+    QFETCH(OpacityMode, mode);
+
+    QVector<TestWindow> windows;
+    for (int i = 0; i < 20; ++i) {
+        TestWindow window;
+        window.frameGeometry = QRect(i * 40, i * 30, 800, 600);
+        window.visibleGeometry = window.frameGeometry.adjusted(-20, -20, 20, 20);
+        window.shadow = QImage(window.visibleGeometry.size(), QImage::Format_ARGB32_Premultiplied);
+        window.shadow.fill(QColor(0, 0, 0, 64));
+        window.decoration = QImage(800, 30, QImage::Format_ARGB32_Premultiplied);
+        window.decoration.fill(QColor(40, 40, 90));
+        window.contents = QImage(800, 570, QImage::Format_ARGB32_Premultiplied);
+        window.contents.fill(QColor::fromHsv(i * 18, 200, 220));
+        windows << window;
+    }
+
+    QImage buffer(1920, 1080, QImage::Format_RGB32);
+    buffer.fill(Qt::black);
+    QPainter painter(&buffer);
+    ScratchBufferPool pool;
+
+    qint64 frameCount = 0;
+    s_allocationCount = 0;
+
+    QBENCHMARK {
+        for (const TestWindow &window : windows) {
+            painter.save();
+            painter.setClipRect(window.visibleGeometry);
+            painter.translate(window.frameGeometry.topLeft());
+
+            switch (mode) {
+            case OpacityMode::TemporaryImage: {
+                QImage tempImage(window.visibleGeometry.size(), QImage::Format_ARGB32_Premultiplied);
+                tempImage.fill(Qt::transparent);
+                QPainter tempPainter(&tempImage);
+                tempPainter.translate(window.frameGeometry.topLeft() - window.visibleGeometry.topLeft());
+                renderWindow(&tempPainter, window);
+                tempPainter.resetTransform();
+                tempPainter.setCompositionMode(QPainter::CompositionMode_DestinationIn);
+                tempPainter.fillRect(tempImage.rect(), QColor(0, 0, 0, 191));
+                tempPainter.end();
+                painter.drawImage(window.visibleGeometry.topLeft() - window.frameGeometry.topLeft(), tempImage);
+                break;
+            }
+            case OpacityMode::PainterOpacity:
+                painter.setOpacity(0.75);
+                renderWindow(&painter, window);
+                break;
+            case OpacityMode::ScratchBuffer: {
+                QImage scratch = pool.acquire(window.visibleGeometry.size());
+                QPainter scratchPainter(&scratch);
+                scratchPainter.translate(window.frameGeometry.topLeft() - window.visibleGeometry.topLeft());
+                renderWindow(&scratchPainter, window);
+                scratchPainter.end();
+                painter.setOpacity(0.75);
+                painter.drawImage(window.visibleGeometry.topLeft() - window.frameGeometry.topLeft(), scratch);
+                pool.release(scratch);
+                break;
+            }
+            }
+
+            painter.restore();
+        }
+        pool.endFrame();
+        frameCount++;
+    }
+
+    qInfo("%.1f allocations per frame", qreal(s_allocationCount) / frameCount);
+}
+
+QTEST_GUILESS_MAIN(ScratchBufferPoolTest)
+#include "test_scratchbufferpool.moc"
@@ -0,0 +1,246 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "plugins/scenes/opengl/shelfallocator.h"
+#include "tiledrasterizer.h"
+
+#include <QLinearGradient>
+#include <QPainter>
+#include <QTest>
+
+using namespace KWin;
+
+static int align(int value, int align)
+{
+    return (value + align - 1) & ~(align - 1);
+}
+
+// Paints something that looks like the title bar of a decoration.
+static void paintTitleBar(QPainter *painter, const QSize &size)
+{
+    painter->setRenderHint(QPainter::Antialiasing);
+    QLinearGradient gradient(0, 0, 0, size.height());
+    gradient.setColorAt(0, QColor(70, 80, 90));
+    gradient.setColorAt(1, QColor(50, 55, 60));
+    painter->setPen(Qt::NoPen);
+    painter->setBrush(gradient);
+    painter->drawRoundedRect(QRect(QPoint(), size), 4, 4);
+    painter->setBrush(QColor(200, 60, 60));
+    for (int i = 0; i < 3; ++i) {
+        painter->drawEllipse(QRect(size.width() - 28 * (i + 1), 4, 20, 20));
+    }
+    painter->setPen(Qt::white);
+    painter->drawText(QRect(8, 0, size.width() - 100, size.height()), Qt::AlignVCenter, QStringLiteral("Konsole - ~/src/kwin"));
+}
+
+class ShelfAllocatorTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void testAllocate();
+    void testRelease();
+    void testResize();
+    void testGrow();
+    void testSizeToFitWideAfterFull();
+    void testResizeAllocations();
+    void benchmarkResize_data();
+    void benchmarkResize();
+};
+
+void ShelfAllocatorTest::testAllocate()
+{
+    // This test verifies that allocated rectangles stay inside the atlas and don't overlap.
+    ShelfAllocator allocator(QSize(1024, 1024));
+    QVector<QRect> rects;
+    for (int i = 0; i < 60; ++i) {
+        const QRect rect = allocator.allocate(QSize(100 + i * 5, 20 + i % 4 * 10));
+        QVERIFY(!rect.isNull());
+        QCOMPARE(rect.size(), QSize(100 + i * 5, 20 + i % 4 * 10));
+        QVERIFY(QRect(0, 0, 1024, 1024).contains(rect));
+        for (const QRect &other : qAsConst(rects)) {
+            QVERIFY(!rect.intersects(other));
+        }
+        rects << rect;
+    }
+    QCOMPARE(allocator.count(), 60);
+
+    QVERIFY(allocator.allocate(QSize(1025, 10)).isNull());
+    QVERIFY(allocator.allocate(QSize()).isNull());
+}
+
+void ShelfAllocatorTest::testRelease()
+{
+    // This test verifies that released space is given out again.
+    ShelfAllocator allocator(QSize(256, 64));
+    const QRect first = allocator.allocate(QSize(128, 32));
+    const QRect second = allocator.allocate(QSize(128, 32));
+    const QRect third = allocator.allocate(QSize(256, 32));
+    QVERIFY(!first.isNull());
+    QVERIFY(!second.isNull());
+    QVERIFY(!third.isNull());
+    QVERIFY(allocator.allocate(QSize(16, 16)).isNull());
+
+    allocator.release(first);
+    QCOMPARE(allocator.allocate(QSize(100, 30)), QRect(first.topLeft(), QSize(100, 30)));
+
+    // once a shelf is empty, it can take rectangles of another height
+    allocator.release(third);
+    QCOMPARE(allocator.count(), 2);
+    const QRect low = allocator.allocate(QSize(256, 16));
+    QCOMPARE(low.y(), third.y());
+    QVERIFY(!allocator.allocate(QSize(256, 16)).isNull());
+}
+
+void ShelfAllocatorTest::testResize()
+{
+    // This test verifies that a rectangle grows and shrinks without moving.
+    ShelfAllocator allocator(QSize(512, 64));
+    QRect rect = allocator.allocate(QSize(128, 30));
+    const QRect neighbour = allocator.allocate(QSize(128, 30));
+
+    QVERIFY(allocator.resize(&rect, QSize(64, 30)));
+    QCOMPARE(rect, QRect(0, 0, 64, 30));
+    // the neighbour is in the way
+    QVERIFY(!allocator.resize(&rect, QSize(130, 30)));
+    QCOMPARE(rect, QRect(0, 0, 64, 30));
+    // too tall for the shelf
+    QVERIFY(!allocator.resize(&rect, QSize(64, 60)));
+
+    QRect last = neighbour;
+    QVERIFY(allocator.resize(&last, QSize(384, 30)));
+    QCOMPARE(last, QRect(neighbour.topLeft(), QSize(384, 30)));
+    QVERIFY(allocator.allocate(QSize(64, 30)) == QRect(64, 0, 64, 30));
+}
+
+void ShelfAllocatorTest::testGrow()
+{
+    // This test verifies that a grown atlas keeps the rectangles and has room for more.
+    ShelfAllocator allocator(QSize(128, 32));
+    const QRect rect = allocator.allocate(QSize(100, 32));
+    QVERIFY(!rect.isNull());
+    QVERIFY(allocator.allocate(QSize(100, 32)).isNull());
+
+    allocator.grow(QSize(256, 64));
+    QCOMPARE(allocator.size(), QSize(256, 64));
+    QRect resized = rect;
+    QVERIFY(allocator.resize(&resized, QSize(200, 32)));
+    const QRect below = allocator.allocate(QSize(100, 32));
+    QCOMPARE(below.y(), 32);
+}
+
+void ShelfAllocatorTest::testSizeToFitWideAfterFull()
+{
+    // This test verifies that an atlas without vertical room also grows in height when it has
+    // to be widened for a rectangle, as the rectangle doesn't fit next to the existing ones.
+    ShelfAllocator allocator(QSize(1024, 1024));
+    for (int i = 0; i < 32; ++i) {
+        QVERIFY(!allocator.allocate(QSize(1024, 32)).isNull());
+    }
+    QVERIFY(allocator.allocate(QSize(16, 16)).isNull());
+
+    const QSize wide(2000, 32);
+    QVERIFY(!allocator.sizeToFit(wide, QSize(1024, 1024), 1024).isValid());
+    const QSize size = allocator.sizeToFit(wide, QSize(1024, 1024), 4096);
+    QCOMPARE(size, QSize(2048, 2048));
+
+    allocator.grow(size);
+    const QRect rect = allocator.allocate(wide);
+    QVERIFY(!rect.isNull());
+    QCOMPARE(rect.y(), 1024);
+    QCOMPARE(allocator.count(), 33);
+}
+
+void ShelfAllocatorTest::testResizeAllocations()
+{
+    // This test verifies that resizing windows step by step needs fewer allocations in the
+    // atlas than textures of their own, which are reallocated in steps of 128 pixels.
+    ShelfAllocator allocator(QSize(4096, 4096));
+    QVector<QRect> allocations;
+    QVector<int> textureWidths;
+    for (int i = 0; i < 100; ++i) {
+        const int width = 300 + i * 7;
+        allocations << allocator.allocate(QSize(align(width + width / 4, 128), 40));
+        textureWidths << align(width, 128);
+        QVERIFY(!allocations.last().isNull());
+    }
+
+    int textureAllocations = 0;
+    int atlasAllocations = 0;
+    for (int step = 1; step <= 60; ++step) {
+        for (int i = 0; i < allocations.count(); ++i) {
+            const int width = 300 + i * 7 + step * 8;
+            if (align(width, 128) != textureWidths[i]) {
+                textureWidths[i] = align(width, 128);
+                textureAllocations++;
+            }
+
+            QRect &allocation = allocations[i];
+            if (width <= allocation.width()) {
+                continue;
+            }
+            const QSize size(align(width + width / 4, 128), 40);
+            if (allocator.resize(&allocation, size)) {
+                continue;
+            }
+            allocator.release(allocation);
+            allocation = allocator.allocate(size);
+            QVERIFY(!allocation.isNull());
+            atlasAllocations++;
+        }
+    }
+
+    QCOMPARE(allocator.count(), 100);
+    QVERIFY2(atlasAllocations < textureAllocations,
+             qPrintable(QStringLiteral("%1 vs %2").arg(atlasAllocations).arg(textureAllocations)));
+}
+
+void ShelfAllocatorTest::benchmarkResize_data()
+{
+    QTest::addColumn<bool>("atlas");
+    QTest::addColumn<bool>("layoutChanged");
+
+    QTest::addRow("texture per window") << false << true;
+    QTest::addRow("atlas, resize step") << true << true;
+    QTest::addRow("atlas, in-place update") << true << false;
+}
+
+void ShelfAllocatorTest::benchmarkResize()
+{
+    // This benchmark measures the main thread's work for an update of a decoration. A texture
+    // per window rasterizes the title bar. The atlas does the same after a layout change, e.g.
+    // in a resize step, but only records in-place updates and leaves their rasterization to a
+    // worker thread.
+    QFETCH(bool, atlas);
+    QFETCH(bool, layoutChanged);
+
+    const QSize size(1200, 30);
+    QImage image(size, QImage::Format_ARGB32_Premultiplied);
+    ShelfAllocator allocator(QSize(4096, 4096));
+    QRect allocation = allocator.allocate(QSize(align(size.width() + size.width() / 4, 128), size.height()));
+
+    QBENCHMARK {
+        if (atlas && layoutChanged) {
+            allocator.resize(&allocation, QSize(align(size.width() + size.width() / 4, 128), size.height()));
+        }
+        if (atlas && !layoutChanged) {
+            PaintRecorder recorder(image);
+            QPainter painter(&recorder);
+            paintTitleBar(&painter, size);
+            painter.end();
+            QVERIFY(!recorder.paintList().commands.isEmpty());
+        } else {
+            image.fill(Qt::transparent);
+            QPainter painter(&image);
+            paintTitleBar(&painter, size);
+        }
+    }
+}
+
+QTEST_MAIN(ShelfAllocatorTest)
+#include "test_shelfallocator.moc"
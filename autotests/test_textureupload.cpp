@@ -0,0 +1,211 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <QElapsedTimer>
+#include <QTest>
+
+#include "platformsupport/scenes/opengl/textureupload.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+using namespace KWin;
+
+// Counts the heap allocations made with operator new, QImage allocates its private data that way.
+static int s_allocationCount = 0;
+
+void *operator new(std::size_t size)
+{
+    ++s_allocationCount;
+    if (void *pointer = std::malloc(size)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+static QRegion terminalTyping()
+{
+    // A glyph and the text cursor next to it.
+    return QRegion(QRect(243, 504, 9, 18)) | QRect(252, 504, 9, 18);
+}
+
+static QRegion terminalOutput()
+{
+    // The output of ls, three runs of text per line with gaps between them.
+    QRegion region;
+    for (int line = 0; line < 50; ++line) {
+        for (int column = 0; column < 3; ++column) {
+            region |= QRect(column * 30 * 9, line * 18, (8 + (line * 7 + column * 3) % 15) * 9, 18);
+        }
+    }
+    return region;
+}
+
+static QRegion browserScroll()
+{
+    // Everything but the toolbar.
+    return QRect(0, 80, 1920, 1000);
+}
+
+static QRegion browserAnimation()
+{
+    // A loading spinner, a video, a text caret and an animated banner.
+    return QRegion(QRect(16, 16, 32, 32)) | QRect(640, 200, 640, 360) | QRect(400, 700, 2, 20) | QRect(1200, 900, 728, 90);
+}
+
+class TextureUploadTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testCoalesce_data();
+    void testCoalesce();
+    void testNoCoalescing();
+    void testPackRects();
+    void benchmarkUpload_data();
+    void benchmarkUpload();
+};
+
+void TextureUploadTest::testCoalesce_data()
+{
+    QTest::addColumn<QRegion>("damage");
+    QTest::addColumn<int>("maximumRectCount");
+
+    QTest::addRow("terminal typing") << terminalTyping() << 1;
+    QTest::addRow("terminal output") << terminalOutput() << 50;
+    QTest::addRow("browser scroll") << browserScroll() << 1;
+    QTest::addRow("browser animation") << browserAnimation() << 4;
+}
+
+void TextureUploadTest::testCoalesce()
+{
+    QFETCH(QRegion, damage);
+    QFETCH(int, maximumRectCount);
+
+    const QVector<QRect> rects = coalesceUploadRects(damage, 4096);
+    QVERIFY(rects.count() <= maximumRectCount);
+    QVERIFY(rects.count() <= damage.rectCount());
+
+    // Every damaged pixel must be uploaded.
+    QRegion uploaded;
+    for (const QRect &rect : rects) {
+        uploaded |= rect;
+    }
+    QCOMPARE(damage - uploaded, QRegion());
+}
+
+void TextureUploadTest::testNoCoalescing()
+{
+    const QRegion damage = terminalOutput();
+    const QVector<QRect> rects = coalesceUploadRects(damage, -1);
+    QCOMPARE(rects.count(), damage.rectCount());
+
+    QRegion uploaded;
+    uploaded.setRects(rects.constData(), rects.count());
+    QCOMPARE(uploaded, damage);
+}
+
+void TextureUploadTest::testPackRects()
+{
+    const QSize size(64, 32);
+    QVector<uchar> storage(72 * 4 * size.height());
+    for (int i = 0; i < storage.count(); ++i) {
+        storage[i] = i % 251;
+    }
+    const QImage image(storage.data(), size.width(), size.height(), 72 * 4, QImage::Format_ARGB32_Premultiplied);
+
+    const QVector<QRect> rects{QRect(0, 0, 64, 1), QRect(3, 5, 7, 11), QRect(60, 31, 4, 1)};
+    QCOMPARE(packedRectsSize(rects), qsizetype((64 + 7 * 11 + 4) * 4));
+
+    QVector<uchar> packed(packedRectsSize(rects));
+    packRects(image, rects, packed.data());
+
+    const uchar *data = packed.constData();
+    for (const QRect &rect : rects) {
+        const QImage expected = image.copy(rect);
+        for (int y = 0; y < rect.height(); ++y) {
+            QVERIFY(std::memcmp(data, expected.constScanLine(y), rect.width() * 4) == 0);
+            data += rect.width() * 4;
+        }
+    }
+}
+
+void TextureUploadTest::benchmarkUpload_data()
+{
+    QTest::addColumn<QRegion>("damage");
+    QTest::addColumn<bool>("streaming");
+
+    const QVector<QPair<const char *, QRegion>> patterns{
+        {"terminal typing", terminalTyping()},
+        {"terminal output", terminalOutput()},
+        {"browser scroll", browserScroll()},
+        {"browser animation", browserAnimation()},
+    };
+    for (const auto &pattern : patterns) {
+        QTest::addRow("%s, copy per rect", pattern.first) << pattern.second << false;
+        QTest::addRow("%s, streaming", pattern.first) << pattern.second << true;
+    }
+}
+
+void TextureUploadTest::benchmarkUpload()
+{
+    // This benchmark compares the work done on the CPU to upload a shared memory buffer. The
+    // old path converted the image and copied every damaged rect into a new image, the new
+    // path copies the coalesced rects straight into the upload buffer.
+    QFETCH(QRegion, damage);
+    QFETCH(bool, streaming);
+
+    // Shared memory buffers may have padding at the end of each row.
+    const int bytesPerLine = 1920 * 4 + 64;
+    QVector<uchar> storage(bytesPerLine * 1080, 0x7f);
+    const QImage image(storage.constData(), 1920, 1080, bytesPerLine, QImage::Format_ARGB32_Premultiplied);
+    QVector<uchar> uploadBuffer(image.sizeInBytes());
+
+    qint64 frameCount = 0;
+    qint64 uploadedBytes = 0;
+    s_allocationCount = 0;
+
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK {
+        if (streaming) {
+            const QVector<QRect> rects = coalesceUploadRects(damage, uploadCoalesceThreshold());
+            packRects(image, rects, uploadBuffer.data());
+            uploadedBytes += packedRectsSize(rects);
+        } else {
+            const QImage im = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+            uchar *destination = uploadBuffer.data();
+            for (const QRect &rect : damage) {
+                const QImage copy = im.copy(rect);
+                std::memcpy(destination, copy.constBits(), copy.sizeInBytes());
+                destination += copy.sizeInBytes();
+                uploadedBytes += copy.sizeInBytes();
+            }
+        }
+        frameCount++;
+    }
+    const qint64 elapsed = timer.nsecsElapsed();
+
+    qInfo("%.1f MB/s uploaded, %.1f allocations per frame",
+          uploadedBytes / 1048576.0 / (elapsed / 1e9), qreal(s_allocationCount) / frameCount);
+}
+
+QTEST_GUILESS_MAIN(TextureUploadTest)
+#include "test_textureupload.moc"
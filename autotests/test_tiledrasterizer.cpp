@@ -0,0 +1,265 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <QPainter>
+#include <QTest>
+#include <QThread>
+
+#include "tiledrasterizer.h"
+
+using namespace KWin;
+
+static QImage createWindowContents(const QSize &size, const QColor &color)
+{
+    QImage image(size, QImage::Format_ARGB32_Premultiplied);
+    image.fill(color);
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setPen(QPen(Qt::white, 3));
+    painter.setBrush(Qt::NoBrush);
+    for (int i = 0; i < 8; ++i) {
+        painter.drawEllipse(QPointF(size.width() / 2, size.height() / 2), 10 + i * 23, 5 + i * 17);
+    }
+    painter.fillRect(QRect(0, 0, size.width(), 24), QColor(0, 0, 0, 128));
+    return image;
+}
+
+/**
+ * Paints something that resembles what the QPainter scene does: a background, windows with
+ * decorations and shadows, a translucent window, a scaled window and the cursor.
+ */
+static void paintScene(QPainter *painter, const QSize &size, const QVector<QImage> &windows)
+{
+    painter->setWindow(QRect(QPoint(0, 0), size));
+
+    const QRegion damage = QRegion(0, 0, size.width(), size.height() / 2)
+        | QRegion(size.width() / 3, size.height() / 3, size.width() / 2, size.height() / 2);
+    painter->setClipRegion(damage);
+    for (const QRect &rect : damage) {
+        painter->fillRect(rect, Qt::black);
+    }
+
+    for (int i = 0; i < windows.count(); ++i) {
+        const QImage &contents = windows[i];
+        const QPoint position((i * 211) % (size.width() - 100), (i * 137) % (size.height() - 100));
+
+        painter->save();
+        painter->translate(position);
+        if (i % 4 == 1) {
+            painter->setOpacity(0.6);
+        }
+        if (i % 4 == 2) {
+            painter->scale(0.75, 0.75);
+            painter->setRenderHint(QPainter::SmoothPixmapTransform);
+        }
+        painter->setClipRect(QRect(-8, -8, contents.width() + 16, contents.height() + 16), Qt::IntersectClip);
+
+        // shadow and decoration
+        painter->fillRect(QRect(-8, -8, contents.width() + 16, contents.height() + 16), QColor(0, 0, 0, 64));
+        painter->fillRect(QRect(0, -24, contents.width(), 24), QColor(40, 40, 90));
+        painter->setRenderHint(QPainter::Antialiasing);
+        painter->setPen(QPen(Qt::lightGray, 1.5));
+        painter->setBrush(Qt::red);
+        painter->drawEllipse(QRectF(contents.width() - 20, -20, 16, 16));
+
+        painter->drawImage(QPoint(0, 0), contents);
+        painter->restore();
+    }
+
+    painter->save();
+    painter->setCompositionMode(QPainter::CompositionMode_DestinationIn);
+    painter->fillRect(QRect(size.width() / 2, 10, 100, 100), QColor(0, 0, 0, 200));
+    painter->restore();
+
+    painter->save();
+    painter->translate(size.width() / 2, size.height() / 2);
+    painter->rotate(30);
+    painter->setRenderHint(QPainter::SmoothPixmapTransform);
+    painter->drawImage(QRectF(-100, -60, 200, 120), windows.first(), QRectF(10, 10, 100, 60));
+    painter->restore();
+
+    // cursor
+    QPolygonF arrow;
+    arrow << QPointF(0, 0) << QPointF(0, 20) << QPointF(5, 15) << QPointF(12, 15);
+    painter->save();
+    painter->translate(size.width() / 2 + 7, size.height() / 3 + 3);
+    painter->setPen(Qt::black);
+    painter->setBrush(Qt::white);
+    painter->drawPolygon(arrow);
+    painter->restore();
+}
+
+static QImage createBuffer(const QSize &size)
+{
+    QImage buffer(size, QImage::Format_RGB32);
+    buffer.fill(Qt::darkCyan);
+    return buffer;
+}
+
+class TiledRasterizerTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testCompareWithDirectPainting_data();
+    void testCompareWithDirectPainting();
+    void testEmptyPaintList();
+    void testText();
+    void benchmarkScaling_data();
+    void benchmarkScaling();
+};
+
+void TiledRasterizerTest::testCompareWithDirectPainting_data()
+{
+    QTest::addColumn<QSize>("size");
+    QTest::addColumn<int>("threadCount");
+
+    QTest::addRow("1280x1024, 1 thread") << QSize(1280, 1024) << 1;
+    QTest::addRow("1280x1024, 4 threads") << QSize(1280, 1024) << 4;
+    QTest::addRow("1000x700, 3 threads") << QSize(1000, 700) << 3;
+    QTest::addRow("1920x1080, 8 threads") << QSize(1920, 1080) << 8;
+}
+
+void TiledRasterizerTest::testCompareWithDirectPainting()
+{
+    // This test verifies that the tiled rasterizer produces exactly the same pixels as
+    // painting directly on a single thread.
+    QFETCH(QSize, size);
+    QFETCH(int, threadCount);
+
+    QVector<QImage> windows;
+    for (int i = 0; i < 6; ++i) {
+        windows << createWindowContents(QSize(300 + i * 40, 200 + i * 30), QColor::fromHsv(i * 60, 200, 220));
+    }
+
+    QImage expected = createBuffer(size);
+    QPainter directPainter(&expected);
+    paintScene(&directPainter, size, windows);
+    directPainter.end();
+
+    QImage buffer = createBuffer(size);
+    PaintRecorder recorder(buffer);
+    QPainter recordingPainter(&recorder);
+    paintScene(&recordingPainter, size, windows);
+    recordingPainter.end();
+
+    TiledRasterizer rasterizer(threadCount);
+    rasterizer.rasterize(recorder.paintList(), &buffer);
+    QCOMPARE(buffer, expected);
+
+    // Rasterizing is deterministic.
+    QImage again = createBuffer(size);
+    rasterizer.rasterize(recorder.paintList(), &again);
+    QCOMPARE(again, buffer);
+}
+
+void TiledRasterizerTest::testEmptyPaintList()
+{
+    QImage buffer = createBuffer(QSize(640, 480));
+    const QImage expected = buffer.copy();
+
+    PaintRecorder recorder(buffer);
+    QPainter painter(&recorder);
+    painter.setClipRect(QRect(10, 10, 10, 10));
+    painter.fillRect(QRect(100, 100, 50, 50), Qt::red);
+    painter.end();
+
+    // Nothing is visible, so nothing should be recorded.
+    QVERIFY(recorder.paintList().commands.isEmpty());
+
+    TiledRasterizer rasterizer(2);
+    rasterizer.rasterize(recorder.paintList(), &buffer);
+    QCOMPARE(buffer, expected);
+}
+
+void TiledRasterizerTest::testText()
+{
+    // This test verifies that text is rasterized as text rather than as paths, so it gets the
+    // same pixels as text painted directly, also where it crosses tiles.
+    const QSize size(400, 300);
+    auto paintText = [size](QPainter *painter) {
+        painter->setWindow(QRect(QPoint(0, 0), size));
+        painter->setPen(Qt::white);
+        QFont font = painter->font();
+        font.setPixelSize(15);
+        painter->setFont(font);
+        painter->drawText(QPointF(4, 20), QStringLiteral("Title of a window - Application"));
+        font.setBold(true);
+        painter->setFont(font);
+        painter->drawText(QRect(100, 110, 200, 40), Qt::AlignCenter, QStringLiteral("Centered title"));
+        painter->setClipRect(QRect(0, 200, 200, 100));
+        painter->scale(1.5, 1.5);
+        painter->drawText(QPointF(60, 140), QStringLiteral("Clipped and scaled"));
+    };
+
+    QImage expected = createBuffer(size);
+    QPainter directPainter(&expected);
+    paintText(&directPainter);
+    directPainter.end();
+
+    QImage buffer = createBuffer(size);
+    PaintRecorder recorder(buffer);
+    QPainter recordingPainter(&recorder);
+    paintText(&recordingPainter);
+    recordingPainter.end();
+    QVERIFY(!recorder.paintList().commands.isEmpty());
+    for (const PaintCommand &command : recorder.paintList().commands) {
+        QVERIFY(command.type == PaintCommand::Type::Text);
+    }
+
+    TiledRasterizer rasterizer(2);
+    rasterizer.rasterize(recorder.paintList(), &buffer);
+    QCOMPARE(buffer, expected);
+}
+
+void TiledRasterizerTest::benchmarkScaling_data()
+{
+    QTest::addColumn<int>("threadCount");
+
+    QTest::addRow("direct") << 0;
+    for (int threadCount = 1; threadCount < QThread::idealThreadCount(); threadCount *= 2) {
+        QTest::addRow("%d threads", threadCount) << threadCount;
+    }
+    QTest::addRow("%d threads", QThread::idealThreadCount()) << QThread::idealThreadCount();
+}
+
+void TiledRasterizerTest::benchmarkScaling()
+{
+    // This benchmark measures how long it takes to composite a full 4K frame depending on the
+    // number of threads. The direct row paints on the calling thread without recording.
+    QFETCH(int, threadCount);
+
+    const QSize size(3840, 2160);
+    QVector<QImage> windows;
+    for (int i = 0; i < 12; ++i) {
+        windows << createWindowContents(QSize(1280, 900), QColor::fromHsv(i * 30, 200, 220));
+    }
+
+    QImage buffer = createBuffer(size);
+    QScopedPointer<TiledRasterizer> rasterizer;
+    if (threadCount) {
+        rasterizer.reset(new TiledRasterizer(threadCount));
+    }
+
+    QBENCHMARK {
+        if (rasterizer) {
+            PaintRecorder recorder(buffer);
+            QPainter painter(&recorder);
+            paintScene(&painter, size, windows);
+            painter.end();
+            rasterizer->rasterize(recorder.paintList(), &buffer);
+        } else {
+            QPainter painter(&buffer);
+            paintScene(&painter, size, windows);
+        }
+    }
+}
+
+QTEST_MAIN(TiledRasterizerTest)
+#include "test_tiledrasterizer.moc"
@@ -0,0 +1,900 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "effects/wobblywindows/wobblymesh.h"
+
+#include <QTest>
+
+#include <cmath>
+#include <memory>
+#include <vector>
+
+using namespace KWin;
+
+namespace
+{
+
+struct Pair {
+    qreal x;
+    qreal y;
+};
+
+/**
+ * The spring mesh as the wobbly windows effect computed it before WobblyMesh: one array of
+ * double precision pairs per quantity and scalar code for every part of the grid.
+ */
+class ReferenceWobbly
+{
+public:
+    explicit ReferenceWobbly(const WobblyMesh::Parameters &parameters)
+        : m_stiffness(parameters.stiffness)
+        , m_drag(parameters.drag)
+        , m_move_factor(parameters.moveFactor)
+        , m_minVelocity(parameters.minVelocity)
+        , m_maxVelocity(parameters.maxVelocity)
+        , m_minAcceleration(parameters.minAcceleration)
+        , m_maxAcceleration(parameters.maxAcceleration)
+    {
+    }
+
+    void reset(const QRectF &geometry)
+    {
+        const qreal x_increment = geometry.width() / (m_width - 1.0);
+        const qreal y_increment = geometry.height() / (m_height - 1.0);
+        for (unsigned int j = 0; j < m_height; ++j) {
+            for (unsigned int i = 0; i < m_width; ++i) {
+                const unsigned int index = j * m_width + i;
+                m_position[index].x = i == m_width - 1 ? geometry.x() + geometry.width() : geometry.x() + i * x_increment;
+                m_position[index].y = j == m_height - 1 ? geometry.y() + geometry.height() : geometry.y() + j * y_increment;
+                m_origin[index] = m_position[index];
+                m_velocity[index] = {0.0, 0.0};
+                m_constraint[index] = false;
+            }
+        }
+    }
+
+    void step(const QRectF &rect, qreal time);
+    Pair computeBezierPoint(Pair point) const;
+
+    bool m_can_wobble_top = true;
+    bool m_can_wobble_left = true;
+    bool m_can_wobble_right = true;
+    bool m_can_wobble_bottom = true;
+
+    Pair *m_origin = m_storage[0];
+    Pair *m_position = m_storage[1];
+    Pair *m_velocity = m_storage[2];
+    Pair *m_acceleration = m_storage[3];
+    Pair *m_buffer = m_storage[4];
+    bool m_constraint[16];
+
+    qreal accelerationSum = 0.0;
+    qreal velocitySum = 0.0;
+
+private:
+    Q_DISABLE_COPY(ReferenceWobbly)
+
+    void heightRingLinearMean(Pair **data_pointer);
+
+    Pair m_storage[5][16];
+    const unsigned int m_width = 4;
+    const unsigned int m_height = 4;
+    const unsigned int m_count = 16;
+
+    qreal m_stiffness;
+    qreal m_drag;
+    qreal m_move_factor;
+    qreal m_minVelocity;
+    qreal m_maxVelocity;
+    qreal m_minAcceleration;
+    qreal m_maxAcceleration;
+};
+
+static inline void fixVectorBounds(Pair& vec, qreal min, qreal max)
+{
+    if (fabs(vec.x) < min) {
+        vec.x = 0.0;
+    } else if (fabs(vec.x) > max) {
+        if (vec.x > 0.0) {
+            vec.x = max;
+        } else {
+            vec.x = -max;
+        }
+    }
+
+    if (fabs(vec.y) < min) {
+        vec.y = 0.0;
+    } else if (fabs(vec.y) > max) {
+        if (vec.y > 0.0) {
+            vec.y = max;
+        } else {
+            vec.y = -max;
+        }
+    }
+}
+
+void ReferenceWobbly::step(const QRectF &rect, qreal time)
+{
+    qreal x_length = rect.width() / (m_width - 1.0);
+    qreal y_length = rect.height() / (m_height - 1.0);
+
+    Pair origine = {rect.x(), rect.y()};
+
+    for (unsigned int j = 0; j < m_height; ++j) {
+        for (unsigned int i = 0; i < m_width; ++i) {
+            m_origin[m_width*j + i] = origine;
+            if (i != m_width - 2) {
+                origine.x += x_length;
+            } else {
+                origine.x = rect.width() + rect.x();
+            }
+        }
+        origine.x = rect.x();
+        if (j != m_height - 2) {
+            origine.y += y_length;
+        } else {
+            origine.y = rect.height() + rect.y();
+        }
+    }
+
+    Pair neibourgs[4];
+    Pair acceleration;
+
+    qreal acc_sum = 0.0;
+    qreal vel_sum = 0.0;
+
+    // compute acceleration, velocity and position for each point
+
+    // for corners
+
+    // top-left
+
+    if (m_constraint[0]) {
+        Pair window_pos = m_origin[0];
+        Pair current_pos = m_position[0];
+        Pair move = {window_pos.x - current_pos.x, window_pos.y - current_pos.y};
+        Pair accel = {move.x*m_stiffness, move.y*m_stiffness};
+        m_acceleration[0] = accel;
+    } else {
+        Pair& pos = m_position[0];
+        neibourgs[0] = m_position[1];
+        neibourgs[1] = m_position[m_width];
+
+        acceleration.x = ((neibourgs[0].x - pos.x) - x_length) * m_stiffness + (neibourgs[1].x - pos.x) * m_stiffness;
+        acceleration.y = ((neibourgs[1].y - pos.y) - y_length) * m_stiffness + (neibourgs[0].y - pos.y) * m_stiffness;
+
+        acceleration.x /= 2;
+        acceleration.y /= 2;
+
+        m_acceleration[0] = acceleration;
+    }
+
+    // top-right
+
+    if (m_constraint[m_width-1]) {
+        Pair window_pos = m_origin[m_width-1];
+        Pair current_pos = m_position[m_width-1];
+        Pair move = {window_pos.x - current_pos.x, window_pos.y - current_pos.y};
+        Pair accel = {move.x*m_stiffness, move.y*m_stiffness};
+        m_acceleration[m_width-1] = accel;
+    } else {
+        Pair& pos = m_position[m_width-1];
+        neibourgs[0] = m_position[m_width-2];
+        neibourgs[1] = m_position[2*m_width-1];
+
+        acceleration.x = (x_length - (pos.x - neibourgs[0].x)) * m_stiffness + (neibourgs[1].x - pos.x) * m_stiffness;
+        acceleration.y = ((neibourgs[1].y - pos.y) - y_length) * m_stiffness + (neibourgs[0].y - pos.y) * m_stiffness;
+
+        acceleration.x /= 2;
+        acceleration.y /= 2;
+
+        m_acceleration[m_width-1] = acceleration;
+    }
+
+    // bottom-left
+
+    if (m_constraint[m_width*(m_height-1)]) {
+        Pair window_pos = m_origin[m_width*(m_height-1)];
+        Pair current_pos = m_position[m_width*(m_height-1)];
+        Pair move = {window_pos.x - current_pos.x, window_pos.y - current_pos.y};
+        Pair accel = {move.x*m_stiffness, move.y*m_stiffness};
+        m_acceleration[m_width*(m_height-1)] = accel;
+    } else {
+        Pair& pos = m_position[m_width*(m_height-1)];
+        neibourgs[0] = m_position[m_width*(m_height-1)+1];
+        neibourgs[1] = m_position[m_width*(m_height-2)];
+
+        acceleration.x = ((neibourgs[0].x - pos.x) - x_length) * m_stiffness + (neibourgs[1].x - pos.x) * m_stiffness;
+        acceleration.y = (y_length - (pos.y - neibourgs[1].y)) * m_stiffness + (neibourgs[0].y - pos.y) * m_stiffness;
+
+        acceleration.x /= 2;
+        acceleration.y /= 2;
+
+        m_acceleration[m_width*(m_height-1)] = acceleration;
+    }
+
+    // bottom-right
+
+    if (m_constraint[m_count-1]) {
+        Pair window_pos = m_origin[m_count-1];
+        Pair current_pos = m_position[m_count-1];
+        Pair move = {window_pos.x - current_pos.x, window_pos.y - current_pos.y};
+        Pair accel = {move.x*m_stiffness, move.y*m_stiffness};
+        m_acceleration[m_count-1] = accel;
+    } else {
+        Pair& pos = m_position[m_count-1];
+        neibourgs[0] = m_position[m_count-2];
+        neibourgs[1] = m_position[m_width*(m_height-1)-1];
+
+        acceleration.x = (x_length - (pos.x - neibourgs[0].x)) * m_stiffness + (neibourgs[1].x - pos.x) * m_stiffness;
+        acceleration.y = (y_length - (pos.y - neibourgs[1].y)) * m_stiffness + (neibourgs[0].y - pos.y) * m_stiffness;
+
+        acceleration.x /= 2;
+        acceleration.y /= 2;
+
+        m_acceleration[m_count-1] = acceleration;
+    }
+
+    // for borders
+
+    // top border
+    for (unsigned int i = 1; i < m_width - 1; ++i) {
+        if (m_constraint[i]) {
+            Pair window_pos = m_origin[i];
+            Pair current_pos = m_position[i];
+            Pair move = {window_pos.x - current_pos.x, window_pos.y - current_pos.y};
+            Pair accel = {move.x*m_stiffness, move.y*m_stiffness};
+            m_acceleration[i] = accel;
+        } else {
+            Pair& pos = m_position[i];
+            neibourgs[0] = m_position[i-1];
+            neibourgs[1] = m_position[i+1];
+            neibourgs[2] = m_position[i+m_width];
+
+            acceleration.x = (x_length - (pos.x - neibourgs[0].x)) * m_stiffness + ((neibourgs[1].x - pos.x) - x_length) * m_stiffness + (neibourgs[2].x - pos.x) * m_stiffness;
+            acceleration.y = ((neibourgs[2].y - pos.y) - y_length) * m_stiffness + (neibourgs[0].y - pos.y) * m_stiffness + (neibourgs[1].y - pos.y) * m_stiffness;
+
+            acceleration.x /= 3;
+            acceleration.y /= 3;
+
+            m_acceleration[i] = acceleration;
+        }
+    }
+
+    // bottom border
+    for (unsigned int i = m_width * (m_height - 1) + 1; i < m_count - 1; ++i) {
+        if (m_constraint[i]) {
+            Pair window_pos = m_origin[i];
+            Pair current_pos = m_position[i];
+            Pair move = {window_pos.x - current_pos.x, window_pos.y - current_pos.y};
+            Pair accel = {move.x*m_stiffness, move.y*m_stiffness};
+            m_acceleration[i] = accel;
+        } else {
+            Pair& pos = m_position[i];
+            neibourgs[0] = m_position[i-1];
+            neibourgs[1] = m_position[i+1];
+            neibourgs[2] = m_position[i-m_width];
+
+            acceleration.x = (x_length - (pos.x - neibourgs[0].x)) * m_stiffness + ((neibourgs[1].x - pos.x) - x_length) * m_stiffness + (neibourgs[2].x - pos.x) * m_stiffness;
+            acceleration.y = (y_length - (pos.y - neibourgs[2].y)) * m_stiffness + (neibourgs[0].y - pos.y) * m_stiffness + (neibourgs[1].y - pos.y) * m_stiffness;
+
+            acceleration.x /= 3;
+            acceleration.y /= 3;
+
+            m_acceleration[i] = acceleration;
+        }
+    }
+
+    // left border
+    for (unsigned int i = m_width; i < m_width*(m_height - 1); i += m_width) {
+        if (m_constraint[i]) {
+            Pair window_pos = m_origin[i];
+            Pair current_pos = m_position[i];
+            Pair move = {window_pos.x - current_pos.x, window_pos.y - current_pos.y};
+            Pair accel = {move.x*m_stiffness, move.y*m_stiffness};
+            m_acceleration[i] = accel;
+        } else {
+            Pair& pos = m_position[i];
+            neibourgs[0] = m_position[i+1];
+            neibourgs[1] = m_position[i-m_width];
+            neibourgs[2] = m_position[i+m_width];
+
+            acceleration.x = ((neibourgs[0].x - pos.x) - x_length) * m_stiffness + (neibourgs[1].x - pos.x) * m_stiffness + (neibourgs[2].x - pos.x) * m_stiffness;
+            acceleration.y = (y_length - (pos.y - neibourgs[1].y)) * m_stiffness + ((neibourgs[2].y - pos.y) - y_length) * m_stiffness + (neibourgs[0].y - pos.y) * m_stiffness;
+
+            acceleration.x /= 3;
+            acceleration.y /= 3;
+
+            m_acceleration[i] = acceleration;
+        }
+    }
+
+    // right border
+    for (unsigned int i = 2 * m_width - 1; i < m_count - 1; i += m_width) {
+        if (m_constraint[i]) {
+            Pair window_pos = m_origin[i];
+            Pair current_pos = m_position[i];
+            Pair move = {window_pos.x - current_pos.x, window_pos.y - current_pos.y};
+            Pair accel = {move.x*m_stiffness, move.y*m_stiffness};
+            m_acceleration[i] = accel;
+        } else {
+            Pair& pos = m_position[i];
+            neibourgs[0] = m_position[i-1];
+            neibourgs[1] = m_position[i-m_width];
+            neibourgs[2] = m_position[i+m_width];
+
+            acceleration.x = (x_length - (pos.x - neibourgs[0].x)) * m_stiffness + (neibourgs[1].x - pos.x) * m_stiffness + (neibourgs[2].x - pos.x) * m_stiffness;
+            acceleration.y = (y_length - (pos.y - neibourgs[1].y)) * m_stiffness + ((neibourgs[2].y - pos.y) - y_length) * m_stiffness + (neibourgs[0].y - pos.y) * m_stiffness;
+
+            acceleration.x /= 3;
+            acceleration.y /= 3;
+
+            m_acceleration[i] = acceleration;
+        }
+    }
+
+    // for the inner points
+    for (unsigned int j = 1; j < m_height - 1; ++j) {
+        for (unsigned int i = 1; i < m_width - 1; ++i) {
+            unsigned int index = i + j * m_width;
+
+            if (m_constraint[index]) {
+                Pair window_pos = m_origin[index];
+                Pair current_pos = m_position[index];
+                Pair move = {window_pos.x - current_pos.x, window_pos.y - current_pos.y};
+                Pair accel = {move.x*m_stiffness, move.y*m_stiffness};
+                m_acceleration[index] = accel;
+            } else {
+                Pair& pos = m_position[index];
+                neibourgs[0] = m_position[index-1];
+                neibourgs[1] = m_position[index+1];
+                neibourgs[2] = m_position[index-m_width];
+                neibourgs[3] = m_position[index+m_width];
+
+                acceleration.x = ((neibourgs[0].x - pos.x) - x_length) * m_stiffness +
+                                 (x_length - (pos.x - neibourgs[1].x)) * m_stiffness +
+                                 (neibourgs[2].x - pos.x) * m_stiffness +
+                                 (neibourgs[3].x - pos.x) * m_stiffness;
+                acceleration.y = (y_length - (pos.y - neibourgs[2].y)) * m_stiffness +
+                                 ((neibourgs[3].y - pos.y) - y_length) * m_stiffness +
+                                 (neibourgs[0].y - pos.y) * m_stiffness +
+                                 (neibourgs[1].y - pos.y) * m_stiffness;
+
+                acceleration.x /= 4;
+                acceleration.y /= 4;
+
+                m_acceleration[index] = acceleration;
+            }
+        }
+    }
+
+    heightRingLinearMean(&m_acceleration);
+
+    // compute the new velocity of each vertex.
+    for (unsigned int i = 0; i < m_count; ++i) {
+        Pair acc = m_acceleration[i];
+        fixVectorBounds(acc, m_minAcceleration, m_maxAcceleration);
+
+        Pair& vel = m_velocity[i];
+        vel.x = acc.x * time + vel.x * m_drag;
+        vel.y = acc.y * time + vel.y * m_drag;
+
+        acc_sum += fabs(acc.x) + fabs(acc.y);
+    }
+
+    heightRingLinearMean(&m_velocity);
+
+    // compute the new pos of each vertex.
+    for (unsigned int i = 0; i < m_count; ++i) {
+        Pair& pos = m_position[i];
+        Pair& vel = m_velocity[i];
+
+        fixVectorBounds(vel, m_minVelocity, m_maxVelocity);
+
+        pos.x += vel.x * time * m_move_factor;
+        pos.y += vel.y * time * m_move_factor;
+
+        vel_sum += fabs(vel.x) + fabs(vel.y);
+
+    }
+
+    if (!m_can_wobble_top) {
+        for (unsigned int i = 0; i < m_width; ++i)
+            for (unsigned j = 0; j < m_width - 1; ++j)
+                m_position[i+m_width*j].y = m_origin[i+m_width*j].y;
+    }
+    if (!m_can_wobble_bottom) {
+        for (unsigned int i = m_width * (m_height - 1); i < m_count; ++i)
+            for (unsigned j = 0; j < m_width - 1; ++j)
+                m_position[i-m_width*j].y = m_origin[i-m_width*j].y;
+    }
+    if (!m_can_wobble_left) {
+        for (unsigned int i = 0; i < m_count; i += m_width)
+            for (unsigned j = 0; j < m_width - 1; ++j)
+                m_position[i+j].x = m_origin[i+j].x;
+    }
+    if (!m_can_wobble_right) {
+        for (unsigned int i = m_width - 1; i < m_count; i += m_width)
+            for (unsigned j = 0; j < m_width - 1; ++j)
+                m_position[i-j].x = m_origin[i-j].x;
+    }
+
+    accelerationSum = acc_sum;
+    velocitySum = vel_sum;
+}
+
+void ReferenceWobbly::heightRingLinearMean(Pair** data_pointer)
+{
+    Pair* data = *data_pointer;
+    Pair neibourgs[8];
+
+    // for corners
+
+    // top-left
+    {
+        Pair& res = m_buffer[0];
+        Pair vit = data[0];
+        neibourgs[0] = data[1];
+        neibourgs[1] = data[m_width];
+        neibourgs[2] = data[m_width+1];
+
+        res.x = (neibourgs[0].x + neibourgs[1].x + neibourgs[2].x + 3.0 * vit.x) / 6.0;
+        res.y = (neibourgs[0].y + neibourgs[1].y + neibourgs[2].y + 3.0 * vit.y) / 6.0;
+    }
+
+
+    // top-right
+    {
+        Pair& res = m_buffer[m_width-1];
+        Pair vit = data[m_width-1];
+        neibourgs[0] = data[m_width-2];
+        neibourgs[1] = data[2*m_width-1];
+        neibourgs[2] = data[2*m_width-2];
+
+        res.x = (neibourgs[0].x + neibourgs[1].x + neibourgs[2].x + 3.0 * vit.x) / 6.0;
+        res.y = (neibourgs[0].y + neibourgs[1].y + neibourgs[2].y + 3.0 * vit.y) / 6.0;
+    }
+
+
+    // bottom-left
+    {
+        Pair& res = m_buffer[m_width*(m_height-1)];
+        Pair vit = data[m_width*(m_height-1)];
+        neibourgs[0] = data[m_width*(m_height-1)+1];
+        neibourgs[1] = data[m_width*(m_height-2)];
+        neibourgs[2] = data[m_width*(m_height-2)+1];
+
+        res.x = (neibourgs[0].x + neibourgs[1].x + neibourgs[2].x + 3.0 * vit.x) / 6.0;
+        res.y = (neibourgs[0].y + neibourgs[1].y + neibourgs[2].y + 3.0 * vit.y) / 6.0;
+    }
+
+
+    // bottom-right
+    {
+        Pair& res = m_buffer[m_count-1];
+        Pair vit = data[m_count-1];
+        neibourgs[0] = data[m_count-2];
+        neibourgs[1] = data[m_width*(m_height-1)-1];
+        neibourgs[2] = data[m_width*(m_height-1)-2];
+
+        res.x = (neibourgs[0].x + neibourgs[1].x + neibourgs[2].x + 3.0 * vit.x) / 6.0;
+        res.y = (neibourgs[0].y + neibourgs[1].y + neibourgs[2].y + 3.0 * vit.y) / 6.0;
+    }
+
+
+    // for borders
+
+    // top border
+    for (unsigned int i = 1; i < m_width - 1; ++i) {
+        Pair& res = m_buffer[i];
+        Pair vit = data[i];
+        neibourgs[0] = data[i-1];
+        neibourgs[1] = data[i+1];
+        neibourgs[2] = data[i+m_width];
+        neibourgs[3] = data[i+m_width-1];
+        neibourgs[4] = data[i+m_width+1];
+
+        res.x = (neibourgs[0].x + neibourgs[1].x + neibourgs[2].x + neibourgs[3].x + neibourgs[4].x + 5.0 * vit.x) / 10.0;
+        res.y = (neibourgs[0].y + neibourgs[1].y + neibourgs[2].y + neibourgs[3].y + neibourgs[4].y + 5.0 * vit.y) / 10.0;
+    }
+
+    // bottom border
+    for (unsigned int i = m_width * (m_height - 1) + 1; i < m_count - 1; ++i) {
+        Pair& res = m_buffer[i];
+        Pair vit = data[i];
+        neibourgs[0] = data[i-1];
+        neibourgs[1] = data[i+1];
+        neibourgs[2] = data[i-m_width];
+        neibourgs[3] = data[i-m_width-1];
+        neibourgs[4] = data[i-m_width+1];
+
+        res.x = (neibourgs[0].x + neibourgs[1].x + neibourgs[2].x + neibourgs[3].x + neibourgs[4].x + 5.0 * vit.x) / 10.0;
+        res.y = (neibourgs[0].y + neibourgs[1].y + neibourgs[2].y + neibourgs[3].y + neibourgs[4].y + 5.0 * vit.y) / 10.0;
+    }
+
+    // left border
+    for (unsigned int i = m_width; i < m_width*(m_height - 1); i += m_width) {
+        Pair& res = m_buffer[i];
+        Pair vit = data[i];
+        neibourgs[0] = data[i+1];
+        neibourgs[1] = data[i-m_width];
+        neibourgs[2] = data[i+m_width];
+        neibourgs[3] = data[i-m_width+1];
+        neibourgs[4] = data[i+m_width+1];
+
+        res.x = (neibourgs[0].x + neibourgs[1].x + neibourgs[2].x + neibourgs[3].x + neibourgs[4].x + 5.0 * vit.x) / 10.0;
+        res.y = (neibourgs[0].y + neibourgs[1].y + neibourgs[2].y + neibourgs[3].y + neibourgs[4].y + 5.0 * vit.y) / 10.0;
+    }
+
+    // right border
+    for (unsigned int i = 2 * m_width - 1; i < m_count - 1; i += m_width) {
+        Pair& res = m_buffer[i];
+        Pair vit = data[i];
+        neibourgs[0] = data[i-1];
+        neibourgs[1] = data[i-m_width];
+        neibourgs[2] = data[i+m_width];
+        neibourgs[3] = data[i-m_width-1];
+        neibourgs[4] = data[i+m_width-1];
+
+        res.x = (neibourgs[0].x + neibourgs[1].x + neibourgs[2].x + neibourgs[3].x + neibourgs[4].x + 5.0 * vit.x) / 10.0;
+        res.y = (neibourgs[0].y + neibourgs[1].y + neibourgs[2].y + neibourgs[3].y + neibourgs[4].y + 5.0 * vit.y) / 10.0;
+    }
+
+    // for the inner points
+    for (unsigned int j = 1; j < m_height - 1; ++j) {
+        for (unsigned int i = 1; i < m_width - 1; ++i) {
+            unsigned int index = i + j * m_width;
+
+            Pair& res = m_buffer[index];
+            Pair& vit = data[index];
+            neibourgs[0] = data[index-1];
+            neibourgs[1] = data[index+1];
+            neibourgs[2] = data[index-m_width];
+            neibourgs[3] = data[index+m_width];
+            neibourgs[4] = data[index-m_width-1];
+            neibourgs[5] = data[index-m_width+1];
+            neibourgs[6] = data[index+m_width-1];
+            neibourgs[7] = data[index+m_width+1];
+
+            res.x = (neibourgs[0].x + neibourgs[1].x + neibourgs[2].x + neibourgs[3].x + neibourgs[4].x + neibourgs[5].x + neibourgs[6].x + neibourgs[7].x + 8.0 * vit.x) / 16.0;
+            res.y = (neibourgs[0].y + neibourgs[1].y + neibourgs[2].y + neibourgs[3].y + neibourgs[4].y + neibourgs[5].y + neibourgs[6].y + neibourgs[7].y + 8.0 * vit.y) / 16.0;
+        }
+    }
+
+    Pair* tmp = data;
+    *data_pointer = m_buffer;
+    m_buffer = tmp;
+}
+
+Pair ReferenceWobbly::computeBezierPoint(Pair point) const
+{
+    const qreal tx = point.x;
+    const qreal ty = point.y;
+
+    // compute polynomial coeff
+
+    qreal px[4];
+    px[0] = (1 - tx) * (1 - tx) * (1 - tx);
+    px[1] = 3 * (1 - tx) * (1 - tx) * tx;
+    px[2] = 3 * (1 - tx) * tx * tx;
+    px[3] = tx * tx * tx;
+
+    qreal py[4];
+    py[0] = (1 - ty) * (1 - ty) * (1 - ty);
+    py[1] = 3 * (1 - ty) * (1 - ty) * ty;
+    py[2] = 3 * (1 - ty) * ty * ty;
+    py[3] = ty * ty * ty;
+
+    Pair res = {0.0, 0.0};
+
+    for (unsigned int j = 0; j < 4; ++j) {
+        for (unsigned int i = 0; i < 4; ++i) {
+            // this assume the grid is 4*4
+            res.x += px[i] * py[j] * m_position[i + j * m_width].x;
+            res.y += px[i] * py[j] * m_position[i + j * m_width].y;
+        }
+    }
+
+    return res;
+}
+
+// The parameters of the default wobbliness level.
+const WobblyMesh::Parameters s_parameters = {0.06f, 0.90f, 0.10f, 0.0f, 1000.0f, 0.0f, 1000.0f};
+
+// The mesh starts on the window at geometry. While activeSteps haven't passed yet, the window
+// is moved and grown with every step.
+struct Scenario
+{
+    QRectF geometry;
+    QVector<int> constrained;
+    QVector<QPointF> velocities;
+    Qt::Edges edges = Qt::TopEdge | Qt::LeftEdge | Qt::RightEdge | Qt::BottomEdge;
+    QPointF move;
+    QSizeF grow;
+    int activeSteps = 0;
+};
+
+Scenario makeScenario(const QString &name)
+{
+    Scenario scenario;
+    scenario.geometry = QRectF(200, 150, 640, 480);
+    if (name == QLatin1String("drag")) {
+        // the window is dragged at the second point of the second row and then let go
+        scenario.constrained = {5};
+        scenario.move = QPointF(23, -11);
+        scenario.activeSteps = 30;
+    } else if (name == QLatin1String("throb")) {
+        // the window got maximized, see WobblyWindowsEffect::stepMovedResized()
+        for (int j = 0; j < WobblyMesh::GridSize; ++j) {
+            for (int i = 0; i < WobblyMesh::GridSize; ++i) {
+                scenario.velocities << QPointF(10 * (i / 3.0 - 0.5), 10 * (j / 3.0 - 0.5));
+                if (i > 0 && i < 3 && j > 0 && j < 3) {
+                    scenario.constrained << j * WobblyMesh::GridSize + i;
+                }
+            }
+        }
+    } else if (name == QLatin1String("resize")) {
+        // the window is resized at its bottom right corner, the other edges don't wobble
+        scenario.constrained = {15};
+        scenario.edges = Qt::RightEdge | Qt::BottomEdge;
+        scenario.grow = QSizeF(17, 9);
+        scenario.activeSteps = 40;
+    }
+    return scenario;
+}
+
+void setUp(const Scenario &scenario, WobblyMesh &mesh)
+{
+    mesh.reset(scenario.geometry);
+    for (int index : scenario.constrained) {
+        mesh.setConstrained(index, true);
+    }
+    for (int i = 0; i < scenario.velocities.count(); ++i) {
+        mesh.setVelocity(i, scenario.velocities[i]);
+    }
+}
+
+void setUp(const Scenario &scenario, ReferenceWobbly &reference)
+{
+    reference.reset(scenario.geometry);
+    for (int index : scenario.constrained) {
+        reference.m_constraint[index] = true;
+    }
+    for (int i = 0; i < scenario.velocities.count(); ++i) {
+        reference.m_velocity[i] = {scenario.velocities[i].x(), scenario.velocities[i].y()};
+    }
+    reference.m_can_wobble_top = scenario.edges & Qt::TopEdge;
+    reference.m_can_wobble_left = scenario.edges & Qt::LeftEdge;
+    reference.m_can_wobble_right = scenario.edges & Qt::RightEdge;
+    reference.m_can_wobble_bottom = scenario.edges & Qt::BottomEdge;
+}
+
+QRectF geometryAt(const Scenario &scenario, int step)
+{
+    const int activeSteps = std::min(step, scenario.activeSteps);
+    QRectF geometry = scenario.geometry;
+    geometry.translate(scenario.move * activeSteps);
+    geometry.setSize(geometry.size() + scenario.grow * activeSteps);
+    return geometry;
+}
+
+WindowQuadList makeWindowQuads(const QRectF &rect)
+{
+    WindowQuad quad(WindowQuadContents);
+    quad[0] = WindowVertex(rect.left(), rect.top(), 0, 0);
+    quad[1] = WindowVertex(rect.right(), rect.top(), 1, 0);
+    quad[2] = WindowVertex(rect.right(), rect.bottom(), 1, 1);
+    quad[3] = WindowVertex(rect.left(), rect.bottom(), 0, 1);
+    WindowQuadList quads;
+    quads << quad;
+    return quads;
+}
+
+// This is how WobblyWindowsEffect::paintWindow() moved the vertices before WobblyMesh.
+void referenceDeform(const ReferenceWobbly &reference, WindowQuadList &quads, const QSizeF &size, const QPointF &origin)
+{
+    for (int i = 0; i < quads.count(); ++i) {
+        for (int j = 0; j < 4; ++j) {
+            WindowVertex &v = quads[i][j];
+            const Pair uv = {v.x() / size.width(), v.y() / size.height()};
+            const Pair newPos = reference.computeBezierPoint(uv);
+            v.move(newPos.x - origin.x(), newPos.y - origin.y());
+        }
+    }
+}
+
+} // anonymous namespace
+
+class WobblyMeshTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void testStepMatchesReference_data();
+    void testStepMatchesReference();
+    void testDeformMatchesReference();
+    void benchmarkStep_data();
+    void benchmarkStep();
+    void benchmarkDeform_data();
+    void benchmarkDeform();
+};
+
+void WobblyMeshTest::testStepMatchesReference_data()
+{
+    QTest::addColumn<QString>("scenario");
+
+    QTest::addRow("drag") << QStringLiteral("drag");
+    QTest::addRow("throb") << QStringLiteral("throb");
+    QTest::addRow("resize") << QStringLiteral("resize");
+}
+
+void WobblyMeshTest::testStepMatchesReference()
+{
+    // This test verifies that the float mesh follows the double precision reference closely
+    // enough that the difference can't be seen, i.e. well below a pixel.
+    QFETCH(QString, scenario);
+    const Scenario setup = makeScenario(scenario);
+
+    WobblyMesh mesh;
+    setUp(setup, mesh);
+    ReferenceWobbly reference(s_parameters);
+    setUp(setup, reference);
+
+    for (int step = 0; step < 300; ++step) {
+        const QRectF geometry = geometryAt(setup, step);
+        float accelerationSum;
+        float velocitySum;
+        mesh.step(geometry, 10, s_parameters, setup.edges, &accelerationSum, &velocitySum);
+        reference.step(geometry, 10);
+
+        for (int i = 0; i < WobblyMesh::PointCount; ++i) {
+            const QPointF position = mesh.position(i);
+            QVERIFY2(std::abs(position.x() - reference.m_position[i].x) < 0.05,
+                     qPrintable(QStringLiteral("step %1, point %2: %3 vs %4").arg(step).arg(i).arg(position.x()).arg(reference.m_position[i].x)));
+            QVERIFY2(std::abs(position.y() - reference.m_position[i].y) < 0.05,
+                     qPrintable(QStringLiteral("step %1, point %2: %3 vs %4").arg(step).arg(i).arg(position.y()).arg(reference.m_position[i].y)));
+        }
+        QVERIFY(std::abs(accelerationSum - reference.accelerationSum) < 0.01 + 0.001 * reference.accelerationSum);
+        QVERIFY(std::abs(velocitySum - reference.velocitySum) < 0.01 + 0.001 * reference.velocitySum);
+    }
+}
+
+void WobblyMeshTest::testDeformMatchesReference()
+{
+    // This test verifies that deforming the window quads with the cached bezier tables gives
+    // the same vertices as evaluating the bezier surface for every vertex.
+    const Scenario setup = makeScenario(QStringLiteral("drag"));
+    WobblyMesh mesh;
+    setUp(setup, mesh);
+    float accelerationSum;
+    float velocitySum;
+    for (int step = 0; step < 20; ++step) {
+        mesh.step(geometryAt(setup, step), 10, s_parameters, setup.edges, &accelerationSum, &velocitySum);
+    }
+
+    // use the same control points for the reference
+    ReferenceWobbly reference(s_parameters);
+    for (int i = 0; i < WobblyMesh::PointCount; ++i) {
+        reference.m_position[i] = {mesh.position(i).x(), mesh.position(i).y()};
+    }
+
+    const QRectF geometry = geometryAt(setup, 20);
+    // the quads extend beyond the window, like a shadow does
+    const WindowQuadList quads = makeWindowQuads(QRectF(-20, -15, geometry.width() + 40, geometry.height() + 35)).makeRegularGrid(20, 20);
+
+    WindowQuadList deformed = quads;
+    const QRectF bounds = mesh.deform(deformed, geometry.size(), geometry.topLeft());
+    WindowQuadList expected = quads;
+    referenceDeform(reference, expected, geometry.size(), geometry.topLeft());
+
+    QCOMPARE(deformed.count(), expected.count());
+    QRectF expectedBounds;
+    for (int i = 0; i < expected.count(); ++i) {
+        for (int j = 0; j < 4; ++j) {
+            QVERIFY(std::abs(deformed[i][j].x() - expected[i][j].x()) < 0.05);
+            QVERIFY(std::abs(deformed[i][j].y() - expected[i][j].y()) < 0.05);
+            // the texture coordinates are left alone
+            QCOMPARE(deformed[i][j].u(), quads[i][j].u());
+            QCOMPARE(deformed[i][j].v(), quads[i][j].v());
+        }
+        expectedBounds |= QRectF(QPointF(expected[i].left(), expected[i].top()), QPointF(expected[i].right(), expected[i].bottom()));
+    }
+    QVERIFY(std::abs(bounds.left() - expectedBounds.left()) < 0.05);
+    QVERIFY(std::abs(bounds.top() - expectedBounds.top()) < 0.05);
+    QVERIFY(std::abs(bounds.right() - expectedBounds.right()) < 0.05);
+    QVERIFY(std::abs(bounds.bottom() - expectedBounds.bottom()) < 0.05);
+}
+
+void WobblyMeshTest::benchmarkStep_data()
+{
+    QTest::addColumn<int>("windowCount");
+    QTest::addColumn<bool>("useReference");
+
+    QTest::addRow("10 windows, reference") << 10 << true;
+    QTest::addRow("10 windows, mesh") << 10 << false;
+    QTest::addRow("100 windows, reference") << 100 << true;
+    QTest::addRow("100 windows, mesh") << 100 << false;
+}
+
+void WobblyMeshTest::benchmarkStep()
+{
+    // This benchmark measures one integration step of the springs of many wobbling windows.
+    QFETCH(int, windowCount);
+    QFETCH(bool, useReference);
+
+    const Scenario setup = makeScenario(QStringLiteral("drag"));
+    std::vector<std::unique_ptr<ReferenceWobbly>> references;
+    QVector<WobblyMesh> meshes(windowCount);
+    for (int i = 0; i < windowCount; ++i) {
+        references.emplace_back(new ReferenceWobbly(s_parameters));
+        setUp(setup, *references.back());
+        setUp(setup, meshes[i]);
+    }
+
+    int step = 0;
+    QBENCHMARK {
+        const QRectF geometry = geometryAt(setup, step++ % setup.activeSteps);
+        if (useReference) {
+            for (const auto &reference : references) {
+                reference->step(geometry, 10);
+            }
+        } else {
+            float accelerationSum;
+            float velocitySum;
+            for (WobblyMesh &mesh : meshes) {
+                mesh.step(geometry, 10, s_parameters, setup.edges, &accelerationSum, &velocitySum);
+            }
+        }
+    }
+}
+
+void WobblyMeshTest::benchmarkDeform_data()
+{
+    QTest::addColumn<QSizeF>("size");
+    QTest::addColumn<int>("tesselation");
+    QTest::addColumn<bool>("useReference");
+
+    QTest::addRow("1280x800, 20x20, reference") << QSizeF(1280, 800) << 20 << true;
+    QTest::addRow("1280x800, 20x20, mesh") << QSizeF(1280, 800) << 20 << false;
+    QTest::addRow("3840x2160, 40x40, reference") << QSizeF(3840, 2160) << 40 << true;
+    QTest::addRow("3840x2160, 40x40, mesh") << QSizeF(3840, 2160) << 40 << false;
+}
+
+void WobblyMeshTest::benchmarkDeform()
+{
+    // This benchmark measures moving the vertices of a tesselated window onto the surface.
+    QFETCH(QSizeF, size);
+    QFETCH(int, tesselation);
+    QFETCH(bool, useReference);
+
+    const Scenario setup = makeScenario(QStringLiteral("drag"));
+    WobblyMesh mesh;
+    setUp(setup, mesh);
+    ReferenceWobbly reference(s_parameters);
+    setUp(setup, reference);
+    float accelerationSum;
+    float velocitySum;
+    for (int step = 0; step < 10; ++step) {
+        mesh.step(geometryAt(setup, step), 10, s_parameters, setup.edges, &accelerationSum, &velocitySum);
+        reference.step(geometryAt(setup, step), 10);
+    }
+
+    const QPointF origin = geometryAt(setup, 10).topLeft();
+    const WindowQuadList quads = makeWindowQuads(QRectF(QPointF(0, 0), size)).makeRegularGrid(tesselation, tesselation);
+    QBENCHMARK {
+        WindowQuadList deformed = quads;
+        if (useReference) {
+            referenceDeform(reference, deformed, size, origin);
+        } else {
+            mesh.deform(deformed, size, origin);
+        }
+    }
+}
+
+QTEST_MAIN(WobblyMeshTest)
+#include "test_wobblymesh.moc"
@@ -0,0 +1,303 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "xcursortheme.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QThreadPool>
+
+using namespace KWin;
+
+struct TestSprite
+{
+    int size;
+    QPoint hotspot;
+    int delay;
+    QRgb color;
+};
+
+// Writes an Xcursor file, every sprite is filled with a single color.
+static bool writeCursor(const QString &fileName, const QVector<TestSprite> &sprites)
+{
+    QVector<quint32> data{0x72756358, 16, 0x10000, quint32(sprites.count())};
+    quint32 position = 16 + sprites.count() * 12;
+    for (const TestSprite &sprite : sprites) {
+        data << 0xfffd0002 << sprite.size << position;
+        position += 36 + sprite.size * sprite.size * 4;
+    }
+    for (const TestSprite &sprite : sprites) {
+        data << 36 << 0xfffd0002 << sprite.size << 1 << sprite.size << sprite.size
+             << sprite.hotspot.x() << sprite.hotspot.y() << sprite.delay;
+        data << QVector<quint32>(sprite.size * sprite.size, sprite.color);
+    }
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    return file.write(reinterpret_cast<const char *>(data.constData()), data.count() * 4) == data.count() * 4;
+}
+
+static bool writeTheme(const QString &directory, const QString &inherits)
+{
+    if (!QDir().mkpath(directory + QStringLiteral("/cursors"))) {
+        return false;
+    }
+    QFile index(directory + QStringLiteral("/index.theme"));
+    if (!index.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    index.write("[Icon Theme]\n");
+    if (!inherits.isEmpty()) {
+        index.write("Inherits=" + inherits.toUtf8() + "\n");
+    }
+    return true;
+}
+
+static qint64 residentMemory()
+{
+    QFile status(QStringLiteral("/proc/self/status"));
+    if (!status.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    const QList<QByteArray> lines = status.readAll().split('\n');
+    for (const QByteArray &line : lines) {
+        if (line.startsWith("VmRSS:")) {
+            return line.mid(6).simplified().split(' ').first().toLongLong();
+        }
+    }
+    return -1;
+}
+
+static void loadCursors(const QString &themeName, qreal scale)
+{
+    const KXcursorTheme theme = KXcursorTheme::fromTheme(themeName, 24, scale);
+    for (const char *name : {"left_ptr", "xterm", "hand2", "sb_h_double_arrow", "watch"}) {
+        theme.shape(QByteArray(name));
+    }
+}
+
+class XcursorThemeTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void testShape();
+    void testDevicePixelRatio();
+    void testInherits();
+    void testMissingTheme();
+    void testDiskCache();
+    void testMapDiskCache();
+    void benchmarkLoadTheme_data();
+    void benchmarkLoadTheme();
+
+private:
+    QTemporaryDir m_iconsDirectory;
+};
+
+void XcursorThemeTest::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+    QDir(QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QStringLiteral("/kwin/xcursor")).removeRecursively();
+
+    // The search path is read once, the system themes are used by the benchmark.
+    QVERIFY(m_iconsDirectory.isValid());
+    qputenv("XCURSOR_PATH", QFile::encodeName(m_iconsDirectory.path()) + ":~/.icons:/usr/share/icons:/usr/share/pixmaps");
+
+    const QString parent = m_iconsDirectory.filePath(QStringLiteral("kwin-test-parent"));
+    QVERIFY(writeTheme(parent, QString()));
+    QVERIFY(writeCursor(parent + QStringLiteral("/cursors/left_ptr"), {
+        {24, QPoint(2, 4), 0, 0xff0000ff},
+    }));
+    QVERIFY(writeCursor(parent + QStringLiteral("/cursors/wait"), {
+        {24, QPoint(12, 12), 50, 0xff00ff00},
+        {24, QPoint(12, 12), 60, 0xff00ff00},
+        {48, QPoint(24, 24), 50, 0xffff0000},
+        {48, QPoint(24, 24), 60, 0xffff0000},
+    }));
+    QVERIFY(QFile::link(QStringLiteral("wait"), parent + QStringLiteral("/cursors/watch")));
+
+    const QString child = m_iconsDirectory.filePath(QStringLiteral("kwin-test-child"));
+    QVERIFY(writeTheme(child, QStringLiteral("kwin-test-parent")));
+    QVERIFY(writeCursor(child + QStringLiteral("/cursors/left_ptr"), {
+        {24, QPoint(1, 1), 0, 0xffffffff},
+    }));
+}
+
+void XcursorThemeTest::testShape()
+{
+    // This test verifies that the sprites of a cursor are loaded with their hotspots and delays.
+    const KXcursorTheme theme = KXcursorTheme::fromTheme(QStringLiteral("kwin-test-parent"), 24, 1);
+    QVERIFY(!theme.isEmpty());
+
+    const QVector<KXcursorSprite> arrow = theme.shape(QByteArrayLiteral("left_ptr"));
+    QCOMPARE(arrow.count(), 1);
+    QCOMPARE(arrow[0].data().size(), QSize(24, 24));
+    QCOMPARE(arrow[0].data().pixel(0, 0), 0xff0000ff);
+    QCOMPARE(arrow[0].hotspot(), QPoint(2, 4));
+
+    const QVector<KXcursorSprite> wait = theme.shape(QByteArrayLiteral("wait"));
+    QCOMPARE(wait.count(), 2);
+    QCOMPARE(wait[0].delay(), std::chrono::milliseconds(50));
+    QCOMPARE(wait[1].delay(), std::chrono::milliseconds(60));
+    QCOMPARE(wait[1].data().pixel(23, 23), 0xff00ff00);
+
+    // aliases give the same sprites
+    const QVector<KXcursorSprite> watch = theme.shape(QByteArrayLiteral("watch"));
+    QCOMPARE(watch.count(), 2);
+    QCOMPARE(watch[0].data().constBits(), wait[0].data().constBits());
+
+    QVERIFY(theme.shape(QByteArrayLiteral("no_such_cursor")).isEmpty());
+}
+
+void XcursorThemeTest::testDevicePixelRatio()
+{
+    // This test verifies that a scaled theme picks the larger sprites, with the hotspot in
+    // device independent pixels, and shares them with a theme of that size.
+    const KXcursorTheme scaled = KXcursorTheme::fromTheme(QStringLiteral("kwin-test-parent"), 24, 2);
+    QCOMPARE(scaled.devicePixelRatio(), 2.0);
+    const QVector<KXcursorSprite> wait = scaled.shape(QByteArrayLiteral("wait"));
+    QCOMPARE(wait.count(), 2);
+    QCOMPARE(wait[0].data().size(), QSize(48, 48));
+    QCOMPARE(wait[0].data().devicePixelRatio(), 2.0);
+    QCOMPARE(wait[0].data().pixel(0, 0), 0xffff0000);
+    QCOMPARE(wait[0].hotspot(), QPoint(12, 12));
+
+    const KXcursorTheme large = KXcursorTheme::fromTheme(QStringLiteral("kwin-test-parent"), 48, 1);
+    const QVector<KXcursorSprite> largeWait = large.shape(QByteArrayLiteral("wait"));
+    QCOMPARE(largeWait.count(), 2);
+    QCOMPARE(largeWait[0].hotspot(), QPoint(24, 24));
+    QCOMPARE(largeWait[0].data().devicePixelRatio(), 1.0);
+    QCOMPARE(largeWait[0].data().constBits(), wait[0].data().constBits());
+}
+
+void XcursorThemeTest::testInherits()
+{
+    // This test verifies that a theme overrides the cursors of the theme it inherits.
+    const KXcursorTheme theme = KXcursorTheme::fromTheme(QStringLiteral("kwin-test-child"), 24, 1);
+    const QVector<KXcursorSprite> arrow = theme.shape(QByteArrayLiteral("left_ptr"));
+    QCOMPARE(arrow.count(), 1);
+    QCOMPARE(arrow[0].data().pixel(0, 0), 0xffffffff);
+    QCOMPARE(arrow[0].hotspot(), QPoint(1, 1));
+
+    QCOMPARE(theme.shape(QByteArrayLiteral("wait")).count(), 2);
+}
+
+void XcursorThemeTest::testMissingTheme()
+{
+    QVERIFY(KXcursorTheme::fromTheme(QStringLiteral("kwin-test-missing"), 24, 1).shape(QByteArrayLiteral("left_ptr")).isEmpty());
+}
+
+void XcursorThemeTest::testDiskCache()
+{
+    // This test verifies that decoded cursors are stored in the disk cache.
+    const QDir cacheDirectory(QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QStringLiteral("/kwin/xcursor"));
+    // the files are written in worker threads
+    QThreadPool::globalInstance()->waitForDone();
+    const QStringList before = cacheDirectory.entryList(QDir::Files);
+
+    const KXcursorTheme theme = KXcursorTheme::fromTheme(QStringLiteral("kwin-test-parent"), 32, 1);
+    QCOMPARE(theme.shape(QByteArrayLiteral("left_ptr")).count(), 1);
+
+    QThreadPool::globalInstance()->waitForDone();
+    QStringList added = cacheDirectory.entryList(QDir::Files);
+    for (const QString &fileName : before) {
+        added.removeOne(fileName);
+    }
+    QCOMPARE(added.count(), 1);
+    // the header, one sprite and its pixels
+    QCOMPARE(QFileInfo(cacheDirectory.filePath(added.first())).size(), qint64((3 + 5) * 4 + 24 * 24 * 4));
+}
+
+void XcursorThemeTest::testMapDiskCache()
+{
+    // This test verifies that cursors which are not cached in memory are read from the disk cache.
+    const QDir cacheDirectory(QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QStringLiteral("/kwin/xcursor"));
+    // the files are written in worker threads
+    QThreadPool::globalInstance()->waitForDone();
+    const QStringList before = cacheDirectory.entryList(QDir::Files);
+
+    const KXcursorTheme theme = KXcursorTheme::fromTheme(QStringLiteral("kwin-test-parent"), 16, 1);
+    const QVector<KXcursorSprite> decoded = theme.shape(QByteArrayLiteral("wait"));
+    QCOMPARE(decoded.count(), 2);
+    QCOMPARE(decoded[0].data().pixel(0, 0), 0xff00ff00);
+
+    QThreadPool::globalInstance()->waitForDone();
+    QStringList added = cacheDirectory.entryList(QDir::Files);
+    for (const QString &fileName : before) {
+        added.removeOne(fileName);
+    }
+    QCOMPARE(added.count(), 1);
+
+    // Paint the pixels of the second sprite in the file blue, so they can only come from there.
+    QFile file(cacheDirectory.filePath(added.first()));
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    const qint64 secondSprite = (3 + 2 * 5) * 4 + 24 * 24 * 4;
+    QCOMPARE(file.size(), secondSprite + 24 * 24 * 4);
+    QVERIFY(file.seek(secondSprite));
+    const QVector<quint32> blue(24 * 24, 0xff0000ff);
+    QCOMPARE(file.write(reinterpret_cast<const char *>(blue.constData()), blue.count() * 4), qint64(blue.count() * 4));
+    file.close();
+
+    KXcursorTheme::clearCache();
+    const QVector<KXcursorSprite> mapped = theme.shape(QByteArrayLiteral("wait"));
+    QCOMPARE(mapped.count(), 2);
+    QCOMPARE(mapped[0].data().size(), QSize(24, 24));
+    QCOMPARE(mapped[0].data().format(), QImage::Format_ARGB32_Premultiplied);
+    QCOMPARE(mapped[0].data().pixel(0, 0), 0xff00ff00);
+    QCOMPARE(mapped[0].data().pixel(23, 23), 0xff00ff00);
+    QCOMPARE(mapped[0].hotspot(), QPoint(12, 12));
+    QCOMPARE(mapped[0].delay(), std::chrono::milliseconds(50));
+    QCOMPARE(mapped[1].data().pixel(0, 0), 0xff0000ff);
+    QCOMPARE(mapped[1].data().pixel(23, 23), 0xff0000ff);
+    QCOMPARE(mapped[1].delay(), std::chrono::milliseconds(60));
+    QVERIFY(mapped[0].data().constBits() != decoded[0].data().constBits());
+}
+
+void XcursorThemeTest::benchmarkLoadTheme_data()
+{
+    QTest::addColumn<QString>("themeName");
+    QTest::addColumn<qreal>("scale");
+
+    for (const QString &themeName : {QStringLiteral("breeze_cursors"), QStringLiteral("Adwaita")}) {
+        for (qreal scale : {1.0, 1.5, 2.0}) {
+            QTest::addRow("%s, scale %.1f", qPrintable(themeName), scale) << themeName << scale;
+        }
+    }
+}
+
+void XcursorThemeTest::benchmarkLoadTheme()
+{
+    // This benchmark measures loading a system theme and the cursors that are shown at startup.
+    QFETCH(QString, themeName);
+    QFETCH(qreal, scale);
+
+    if (KXcursorTheme::fromTheme(themeName, 24, scale).isEmpty()) {
+        QSKIP("The cursor theme is not installed");
+    }
+
+    const qint64 memoryBefore = residentMemory();
+    QElapsedTimer timer;
+    timer.start();
+    loadCursors(themeName, scale);
+    qDebug() << themeName << scale << "first load took" << timer.elapsed() << "ms,"
+             << "resident memory grew by" << residentMemory() - memoryBefore << "KiB";
+
+    QBENCHMARK {
+        loadCursors(themeName, scale);
+    }
+}
+
+QTEST_MAIN(XcursorThemeTest)
+#include "test_xcursortheme.moc"
@@ -0,0 +1,225 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "xwl/transferbuffer.h"
+
+#include <QFile>
+#include <QTest>
+
+#include <thread>
+
+#include <errno.h>
+#include <unistd.h>
+
+using namespace KWin;
+using namespace KWin::Xwl;
+
+static const int s_chunkSize = 63 * 1024;
+
+// The peak resident set size of the process, in KiB.
+static qint64 peakMemory()
+{
+    QFile status(QStringLiteral("/proc/self/status"));
+    if (!status.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    const QList<QByteArray> lines = status.readAll().split('\n');
+    for (const QByteArray &line : lines) {
+        if (line.startsWith("VmHWM:")) {
+            return line.mid(6).simplified().split(' ').first().toLongLong();
+        }
+    }
+    return -1;
+}
+
+// The bytes of the fake selection, so that both ends can check them without storing them.
+static char selectionByte(qint64 offset)
+{
+    return char((offset * 7 + offset / 4096) & 0xff);
+}
+
+class TransferBufferTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void testAppendWrapsAround();
+    void testFrontIsAtMostOneChunk();
+    void testReadWrite();
+    void testLargeSelection_data();
+    void testLargeSelection();
+};
+
+void TransferBufferTest::testAppendWrapsAround()
+{
+    // This test verifies that data that wraps around the end of the ring comes out in order.
+    TransferBuffer buffer(4, 2);
+    QCOMPARE(buffer.capacity(), 8);
+    QVERIFY(buffer.isEmpty());
+
+    QCOMPARE(buffer.append("abcdef", 6), 6);
+    buffer.consume(4);
+    QCOMPARE(buffer.append("ghijklmn", 8), 6);
+    QVERIFY(buffer.isFull());
+
+    QByteArray data;
+    while (!buffer.isEmpty()) {
+        const QByteArray front = buffer.front();
+        data += front;
+        buffer.consume(front.size());
+    }
+    QCOMPARE(data, QByteArray("efghijkl"));
+}
+
+void TransferBufferTest::testFrontIsAtMostOneChunk()
+{
+    // This test verifies that the data is handed out in chunks, as the INCR protocol needs it.
+    TransferBuffer buffer(4, 4);
+    QCOMPARE(buffer.append("0123456789", 10), 10);
+    QCOMPARE(buffer.front(), QByteArray("0123"));
+    buffer.consume(4);
+    QCOMPARE(buffer.front(), QByteArray("4567"));
+    buffer.consume(4);
+    QCOMPARE(buffer.front(), QByteArray("89"));
+    buffer.consume(2);
+    QVERIFY(buffer.isEmpty());
+    QVERIFY(buffer.front().isEmpty());
+}
+
+void TransferBufferTest::testReadWrite()
+{
+    // This test verifies that reads and writes split around the end of the ring keep the data.
+    int in[2];
+    int out[2];
+    QCOMPARE(pipe(in), 0);
+    QCOMPARE(pipe(out), 0);
+
+    TransferBuffer buffer(4, 2);
+    QCOMPARE(write(in[1], "abcdef", 6), 6);
+    QCOMPARE(buffer.readFrom(in[0]), 6);
+    buffer.consume(5);
+    QCOMPARE(write(in[1], "ghijklmno", 9), 9);
+    QCOMPARE(buffer.readFrom(in[0]), 7);
+    QVERIFY(buffer.isFull());
+    // a full buffer is not the end of the file
+    QCOMPARE(buffer.readFrom(in[0]), -1);
+    QCOMPARE(errno, EAGAIN);
+
+    QCOMPARE(buffer.writeTo(out[1]), 8);
+    QVERIFY(buffer.isEmpty());
+    char data[8];
+    QCOMPARE(read(out[0], data, sizeof(data)), 8);
+    QCOMPARE(QByteArray(data, sizeof(data)), QByteArray("fghijklm"));
+
+    // the rest is still in the pipe
+    QCOMPARE(buffer.readFrom(in[0]), 2);
+    QCOMPARE(buffer.front(), QByteArray("no"));
+
+    close(in[0]);
+    close(in[1]);
+    close(out[0]);
+    close(out[1]);
+}
+
+void TransferBufferTest::testLargeSelection_data()
+{
+    QTest::addColumn<bool>("incr");
+
+    QTest::addRow("wayland to x") << true;
+    QTest::addRow("x to wayland") << false;
+}
+
+void TransferBufferTest::testLargeSelection()
+{
+    // This test verifies that a selection much larger than the buffer goes through it unchanged
+    // and without growing the memory of the process. Wayland to X hands the data out in chunks,
+    // as they are put into the property; X to Wayland writes it to another pipe.
+    QFETCH(bool, incr);
+    const qint64 selectionSize = qint64(2) << 30;
+    const qint64 peakBefore = peakMemory();
+
+    int source[2];
+    int target[2];
+    QCOMPARE(pipe(source), 0);
+    QCOMPARE(pipe(target), 0);
+
+    std::thread producer([&source, selectionSize]() {
+        char data[64 * 1024];
+        qint64 offset = 0;
+        while (offset < selectionSize) {
+            const int length = int(std::min<qint64>(sizeof(data), selectionSize - offset));
+            for (int i = 0; i < length; ++i) {
+                data[i] = selectionByte(offset + i);
+            }
+            int written = 0;
+            while (written < length) {
+                const ssize_t n = write(source[1], data + written, length - written);
+                if (n < 0) {
+                    return;
+                }
+                written += n;
+            }
+            offset += length;
+        }
+        close(source[1]);
+    });
+
+    qint64 consumed = 0;
+    bool intact = true;
+    std::thread consumer([&target, &consumed, &intact]() {
+        char data[64 * 1024];
+        ssize_t n;
+        while ((n = read(target[0], data, sizeof(data))) > 0) {
+            for (int i = 0; i < n; ++i) {
+                intact = intact && data[i] == selectionByte(consumed + i);
+            }
+            consumed += n;
+        }
+    });
+
+    TransferBuffer buffer(s_chunkSize);
+    qint64 received = 0;
+    qint64 readTotal = 0;
+    bool atEnd = false;
+    while (!atEnd || !buffer.isEmpty()) {
+        if (!atEnd && !buffer.isFull()) {
+            const qint64 n = buffer.readFrom(source[0]);
+            QVERIFY(n >= 0 || errno == EINTR);
+            atEnd = n == 0;
+            readTotal += std::max<qint64>(n, 0);
+        }
+        QVERIFY(buffer.size() <= buffer.capacity());
+        if (incr) {
+            const QByteArray chunk = buffer.front();
+            QVERIFY(chunk.size() <= s_chunkSize);
+            for (int i = 0; i < chunk.size() && intact; ++i) {
+                intact = chunk[i] == selectionByte(received + i);
+            }
+            received += chunk.size();
+            buffer.consume(chunk.size());
+        } else {
+            const qint64 n = buffer.writeTo(target[1]);
+            QVERIFY(n >= 0 || errno == EINTR);
+        }
+    }
+    close(target[1]);
+    producer.join();
+    consumer.join();
+    close(source[0]);
+    close(target[0]);
+
+    QCOMPARE(readTotal, selectionSize);
+    QCOMPARE(incr ? received : consumed, selectionSize);
+    QVERIFY(intact);
+    if (peakBefore != -1) {
+        QVERIFY(peakMemory() - peakBefore < 16 * 1024);
+    }
+}
+
+QTEST_MAIN(TransferBufferTest)
+#include "test_xwl_transferbuffer.moc"
@@ -846,6 +846,23 @@ XcursorScanTheme (const char *theme, const char *name)
     return f;
 }
 
+XcursorImages *
+XcursorFilenameLoadImages (const char *file, int size)
+{
+    FILE	    *f;
+    XcursorImages   *images;
+
+    if (!file || size < 0)
+        return NULL;
+
+    f = fopen (file, "r");
+    if (!f)
+	return NULL;
+    images = XcursorFileLoadImages (f, size);
+    fclose (f);
+    return images;
+}
+
 XcursorImages *
 XcursorLibraryLoadImages (const char *file, const char *theme, int size)
 {
@@ -977,3 +994,95 @@ xcursor_load_theme(const char *theme, int size,
 	if (inherits)
 		free(inherits);
 }
+
+static void
+index_all_cursors_in_dir(const char *path,
+			 void (*index_callback)(const char *, const char *, void *),
+			 void *user_data)
+{
+	DIR *dir = opendir(path);
+	struct dirent *ent;
+	char *full;
+
+	if (!dir)
+		return;
+
+	for(ent = readdir(dir); ent; ent = readdir(dir)) {
+#ifdef _DIRENT_HAVE_D_TYPE
+		if (ent->d_type != DT_UNKNOWN &&
+		    (ent->d_type != DT_REG && ent->d_type != DT_LNK))
+			continue;
+#endif
+		if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+			continue;
+
+		full = _XcursorBuildFullname(path, "", ent->d_name);
+		if (!full)
+			continue;
+
+		index_callback(ent->d_name, full, user_data);
+		free(full);
+	}
+
+	closedir(dir);
+}
+
+/** Index all the cursors of a theme
+ *
+ * This function walks the same directories as xcursor_load_theme(), but
+ * doesn't open any cursor file. The index callback is called with the
+ * name of every cursor and the full path of its file. Cursors are listed
+ * in lookup order, that is the theme before the themes it inherits, so
+ * the first file given for a name is the one that should be used. The
+ * files can be loaded later with XcursorFilenameLoadImages().
+ *
+ * \param theme The name of theme that should be indexed
+ * \param index_callback A callback function that will be called
+ * for each cursor file with the name of the cursor, the path of the file
+ * and the data provided by the user.
+ * \param user_data The data that should be passed to the index callback
+ */
+void
+xcursor_index_theme(const char *theme,
+		    void (*index_callback)(const char *, const char *, void *),
+		    void *user_data)
+{
+	char *full, *dir;
+	char *inherits = NULL;
+	const char *path, *i;
+
+	if (!theme)
+		theme = "default";
+
+	for (path = XcursorLibraryPath();
+	     path;
+	     path = _XcursorNextPath(path)) {
+		dir = _XcursorBuildThemeDir(path, theme);
+		if (!dir)
+			continue;
+
+		full = _XcursorBuildFullname(dir, "cursors", "");
+
+		if (full) {
+			index_all_cursors_in_dir(full, index_callback,
+						 user_data);
+			free(full);
+		}
+
+		if (!inherits) {
+			full = _XcursorBuildFullname(dir, "", "index.theme");
+			if (full) {
+				inherits = _XcursorThemeInherits(full);
+				free(full);
+			}
+		}
+
+		free(dir);
+	}
+
+	for (i = inherits; i; i = _XcursorNextPath(i))
+		xcursor_index_theme(i, index_callback, user_data);
+
+	if (inherits)
+		free(inherits);
+}
@@ -61,6 +61,9 @@ typedef struct _XcursorImages {
 XcursorImages *
 XcursorLibraryLoadImages (const char *file, const char *theme, int size);
 
+XcursorImages *
+XcursorFilenameLoadImages (const char *file, int size);
+
 void
 XcursorImagesDestroy (XcursorImages *images);
 
@@ -69,6 +72,11 @@ xcursor_load_theme(const char *theme, int size,
 		    void (*load_callback)(XcursorImages *, void *),
 		    void *user_data);
 
+void
+xcursor_index_theme(const char *theme,
+		    void (*index_callback)(const char *, const char *, void *),
+		    void *user_data);
+
 #ifdef __cplusplus
 }
 #endif
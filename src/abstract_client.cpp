@@ -2816,6 +2816,13 @@ void AbstractClient::evaluateWindowRules()
     applyWindowRules();
 }
 
+void AbstractClient::evaluateTitleRules()
+{
+    if (RuleBook::self()->updateTitleRules(this, &m_rules)) {
+        applyWindowRules();
+    }
+}
+
 /**
  * Returns the list of activities the client window is on.
  * if it's on all activities, the list will be empty.
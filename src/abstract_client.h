@@ -550,6 +550,10 @@ public:
     void removeRule(Rules* r);
     void setupWindowRules(bool ignore_temporary);
     void evaluateWindowRules();
+    /**
+     * Re-evaluates only the rules that match the window title, after the caption has changed.
+     */
+    void evaluateTitleRules();
     virtual void applyWindowRules();
     virtual bool takeFocus() = 0;
     virtual bool wantsInput() const = 0;
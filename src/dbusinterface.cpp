@@ -15,6 +15,7 @@
 
 // kwin
 #include "abstract_client.h"
+#include "abstract_output.h"
 #include "atoms.h"
 #include "composite.h"
 #include "debug_console.h"
@@ -23,6 +24,8 @@
 #include "platform.h"
 #include "pluginmanager.h"
 #include "kwinadaptor.h"
+#include "renderjournal.h"
+#include "renderloop.h"
 #include "scene.h"
 #include "unmanaged.h"
 #include "workspace.h"
@@ -332,6 +335,39 @@ void CompositorDBusInterface::reinitialize()
     m_compositor->reinitialize();
 }
 
+QVariantMap CompositorDBusInterface::renderTimeStatistics(const QString &outputName) const
+{
+    const Platform *platform = kwinApp()->platform();
+
+    RenderLoop *renderLoop = nullptr;
+    if (outputName.isEmpty()) {
+        renderLoop = platform->renderLoop();
+    } else {
+        const auto outputs = platform->enabledOutputs();
+        for (AbstractOutput *output : outputs) {
+            if (output->name() == outputName) {
+                renderLoop = output->renderLoop();
+                break;
+            }
+        }
+    }
+    if (!renderLoop) {
+        return QVariantMap{};
+    }
+
+    const RenderJournal *journal = renderLoop->renderJournal();
+    return QVariantMap{
+        {QStringLiteral("refreshRate"), renderLoop->refreshRate()},
+        {QStringLiteral("minimum"), qlonglong(journal->minimum().count())},
+        {QStringLiteral("maximum"), qlonglong(journal->maximum().count())},
+        {QStringLiteral("average"), qlonglong(journal->average().count())},
+        {QStringLiteral("exponentialAverage"), qlonglong(journal->exponentialAverage().count())},
+        {QStringLiteral("percentile50"), qlonglong(journal->percentile(0.5).count())},
+        {QStringLiteral("percentile90"), qlonglong(journal->percentile(0.9).count())},
+        {QStringLiteral("percentile99"), qlonglong(journal->percentile(0.99).count())},
+    };
+}
+
 QStringList CompositorDBusInterface::supportedOpenGLPlatformInterfaces() const
 {
     QStringList interfaces;
@@ -162,6 +162,18 @@ public Q_SLOTS:
      * On signal Compositor reloads settings and restarts.
      */
     void reinitialize();
+    /**
+     * @brief Returns how long it takes to render frames on the output with the given name.
+     *
+     * The returned map contains the estimates of the render journal in nanoseconds, i.e.
+     * the minimum, maximum, average, exponentialAverage, percentile50, percentile90 and
+     * percentile99 keys, as well as the refreshRate of the output in millihertz. If the
+     * output name is empty, the statistics of the render loop shared by all outputs are
+     * returned, which is the case on X11.
+     *
+     * @return QVariantMap
+     */
+    QVariantMap renderTimeStatistics(const QString &outputName) const;
 
 Q_SIGNALS:
     void compositingToggled(bool active);
@@ -8,6 +8,7 @@
 */
 #include "debug_console.h"
 #include "composite.h"
+#include "effects.h"
 #include "x11client.h"
 #include "input_event.h"
 #include "internal_client.h"
@@ -38,6 +39,7 @@
 #include <QMouseEvent>
 #include <QMetaProperty>
 #include <QMetaType>
+#include <QTimer>
 
 // xkb
 #include <xkbcommon/xkbcommon.h>
@@ -577,6 +579,13 @@ DebugConsole::DebugConsole()
         m_ui->tabWidget->setTabEnabled(3, false);
     }
 
+    if (!effects) {
+        m_ui->tabWidget->setTabEnabled(6, false);
+    }
+    m_effectsTabTimer = new QTimer(this);
+    m_effectsTabTimer->setInterval(1000);
+    connect(m_effectsTabTimer, &QTimer::timeout, this, &DebugConsole::updateEffectsTab);
+
     connect(m_ui->quitButton, &QAbstractButton::clicked, this, &DebugConsole::deleteLater);
     connect(m_ui->tabWidget, &QTabWidget::currentChanged, this,
         [this] (int index) {
@@ -589,6 +598,13 @@ DebugConsole::DebugConsole()
                 updateKeyboardTab();
                 connect(input(), &InputRedirection::keyStateChanged, this, &DebugConsole::updateKeyboardTab);
             }
+            // the counters change with every frame, only poll them while they are visible
+            if (index == 6) {
+                updateEffectsTab();
+                m_effectsTabTimer->start();
+            } else {
+                m_effectsTabTimer->stop();
+            }
         }
     );
 
@@ -673,6 +689,19 @@ void DebugConsole::updateKeyboardTab()
     m_ui->activeModifiersLabel->setText(stateActiveComponents<xkb_mod_index_t>(state, xkb_keymap_num_mods(map), modActive, &xkb_keymap_mod_get_name));
 }
 
+void DebugConsole::updateEffectsTab()
+{
+    if (!effects) {
+        return;
+    }
+    const EffectsHandlerImpl::WindowChainStatistics statistics = static_cast<EffectsHandlerImpl *>(effects)->windowChainStatistics();
+    m_ui->windowScopedEffectsLabel->setText(QString::number(statistics.windowScopedEffects));
+    m_ui->windowsWithOwnChainLabel->setText(QString::number(statistics.windowsWithOwnChain));
+    m_ui->chainDispatchesLabel->setText(QString::number(statistics.chainDispatches));
+    m_ui->chainCallsLabel->setText(QString::number(statistics.effectCalls));
+    m_ui->skippedEffectsLabel->setText(QString::number(statistics.skippedEffects));
+}
+
 void DebugConsole::showEvent(QShowEvent *event)
 {
     QWidget::showEvent(event);
@@ -20,6 +20,7 @@
 #include <functional>
 
 class QTextEdit;
+class QTimer;
 
 namespace Ui
 {
@@ -104,9 +105,11 @@ protected:
 private:
     void initGLTab();
     void updateKeyboardTab();
+    void updateEffectsTab();
 
     QScopedPointer<Ui::DebugConsole> m_ui;
     QScopedPointer<DebugConsoleFilter> m_inputFilter;
+    QTimer *m_effectsTabTimer = nullptr;
 };
 
 class SurfaceTreeModel : public QAbstractItemModel
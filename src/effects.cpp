@@ -376,6 +376,116 @@ void EffectsHandlerImpl::reconfigure()
     m_effectLoader->queryAndLoadAll();
 }
 
+/**
+ * Switches the cursor to the paint chain of @a window unless the window is already being
+ * painted, e.g. when an effect calls paintWindow() from its own paintWindow(). The cursor
+ * is restored when the scope is left, so painting a thumbnail from within another window's
+ * chain resumes that chain afterwards.
+ */
+class EffectsHandlerImpl::WindowChainScope
+{
+public:
+    WindowChainScope(EffectsHandlerImpl *handler, WindowChainCursor &cursor, EffectWindow *window)
+        : m_cursor(cursor)
+        , m_saved(cursor)
+    {
+        if (cursor.window != window) {
+            const EffectsList &chain = handler->windowChain(window);
+            cursor.window = window;
+            cursor.current = chain.constBegin();
+            cursor.end = chain.constEnd();
+            m_switched = true;
+        }
+        ++handler->m_windowChainStatistics.effectCalls;
+    }
+    ~WindowChainScope()
+    {
+        if (m_switched) {
+            m_cursor = m_saved;
+        }
+    }
+
+private:
+    WindowChainCursor &m_cursor;
+    const WindowChainCursor m_saved;
+    bool m_switched = false;
+};
+
+const EffectsHandlerImpl::EffectsList &EffectsHandlerImpl::windowChain(const EffectWindow *w)
+{
+    ++m_windowChainStatistics.chainDispatches;
+    auto it = m_windowEffects.find(w);
+    if (it == m_windowEffects.end() || it->subscribed.isEmpty()) {
+        m_windowChainStatistics.skippedEffects += m_activeEffects.count() - m_globalWindowEffects.count();
+        return m_globalWindowEffects;
+    }
+    if (it->serial != m_windowChainSerial) {
+        it->chain.clear();
+        for (Effect *effect : qAsConst(m_activeEffects)) {
+            if (!m_windowScopedEffects.contains(effect) || it->subscribed.contains(effect)) {
+                it->chain.append(effect);
+            }
+        }
+        it->serial = m_windowChainSerial;
+    }
+    m_windowChainStatistics.skippedEffects += m_activeEffects.count() - it->chain.count();
+    return it->chain;
+}
+
+void EffectsHandlerImpl::setEffectWindowScoped(Effect *effect, bool scoped)
+{
+    if (scoped) {
+        m_windowScopedEffects.insert(effect);
+    } else if (m_windowScopedEffects.remove(effect)) {
+        for (WindowEffects &windowEffects : m_windowEffects) {
+            windowEffects.subscribed.removeOne(effect);
+        }
+    }
+    ++m_windowChainSerial;
+}
+
+bool EffectsHandlerImpl::isEffectWindowScoped(const Effect *effect) const
+{
+    return m_windowScopedEffects.contains(effect);
+}
+
+void EffectsHandlerImpl::addAffectedWindow(Effect *effect, EffectWindow *w)
+{
+    if (!m_windowScopedEffects.contains(effect)) {
+        return;
+    }
+    auto it = m_windowEffects.find(w);
+    if (it == m_windowEffects.end()) {
+        it = m_windowEffects.insert(w, WindowEffects());
+        connect(w, &QObject::destroyed, this, [this, w] {
+            m_windowEffects.remove(w);
+        });
+    }
+    if (!it->subscribed.contains(effect)) {
+        it->subscribed.append(effect);
+        ++m_windowChainSerial;
+    }
+}
+
+void EffectsHandlerImpl::removeAffectedWindow(Effect *effect, EffectWindow *w)
+{
+    auto it = m_windowEffects.find(w);
+    if (it != m_windowEffects.end() && it->subscribed.removeOne(effect)) {
+        ++m_windowChainSerial;
+    }
+}
+
+EffectsHandlerImpl::WindowChainStatistics EffectsHandlerImpl::windowChainStatistics() const
+{
+    WindowChainStatistics statistics = m_windowChainStatistics;
+    statistics.windowScopedEffects = m_windowScopedEffects.count();
+    statistics.windowsWithOwnChain = std::count_if(m_windowEffects.cbegin(), m_windowEffects.cend(),
+        [](const WindowEffects &windowEffects) {
+            return !windowEffects.subscribed.isEmpty();
+        });
+    return statistics;
+}
+
 // the idea is that effects call this function again which calls the next one
 void EffectsHandlerImpl::prePaintScreen(ScreenPrePaintData& data, std::chrono::milliseconds presentTime)
 {
@@ -422,18 +532,20 @@ void EffectsHandlerImpl::postPaintScreen()
 
 void EffectsHandlerImpl::prePaintWindow(EffectWindow* w, WindowPrePaintData& data, std::chrono::milliseconds presentTime)
 {
-    if (m_currentPaintWindowIterator != m_activeEffects.constEnd()) {
-        (*m_currentPaintWindowIterator++)->prePaintWindow(w, data, presentTime);
-        --m_currentPaintWindowIterator;
+    WindowChainScope scope(this, m_paintWindowCursor, w);
+    if (m_paintWindowCursor.current != m_paintWindowCursor.end) {
+        (*m_paintWindowCursor.current++)->prePaintWindow(w, data, presentTime);
+        --m_paintWindowCursor.current;
     }
     // no special final code
 }
 
 void EffectsHandlerImpl::paintWindow(EffectWindow* w, int mask, const QRegion &region, WindowPaintData& data)
 {
-    if (m_currentPaintWindowIterator != m_activeEffects.constEnd()) {
-        (*m_currentPaintWindowIterator++)->paintWindow(w, mask, region, data);
-        --m_currentPaintWindowIterator;
+    WindowChainScope scope(this, m_paintWindowCursor, w);
+    if (m_paintWindowCursor.current != m_paintWindowCursor.end) {
+        (*m_paintWindowCursor.current++)->paintWindow(w, mask, region, data);
+        --m_paintWindowCursor.current;
     } else
         m_scene->finalPaintWindow(static_cast<EffectWindowImpl*>(w), mask, region, data);
 }
@@ -451,9 +563,10 @@ void EffectsHandlerImpl::paintEffectFrame(EffectFrame* frame, const QRegion &reg
 
 void EffectsHandlerImpl::postPaintWindow(EffectWindow* w)
 {
-    if (m_currentPaintWindowIterator != m_activeEffects.constEnd()) {
-        (*m_currentPaintWindowIterator++)->postPaintWindow(w);
-        --m_currentPaintWindowIterator;
+    WindowChainScope scope(this, m_paintWindowCursor, w);
+    if (m_paintWindowCursor.current != m_paintWindowCursor.end) {
+        (*m_paintWindowCursor.current++)->postPaintWindow(w);
+        --m_paintWindowCursor.current;
     }
     // no special final code
 }
@@ -468,9 +581,10 @@ Effect *EffectsHandlerImpl::provides(Effect::Feature ef)
 
 void EffectsHandlerImpl::drawWindow(EffectWindow* w, int mask, const QRegion &region, WindowPaintData& data)
 {
-    if (m_currentDrawWindowIterator != m_activeEffects.constEnd()) {
-        (*m_currentDrawWindowIterator++)->drawWindow(w, mask, region, data);
-        --m_currentDrawWindowIterator;
+    WindowChainScope scope(this, m_drawWindowCursor, w);
+    if (m_drawWindowCursor.current != m_drawWindowCursor.end) {
+        (*m_drawWindowCursor.current++)->drawWindow(w, mask, region, data);
+        --m_drawWindowCursor.current;
     } else
         m_scene->finalDrawWindow(static_cast<EffectWindowImpl*>(w), mask, region, data);
 }
@@ -508,15 +622,30 @@ bool EffectsHandlerImpl::decorationSupportsBlurBehind() const
 // start another painting pass
 void EffectsHandlerImpl::startPaint()
 {
-    m_activeEffects.clear();
-    m_activeEffects.reserve(loaded_effects.count());
+    EffectsList activeEffects;
+    activeEffects.reserve(loaded_effects.count());
     for(QVector< KWin::EffectPair >::const_iterator it = loaded_effects.constBegin(); it != loaded_effects.constEnd(); ++it) {
         if (it->second->isActive()) {
-            m_activeEffects << it->second;
+            activeEffects << it->second;
         }
     }
-    m_currentDrawWindowIterator = m_activeEffects.constBegin();
-    m_currentPaintWindowIterator = m_activeEffects.constBegin();
+    // The per-window chains only have to be rebuilt if the set of active effects changed.
+    if (activeEffects != m_activeEffects) {
+        m_activeEffects = activeEffects;
+        ++m_windowChainSerial;
+    }
+    if (m_windowScopedEffects.isEmpty()) {
+        m_globalWindowEffects = m_activeEffects;
+    } else {
+        m_globalWindowEffects.clear();
+        for (Effect *effect : qAsConst(m_activeEffects)) {
+            if (!m_windowScopedEffects.contains(effect)) {
+                m_globalWindowEffects << effect;
+            }
+        }
+    }
+    m_drawWindowCursor = WindowChainCursor();
+    m_paintWindowCursor = WindowChainCursor();
     m_currentPaintScreenIterator = m_activeEffects.constBegin();
     m_currentPaintEffectFrameIterator = m_activeEffects.constBegin();
 }
@@ -1081,11 +1210,8 @@ EffectWindow *EffectsHandlerImpl::findWindow(QWindow *w) const
 
 EffectWindow *EffectsHandlerImpl::findWindow(const QUuid &id) const
 {
-    if (const auto client = workspace()->findAbstractClient([&id] (const AbstractClient *c) { return c->internalId() == id; })) {
-        return client->effectWindow();
-    }
-    if (const auto unmanaged = workspace()->findUnmanaged([&id] (const Unmanaged *c) { return c->internalId() == id; })) {
-        return unmanaged->effectWindow();
+    if (Toplevel *toplevel = workspace()->findToplevel(id)) {
+        return toplevel->effectWindow();
     }
     return nullptr;
 }
@@ -1419,6 +1545,7 @@ void EffectsHandlerImpl::destroyEffect(Effect *effect)
     }
 
     stopMouseInterception(effect);
+    setEffectWindowScoped(effect, false);
 
     const QList<QByteArray> properties = m_propertiesForEffects.keys();
     for (const QByteArray &property : properties) {
@@ -1492,6 +1619,8 @@ void EffectsHandlerImpl::effectsChanged()
 {
     loaded_effects.clear();
     m_activeEffects.clear(); // it's possible to have a reconfigure and a quad rebuild between two paint cycles - bug #308201
+    m_globalWindowEffects.clear();
+    ++m_windowChainSerial;
 
     loaded_effects.reserve(effect_order.count());
     std::copy(effect_order.constBegin(), effect_order.constEnd(),
@@ -1802,11 +1931,6 @@ EffectWindowImpl::EffectWindowImpl(Toplevel *toplevel)
 
 EffectWindowImpl::~EffectWindowImpl()
 {
-    QVariant cachedTextureVariant = data(LanczosCacheRole);
-    if (cachedTextureVariant.isValid()) {
-        GLTexture *cachedTexture = static_cast< GLTexture*>(cachedTextureVariant.value<void*>());
-        delete cachedTexture;
-    }
 }
 
 bool EffectWindowImpl::isPaintingEnabled()
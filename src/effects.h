@@ -16,6 +16,7 @@
 #include "scene.h"
 
 #include <QHash>
+#include <QSet>
 #include <Plasma/FrameSvg>
 
 #include <memory>
@@ -272,6 +273,32 @@ public:
     EffectScreen *findScreen(const QString &name) const override;
     EffectScreen *findScreen(int screenId) const override;
 
+    void setEffectWindowScoped(Effect *effect, bool scoped) override;
+    bool isEffectWindowScoped(const Effect *effect) const override;
+    void addAffectedWindow(Effect *effect, EffectWindow *w) override;
+    void removeAffectedWindow(Effect *effect, EffectWindow *w) override;
+
+    /**
+     * Counters of the window paint chains, shown in the debug console.
+     */
+    struct WindowChainStatistics {
+        int windowScopedEffects = 0;
+        int windowsWithOwnChain = 0;
+        /**
+         * Number of times a window paint chain has been entered.
+         */
+        quint64 chainDispatches = 0;
+        /**
+         * Number of calls through window paint chains, including the final calls into the scene.
+         */
+        quint64 effectCalls = 0;
+        /**
+         * Number of active effects that were left out of a window paint chain.
+         */
+        quint64 skippedEffects = 0;
+    };
+    WindowChainStatistics windowChainStatistics() const;
+
 public Q_SLOTS:
     void slotCurrentTabAboutToChange(EffectWindow* from, EffectWindow* to);
     void slotTabAdded(EffectWindow* from, EffectWindow* to);
@@ -345,9 +372,36 @@ private:
 
     typedef QVector< Effect*> EffectsList;
     typedef EffectsList::const_iterator EffectsIterator;
+
+    /**
+     * Position in the paint chain of the window that is currently being painted.
+     */
+    struct WindowChainCursor {
+        const EffectWindow *window = nullptr;
+        EffectsIterator current;
+        EffectsIterator end;
+    };
+    class WindowChainScope;
+
+    /**
+     * The effects subscribed to a window by window scoped effects, and the resulting chain.
+     */
+    struct WindowEffects {
+        EffectsList subscribed;
+        EffectsList chain;
+        quint64 serial = 0;
+    };
+
+    const EffectsList &windowChain(const EffectWindow *w);
+
     EffectsList m_activeEffects;
-    EffectsIterator m_currentDrawWindowIterator;
-    EffectsIterator m_currentPaintWindowIterator;
+    EffectsList m_globalWindowEffects;
+    QSet<const Effect *> m_windowScopedEffects;
+    QHash<const EffectWindow *, WindowEffects> m_windowEffects;
+    quint64 m_windowChainSerial = 0;
+    WindowChainStatistics m_windowChainStatistics;
+    WindowChainCursor m_drawWindowCursor;
+    WindowChainCursor m_paintWindowCursor;
     EffectsIterator m_currentPaintEffectFrameIterator;
     EffectsIterator m_currentPaintScreenIterator;
     EffectsIterator m_currentBuildQuadsIterator;
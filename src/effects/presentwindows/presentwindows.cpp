@@ -9,6 +9,7 @@
 */
 
 #include "presentwindows.h"
+#include "presentwindowslayout.h"
 //KConfigSkeleton
 #include "presentwindowsconfig.h"
 #include <QAction>
@@ -27,7 +28,10 @@
 #include <QQuickItem>
 #include <QQuickView>
 #include <QGraphicsObject>
+#include <QFutureWatcher>
+#include <QPointer>
 #include <QTimer>
+#include <QtConcurrentRun>
 #include <QVector2D>
 #include <QVector4D>
 
@@ -1028,6 +1032,11 @@ void PresentWindowsEffect::rearrangeWindows()
         calculateWindowTransformations(windows, screen, m_motionManager);
     }
 
+    updateTextFrames();
+}
+
+void PresentWindowsEffect::updateTextFrames()
+{
     // Resize text frames if required
     QFontMetrics* metrics = nullptr; // All fonts are the same
     foreach (EffectWindow * w, m_motionManager.managedWindows()) {
@@ -1061,11 +1070,17 @@ void PresentWindowsEffect::calculateWindowTransformations(EffectWindowList windo
         m_windowData.clear();
 }
 
-static inline int distance(QPoint &pos1, QPoint &pos2)
+// From this many windows on the natural layout is computed in a thread
+static const int s_asynchronousLayoutWindows = 20;
+
+static QVector<QRect> windowGeometries(const EffectWindowList &windowlist)
 {
-    const int xdiff = pos1.x() - pos2.x();
-    const int ydiff = pos1.y() - pos2.y();
-    return int(sqrt(float(xdiff*xdiff + ydiff*ydiff)));
+    QVector<QRect> geometries;
+    geometries.reserve(windowlist.count());
+    for (EffectWindow *w : windowlist) {
+        geometries.append(w->geometry());
+    }
+    return geometries;
 }
 
 void PresentWindowsEffect::calculateWindowTransformationsClosest(EffectWindowList windowlist, int screen,
@@ -1078,8 +1093,9 @@ void PresentWindowsEffect::calculateWindowTransformationsClosest(EffectWindowLis
     QRect area = effects->clientArea(ScreenArea, screen, effects->currentDesktop());
     if (m_showPanel)   // reserve space for the panel
         area = effects->clientArea(MaximizeArea, screen, effects->currentDesktop());
-    int columns = int(ceil(sqrt(double(windowlist.count()))));
-    int rows = int(ceil(windowlist.count() / double(columns)));
+
+    int columns, rows;
+    const QVector<QRect> targets = PresentWindowsLayout(windowGeometries(windowlist), area).closest(&columns, &rows);
 
     // Remember the size for later
     // If we are using this layout externally we don't need to remember m_gridSizes.
@@ -1088,83 +1104,8 @@ void PresentWindowsEffect::calculateWindowTransformationsClosest(EffectWindowLis
         m_gridSizes[screen].rows = rows;
     }
 
-    // Assign slots
-    int slotWidth = area.width() / columns;
-    int slotHeight = area.height() / rows;
-    QVector<EffectWindow*> takenSlots;
-    takenSlots.resize(rows*columns);
-    takenSlots.fill(0);
-
-    // precalculate all slot centers
-    QVector<QPoint> slotCenters;
-    slotCenters.resize(rows*columns);
-    for (int x = 0; x < columns; ++x)
-        for (int y = 0; y < rows; ++y) {
-            slotCenters[x + y*columns] = QPoint(area.x() + slotWidth * x + slotWidth / 2,
-                                                area.y() + slotHeight * y + slotHeight / 2);
-        }
-
-    // Assign each window to the closest available slot
-    EffectWindowList tmpList = windowlist; // use a QLinkedList copy instead?
-    QPoint otherPos;
-    while (!tmpList.isEmpty()) {
-        EffectWindow *w = tmpList.first();
-        int slotCandidate = -1, slotCandidateDistance = INT_MAX;
-        QPoint pos = w->geometry().center();
-
-        for (int i = 0; i < columns*rows; ++i) { // all slots
-            const int dist = distance(pos, slotCenters[i]);
-            if (dist < slotCandidateDistance) { // window is interested in this slot
-                EffectWindow *occupier = takenSlots[i];
-                Q_ASSERT(occupier != w);
-                if (!occupier || dist < distance((otherPos = occupier->geometry().center()), slotCenters[i])) {
-                    // either nobody lives here, or we're better - takeover the slot if it's our best
-                    slotCandidate = i;
-                    slotCandidateDistance = dist;
-                }
-            }
-        }
-        Q_ASSERT(slotCandidate != -1);
-        if (takenSlots[slotCandidate])
-            tmpList << takenSlots[slotCandidate]; // occupier needs a new home now :p
-        tmpList.removeAll(w);
-        takenSlots[slotCandidate] = w; // ...and we rumble in =)
-    }
-
-    for (int slot = 0; slot < columns*rows; ++slot) {
-        EffectWindow *w = takenSlots[slot];
-        if (!w) // some slots might be empty
-            continue;
-
-        // Work out where the slot is
-        QRect target(
-            area.x() + (slot % columns) * slotWidth,
-            area.y() + (slot / columns) * slotHeight,
-            slotWidth, slotHeight);
-        target.adjust(10, 10, -10, -10);   // Borders
-
-        double scale;
-        if (target.width() / double(w->width()) < target.height() / double(w->height())) {
-            // Center vertically
-            scale = target.width() / double(w->width());
-            target.moveTop(target.top() + (target.height() - int(w->height() * scale)) / 2);
-            target.setHeight(int(w->height() * scale));
-        } else {
-            // Center horizontally
-            scale = target.height() / double(w->height());
-            target.moveLeft(target.left() + (target.width() - int(w->width() * scale)) / 2);
-            target.setWidth(int(w->width() * scale));
-        }
-        // Don't scale the windows too much
-        if (scale > 2.0 || (scale > 1.0 && (w->width() > 300 || w->height() > 300))) {
-            scale = (w->width() > 300 || w->height() > 300) ? 1.0 : 2.0;
-            target = QRect(
-                         target.center().x() - int(w->width() * scale) / 2,
-                         target.center().y() - int(w->height() * scale) / 2,
-                         scale * w->width(), scale * w->height());
-        }
-        motionManager.moveWindow(w, target);
-    }
+    for (int i = 0; i < windowlist.count(); ++i)
+        motionManager.moveWindow(windowlist[i], targets[i]);
 }
 
 void PresentWindowsEffect::calculateWindowTransformationsKompose(EffectWindowList windowlist, int screen,
@@ -1179,128 +1120,9 @@ void PresentWindowsEffect::calculateWindowTransformationsKompose(EffectWindowLis
         availRect = effects->clientArea(MaximizeArea, screen, effects->currentDesktop());
     std::sort(windowlist.begin(), windowlist.end());   // The location of the windows should not depend on the stacking order
 
-    // Following code is taken from Kompose 0.5.4, src/komposelayout.cpp
-    int spacing = 10;
-    int rows, columns;
-    double parentRatio = availRect.width() / (double)availRect.height();
-    // Use more columns than rows when parent's width > parent's height
-    if (parentRatio > 1) {
-        columns = (int)ceil(sqrt((double)windowlist.count()));
-        rows = (int)ceil((double)windowlist.count() / (double)columns);
-    } else {
-        rows = (int)ceil(sqrt((double)windowlist.count()));
-        columns = (int)ceil((double)windowlist.count() / (double)rows);
-    }
-    //qCDebug(KWINEFFECTS) << "Using " << rows << " rows & " << columns << " columns for " << windowlist.count() << " clients";
-
-    // Calculate width & height
-    int w = (availRect.width() - (columns + 1) * spacing) / columns;
-    int h = (availRect.height() - (rows + 1) * spacing) / rows;
-
-    EffectWindowList::iterator it(windowlist.begin());
-    QList<QRect> geometryRects;
-    QList<int> maxRowHeights;
-    // Process rows
-    for (int i = 0; i < rows; ++i) {
-        int xOffsetFromLastCol = 0;
-        int maxHeightInRow = 0;
-        // Process columns
-        for (int j = 0; j < columns; ++j) {
-            EffectWindow* window;
-
-            // Check for end of List
-            if (it == windowlist.end())
-                break;
-            window = *it;
-
-            // Calculate width and height of widget
-            double ratio = aspectRatio(window);
-
-            int widgetw = 100;
-            int widgeth = 100;
-            int usableW = w;
-            int usableH = h;
-
-            // use width of two boxes if there is no right neighbour
-            if (window == windowlist.last() && j != columns - 1) {
-                usableW = 2 * w;
-            }
-            ++it; // We need access to the neighbour in the following
-            // expand if right neighbour has ratio < 1
-            if (j != columns - 1 && it != windowlist.end() && aspectRatio(*it) < 1) {
-                int addW = w - widthForHeight(*it, h);
-                if (addW > 0) {
-                    usableW = w + addW;
-                }
-            }
-
-            if (ratio == -1) {
-                widgetw = w;
-                widgeth = h;
-            } else {
-                double widthByHeight = widthForHeight(window, usableH);
-                double heightByWidth = heightForWidth(window, usableW);
-                if ((ratio >= 1.0 && heightByWidth <= usableH) ||
-                        (ratio < 1.0 && widthByHeight > usableW)) {
-                    widgetw = usableW;
-                    widgeth = (int)heightByWidth;
-                } else if ((ratio < 1.0 && widthByHeight <= usableW) ||
-                          (ratio >= 1.0 && heightByWidth > usableH)) {
-                    widgeth = usableH;
-                    widgetw = (int)widthByHeight;
-                }
-                // Don't upscale large-ish windows
-                if (widgetw > window->width() && (window->width() > 300 || window->height() > 300)) {
-                    widgetw = window->width();
-                    widgeth = window->height();
-                }
-            }
-
-            // Set the Widget's size
-
-            int alignmentXoffset = 0;
-            int alignmentYoffset = 0;
-            if (i == 0 && h > widgeth)
-                alignmentYoffset = h - widgeth;
-            if (j == 0 && w > widgetw)
-                alignmentXoffset = w - widgetw;
-            QRect geom(availRect.x() + j *(w + spacing) + spacing + alignmentXoffset + xOffsetFromLastCol,
-                       availRect.y() + i *(h + spacing) + spacing + alignmentYoffset,
-                       widgetw, widgeth);
-            geometryRects.append(geom);
-
-            // Set the x offset for the next column
-            if (alignmentXoffset == 0)
-                xOffsetFromLastCol += widgetw - w;
-            if (maxHeightInRow < widgeth)
-                maxHeightInRow = widgeth;
-        }
-        maxRowHeights.append(maxHeightInRow);
-    }
-
-    int topOffset = 0;
-    for (int i = 0; i < rows; i++) {
-        for (int j = 0; j < columns; j++) {
-            int pos = i * columns + j;
-            if (pos >= windowlist.count())
-                break;
-
-            EffectWindow* window = windowlist[pos];
-            QRect target = geometryRects[pos];
-            target.setY(target.y() + topOffset);
-            // @Marrtin: any idea what this is good for?
-//             DataHash::iterator winData = m_windowData.find(window);
-//             if (winData != m_windowData.end())
-//                 winData->slot = pos;
-            motionManager.moveWindow(window, target);
-
-            //qCDebug(KWINEFFECTS) << "Window '" << window->caption() << "' gets moved to (" <<
-            //        mWindowData[window].area.left() << "; " << mWindowData[window].area.right() <<
-            //        "), scale: " << mWindowData[window].scale << endl;
-        }
-        if (maxRowHeights[i] - h > 0)
-            topOffset += maxRowHeights[i] - h;
-    }
+    const QVector<QRect> targets = PresentWindowsLayout(windowGeometries(windowlist), availRect).kompose();
+    for (int i = 0; i < windowlist.count(); ++i)
+        motionManager.moveWindow(windowlist[i], targets[i]);
 }
 
 void PresentWindowsEffect::calculateWindowTransformationsNatural(EffectWindowList windowlist, int screen,
@@ -1328,242 +1150,53 @@ void PresentWindowsEffect::calculateWindowTransformationsNatural(EffectWindowLis
     QRect area = effects->clientArea(ScreenArea, screen, effects->currentDesktop());
     if (m_showPanel)   // reserve space for the panel
         area = effects->clientArea(MaximizeArea, screen, effects->currentDesktop());
-    QRect bounds = area;
-    int direction = 0;
-    QHash<EffectWindow*, QRect> targets;
-    QHash<EffectWindow*, int> directions;
-    foreach (EffectWindow * w, windowlist) {
-        bounds = bounds.united(w->geometry());
-        targets[w] = w->geometry();
-        // Reuse the unused "slot" as a preferred direction attribute. This is used when the window
-        // is on the edge of the screen to try to use as much screen real estate as possible.
-        directions[w] = direction;
-        direction++;
-        if (direction == 4)
-            direction = 0;
-    }
-
-    // Iterate over all windows, if two overlap push them apart _slightly_ as we try to
-    // brute-force the most optimal positions over many iterations.
-    bool overlap;
-    do {
-        overlap = false;
-        foreach (EffectWindow * w, windowlist) {
-            QRect *target_w = &targets[w];
-            foreach (EffectWindow * e, windowlist) {
-                if (w == e)
-                    continue;
-
-                QRect *target_e = &targets[e];
-                if (target_w->adjusted(-5, -5, 5, 5).intersects(target_e->adjusted(-5, -5, 5, 5))) {
-                    overlap = true;
-
-                    // Determine pushing direction
-                    QPoint diff(target_e->center() - target_w->center());
-                    // Prevent dividing by zero and non-movement
-                    if (diff.x() == 0 && diff.y() == 0)
-                        diff.setX(1);
-                    // Try to keep screen aspect ratio
-                    //if (bounds.height() / bounds.width() > area.height() / area.width())
-                    //    diff.setY(diff.y() / 2);
-                    //else
-                    //    diff.setX(diff.x() / 2);
-                    // Approximate a vector of between 10px and 20px in magnitude in the same direction
-                    diff *= m_accuracy / double(diff.manhattanLength());
-                    // Move both windows apart
-                    target_w->translate(-diff);
-                    target_e->translate(diff);
-
-                    // Try to keep the bounding rect the same aspect as the screen so that more
-                    // screen real estate is utilised. We do this by splitting the screen into nine
-                    // equal sections, if the window center is in any of the corner sections pull the
-                    // window towards the outer corner. If it is in any of the other edge sections
-                    // alternate between each corner on that edge. We don't want to determine it
-                    // randomly as it will not produce consistant locations when using the filter.
-                    // Only move one window so we don't cause large amounts of unnecessary zooming
-                    // in some situations. We need to do this even when expanding later just in case
-                    // all windows are the same size.
-                    // (We are using an old bounding rect for this, hopefully it doesn't matter)
-                    int xSection = (target_w->x() - bounds.x()) / (bounds.width() / 3);
-                    int ySection = (target_w->y() - bounds.y()) / (bounds.height() / 3);
-                    diff = QPoint(0, 0);
-                    if (xSection != 1 || ySection != 1) { // Remove this if you want the center to pull as well
-                        if (xSection == 1)
-                            xSection = (directions[w] / 2 ? 2 : 0);
-                        if (ySection == 1)
-                            ySection = (directions[w] % 2 ? 2 : 0);
-                    }
-                    if (xSection == 0 && ySection == 0)
-                        diff = QPoint(bounds.topLeft() - target_w->center());
-                    if (xSection == 2 && ySection == 0)
-                        diff = QPoint(bounds.topRight() - target_w->center());
-                    if (xSection == 2 && ySection == 2)
-                        diff = QPoint(bounds.bottomRight() - target_w->center());
-                    if (xSection == 0 && ySection == 2)
-                        diff = QPoint(bounds.bottomLeft() - target_w->center());
-                    if (diff.x() != 0 || diff.y() != 0) {
-                        diff *= m_accuracy / double(diff.manhattanLength());
-                        target_w->translate(diff);
-                    }
-
-                    // Update bounding rect
-                    bounds = bounds.united(*target_w);
-                    bounds = bounds.united(*target_e);
-                }
-            }
-        }
-    } while (overlap);
-
-    // Work out scaling by getting the most top-left and most bottom-right window coords.
-    // The 20's and 10's are so that the windows don't touch the edge of the screen.
-    double scale;
-    if (bounds == area)
-        scale = 1.0; // Don't add borders to the screen
-    else if (area.width() / double(bounds.width()) < area.height() / double(bounds.height()))
-        scale = (area.width() - 20) / double(bounds.width());
-    else
-        scale = (area.height() - 20) / double(bounds.height());
-    // Make bounding rect fill the screen size for later steps
-    bounds = QRect(
-                 (bounds.x() * scale - (area.width() - 20 - bounds.width() * scale) / 2 - 10) / scale,
-                 (bounds.y() * scale - (area.height() - 20 - bounds.height() * scale) / 2 - 10) / scale,
-                 area.width() / scale,
-                 area.height() / scale
-             );
-
-    // Move all windows back onto the screen and set their scale
-    QHash<EffectWindow*, QRect>::iterator target = targets.begin();
-    while (target != targets.end()) {
-        target->setRect((target->x() - bounds.x()) * scale + area.x(),
-                        (target->y() - bounds.y()) * scale + area.y(),
-                        target->width() * scale,
-                        target->height() * scale
-                        );
-        ++target;
-    }
-
-    // Try to fill the gaps by enlarging windows if they have the space
-    if (m_fillGaps) {
-        // Don't expand onto or over the border
-        QRegion borderRegion(area.adjusted(-200, -200, 200, 200));
-        borderRegion ^= area.adjusted(10 / scale, 10 / scale, -10 / scale, -10 / scale);
-
-        bool moved;
-        do {
-            moved = false;
-            foreach (EffectWindow * w, windowlist) {
-                QRect oldRect;
-                QRect *target = &targets[w];
-                // This may cause some slight distortion if the windows are enlarged a large amount
-                int widthDiff = m_accuracy;
-                int heightDiff = heightForWidth(w, target->width() + widthDiff) - target->height();
-                int xDiff = widthDiff / 2;  // Also move a bit in the direction of the enlarge, allows the
-                int yDiff = heightDiff / 2; // center windows to be enlarged if there is gaps on the side.
-
-                // heightDiff (and yDiff) will be re-computed after each successful enlargement attempt
-                // so that the error introduced in the window's aspect ratio is minimized
-
-                // Attempt enlarging to the top-right
-                oldRect = *target;
-                target->setRect(target->x() + xDiff,
-                                target->y() - yDiff - heightDiff,
-                                target->width() + widthDiff,
-                                target->height() + heightDiff
-                                );
-                if (isOverlappingAny(w, targets, borderRegion))
-                    *target = oldRect;
-                else {
-                    moved = true;
-                    heightDiff = heightForWidth(w, target->width() + widthDiff) - target->height();
-                    yDiff = heightDiff / 2;
-                }
-
-                // Attempt enlarging to the bottom-right
-                oldRect = *target;
-                target->setRect(
-                                 target->x() + xDiff,
-                                 target->y() + yDiff,
-                                 target->width() + widthDiff,
-                                 target->height() + heightDiff
-                             );
-                if (isOverlappingAny(w, targets, borderRegion))
-                    *target = oldRect;
-                else {
-                    moved = true;
-                    heightDiff = heightForWidth(w, target->width() + widthDiff) - target->height();
-                    yDiff = heightDiff / 2;
-                }
-
-                // Attempt enlarging to the bottom-left
-                oldRect = *target;
-                target->setRect(
-                                 target->x() - xDiff - widthDiff,
-                                 target->y() + yDiff,
-                                 target->width() + widthDiff,
-                                 target->height() + heightDiff
-                             );
-                if (isOverlappingAny(w, targets, borderRegion))
-                    *target = oldRect;
-                else {
-                    moved = true;
-                    heightDiff = heightForWidth(w, target->width() + widthDiff) - target->height();
-                    yDiff = heightDiff / 2;
-                }
 
-                // Attempt enlarging to the top-left
-                oldRect = *target;
-                target->setRect(
-                                 target->x() - xDiff - widthDiff,
-                                 target->y() - yDiff - heightDiff,
-                                 target->width() + widthDiff,
-                                 target->height() + heightDiff
-                             );
-                if (isOverlappingAny(w, targets, borderRegion))
-                    *target = oldRect;
-                else
-                    moved = true;
-            }
-        } while (moved);
-
-        // The expanding code above can actually enlarge windows over 1.0/2.0 scale, we don't like this
-        // We can't add this to the loop above as it would cause a never-ending loop so we have to make
-        // do with the less-than-optimal space usage with using this method.
-        foreach (EffectWindow * w, windowlist) {
-            QRect *target = &targets[w];
-            double scale = target->width() / double(w->width());
-            if (scale > 2.0 || (scale > 1.0 && (w->width() > 300 || w->height() > 300))) {
-                scale = (w->width() > 300 || w->height() > 300) ? 1.0 : 2.0;
-                target->setRect(
-                                 target->center().x() - int(w->width() * scale) / 2,
-                                 target->center().y() - int(w->height() * scale) / 2,
-                                 w->width() * scale,
-                                 w->height() * scale);
-            }
-        }
+    PresentWindowsLayout layout(windowGeometries(windowlist), area);
+    layout.setAccuracy(m_accuracy);
+    layout.setFillGaps(m_fillGaps);
+
+    // Layouts for another motion manager are expected to be done when this returns
+    if (&motionManager != &m_motionManager || windowlist.count() < s_asynchronousLayoutWindows) {
+        if (&motionManager == &m_motionManager)
+            m_layoutSerials[screen] = ++m_lastLayoutSerial; // a layout still computed in a thread is outdated
+        const QVector<QRect> targets = layout.natural();
+        for (int i = 0; i < windowlist.count(); ++i)
+            motionManager.moveWindow(windowlist[i], targets[i]);
+        return;
     }
 
-    // Notify the motion manager of the targets
-    foreach (EffectWindow * w, windowlist)
-        motionManager.moveWindow(w, targets.value(w));
-}
-
-bool PresentWindowsEffect::isOverlappingAny(EffectWindow *w, const QHash<EffectWindow*, QRect> &targets, const QRegion &border)
-{
-    QHash<EffectWindow*, QRect>::const_iterator winTarget = targets.find(w);
-    if (winTarget == targets.constEnd())
-        return false;
-    if (border.intersects(*winTarget))
-        return true;
-
-    // Is there a better way to do this?
-    QHash<EffectWindow*, QRect>::const_iterator target;
-    for (target = targets.constBegin(); target != targets.constEnd(); ++target) {
-        if (target == winTarget)
-            continue;
-        if (winTarget->adjusted(-5, -5, 5, 5).intersects(target->adjusted(-5, -5, 5, 5)))
-            return true;
+    // Many windows take a while to push apart, do it in a thread. When the windows have not
+    // been arranged yet, they start moving towards the grid layout meanwhile.
+    if (!m_layoutSerials.contains(screen)) {
+        const QVector<QRect> targets = layout.closest();
+        for (int i = 0; i < windowlist.count(); ++i)
+            motionManager.moveWindow(windowlist[i], targets[i]);
     }
-    return false;
+    const quint64 serial = ++m_lastLayoutSerial;
+    m_layoutSerials[screen] = serial;
+    // A window may be destroyed while the layout is computed, and another one may get its address
+    QVector<QPointer<EffectWindow>> windows;
+    windows.reserve(windowlist.count());
+    for (EffectWindow *w : qAsConst(windowlist))
+        windows.append(w);
+    QFutureWatcher<QVector<QRect>> *watcher = new QFutureWatcher<QVector<QRect>>(this);
+    connect(watcher, &QFutureWatcher<QVector<QRect>>::finished, this, [this, watcher, windows, screen, serial]() {
+        watcher->deleteLater();
+        // Another layout has been started meanwhile
+        if (!m_activated || m_layoutSerials.value(screen) != serial)
+            return;
+        const QVector<QRect> targets = watcher->result();
+        for (int i = 0; i < windows.count(); ++i) {
+            EffectWindow *w = windows[i];
+            if (w && m_motionManager.isManaging(w))
+                m_motionManager.moveWindow(w, targets[i]);
+        }
+        updateTextFrames();
+        effects->addRepaintFull();
+    });
+    watcher->setFuture(QtConcurrent::run([layout]() {
+        return layout.natural();
+    }));
 }
 
 //-----------------------------------------------------------------------------
@@ -1578,6 +1211,7 @@ void PresentWindowsEffect::setActive(bool active)
 
     m_activated = active;
     if (m_activated) {
+        m_layoutSerials.clear();
         effects->setShowingDesktop(false);
         m_needInitialSelection = true;
         m_closeButtonCorner = (Qt::Corner)effects->kwinOption(KWin::CloseButtonCorner).toInt();
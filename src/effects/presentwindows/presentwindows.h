@@ -223,17 +223,7 @@ protected:
     void calculateWindowTransformationsNatural(EffectWindowList windowlist, int screen,
             WindowMotionManager& motionManager);
 
-    // Helper functions for window rearranging
-    inline double aspectRatio(EffectWindow *w) {
-        return w->width() / double(w->height());
-    }
-    inline int widthForHeight(EffectWindow *w, int height) {
-        return int((height / double(w->height())) * w->width());
-    }
-    inline int heightForWidth(EffectWindow *w, int width) {
-        return int((width / double(w->width())) * w->height());
-    }
-    bool isOverlappingAny(EffectWindow *w, const QHash<EffectWindow*, QRect> &targets, const QRegion &border);
+    void updateTextFrames();
 
     // Filter box
     void updateFilterFrame();
@@ -291,6 +281,11 @@ private:
     // Grid layout info
     QList<GridSize> m_gridSizes;
 
+    // Natural layouts computed in a thread, by screen. Only the result of the latest is used.
+    // The serials are never reused, a layout from a previous activation never matches.
+    QHash<int, quint64> m_layoutSerials;
+    quint64 m_lastLayoutSerial = 0;
+
     // Filter box
     EffectFrame* m_filterFrame;
     QString m_windowFilter;
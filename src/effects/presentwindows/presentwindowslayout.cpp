@@ -0,0 +1,724 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2007 Rivo Laks <rivolaks@hot.ee>
+    SPDX-FileCopyrightText: 2008 Lucas Murray <lmurray@undefinedfire.com>
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "presentwindowslayout.h"
+
+#include <QRegion>
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <numeric>
+
+namespace KWin
+{
+
+namespace
+{
+
+/**
+ * A uniform grid over rectangles that finds the rectangles which might intersect a given
+ * one without looking at all of them.
+ */
+class RectGrid
+{
+public:
+    void build(const QVector<QRect> &rects, int margin);
+    /**
+     * Stores the indices of the rectangles sharing a cell with @a rect in ascending order.
+     */
+    void query(const QRect &rect, QVector<int> &result);
+
+private:
+    void cellRange(const QRect &rect, int *left, int *top, int *right, int *bottom) const;
+
+    // the cells have at least the average size of the rectangles, but there are no more
+    // cells per direction than this
+    static const int s_maximumCells = 64;
+
+    QRect m_extent;
+    int m_cellWidth = 1;
+    int m_cellHeight = 1;
+    int m_columns = 1;
+    int m_rows = 1;
+    // the entries of cell i are m_entries[m_cellStart[i]] to m_entries[m_cellStart[i + 1] - 1]
+    QVector<int> m_cellStart;
+    QVector<int> m_entries;
+    QVector<int> m_stamps;
+    int m_stamp = 0;
+};
+
+void RectGrid::build(const QVector<QRect> &rects, int margin)
+{
+    m_extent = QRect();
+    qint64 size = 0;
+    for (const QRect &rect : rects) {
+        m_extent |= rect.adjusted(-margin, -margin, margin, margin);
+        size += rect.width() + rect.height() + 4 * margin;
+    }
+    const int averageSize = rects.isEmpty() ? 1 : qMax<qint64>(1, size / (2 * rects.count()));
+    m_cellWidth = qMax(averageSize, m_extent.width() / s_maximumCells + 1);
+    m_cellHeight = qMax(averageSize, m_extent.height() / s_maximumCells + 1);
+    m_columns = m_extent.width() / m_cellWidth + 1;
+    m_rows = m_extent.height() / m_cellHeight + 1;
+
+    // count the entries of every cell, then place them
+    m_cellStart.fill(0, m_columns * m_rows + 1);
+    for (const QRect &rect : rects) {
+        int left, top, right, bottom;
+        cellRange(rect.adjusted(-margin, -margin, margin, margin), &left, &top, &right, &bottom);
+        for (int y = top; y <= bottom; ++y) {
+            for (int x = left; x <= right; ++x) {
+                m_cellStart[y * m_columns + x + 1]++;
+            }
+        }
+    }
+    for (int i = 1; i < m_cellStart.count(); ++i) {
+        m_cellStart[i] += m_cellStart[i - 1];
+    }
+    m_entries.resize(m_cellStart.last());
+    QVector<int> fill = m_cellStart;
+    for (int i = 0; i < rects.count(); ++i) {
+        int left, top, right, bottom;
+        cellRange(rects[i].adjusted(-margin, -margin, margin, margin), &left, &top, &right, &bottom);
+        for (int y = top; y <= bottom; ++y) {
+            for (int x = left; x <= right; ++x) {
+                m_entries[fill[y * m_columns + x]++] = i;
+            }
+        }
+    }
+    m_stamps.fill(0, rects.count());
+    m_stamp = 0;
+}
+
+void RectGrid::cellRange(const QRect &rect, int *left, int *top, int *right, int *bottom) const
+{
+    *left = qBound(0, (rect.left() - m_extent.left()) / m_cellWidth, m_columns - 1);
+    *right = qBound(0, (rect.right() - m_extent.left()) / m_cellWidth, m_columns - 1);
+    *top = qBound(0, (rect.top() - m_extent.top()) / m_cellHeight, m_rows - 1);
+    *bottom = qBound(0, (rect.bottom() - m_extent.top()) / m_cellHeight, m_rows - 1);
+}
+
+void RectGrid::query(const QRect &rect, QVector<int> &result)
+{
+    result.clear();
+    ++m_stamp;
+    int left, top, right, bottom;
+    cellRange(rect, &left, &top, &right, &bottom);
+    for (int y = top; y <= bottom; ++y) {
+        for (int x = left; x <= right; ++x) {
+            const int cell = y * m_columns + x;
+            for (int i = m_cellStart[cell]; i < m_cellStart[cell + 1]; ++i) {
+                const int entry = m_entries[i];
+                if (m_stamps[entry] != m_stamp) {
+                    m_stamps[entry] = m_stamp;
+                    result.append(entry);
+                }
+            }
+        }
+    }
+    std::sort(result.begin(), result.end());
+}
+
+/**
+ * A uniform grid over rectangles that can move one at a time. Unlike RectGrid, it doesn't
+ * have to be rebuilt when a rectangle changes, but queries don't return the rectangles in
+ * a defined order.
+ */
+class RectBuckets
+{
+public:
+    RectBuckets(const QVector<QRect> &rects, int margin);
+
+    /**
+     * Moves the rectangle @a index, which was @a from, to @a to.
+     */
+    void move(int index, const QRect &from, const QRect &to);
+    /**
+     * Returns whether any rectangle other than @a except intersects @a rect, after both
+     * have been enlarged by the margin.
+     */
+    bool intersectsAny(const QRect &rect, int except) const;
+
+private:
+    void cellRange(const QRect &rect, int *left, int *top, int *right, int *bottom) const;
+
+    static const int s_maximumCells = 64;
+
+    const QVector<QRect> &m_rects;
+    int m_margin;
+    QRect m_extent;
+    int m_cellWidth = 1;
+    int m_cellHeight = 1;
+    int m_columns = 1;
+    int m_rows = 1;
+    QVector<QVector<int>> m_cells;
+};
+
+RectBuckets::RectBuckets(const QVector<QRect> &rects, int margin)
+    : m_rects(rects)
+    , m_margin(margin)
+{
+    // Rectangles that leave the extent later end up in the cells at its edges.
+    qint64 size = 0;
+    for (const QRect &rect : rects) {
+        m_extent |= rect.adjusted(-margin, -margin, margin, margin);
+        size += rect.width() + rect.height() + 4 * margin;
+    }
+    const int averageSize = rects.isEmpty() ? 1 : qMax<qint64>(1, size / (2 * rects.count()));
+    m_cellWidth = qMax(averageSize, m_extent.width() / s_maximumCells + 1);
+    m_cellHeight = qMax(averageSize, m_extent.height() / s_maximumCells + 1);
+    m_columns = m_extent.width() / m_cellWidth + 1;
+    m_rows = m_extent.height() / m_cellHeight + 1;
+    m_cells.resize(m_columns * m_rows);
+    for (int i = 0; i < rects.count(); ++i) {
+        move(i, QRect(), rects[i]);
+    }
+}
+
+void RectBuckets::cellRange(const QRect &rect, int *left, int *top, int *right, int *bottom) const
+{
+    const QRect adjusted = rect.adjusted(-m_margin, -m_margin, m_margin, m_margin);
+    *left = qBound(0, (adjusted.left() - m_extent.left()) / m_cellWidth, m_columns - 1);
+    *right = qBound(0, (adjusted.right() - m_extent.left()) / m_cellWidth, m_columns - 1);
+    *top = qBound(0, (adjusted.top() - m_extent.top()) / m_cellHeight, m_rows - 1);
+    *bottom = qBound(0, (adjusted.bottom() - m_extent.top()) / m_cellHeight, m_rows - 1);
+}
+
+void RectBuckets::move(int index, const QRect &from, const QRect &to)
+{
+    int left, top, right, bottom;
+    if (!from.isNull()) {
+        cellRange(from, &left, &top, &right, &bottom);
+        for (int y = top; y <= bottom; ++y) {
+            for (int x = left; x <= right; ++x) {
+                m_cells[y * m_columns + x].removeOne(index);
+            }
+        }
+    }
+    cellRange(to, &left, &top, &right, &bottom);
+    for (int y = top; y <= bottom; ++y) {
+        for (int x = left; x <= right; ++x) {
+            m_cells[y * m_columns + x].append(index);
+        }
+    }
+}
+
+bool RectBuckets::intersectsAny(const QRect &rect, int except) const
+{
+    const QRect adjusted = rect.adjusted(-m_margin, -m_margin, m_margin, m_margin);
+    int left, top, right, bottom;
+    cellRange(rect, &left, &top, &right, &bottom);
+    for (int y = top; y <= bottom; ++y) {
+        for (int x = left; x <= right; ++x) {
+            for (int i : m_cells[y * m_columns + x]) {
+                if (i != except && adjusted.intersects(m_rects[i].adjusted(-m_margin, -m_margin, m_margin, m_margin))) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+inline int distance(const QPoint &pos1, const QPoint &pos2)
+{
+    const int xdiff = pos1.x() - pos2.x();
+    const int ydiff = pos1.y() - pos2.y();
+    return int(sqrt(float(xdiff*xdiff + ydiff*ydiff)));
+}
+
+} // anonymous namespace
+
+PresentWindowsLayout::PresentWindowsLayout(const QVector<QRect> &geometries, const QRect &area)
+    : m_geometries(geometries)
+    , m_area(area)
+{
+}
+
+void PresentWindowsLayout::setAccuracy(int accuracy)
+{
+    m_accuracy = accuracy;
+}
+
+void PresentWindowsLayout::setFillGaps(bool fillGaps)
+{
+    m_fillGaps = fillGaps;
+}
+
+void PresentWindowsLayout::setMaximumIterations(int iterations)
+{
+    m_maximumIterations = iterations;
+}
+
+double PresentWindowsLayout::aspectRatio(int index) const
+{
+    return m_geometries[index].width() / double(m_geometries[index].height());
+}
+
+int PresentWindowsLayout::widthForHeight(int index, int height) const
+{
+    return int((height / double(m_geometries[index].height())) * m_geometries[index].width());
+}
+
+int PresentWindowsLayout::heightForWidth(int index, int width) const
+{
+    return int((width / double(m_geometries[index].width())) * m_geometries[index].height());
+}
+
+QVector<QRect> PresentWindowsLayout::closest(int *columnCount, int *rowCount) const
+{
+    QVector<QRect> targets(m_geometries.count());
+    if (m_geometries.isEmpty()) {
+        return targets;
+    }
+
+    const QRect &area = m_area;
+    int columns = int(ceil(sqrt(double(m_geometries.count()))));
+    int rows = int(ceil(m_geometries.count() / double(columns)));
+    if (columnCount) {
+        *columnCount = columns;
+    }
+    if (rowCount) {
+        *rowCount = rows;
+    }
+
+    // Assign slots
+    int slotWidth = area.width() / columns;
+    int slotHeight = area.height() / rows;
+    QVector<int> takenSlots(rows * columns, -1);
+
+    // precalculate all slot centers
+    QVector<QPoint> slotCenters;
+    slotCenters.resize(rows*columns);
+    for (int x = 0; x < columns; ++x)
+        for (int y = 0; y < rows; ++y) {
+            slotCenters[x + y*columns] = QPoint(area.x() + slotWidth * x + slotWidth / 2,
+                                                area.y() + slotHeight * y + slotHeight / 2);
+        }
+
+    // Assign each window to the closest available slot
+    QVector<int> pending(m_geometries.count());
+    std::iota(pending.begin(), pending.end(), 0);
+    for (int next = 0; next < pending.count(); ++next) {
+        const int w = pending[next];
+        int slotCandidate = -1, slotCandidateDistance = INT_MAX;
+        const QPoint pos = m_geometries[w].center();
+
+        for (int i = 0; i < columns*rows; ++i) { // all slots
+            const int dist = distance(pos, slotCenters[i]);
+            if (dist < slotCandidateDistance) { // window is interested in this slot
+                const int occupier = takenSlots[i];
+                Q_ASSERT(occupier != w);
+                if (occupier == -1 || dist < distance(m_geometries[occupier].center(), slotCenters[i])) {
+                    // either nobody lives here, or we're better - takeover the slot if it's our best
+                    slotCandidate = i;
+                    slotCandidateDistance = dist;
+                }
+            }
+        }
+        Q_ASSERT(slotCandidate != -1);
+        if (takenSlots[slotCandidate] != -1)
+            pending << takenSlots[slotCandidate]; // occupier needs a new home now :p
+        takenSlots[slotCandidate] = w; // ...and we rumble in =)
+    }
+
+    for (int slot = 0; slot < columns*rows; ++slot) {
+        const int w = takenSlots[slot];
+        if (w == -1) // some slots might be empty
+            continue;
+        const int width = m_geometries[w].width();
+        const int height = m_geometries[w].height();
+
+        // Work out where the slot is
+        QRect target(
+            area.x() + (slot % columns) * slotWidth,
+            area.y() + (slot / columns) * slotHeight,
+            slotWidth, slotHeight);
+        target.adjust(10, 10, -10, -10);   // Borders
+
+        double scale;
+        if (target.width() / double(width) < target.height() / double(height)) {
+            // Center vertically
+            scale = target.width() / double(width);
+            target.moveTop(target.top() + (target.height() - int(height * scale)) / 2);
+            target.setHeight(int(height * scale));
+        } else {
+            // Center horizontally
+            scale = target.height() / double(height);
+            target.moveLeft(target.left() + (target.width() - int(width * scale)) / 2);
+            target.setWidth(int(width * scale));
+        }
+        // Don't scale the windows too much
+        if (scale > 2.0 || (scale > 1.0 && (width > 300 || height > 300))) {
+            scale = (width > 300 || height > 300) ? 1.0 : 2.0;
+            target = QRect(
+                         target.center().x() - int(width * scale) / 2,
+                         target.center().y() - int(height * scale) / 2,
+                         scale * width, scale * height);
+        }
+        targets[w] = target;
+    }
+    return targets;
+}
+
+QVector<QRect> PresentWindowsLayout::kompose() const
+{
+    QVector<QRect> targets(m_geometries.count());
+    if (m_geometries.isEmpty()) {
+        return targets;
+    }
+    const QRect &availRect = m_area;
+    const int count = m_geometries.count();
+
+    // Following code is taken from Kompose 0.5.4, src/komposelayout.cpp
+    int spacing = 10;
+    int rows, columns;
+    double parentRatio = availRect.width() / (double)availRect.height();
+    // Use more columns than rows when parent's width > parent's height
+    if (parentRatio > 1) {
+        columns = (int)ceil(sqrt((double)count));
+        rows = (int)ceil((double)count / (double)columns);
+    } else {
+        rows = (int)ceil(sqrt((double)count));
+        columns = (int)ceil((double)count / (double)rows);
+    }
+
+    // Calculate width & height
+    int w = (availRect.width() - (columns + 1) * spacing) / columns;
+    int h = (availRect.height() - (rows + 1) * spacing) / rows;
+
+    int it = 0;
+    QVector<int> maxRowHeights;
+    // Process rows
+    for (int i = 0; i < rows; ++i) {
+        int xOffsetFromLastCol = 0;
+        int maxHeightInRow = 0;
+        // Process columns
+        for (int j = 0; j < columns; ++j) {
+            // Check for end of List
+            if (it == count)
+                break;
+            const int window = it;
+            const int windowWidth = m_geometries[window].width();
+            const int windowHeight = m_geometries[window].height();
+
+            // Calculate width and height of widget
+            double ratio = aspectRatio(window);
+
+            int widgetw = 100;
+            int widgeth = 100;
+            int usableW = w;
+            int usableH = h;
+
+            // use width of two boxes if there is no right neighbour
+            if (window == count - 1 && j != columns - 1) {
+                usableW = 2 * w;
+            }
+            ++it; // We need access to the neighbour in the following
+            // expand if right neighbour has ratio < 1
+            if (j != columns - 1 && it != count && aspectRatio(it) < 1) {
+                int addW = w - widthForHeight(it, h);
+                if (addW > 0) {
+                    usableW = w + addW;
+                }
+            }
+
+            if (ratio == -1) {
+                widgetw = w;
+                widgeth = h;
+            } else {
+                double widthByHeight = widthForHeight(window, usableH);
+                double heightByWidth = heightForWidth(window, usableW);
+                if ((ratio >= 1.0 && heightByWidth <= usableH) ||
+                        (ratio < 1.0 && widthByHeight > usableW)) {
+                    widgetw = usableW;
+                    widgeth = (int)heightByWidth;
+                } else if ((ratio < 1.0 && widthByHeight <= usableW) ||
+                          (ratio >= 1.0 && heightByWidth > usableH)) {
+                    widgeth = usableH;
+                    widgetw = (int)widthByHeight;
+                }
+                // Don't upscale large-ish windows
+                if (widgetw > windowWidth && (windowWidth > 300 || windowHeight > 300)) {
+                    widgetw = windowWidth;
+                    widgeth = windowHeight;
+                }
+            }
+
+            // Set the Widget's size
+
+            int alignmentXoffset = 0;
+            int alignmentYoffset = 0;
+            if (i == 0 && h > widgeth)
+                alignmentYoffset = h - widgeth;
+            if (j == 0 && w > widgetw)
+                alignmentXoffset = w - widgetw;
+            targets[window] = QRect(availRect.x() + j *(w + spacing) + spacing + alignmentXoffset + xOffsetFromLastCol,
+                                    availRect.y() + i *(h + spacing) + spacing + alignmentYoffset,
+                                    widgetw, widgeth);
+
+            // Set the x offset for the next column
+            if (alignmentXoffset == 0)
+                xOffsetFromLastCol += widgetw - w;
+            if (maxHeightInRow < widgeth)
+                maxHeightInRow = widgeth;
+        }
+        maxRowHeights.append(maxHeightInRow);
+    }
+
+    int topOffset = 0;
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < columns; j++) {
+            int pos = i * columns + j;
+            if (pos >= count)
+                break;
+            targets[pos].setY(targets[pos].y() + topOffset);
+        }
+        if (maxRowHeights[i] - h > 0)
+            topOffset += maxRowHeights[i] - h;
+    }
+    return targets;
+}
+
+QVector<QRect> PresentWindowsLayout::natural() const
+{
+    const int count = m_geometries.count();
+    const QRect &area = m_area;
+    QRect bounds = area;
+    QVector<QRect> targets = m_geometries;
+    QVector<int> directions(count);
+    for (int i = 0; i < count; ++i) {
+        bounds = bounds.united(m_geometries[i]);
+        // Reuse the unused "slot" as a preferred direction attribute. This is used when the window
+        // is on the edge of the screen to try to use as much screen real estate as possible.
+        directions[i] = i % 4;
+    }
+
+    // Iterate over all windows, if two overlap push them apart _slightly_ as we try to
+    // brute-force the most optimal positions over many iterations. Only the windows sharing
+    // a cell of the grid are tested. The grid is built from the targets at the start of every
+    // iteration, so an iteration that doesn't move any window has seen all overlaps.
+    RectGrid grid;
+    QVector<int> candidates;
+    bool overlap;
+    int iteration = 0;
+    do {
+        overlap = false;
+        grid.build(targets, 5);
+        for (int w = 0; w < count; ++w) {
+            grid.query(targets[w].adjusted(-5, -5, 5, 5), candidates);
+            for (int e : qAsConst(candidates)) {
+                if (w == e)
+                    continue;
+
+                QRect *target_w = &targets[w];
+                QRect *target_e = &targets[e];
+                if (target_w->adjusted(-5, -5, 5, 5).intersects(target_e->adjusted(-5, -5, 5, 5))) {
+                    overlap = true;
+
+                    // Determine pushing direction
+                    QPoint diff(target_e->center() - target_w->center());
+                    // Prevent dividing by zero and non-movement
+                    if (diff.x() == 0 && diff.y() == 0)
+                        diff.setX(1);
+                    // Approximate a vector of between 10px and 20px in magnitude in the same direction
+                    diff *= m_accuracy / double(diff.manhattanLength());
+                    // Move both windows apart
+                    target_w->translate(-diff);
+                    target_e->translate(diff);
+
+                    // Try to keep the bounding rect the same aspect as the screen so that more
+                    // screen real estate is utilised. We do this by splitting the screen into nine
+                    // equal sections, if the window center is in any of the corner sections pull the
+                    // window towards the outer corner. If it is in any of the other edge sections
+                    // alternate between each corner on that edge. We don't want to determine it
+                    // randomly as it will not produce consistant locations when using the filter.
+                    // Only move one window so we don't cause large amounts of unnecessary zooming
+                    // in some situations. We need to do this even when expanding later just in case
+                    // all windows are the same size.
+                    // (We are using an old bounding rect for this, hopefully it doesn't matter)
+                    int xSection = (target_w->x() - bounds.x()) / (bounds.width() / 3);
+                    int ySection = (target_w->y() - bounds.y()) / (bounds.height() / 3);
+                    diff = QPoint(0, 0);
+                    if (xSection != 1 || ySection != 1) { // Remove this if you want the center to pull as well
+                        if (xSection == 1)
+                            xSection = (directions[w] / 2 ? 2 : 0);
+                        if (ySection == 1)
+                            ySection = (directions[w] % 2 ? 2 : 0);
+                    }
+                    if (xSection == 0 && ySection == 0)
+                        diff = QPoint(bounds.topLeft() - target_w->center());
+                    if (xSection == 2 && ySection == 0)
+                        diff = QPoint(bounds.topRight() - target_w->center());
+                    if (xSection == 2 && ySection == 2)
+                        diff = QPoint(bounds.bottomRight() - target_w->center());
+                    if (xSection == 0 && ySection == 2)
+                        diff = QPoint(bounds.bottomLeft() - target_w->center());
+                    if (diff.x() != 0 || diff.y() != 0) {
+                        diff *= m_accuracy / double(diff.manhattanLength());
+                        target_w->translate(diff);
+                    }
+
+                    // Update bounding rect
+                    bounds = bounds.united(*target_w);
+                    bounds = bounds.united(*target_e);
+                }
+            }
+        }
+    } while (overlap && ++iteration < m_maximumIterations);
+
+    // Work out scaling by getting the most top-left and most bottom-right window coords.
+    // The 20's and 10's are so that the windows don't touch the edge of the screen.
+    double scale;
+    if (bounds == area)
+        scale = 1.0; // Don't add borders to the screen
+    else if (area.width() / double(bounds.width()) < area.height() / double(bounds.height()))
+        scale = (area.width() - 20) / double(bounds.width());
+    else
+        scale = (area.height() - 20) / double(bounds.height());
+    // Make bounding rect fill the screen size for later steps
+    bounds = QRect(
+                 (bounds.x() * scale - (area.width() - 20 - bounds.width() * scale) / 2 - 10) / scale,
+                 (bounds.y() * scale - (area.height() - 20 - bounds.height() * scale) / 2 - 10) / scale,
+                 area.width() / scale,
+                 area.height() / scale
+             );
+
+    // Move all windows back onto the screen and set their scale
+    for (QRect &target : targets) {
+        target.setRect((target.x() - bounds.x()) * scale + area.x(),
+                       (target.y() - bounds.y()) * scale + area.y(),
+                       target.width() * scale,
+                       target.height() * scale
+                       );
+    }
+
+    // Try to fill the gaps by enlarging windows if they have the space
+    if (m_fillGaps) {
+        // Don't expand onto or over the border
+        QRegion borderRegion(area.adjusted(-200, -200, 200, 200));
+        borderRegion ^= area.adjusted(10 / scale, 10 / scale, -10 / scale, -10 / scale);
+
+        // Only the windows sharing a cell of the buckets are tested. A window is moved in the
+        // buckets once its attempts are done, its own stale cells don't matter meanwhile.
+        RectBuckets buckets(targets, 5);
+        auto isOverlappingAny = [&targets, &borderRegion, &buckets](int w) {
+            const QRect &winTarget = targets[w];
+            if (borderRegion.intersects(winTarget))
+                return true;
+            return buckets.intersectsAny(winTarget, w);
+        };
+
+        bool moved;
+        do {
+            moved = false;
+            for (int w = 0; w < count; ++w) {
+                QRect oldRect;
+                QRect *target = &targets[w];
+                const QRect initialRect = *target;
+                // This may cause some slight distortion if the windows are enlarged a large amount
+                int widthDiff = m_accuracy;
+                int heightDiff = heightForWidth(w, target->width() + widthDiff) - target->height();
+                int xDiff = widthDiff / 2;  // Also move a bit in the direction of the enlarge, allows the
+                int yDiff = heightDiff / 2; // center windows to be enlarged if there is gaps on the side.
+
+                // heightDiff (and yDiff) will be re-computed after each successful enlargement attempt
+                // so that the error introduced in the window's aspect ratio is minimized
+
+                // Attempt enlarging to the top-right
+                oldRect = *target;
+                target->setRect(target->x() + xDiff,
+                                target->y() - yDiff - heightDiff,
+                                target->width() + widthDiff,
+                                target->height() + heightDiff
+                                );
+                if (isOverlappingAny(w))
+                    *target = oldRect;
+                else {
+                    moved = true;
+                    heightDiff = heightForWidth(w, target->width() + widthDiff) - target->height();
+                    yDiff = heightDiff / 2;
+                }
+
+                // Attempt enlarging to the bottom-right
+                oldRect = *target;
+                target->setRect(
+                                 target->x() + xDiff,
+                                 target->y() + yDiff,
+                                 target->width() + widthDiff,
+                                 target->height() + heightDiff
+                             );
+                if (isOverlappingAny(w))
+                    *target = oldRect;
+                else {
+                    moved = true;
+                    heightDiff = heightForWidth(w, target->width() + widthDiff) - target->height();
+                    yDiff = heightDiff / 2;
+                }
+
+                // Attempt enlarging to the bottom-left
+                oldRect = *target;
+                target->setRect(
+                                 target->x() - xDiff - widthDiff,
+                                 target->y() + yDiff,
+                                 target->width() + widthDiff,
+                                 target->height() + heightDiff
+                             );
+                if (isOverlappingAny(w))
+                    *target = oldRect;
+                else {
+                    moved = true;
+                    heightDiff = heightForWidth(w, target->width() + widthDiff) - target->height();
+                    yDiff = heightDiff / 2;
+                }
+
+                // Attempt enlarging to the top-left
+                oldRect = *target;
+                target->setRect(
+                                 target->x() - xDiff - widthDiff,
+                                 target->y() - yDiff - heightDiff,
+                                 target->width() + widthDiff,
+                                 target->height() + heightDiff
+                             );
+                if (isOverlappingAny(w))
+                    *target = oldRect;
+                else
+                    moved = true;
+
+                if (*target != initialRect)
+                    buckets.move(w, initialRect, *target);
+            }
+        } while (moved);
+
+        // The expanding code above can actually enlarge windows over 1.0/2.0 scale, we don't like this
+        // We can't add this to the loop above as it would cause a never-ending loop so we have to make
+        // do with the less-than-optimal space usage with using this method.
+        for (int w = 0; w < count; ++w) {
+            QRect *target = &targets[w];
+            const int width = m_geometries[w].width();
+            const int height = m_geometries[w].height();
+            double scale = target->width() / double(width);
+            if (scale > 2.0 || (scale > 1.0 && (width > 300 || height > 300))) {
+                scale = (width > 300 || height > 300) ? 1.0 : 2.0;
+                target->setRect(
+                                 target->center().x() - int(width * scale) / 2,
+                                 target->center().y() - int(height * scale) / 2,
+                                 width * scale,
+                                 height * scale);
+            }
+        }
+    }
+
+    return targets;
+}
+
+} // namespace KWin
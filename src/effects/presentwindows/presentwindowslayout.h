@@ -0,0 +1,75 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef KWIN_PRESENTWINDOWSLAYOUT_H
+#define KWIN_PRESENTWINDOWSLAYOUT_H
+
+#include <QRect>
+#include <QVector>
+
+namespace KWin
+{
+
+/**
+ * The layouts of the present windows effect.
+ *
+ * A layout works on a snapshot of the window geometries and returns the target geometries in
+ * the same order. It doesn't access any EffectWindow, so it can be computed in a worker thread.
+ */
+class PresentWindowsLayout
+{
+public:
+    /**
+     * Creates a layout of windows with the given @a geometries in @a area.
+     */
+    PresentWindowsLayout(const QVector<QRect> &geometries, const QRect &area);
+
+    /**
+     * Sets the distance windows are pushed by in every step of the natural layout.
+     */
+    void setAccuracy(int accuracy);
+    /**
+     * Sets whether the natural layout enlarges windows into the gaps between them.
+     */
+    void setFillGaps(bool fillGaps);
+    /**
+     * Sets how often the natural layout may push all overlapping windows apart before it
+     * settles for the current targets.
+     */
+    void setMaximumIterations(int iterations);
+
+    /**
+     * Puts every window into the closest slot of a regular grid. The size of the grid is
+     * stored in @a columns and @a rows.
+     */
+    QVector<QRect> closest(int *columns = nullptr, int *rows = nullptr) const;
+    /**
+     * Arranges the windows in a flexible grid, as Kompose did.
+     */
+    QVector<QRect> kompose() const;
+    /**
+     * Pushes overlapping windows apart until none overlap and scales the result into the area.
+     */
+    QVector<QRect> natural() const;
+
+private:
+    double aspectRatio(int index) const;
+    int widthForHeight(int index, int height) const;
+    int heightForWidth(int index, int width) const;
+
+    QVector<QRect> m_geometries;
+    QRect m_area;
+    int m_accuracy = 20;
+    bool m_fillGaps = true;
+    int m_maximumIterations = 1000;
+};
+
+} // namespace KWin
+
+#endif
@@ -45,9 +45,22 @@ struct ScreenShotScreenData
 {
     QFutureInterface<QImage> promise;
     ScreenShotFlags flags;
+    ScreenShotAllocator allocator;
     EffectScreen *screen = nullptr;
 };
 
+struct ScreenShotReadback
+{
+    QFutureInterface<QImage> promise;
+    ScreenShotFlags flags;
+    ScreenShotAllocator allocator;
+    QRect geometry;
+    QSize size;
+    qreal devicePixelRatio = 1.0;
+    GLuint buffer = 0;
+    GLsync sync = nullptr;
+};
+
 static void convertFromGLImage(QImage &img, int w, int h)
 {
     // from QtOpenGL/qgl.cpp
@@ -110,6 +123,18 @@ bool ScreenShotEffect::supported()
            (effects->isOpenGLCompositing() && GLRenderTarget::supported());
 }
 
+bool ScreenShotEffect::asynchronousReadbackSupported()
+{
+    if (!effects->isOpenGLCompositing() || !GLRenderTarget::blitSupported()) {
+        return false;
+    }
+    // pixel buffer objects, sync objects and glMapBufferRange()
+    if (GLPlatform::instance()->isGLES()) {
+        return hasGLVersion(3, 0);
+    }
+    return hasGLVersion(3, 2);
+}
+
 ScreenShotEffect::ScreenShotEffect()
     : m_dbusInterface1(new ScreenShotDBusInterface1(this))
     , m_dbusInterface2(new ScreenShotDBusInterface2(this))
@@ -117,6 +142,15 @@ ScreenShotEffect::ScreenShotEffect()
     connect(effects, &EffectsHandler::screenAdded, this, &ScreenShotEffect::handleScreenAdded);
     connect(effects, &EffectsHandler::screenRemoved, this, &ScreenShotEffect::handleScreenRemoved);
     connect(effects, &EffectsHandler::windowClosed, this, &ScreenShotEffect::handleWindowClosed);
+
+    // Sync objects can't notify us when they get signaled, so they have to be polled.
+    m_readbackTimer.setInterval(1);
+    m_readbackTimer.setTimerType(Qt::PreciseTimer);
+    connect(&m_readbackTimer, &QTimer::timeout, this, [this]() {
+        if (effects->makeOpenGLContextCurrent()) {
+            collectReadbacks();
+        }
+    });
 }
 
 ScreenShotEffect::~ScreenShotEffect()
@@ -124,19 +158,24 @@ ScreenShotEffect::~ScreenShotEffect()
     cancelWindowScreenShots();
     cancelAreaScreenShots();
     cancelScreenScreenShots();
+    cancelReadbacks();
 }
 
-QFuture<QImage> ScreenShotEffect::scheduleScreenShot(EffectScreen *screen, ScreenShotFlags flags)
+QFuture<QImage> ScreenShotEffect::scheduleScreenShot(EffectScreen *screen, ScreenShotFlags flags,
+                                                     const ScreenShotAllocator &allocator)
 {
-    for (ScreenShotScreenData &data : m_screenScreenShots) {
-        if (data.screen == screen && data.flags == flags) {
-            return data.promise.future();
+    if (!allocator) {
+        for (ScreenShotScreenData &data : m_screenScreenShots) {
+            if (data.screen == screen && data.flags == flags && !data.allocator) {
+                return data.promise.future();
+            }
         }
     }
 
     ScreenShotScreenData data;
     data.screen = screen;
     data.flags = flags;
+    data.allocator = allocator;
 
     m_screenScreenShots.append(data);
     effects->addRepaint(screen->geometry());
@@ -227,6 +266,23 @@ void ScreenShotEffect::cancelScreenScreenShots()
     }
 }
 
+void ScreenShotEffect::cancelReadbacks()
+{
+    if (m_readbacks.isEmpty()) {
+        return;
+    }
+    m_readbackTimer.stop();
+    const bool contextCurrent = effects->makeOpenGLContextCurrent();
+    while (!m_readbacks.isEmpty()) {
+        ScreenShotReadback readback = m_readbacks.takeLast();
+        if (contextCurrent) {
+            glDeleteSync(readback.sync);
+            glDeleteBuffers(1, &readback.buffer);
+        }
+        readback.promise.reportCanceled();
+    }
+}
+
 void ScreenShotEffect::paintScreen(int mask, const QRegion &region, ScreenPaintData &data)
 {
     m_paintedScreen = data.screen();
@@ -378,6 +434,11 @@ bool ScreenShotEffect::takeScreenShot(ScreenShotScreenData *screenshot)
             devicePixelRatio = screenshot->screen->devicePixelRatio();
         }
 
+        if ((screenshot->flags & ScreenShotAsynchronous) && asynchronousReadbackSupported()) {
+            scheduleReadback(screenshot, screenshot->screen->geometry(), devicePixelRatio);
+            return true;
+        }
+
         QImage snapshot = blitScreenshot(screenshot->screen->geometry(), devicePixelRatio);
         if (screenshot->flags & ScreenShotIncludeCursor) {
             const int xOffset = screenshot->screen->geometry().width();
@@ -425,18 +486,20 @@ QImage ScreenShotEffect::blitScreenshot(const QRect &geometry, qreal devicePixel
             image = QImage(nativeSize.width(), nativeSize.height(), QImage::Format_ARGB32);
             GLTexture texture(GL_RGBA8, nativeSize.width(), nativeSize.height());
             GLRenderTarget target(texture);
-            target.blitFromFramebuffer(geometry);
-            // copy content from framebuffer into image
+            // A destination with a negative height flips the image while blitting, so the
+            // rows end up in the order QImage expects them.
+            target.blitFromFramebuffer(geometry, QRect(0, nativeSize.height(), nativeSize.width(), -nativeSize.height()));
+            // copy content from framebuffer into image, BGRA in native byte order is ARGB32
             texture.bind();
-            glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV,
                           static_cast<GLvoid *>(image.bits()));
             texture.unbind();
         } else {
             image = QImage(nativeSize.width(), nativeSize.height(), QImage::Format_ARGB32);
             glReadPixels(0, 0, nativeSize.width(), nativeSize.height(), GL_RGBA,
                          GL_UNSIGNED_BYTE, static_cast<GLvoid *>(image.bits()));
+            convertFromGLImage(image, nativeSize.width(), nativeSize.height());
         }
-        convertFromGLImage(image, nativeSize.width(), nativeSize.height());
     }
 
 #if defined(KWIN_HAVE_XRENDER_COMPOSITING)
@@ -449,6 +512,96 @@ QImage ScreenShotEffect::blitScreenshot(const QRect &geometry, qreal devicePixel
     return image;
 }
 
+void ScreenShotEffect::scheduleReadback(ScreenShotScreenData *screenshot, const QRect &geometry, qreal devicePixelRatio)
+{
+    ScreenShotReadback readback;
+    readback.promise = screenshot->promise;
+    readback.flags = screenshot->flags;
+    readback.allocator = screenshot->allocator;
+    readback.geometry = geometry;
+    readback.size = geometry.size() * devicePixelRatio;
+    readback.devicePixelRatio = devicePixelRatio;
+
+    GLTexture texture(GL_RGBA8, readback.size.width(), readback.size.height());
+    GLRenderTarget target(texture);
+    target.blitFromFramebuffer(geometry, QRect(0, readback.size.height(), readback.size.width(), -readback.size.height()));
+
+    glGenBuffers(1, &readback.buffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+    glBufferData(GL_PIXEL_PACK_BUFFER, readback.size.width() * readback.size.height() * 4, nullptr, GL_STREAM_READ);
+
+    // With a pixel buffer bound, glReadPixels() returns without waiting for the copy. RGBA
+    // bytes are QImage::Format_RGBA8888 in either byte order, so nothing has to be swizzled.
+    GLRenderTarget::pushRenderTarget(&target);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, readback.size.width(), readback.size.height(), GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    GLRenderTarget::popRenderTarget();
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    readback.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+
+    m_readbacks.append(readback);
+    m_readbackTimer.start();
+}
+
+void ScreenShotEffect::collectReadbacks()
+{
+    while (!m_readbacks.isEmpty()) {
+        const GLenum status = glClientWaitSync(m_readbacks.first().sync, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            break;
+        }
+        ScreenShotReadback readback = m_readbacks.takeFirst();
+        finishReadback(&readback);
+    }
+    if (m_readbacks.isEmpty()) {
+        m_readbackTimer.stop();
+    }
+}
+
+void ScreenShotEffect::finishReadback(ScreenShotReadback *readback)
+{
+    QImage image;
+    if (readback->allocator) {
+        image = readback->allocator(readback->size, QImage::Format_RGBA8888);
+    }
+    if (image.isNull()) {
+        image = QImage(readback->size, QImage::Format_RGBA8888);
+    }
+
+    const int stride = readback->size.width() * 4;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->buffer);
+    const uchar *pixels = static_cast<const uchar *>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, stride * readback->size.height(), GL_MAP_READ_BIT));
+    if (pixels) {
+        if (image.bytesPerLine() == stride) {
+            memcpy(image.bits(), pixels, stride * readback->size.height());
+        } else {
+            for (int y = 0; y < readback->size.height(); ++y) {
+                memcpy(image.scanLine(y), pixels + y * stride, stride);
+            }
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glDeleteBuffers(1, &readback->buffer);
+    glDeleteSync(readback->sync);
+
+    if (!pixels) {
+        qCWarning(KWINEFFECTS) << "Failed to map the screenshot pixel buffer";
+        readback->promise.reportCanceled();
+        return;
+    }
+
+    image.setDevicePixelRatio(readback->devicePixelRatio);
+    if (readback->flags & ScreenShotIncludeCursor) {
+        grabPointerImage(image, readback->geometry.x(), readback->geometry.y());
+    }
+
+    readback->promise.reportResult(image);
+    readback->promise.reportFinished();
+}
+
 void ScreenShotEffect::grabPointerImage(QImage &snapshot, int xOffset, int yOffset) const
 {
     const PlatformCursorImage cursor = effects->cursorImage();
@@ -16,6 +16,9 @@
 #include <QFutureInterface>
 #include <QImage>
 #include <QObject>
+#include <QTimer>
+
+#include <functional>
 
 namespace KWin
 {
@@ -27,14 +30,22 @@ enum ScreenShotFlag {
     ScreenShotIncludeDecoration = 0x1, ///< Include window titlebar and borders
     ScreenShotIncludeCursor = 0x2, ///< Include the cursor
     ScreenShotNativeResolution = 0x4, ///< Take the screenshot at the native resolution
+    ScreenShotAsynchronous = 0x8, ///< Read the pixels back without stalling the compositor
 };
 Q_DECLARE_FLAGS(ScreenShotFlags, ScreenShotFlag)
 
+/**
+ * Allocates the image that an asynchronous screenshot is read back into, for example in shared
+ * memory. A null image can be returned, in which case the image is allocated on the heap.
+ */
+using ScreenShotAllocator = std::function<QImage(const QSize &size, QImage::Format format)>;
+
 class ScreenShotDBusInterface1;
 class ScreenShotDBusInterface2;
 struct ScreenShotWindowData;
 struct ScreenShotAreaData;
 struct ScreenShotScreenData;
+struct ScreenShotReadback;
 
 /**
  * The ScreenShotEffect provides a convenient way to capture the contents of a given window,
@@ -56,8 +67,13 @@ public:
      * Schedules a screenshot of the given @a screen. The returned QFuture can be used to query
      * the image data. If the screen is removed before the screenshot is taken, the future will
      * be cancelled.
+     *
+     * If @a flags contain ScreenShotAsynchronous, the pixels are copied into a pixel buffer and
+     * read back once the GPU is done, usually a frame later. Such screenshots are in the
+     * QImage::Format_RGBA8888 format and are stored in the image returned by @a allocator.
      */
-    QFuture<QImage> scheduleScreenShot(EffectScreen *screen, ScreenShotFlags flags = {});
+    QFuture<QImage> scheduleScreenShot(EffectScreen *screen, ScreenShotFlags flags = {},
+                                       const ScreenShotAllocator &allocator = {});
 
     /**
      * Schedules a screenshot of the given @a area. The returned QFuture can be used to query the
@@ -78,6 +94,7 @@ public:
     int requestedEffectChainPosition() const override;
 
     static bool supported();
+    static bool asynchronousReadbackSupported();
 
 private Q_SLOTS:
     void handleWindowClosed(EffectWindow *window);
@@ -92,13 +109,19 @@ private:
     void cancelWindowScreenShots();
     void cancelAreaScreenShots();
     void cancelScreenScreenShots();
+    void cancelReadbacks();
 
     void grabPointerImage(QImage &snapshot, int xOffset, int yOffset) const;
     QImage blitScreenshot(const QRect &geometry, qreal devicePixelRatio = 1.0) const;
+    void scheduleReadback(ScreenShotScreenData *screenshot, const QRect &geometry, qreal devicePixelRatio);
+    void collectReadbacks();
+    void finishReadback(ScreenShotReadback *readback);
 
     QVector<ScreenShotWindowData> m_windowScreenShots;
     QVector<ScreenShotAreaData> m_areaScreenShots;
     QVector<ScreenShotScreenData> m_screenScreenShots;
+    QVector<ScreenShotReadback> m_readbacks;
+    QTimer m_readbackTimer;
 
     QScopedPointer<ScreenShotDBusInterface1> m_dbusInterface1;
     QScopedPointer<ScreenShotDBusInterface2> m_dbusInterface2;
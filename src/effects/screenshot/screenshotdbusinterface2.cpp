@@ -14,11 +14,14 @@
 
 #include <QDBusConnection>
 #include <QDBusConnectionInterface>
+#include <QPointer>
 #include <QtConcurrent>
 
 #include <errno.h>
+#include <fcntl.h>
 #include <poll.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
 namespace KWin
@@ -107,6 +110,8 @@ static const QString s_errorInvalidScreen = QStringLiteral("org.kde.KWin.ScreenS
 static const QString s_errorInvalidScreenMessage = QStringLiteral("Invalid screen requested");
 static const QString s_errorFileDescriptor = QStringLiteral("org.kde.KWin.ScreenShot2.Error.FileDescriptor");
 static const QString s_errorFileDescriptorMessage = QStringLiteral("No valid file descriptor");
+static const QString s_errorNotSupported = QStringLiteral("org.kde.KWin.ScreenShot2.Error.NotSupported");
+static const QString s_errorNotSupportedMessage = QStringLiteral("Screenshots in shared memory are not supported");
 
 class ScreenShotSource2 : public QObject
 {
@@ -117,7 +122,7 @@ public:
 
     bool isCancelled() const;
     bool isCompleted() const;
-    void marshal(ScreenShotSinkPipe2 *sink);
+    void marshal(ScreenShotSink2 *sink);
 
 Q_SIGNALS:
     void cancelled();
@@ -133,7 +138,8 @@ class ScreenShotSourceScreen2 : public ScreenShotSource2
     Q_OBJECT
 
 public:
-    ScreenShotSourceScreen2(ScreenShotEffect *effect, EffectScreen *screen, ScreenShotFlags flags);
+    ScreenShotSourceScreen2(ScreenShotEffect *effect, EffectScreen *screen, ScreenShotFlags flags,
+                            const ScreenShotAllocator &allocator = {});
 };
 
 class ScreenShotSourceArea2 : public ScreenShotSource2
@@ -152,22 +158,56 @@ public:
     ScreenShotSourceWindow2(ScreenShotEffect *effect, EffectWindow *window, ScreenShotFlags flags);
 };
 
-class ScreenShotSinkPipe2 : public QObject
+class ScreenShotSink2 : public QObject
 {
     Q_OBJECT
 
 public:
-    ScreenShotSinkPipe2(int fileDescriptor, QDBusMessage replyMessage);
-    ~ScreenShotSinkPipe2();
+    explicit ScreenShotSink2(QDBusMessage replyMessage);
 
     void cancel();
-    void flush(const QImage &image);
+    virtual void flush(const QImage &image) = 0;
+
+protected:
+    QVariantMap imageResults(const QImage &image) const;
 
-private:
     QDBusMessage m_replyMessage;
+};
+
+class ScreenShotSinkPipe2 : public ScreenShotSink2
+{
+    Q_OBJECT
+
+public:
+    ScreenShotSinkPipe2(int fileDescriptor, QDBusMessage replyMessage);
+    ~ScreenShotSinkPipe2() override;
+
+    void flush(const QImage &image) override;
+
+private:
     int m_fileDescriptor;
 };
 
+/**
+ * Hands the screenshot over in a sealed memfd. The screenshot is read back straight into the
+ * memfd, so the pixels aren't copied or written to a pipe once more.
+ */
+class ScreenShotSinkMemfd2 : public ScreenShotSink2
+{
+    Q_OBJECT
+
+public:
+    explicit ScreenShotSinkMemfd2(QDBusMessage replyMessage);
+    ~ScreenShotSinkMemfd2() override;
+
+    QImage allocate(const QSize &size, QImage::Format format);
+    void flush(const QImage &image) override;
+
+private:
+    int m_fileDescriptor = -1;
+    uchar *m_data = nullptr;
+};
+
 ScreenShotSource2::ScreenShotSource2(const QFuture<QImage> &future)
     : m_future(future)
 {
@@ -187,15 +227,16 @@ bool ScreenShotSource2::isCompleted() const
     return m_future.isFinished();
 }
 
-void ScreenShotSource2::marshal(ScreenShotSinkPipe2 *sink)
+void ScreenShotSource2::marshal(ScreenShotSink2 *sink)
 {
     sink->flush(m_future.result());
 }
 
 ScreenShotSourceScreen2::ScreenShotSourceScreen2(ScreenShotEffect *effect,
                                                  EffectScreen *screen,
-                                                 ScreenShotFlags flags)
-    : ScreenShotSource2(effect->scheduleScreenShot(screen, flags))
+                                                 ScreenShotFlags flags,
+                                                 const ScreenShotAllocator &allocator)
+    : ScreenShotSource2(effect->scheduleScreenShot(screen, flags, allocator))
 {
 }
 
@@ -213,8 +254,31 @@ ScreenShotSourceWindow2::ScreenShotSourceWindow2(ScreenShotEffect *effect,
 {
 }
 
-ScreenShotSinkPipe2::ScreenShotSinkPipe2(int fileDescriptor, QDBusMessage replyMessage)
+ScreenShotSink2::ScreenShotSink2(QDBusMessage replyMessage)
     : m_replyMessage(replyMessage)
+{
+}
+
+void ScreenShotSink2::cancel()
+{
+    QDBusConnection::sessionBus().send(m_replyMessage.createErrorReply(s_errorCancelled,
+                                                                       s_errorCancelledMessage));
+}
+
+QVariantMap ScreenShotSink2::imageResults(const QImage &image) const
+{
+    // Note that the type of the data stored in the vardict matters. Be careful.
+    QVariantMap results;
+    results.insert(QStringLiteral("type"), QStringLiteral("raw"));
+    results.insert(QStringLiteral("format"), quint32(image.format()));
+    results.insert(QStringLiteral("width"), quint32(image.width()));
+    results.insert(QStringLiteral("height"), quint32(image.height()));
+    results.insert(QStringLiteral("stride"), quint32(image.bytesPerLine()));
+    return results;
+}
+
+ScreenShotSinkPipe2::ScreenShotSinkPipe2(int fileDescriptor, QDBusMessage replyMessage)
+    : ScreenShotSink2(replyMessage)
     , m_fileDescriptor(fileDescriptor)
 {
 }
@@ -226,30 +290,18 @@ ScreenShotSinkPipe2::~ScreenShotSinkPipe2()
     }
 }
 
-void ScreenShotSinkPipe2::cancel()
-{
-    QDBusConnection::sessionBus().send(m_replyMessage.createErrorReply(s_errorCancelled,
-                                                                       s_errorCancelledMessage));
-}
-
 void ScreenShotSinkPipe2::flush(const QImage &image)
 {
     if (m_fileDescriptor == -1) {
         return;
     }
 
-    // Note that the type of the data stored in the vardict matters. Be careful.
-    QVariantMap results;
-    results.insert(QStringLiteral("type"), QStringLiteral("raw"));
-    results.insert(QStringLiteral("format"), quint32(image.format()));
-    results.insert(QStringLiteral("width"), quint32(image.width()));
-    results.insert(QStringLiteral("height"), quint32(image.height()));
-    results.insert(QStringLiteral("stride"), quint32(image.bytesPerLine()));
-    QDBusConnection::sessionBus().send(m_replyMessage.createReply(results));
+    QDBusConnection::sessionBus().send(m_replyMessage.createReply(imageResults(image)));
 
     QtConcurrent::run([](int fileDescriptor, const QImage &image) {
-        const QByteArray buffer(reinterpret_cast<const char *>(image.constBits()),
-                                image.sizeInBytes());
+        // The image outlives the buffer, so the pixels can be written without a deep copy.
+        const QByteArray buffer = QByteArray::fromRawData(reinterpret_cast<const char *>(image.constBits()),
+                                                          image.sizeInBytes());
         writeBufferToPipe(fileDescriptor, buffer);
     }, m_fileDescriptor, image);
 
@@ -257,6 +309,112 @@ void ScreenShotSinkPipe2::flush(const QImage &image)
     m_fileDescriptor = -1;
 }
 
+ScreenShotSinkMemfd2::ScreenShotSinkMemfd2(QDBusMessage replyMessage)
+    : ScreenShotSink2(replyMessage)
+{
+}
+
+ScreenShotSinkMemfd2::~ScreenShotSinkMemfd2()
+{
+    if (m_fileDescriptor != -1) {
+        close(m_fileDescriptor);
+    }
+}
+
+struct MemfdMapping
+{
+    void *data;
+    size_t size;
+};
+
+static void unmapMemfd(void *info)
+{
+    MemfdMapping *mapping = static_cast<MemfdMapping *>(info);
+    munmap(mapping->data, mapping->size);
+    delete mapping;
+}
+
+QImage ScreenShotSinkMemfd2::allocate(const QSize &size, QImage::Format format)
+{
+#ifdef F_SEAL_SEAL
+    if (m_fileDescriptor != -1) {
+        return QImage();
+    }
+
+    const int stride = size.width() * 4;
+    const size_t bufferSize = size_t(stride) * size.height();
+    m_fileDescriptor = memfd_create("kwin-screenshot", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (m_fileDescriptor == -1) {
+        qCWarning(KWINEFFECTS) << "memfd: Can't create memfd:" << strerror(errno);
+        return QImage();
+    }
+    if (ftruncate(m_fileDescriptor, bufferSize) < 0) {
+        qCWarning(KWINEFFECTS) << "memfd: Can't truncate to" << bufferSize;
+        close(m_fileDescriptor);
+        m_fileDescriptor = -1;
+        return QImage();
+    }
+    // The client can map the memfd without worrying that it shrinks under its feet.
+    if (fcntl(m_fileDescriptor, F_ADD_SEALS, F_SEAL_GROW | F_SEAL_SHRINK) == -1) {
+        qCWarning(KWINEFFECTS) << "memfd: Failed to add seals";
+    }
+
+    void *data = mmap(nullptr, bufferSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fileDescriptor, 0);
+    if (data == MAP_FAILED) {
+        qCWarning(KWINEFFECTS) << "memfd: Failed to mmap memory";
+        close(m_fileDescriptor);
+        m_fileDescriptor = -1;
+        return QImage();
+    }
+
+    m_data = static_cast<uchar *>(data);
+    return QImage(m_data, size.width(), size.height(), stride, format,
+                  unmapMemfd, new MemfdMapping{data, bufferSize});
+#else
+    Q_UNUSED(size)
+    Q_UNUSED(format)
+    return QImage();
+#endif
+}
+
+void ScreenShotSinkMemfd2::flush(const QImage &image)
+{
+#ifdef F_SEAL_SEAL
+    if (m_fileDescriptor == -1 || image.constBits() != m_data) {
+        // The image wasn't read back into the memfd, e.g. because the screenshot was taken
+        // synchronously. Put it there now.
+        if (m_fileDescriptor != -1) {
+            close(m_fileDescriptor);
+            m_fileDescriptor = -1;
+        }
+        QImage target = allocate(image.size(), image.format());
+        if (target.isNull()) {
+            cancel();
+            return;
+        }
+        for (int y = 0; y < image.height(); ++y) {
+            memcpy(target.scanLine(y), image.constScanLine(y), target.bytesPerLine());
+        }
+    }
+
+    int seals = F_SEAL_SEAL;
+#ifdef F_SEAL_FUTURE_WRITE
+    // The image may still be mapped writable here, which rules out F_SEAL_WRITE.
+    seals |= F_SEAL_FUTURE_WRITE;
+#endif
+    if (fcntl(m_fileDescriptor, F_ADD_SEALS, seals) == -1) {
+        qCWarning(KWINEFFECTS) << "memfd: Failed to add seals";
+    }
+
+    QVariantMap results = imageResults(image);
+    results.insert(QStringLiteral("fd"), QVariant::fromValue(QDBusUnixFileDescriptor(m_fileDescriptor)));
+    QDBusConnection::sessionBus().send(m_replyMessage.createReply(results));
+#else
+    Q_UNUSED(image)
+    cancel();
+#endif
+}
+
 ScreenShotDBusInterface2::ScreenShotDBusInterface2(ScreenShotEffect *effect)
     : QObject(effect)
     , m_effect(effect)
@@ -384,6 +542,44 @@ QVariantMap ScreenShotDBusInterface2::CaptureScreen(const QString &name,
     return QVariantMap();
 }
 
+QVariantMap ScreenShotDBusInterface2::CaptureScreenToMemfd(const QString &name,
+                                                            const QVariantMap &options)
+{
+    if (!checkPermissions()) {
+        return QVariantMap();
+    }
+
+#ifndef F_SEAL_SEAL
+    Q_UNUSED(name)
+    Q_UNUSED(options)
+    sendErrorReply(s_errorNotSupported, s_errorNotSupportedMessage);
+    return QVariantMap();
+#else
+    if (!connection().connectionCapabilities().testFlag(QDBusConnection::UnixFileDescriptorPassing)) {
+        sendErrorReply(s_errorNotSupported, s_errorNotSupportedMessage);
+        return QVariantMap();
+    }
+
+    EffectScreen *screen = effects->findScreen(name);
+    if (!screen) {
+        sendErrorReply(s_errorInvalidScreen, s_errorInvalidScreenMessage);
+        return QVariantMap();
+    }
+
+    auto sink = new ScreenShotSinkMemfd2(message());
+    const QPointer<ScreenShotSinkMemfd2> guard(sink);
+    auto allocator = [guard](const QSize &size, QImage::Format format) {
+        return guard ? guard->allocate(size, format) : QImage();
+    };
+    bind(sink, new ScreenShotSourceScreen2(m_effect, screen,
+                                           screenShotFlagsFromOptions(options) | ScreenShotAsynchronous,
+                                           allocator));
+
+    setDelayedReply(true);
+    return QVariantMap();
+#endif
+}
+
 QVariantMap ScreenShotDBusInterface2::CaptureInteractive(uint kind,
                                                          const QVariantMap &options,
                                                          QDBusUnixFileDescriptor pipe)
@@ -437,7 +633,7 @@ QVariantMap ScreenShotDBusInterface2::CaptureInteractive(uint kind,
     return QVariantMap();
 }
 
-void ScreenShotDBusInterface2::bind(ScreenShotSinkPipe2 *sink, ScreenShotSource2 *source)
+void ScreenShotDBusInterface2::bind(ScreenShotSink2 *sink, ScreenShotSource2 *source)
 {
     connect(source, &ScreenShotSource2::cancelled, sink, [sink, source]() {
         sink->cancel();
@@ -455,19 +651,19 @@ void ScreenShotDBusInterface2::bind(ScreenShotSinkPipe2 *sink, ScreenShotSource2
 }
 
 void ScreenShotDBusInterface2::takeScreenShot(EffectScreen *screen, ScreenShotFlags flags,
-                                              ScreenShotSinkPipe2 *sink)
+                                              ScreenShotSink2 *sink)
 {
     bind(sink, new ScreenShotSourceScreen2(m_effect, screen, flags));
 }
 
 void ScreenShotDBusInterface2::takeScreenShot(const QRect &area, ScreenShotFlags flags,
-                                              ScreenShotSinkPipe2 *sink)
+                                              ScreenShotSink2 *sink)
 {
     bind(sink, new ScreenShotSourceArea2(m_effect, area, flags));
 }
 
 void ScreenShotDBusInterface2::takeScreenShot(EffectWindow *window, ScreenShotFlags flags,
-                                              ScreenShotSinkPipe2 *sink)
+                                              ScreenShotSink2 *sink)
 {
     bind(sink, new ScreenShotSourceWindow2(m_effect, window, flags));
 }
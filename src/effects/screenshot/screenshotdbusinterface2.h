@@ -18,7 +18,7 @@ namespace KWin
 {
 
 class ScreenShotEffect;
-class ScreenShotSinkPipe2;
+class ScreenShotSink2;
 class ScreenShotSource2;
 
 /**
@@ -44,15 +44,16 @@ public Q_SLOTS:
                             QDBusUnixFileDescriptor pipe);
     QVariantMap CaptureScreen(const QString &name, const QVariantMap &options,
                               QDBusUnixFileDescriptor pipe);
+    QVariantMap CaptureScreenToMemfd(const QString &name, const QVariantMap &options);
     QVariantMap CaptureInteractive(uint kind, const QVariantMap &options,
                                    QDBusUnixFileDescriptor pipe);
 
 private:
-    void takeScreenShot(EffectScreen *screen, ScreenShotFlags flags, ScreenShotSinkPipe2 *sink);
-    void takeScreenShot(const QRect &area, ScreenShotFlags flags, ScreenShotSinkPipe2 *sink);
-    void takeScreenShot(EffectWindow *window, ScreenShotFlags flags, ScreenShotSinkPipe2 *sink);
+    void takeScreenShot(EffectScreen *screen, ScreenShotFlags flags, ScreenShotSink2 *sink);
+    void takeScreenShot(const QRect &area, ScreenShotFlags flags, ScreenShotSink2 *sink);
+    void takeScreenShot(EffectWindow *window, ScreenShotFlags flags, ScreenShotSink2 *sink);
 
-    void bind(ScreenShotSinkPipe2 *sink, ScreenShotSource2 *source);
+    void bind(ScreenShotSink2 *sink, ScreenShotSource2 *source);
     bool checkPermissions() const;
 
     ScreenShotEffect *m_effect;
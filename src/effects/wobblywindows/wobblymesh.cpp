@@ -0,0 +1,518 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "wobblymesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#  include <arm_neon.h>
+#endif
+
+namespace KWin
+{
+
+namespace
+{
+
+// A row of the grid fits in one vector. Vec4 wraps the native vector type of the target.
+#if defined(__SSE2__)
+
+struct Vec4
+{
+    __m128 v;
+};
+
+struct Mask
+{
+    __m128 m;
+};
+
+inline Vec4 load(const float *p) { return {_mm_loadu_ps(p)}; }
+inline void store(float *p, Vec4 a) { _mm_storeu_ps(p, a.v); }
+inline Vec4 broadcast(float f) { return {_mm_set1_ps(f)}; }
+inline Vec4 make(float a, float b, float c, float d) { return {_mm_setr_ps(a, b, c, d)}; }
+inline Vec4 operator+(Vec4 a, Vec4 b) { return {_mm_add_ps(a.v, b.v)}; }
+inline Vec4 operator-(Vec4 a, Vec4 b) { return {_mm_sub_ps(a.v, b.v)}; }
+inline Vec4 operator*(Vec4 a, Vec4 b) { return {_mm_mul_ps(a.v, b.v)}; }
+inline Mask operator<(Vec4 a, Vec4 b) { return {_mm_cmplt_ps(a.v, b.v)}; }
+inline Mask operator>(Vec4 a, Vec4 b) { return {_mm_cmpgt_ps(a.v, b.v)}; }
+inline Vec4 abs(Vec4 a) { return {_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v)}; }
+
+inline Vec4 copySign(Vec4 magnitude, Vec4 sign)
+{
+    const __m128 signBit = _mm_set1_ps(-0.0f);
+    return {_mm_or_ps(_mm_andnot_ps(signBit, magnitude.v), _mm_and_ps(signBit, sign.v))};
+}
+
+inline Vec4 select(Mask mask, Vec4 a, Vec4 b)
+{
+    return {_mm_or_ps(_mm_and_ps(mask.m, a.v), _mm_andnot_ps(mask.m, b.v))};
+}
+
+// Lane i of the result is lane i - 1 of a, the first lane is zero.
+inline Vec4 shiftUp(Vec4 a)
+{
+    return {_mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(a.v), 4))};
+}
+
+// Lane i of the result is lane i + 1 of a, the last lane is zero.
+inline Vec4 shiftDown(Vec4 a)
+{
+    return {_mm_castsi128_ps(_mm_srli_si128(_mm_castps_si128(a.v), 4))};
+}
+
+inline float horizontalSum(Vec4 a)
+{
+    __m128 sum = _mm_add_ps(a.v, _mm_movehl_ps(a.v, a.v));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32(sum);
+}
+
+#elif defined(__ARM_NEON)
+
+struct Vec4
+{
+    float32x4_t v;
+};
+
+struct Mask
+{
+    uint32x4_t m;
+};
+
+inline Vec4 load(const float *p) { return {vld1q_f32(p)}; }
+inline void store(float *p, Vec4 a) { vst1q_f32(p, a.v); }
+inline Vec4 broadcast(float f) { return {vdupq_n_f32(f)}; }
+inline Vec4 make(float a, float b, float c, float d)
+{
+    const float values[4] = {a, b, c, d};
+    return {vld1q_f32(values)};
+}
+inline Vec4 operator+(Vec4 a, Vec4 b) { return {vaddq_f32(a.v, b.v)}; }
+inline Vec4 operator-(Vec4 a, Vec4 b) { return {vsubq_f32(a.v, b.v)}; }
+inline Vec4 operator*(Vec4 a, Vec4 b) { return {vmulq_f32(a.v, b.v)}; }
+inline Mask operator<(Vec4 a, Vec4 b) { return {vcltq_f32(a.v, b.v)}; }
+inline Mask operator>(Vec4 a, Vec4 b) { return {vcgtq_f32(a.v, b.v)}; }
+inline Vec4 abs(Vec4 a) { return {vabsq_f32(a.v)}; }
+
+inline Vec4 copySign(Vec4 magnitude, Vec4 sign)
+{
+    return {vbslq_f32(vdupq_n_u32(0x80000000), sign.v, magnitude.v)};
+}
+
+inline Vec4 select(Mask mask, Vec4 a, Vec4 b)
+{
+    return {vbslq_f32(mask.m, a.v, b.v)};
+}
+
+inline Vec4 shiftUp(Vec4 a)
+{
+    return {vextq_f32(vdupq_n_f32(0), a.v, 3)};
+}
+
+inline Vec4 shiftDown(Vec4 a)
+{
+    return {vextq_f32(a.v, vdupq_n_f32(0), 1)};
+}
+
+inline float horizontalSum(Vec4 a)
+{
+    const float32x2_t sum = vadd_f32(vget_low_f32(a.v), vget_high_f32(a.v));
+    return vget_lane_f32(vpadd_f32(sum, sum), 0);
+}
+
+#else
+
+struct Vec4
+{
+    float v[4];
+};
+
+struct Mask
+{
+    bool m[4];
+};
+
+inline Vec4 load(const float *p) { return {{p[0], p[1], p[2], p[3]}}; }
+inline void store(float *p, Vec4 a) { std::copy(a.v, a.v + 4, p); }
+inline Vec4 broadcast(float f) { return {{f, f, f, f}}; }
+inline Vec4 make(float a, float b, float c, float d) { return {{a, b, c, d}}; }
+inline Vec4 operator+(Vec4 a, Vec4 b) { return {{a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]}}; }
+inline Vec4 operator-(Vec4 a, Vec4 b) { return {{a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3]}}; }
+inline Vec4 operator*(Vec4 a, Vec4 b) { return {{a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3]}}; }
+inline Mask operator<(Vec4 a, Vec4 b) { return {{a.v[0] < b.v[0], a.v[1] < b.v[1], a.v[2] < b.v[2], a.v[3] < b.v[3]}}; }
+inline Mask operator>(Vec4 a, Vec4 b) { return {{a.v[0] > b.v[0], a.v[1] > b.v[1], a.v[2] > b.v[2], a.v[3] > b.v[3]}}; }
+inline Vec4 abs(Vec4 a) { return {{std::fabs(a.v[0]), std::fabs(a.v[1]), std::fabs(a.v[2]), std::fabs(a.v[3])}}; }
+
+inline Vec4 copySign(Vec4 magnitude, Vec4 sign)
+{
+    return {{std::copysign(magnitude.v[0], sign.v[0]), std::copysign(magnitude.v[1], sign.v[1]),
+             std::copysign(magnitude.v[2], sign.v[2]), std::copysign(magnitude.v[3], sign.v[3])}};
+}
+
+inline Vec4 select(Mask mask, Vec4 a, Vec4 b)
+{
+    return {{mask.m[0] ? a.v[0] : b.v[0], mask.m[1] ? a.v[1] : b.v[1],
+             mask.m[2] ? a.v[2] : b.v[2], mask.m[3] ? a.v[3] : b.v[3]}};
+}
+
+inline Vec4 shiftUp(Vec4 a) { return {{0, a.v[0], a.v[1], a.v[2]}}; }
+inline Vec4 shiftDown(Vec4 a) { return {{a.v[1], a.v[2], a.v[3], 0}}; }
+
+inline float horizontalSum(Vec4 a)
+{
+    return (a.v[0] + a.v[1]) + (a.v[2] + a.v[3]);
+}
+
+#endif
+
+const int GridSize = WobblyMesh::GridSize;
+
+// Per point tables of the grid, one row per line.
+
+// The number of direct neighbours of a point and its inverse.
+const float s_neighbourCount[WobblyMesh::PointCount] = {
+    2, 3, 3, 2,
+    3, 4, 4, 3,
+    3, 4, 4, 3,
+    2, 3, 3, 2,
+};
+
+const float s_inverseNeighbourCount[WobblyMesh::PointCount] = {
+    1 / 2.0f, 1 / 3.0f, 1 / 3.0f, 1 / 2.0f,
+    1 / 3.0f, 1 / 4.0f, 1 / 4.0f, 1 / 3.0f,
+    1 / 3.0f, 1 / 4.0f, 1 / 4.0f, 1 / 3.0f,
+    1 / 2.0f, 1 / 3.0f, 1 / 3.0f, 1 / 2.0f,
+};
+
+// The smoothing filter weighs a point as much as all of its n neighbours in the surrounding
+// ring together, i.e. (ring + n * point) / 2n. The 3x3 box sum already contains the point
+// once, so it's weighted with n - 1 in addition.
+const float s_ringCenterWeight[WobblyMesh::PointCount] = {
+    2, 4, 4, 2,
+    4, 7, 7, 4,
+    4, 7, 7, 4,
+    2, 4, 4, 2,
+};
+
+const float s_ringNormalization[WobblyMesh::PointCount] = {
+    1 / 6.0f, 1 / 10.0f, 1 / 10.0f, 1 / 6.0f,
+    1 / 10.0f, 1 / 16.0f, 1 / 16.0f, 1 / 10.0f,
+    1 / 10.0f, 1 / 16.0f, 1 / 16.0f, 1 / 10.0f,
+    1 / 6.0f, 1 / 10.0f, 1 / 10.0f, 1 / 6.0f,
+};
+
+void smooth(Vec4 (&rows)[GridSize])
+{
+    Vec4 horizontal[GridSize];
+    for (int j = 0; j < GridSize; ++j) {
+        horizontal[j] = shiftUp(rows[j]) + rows[j] + shiftDown(rows[j]);
+    }
+    Vec4 smoothed[GridSize];
+    for (int j = 0; j < GridSize; ++j) {
+        Vec4 box = horizontal[j];
+        if (j > 0) {
+            box = box + horizontal[j - 1];
+        }
+        if (j < GridSize - 1) {
+            box = box + horizontal[j + 1];
+        }
+        const Vec4 weighted = box + load(s_ringCenterWeight + j * GridSize) * rows[j];
+        smoothed[j] = weighted * load(s_ringNormalization + j * GridSize);
+    }
+    std::copy(smoothed, smoothed + GridSize, rows);
+}
+
+// Zeroes values whose magnitude is below min and clamps the ones above max.
+inline Vec4 fixBounds(Vec4 value, Vec4 min, Vec4 max)
+{
+    const Vec4 magnitude = abs(value);
+    value = select(magnitude > max, copySign(max, value), value);
+    return select(magnitude < min, broadcast(0), value);
+}
+
+inline void bernsteinBasis(float t, float *basis)
+{
+    const float s = 1 - t;
+    basis[0] = s * s * s;
+    basis[1] = 3 * s * s * t;
+    basis[2] = 3 * s * t * t;
+    basis[3] = t * t * t;
+}
+
+/**
+ * The vertices of a regular grid share a few distinct coordinates. The work per coordinate is
+ * cached in a small direct-mapped table on the stack.
+ */
+template <typename Entry>
+class CoordinateCache
+{
+public:
+    template <typename Compute>
+    const Entry &lookup(double key, Compute compute)
+    {
+        quint64 bits;
+        std::memcpy(&bits, &key, sizeof(bits));
+        Slot &slot = m_slots[(bits * Q_UINT64_C(0x9e3779b97f4a7c15)) >> (64 - s_bits)];
+        if (!slot.valid || slot.key != key) {
+            compute(key, slot.entry);
+            slot.key = key;
+            slot.valid = true;
+        }
+        return slot.entry;
+    }
+
+private:
+    static const int s_bits = 6;
+    struct Slot
+    {
+        double key;
+        bool valid = false;
+        Entry entry;
+    };
+    Slot m_slots[1 << s_bits];
+};
+
+} // anonymous namespace
+
+void WobblyMesh::reset(const QRectF &geometry)
+{
+    const float xIncrement = geometry.width() / (GridSize - 1.0);
+    const float yIncrement = geometry.height() / (GridSize - 1.0);
+    for (int j = 0; j < GridSize; ++j) {
+        for (int i = 0; i < GridSize; ++i) {
+            const int index = j * GridSize + i;
+            m_positionX[index] = i == GridSize - 1 ? geometry.x() + geometry.width() : geometry.x() + i * xIncrement;
+            m_positionY[index] = j == GridSize - 1 ? geometry.y() + geometry.height() : geometry.y() + j * yIncrement;
+        }
+    }
+    std::fill(m_velocityX, m_velocityX + PointCount, 0.0f);
+    std::fill(m_velocityY, m_velocityY + PointCount, 0.0f);
+    std::fill(m_constraint, m_constraint + PointCount, 0.0f);
+}
+
+QPointF WobblyMesh::position(int index) const
+{
+    return QPointF(m_positionX[index], m_positionY[index]);
+}
+
+QPointF WobblyMesh::velocity(int index) const
+{
+    return QPointF(m_velocityX[index], m_velocityY[index]);
+}
+
+void WobblyMesh::setVelocity(int index, const QPointF &velocity)
+{
+    m_velocityX[index] = velocity.x();
+    m_velocityY[index] = velocity.y();
+}
+
+bool WobblyMesh::isConstrained(int index) const
+{
+    return m_constraint[index] != 0;
+}
+
+void WobblyMesh::setConstrained(int index, bool constrained)
+{
+    m_constraint[index] = constrained ? 1 : 0;
+}
+
+void WobblyMesh::step(const QRectF &geometry, float time, const Parameters &parameters, Qt::Edges edges,
+                      float *accelerationSum, float *velocitySum)
+{
+    const float xLength = geometry.width() / (GridSize - 1.0);
+    const float yLength = geometry.height() / (GridSize - 1.0);
+
+    // Where the points would be if the window didn't wobble.
+    const Vec4 originX = make(geometry.x(), geometry.x() + xLength, geometry.x() + 2 * xLength,
+                              geometry.x() + geometry.width());
+    const float originY[GridSize] = {
+        float(geometry.y()),
+        float(geometry.y() + yLength),
+        float(geometry.y() + 2 * yLength),
+        float(geometry.y() + geometry.height()),
+    };
+
+    const Vec4 zero = broadcast(0);
+    const Vec4 stiffness = broadcast(parameters.stiffness);
+    // A spring to the left pushes a point to the right by its rest length and vice versa,
+    // springs on both sides cancel out.
+    const Vec4 restX = make(-xLength, 0, 0, xLength);
+
+    Vec4 positionX[GridSize];
+    Vec4 positionY[GridSize];
+    for (int j = 0; j < GridSize; ++j) {
+        positionX[j] = load(m_positionX + j * GridSize);
+        positionY[j] = load(m_positionY + j * GridSize);
+    }
+
+    Vec4 accelerationX[GridSize];
+    Vec4 accelerationY[GridSize];
+    for (int j = 0; j < GridSize; ++j) {
+        Vec4 neighboursX = shiftUp(positionX[j]) + shiftDown(positionX[j]);
+        Vec4 neighboursY = shiftUp(positionY[j]) + shiftDown(positionY[j]);
+        float restY = 0;
+        if (j > 0) {
+            neighboursX = neighboursX + positionX[j - 1];
+            neighboursY = neighboursY + positionY[j - 1];
+            restY += yLength;
+        }
+        if (j < GridSize - 1) {
+            neighboursX = neighboursX + positionX[j + 1];
+            neighboursY = neighboursY + positionY[j + 1];
+            restY -= yLength;
+        }
+
+        const Vec4 count = load(s_neighbourCount + j * GridSize);
+        const Vec4 inverseCount = load(s_inverseNeighbourCount + j * GridSize);
+        const Vec4 springX = stiffness * (neighboursX - count * positionX[j] + restX) * inverseCount;
+        const Vec4 springY = stiffness * (neighboursY - count * positionY[j] + broadcast(restY)) * inverseCount;
+
+        const Mask constrained = zero < load(m_constraint + j * GridSize);
+        accelerationX[j] = select(constrained, stiffness * (originX - positionX[j]), springX);
+        accelerationY[j] = select(constrained, stiffness * (broadcast(originY[j]) - positionY[j]), springY);
+    }
+
+    smooth(accelerationX);
+    smooth(accelerationY);
+
+    const Vec4 minAcceleration = broadcast(parameters.minAcceleration);
+    const Vec4 maxAcceleration = broadcast(parameters.maxAcceleration);
+    const Vec4 drag = broadcast(parameters.drag);
+    const Vec4 timeStep = broadcast(time);
+    Vec4 accelerationTotal = zero;
+
+    Vec4 velocityX[GridSize];
+    Vec4 velocityY[GridSize];
+    for (int j = 0; j < GridSize; ++j) {
+        const Vec4 ax = fixBounds(accelerationX[j], minAcceleration, maxAcceleration);
+        const Vec4 ay = fixBounds(accelerationY[j], minAcceleration, maxAcceleration);
+        velocityX[j] = ax * timeStep + load(m_velocityX + j * GridSize) * drag;
+        velocityY[j] = ay * timeStep + load(m_velocityY + j * GridSize) * drag;
+        accelerationTotal = accelerationTotal + abs(ax) + abs(ay);
+    }
+
+    smooth(velocityX);
+    smooth(velocityY);
+
+    const Vec4 minVelocity = broadcast(parameters.minVelocity);
+    const Vec4 maxVelocity = broadcast(parameters.maxVelocity);
+    const Vec4 distance = broadcast(time * parameters.moveFactor);
+    Vec4 velocityTotal = zero;
+
+    // Edges that may not wobble stay in place, together with the inner points next to them.
+    const bool leftLocked = !(edges & Qt::LeftEdge);
+    const bool rightLocked = !(edges & Qt::RightEdge);
+    const bool topLocked = !(edges & Qt::TopEdge);
+    const bool bottomLocked = !(edges & Qt::BottomEdge);
+    const Mask lockColumns = zero < make(leftLocked,
+                                         leftLocked || rightLocked,
+                                         leftLocked || rightLocked,
+                                         rightLocked);
+
+    for (int j = 0; j < GridSize; ++j) {
+        const Vec4 vx = fixBounds(velocityX[j], minVelocity, maxVelocity);
+        const Vec4 vy = fixBounds(velocityY[j], minVelocity, maxVelocity);
+        store(m_velocityX + j * GridSize, vx);
+        store(m_velocityY + j * GridSize, vy);
+        velocityTotal = velocityTotal + abs(vx) + abs(vy);
+
+        Vec4 px = positionX[j] + vx * distance;
+        Vec4 py = positionY[j] + vy * distance;
+        px = select(lockColumns, originX, px);
+        if ((topLocked && j < GridSize - 1) || (bottomLocked && j > 0)) {
+            py = broadcast(originY[j]);
+        }
+        store(m_positionX + j * GridSize, px);
+        store(m_positionY + j * GridSize, py);
+    }
+
+    *accelerationSum = horizontalSum(accelerationTotal);
+    *velocitySum = horizontalSum(velocityTotal);
+}
+
+QRectF WobblyMesh::deform(WindowQuadList &quads, const QSizeF &size, const QPointF &origin) const
+{
+    // The bicubic surface is evaluated as a cubic curve in y, whose control points are cubic
+    // curves in x. The control points for a vertical line and the basis for a horizontal line
+    // only depend on one coordinate, so they are computed once per distinct coordinate.
+    struct Column
+    {
+        float x[GridSize];
+        float y[GridSize];
+    };
+    struct Row
+    {
+        float basis[GridSize];
+    };
+
+    CoordinateCache<Column> columns;
+    CoordinateCache<Row> rows;
+
+    const auto computeColumn = [this, &size](double x, Column &column) {
+        float basis[GridSize];
+        bernsteinBasis(x / size.width(), basis);
+        Vec4 curveX = broadcast(0);
+        Vec4 curveY = broadcast(0);
+        for (int i = 0; i < GridSize; ++i) {
+            // the control points of column i, one per row
+            const Vec4 weight = broadcast(basis[i]);
+            curveX = curveX + weight * make(m_positionX[i], m_positionX[GridSize + i],
+                                            m_positionX[2 * GridSize + i], m_positionX[3 * GridSize + i]);
+            curveY = curveY + weight * make(m_positionY[i], m_positionY[GridSize + i],
+                                            m_positionY[2 * GridSize + i], m_positionY[3 * GridSize + i]);
+        }
+        store(column.x, curveX);
+        store(column.y, curveY);
+    };
+    const auto computeRow = [&size](double y, Row &row) {
+        bernsteinBasis(y / size.height(), row.basis);
+    };
+
+    float left = std::numeric_limits<float>::max();
+    float top = std::numeric_limits<float>::max();
+    float right = std::numeric_limits<float>::lowest();
+    float bottom = std::numeric_limits<float>::lowest();
+
+    for (WindowQuad &quad : quads) {
+        for (int k = 0; k < 4; ++k) {
+            WindowVertex &vertex = quad[k];
+            const Column &column = columns.lookup(vertex.x(), computeColumn);
+            const Row &row = rows.lookup(vertex.y(), computeRow);
+
+            float x = 0;
+            float y = 0;
+            for (int j = 0; j < GridSize; ++j) {
+                x += row.basis[j] * column.x[j];
+                y += row.basis[j] * column.y[j];
+            }
+            x -= origin.x();
+            y -= origin.y();
+            vertex.move(x, y);
+
+            left = std::min(left, x);
+            top = std::min(top, y);
+            right = std::max(right, x);
+            bottom = std::max(bottom, y);
+        }
+    }
+
+    if (left > right) {
+        return QRectF();
+    }
+    return QRectF(QPointF(left, top), QPointF(right, bottom));
+}
+
+} // namespace KWin
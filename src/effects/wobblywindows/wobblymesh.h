@@ -0,0 +1,86 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef KWIN_WOBBLYMESH_H
+#define KWIN_WOBBLYMESH_H
+
+#include <kwineffects.h>
+
+#include <QRectF>
+
+namespace KWin
+{
+
+/**
+ * The spring mesh of a wobbling window.
+ *
+ * The mesh is a fixed grid of 4x4 points which serve as the control points of a bicubic
+ * bezier surface. Each point is pulled towards its neighbours and the constrained points are
+ * pulled towards their place on the window.
+ *
+ * Every quantity is stored as one float array per coordinate, a row of the grid fills one
+ * SIMD register. The mesh doesn't allocate any memory.
+ */
+class WobblyMesh
+{
+public:
+    static const int GridSize = 4;
+    static const int PointCount = GridSize * GridSize;
+
+    struct Parameters
+    {
+        float stiffness;
+        float drag;
+        float moveFactor;
+        float minVelocity;
+        float maxVelocity;
+        float minAcceleration;
+        float maxAcceleration;
+    };
+
+    /**
+     * Places all points at rest on @a geometry, clears the velocities and releases all
+     * constraints.
+     */
+    void reset(const QRectF &geometry);
+
+    QPointF position(int index) const;
+    QPointF velocity(int index) const;
+    void setVelocity(int index, const QPointF &velocity);
+    bool isConstrained(int index) const;
+    void setConstrained(int index, bool constrained);
+
+    /**
+     * Advances the simulation by @a time milliseconds while the window is at @a geometry.
+     * Only the @a edges of the window wobble. The sums of the absolute accelerations and
+     * velocities of all points are stored in @a accelerationSum and @a velocitySum.
+     */
+    void step(const QRectF &geometry, float time, const Parameters &parameters, Qt::Edges edges,
+              float *accelerationSum, float *velocitySum);
+
+    /**
+     * Moves the vertices of @a quads onto the bezier surface. The vertices are in the
+     * coordinate system of a window with the given @a size at @a origin.
+     *
+     * Returns the bounding rectangle of the moved vertices.
+     */
+    QRectF deform(WindowQuadList &quads, const QSizeF &size, const QPointF &origin) const;
+
+private:
+    alignas(16) float m_positionX[PointCount];
+    alignas(16) float m_positionY[PointCount];
+    alignas(16) float m_velocityX[PointCount];
+    alignas(16) float m_velocityY[PointCount];
+    // 1 for points that are pulled towards the window rather than their neighbours, otherwise 0
+    alignas(16) float m_constraint[PointCount];
+};
+
+} // namespace KWin
+
+#endif
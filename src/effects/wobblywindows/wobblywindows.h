@@ -13,6 +13,8 @@
 // Include with base class for effects.
 #include <kwineffects.h>
 
+#include "wobblymesh.h"
+
 namespace KWin
 {
 
@@ -62,11 +64,6 @@ public:
     void setVelocityThreshold(qreal velocityThreshold);
     void setMoveFactor(qreal factor);
 
-    struct Pair {
-        qreal x;
-        qreal y;
-    };
-
     enum WindowStatus {
         Free,
         Moving,
@@ -127,24 +124,9 @@ private:
     bool updateWindowWobblyDatas(EffectWindow* w, qreal time);
 
     struct WindowWobblyInfos {
-        Pair* origin;
-        Pair* position;
-        Pair* velocity;
-        Pair* acceleration;
-        Pair* buffer;
-
-        // if true, the physics system moves this point based only on it "normal" destination
-        // given by the window position, ignoring neighbour points.
-        bool* constraint;
-
-        unsigned int width;
-        unsigned int height;
-        unsigned int count;
-
-        Pair* bezierSurface;
-        unsigned int bezierWidth;
-        unsigned int bezierHeight;
-        unsigned int bezierCount;
+        // constrained points are moved based only on their "normal" destination given by
+        // the window position, ignoring neighbour points.
+        WobblyMesh mesh;
 
         WindowStatus status;
 
@@ -180,11 +162,6 @@ private:
     bool m_resizeWobble;
 
     void initWobblyInfo(WindowWobblyInfos& wwi, QRect geometry) const;
-    void freeWobblyInfo(WindowWobblyInfos& wwi) const;
-
-    WobblyWindowsEffect::Pair computeBezierPoint(const WindowWobblyInfos& wwi, Pair point) const;
-
-    static void heightRingLinearMean(Pair** data_pointer, WindowWobblyInfos& wwi);
 
     void setParameterSet(const ParameterSet& pset);
 };
@@ -0,0 +1,254 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "hittestindex.h"
+#include "abstract_client.h"
+#ifdef KWIN_BUILD_ACTIVITIES
+#include "activities.h"
+#endif
+#include "screens.h"
+#include "toplevel.h"
+#include "virtualdesktops.h"
+#include "workspace.h"
+
+#include <KWaylandServer/surface_interface.h>
+
+#include <algorithm>
+
+namespace KWin
+{
+
+HitTestIndex::HitTestIndex(QObject *parent)
+    : QObject(parent)
+{
+    connect(workspace(), &Workspace::stackingOrderChanged, this, &HitTestIndex::invalidate);
+    // The stacking order is not always updated right away when a window is added or removed.
+    connect(workspace(), &Workspace::clientAdded, this, &HitTestIndex::invalidate);
+    connect(workspace(), &Workspace::clientRemoved, this, &HitTestIndex::invalidate);
+    connect(workspace(), &Workspace::unmanagedAdded, this, &HitTestIndex::invalidate);
+    connect(workspace(), &Workspace::unmanagedRemoved, this, &HitTestIndex::invalidate);
+    connect(workspace(), &Workspace::internalClientAdded, this, &HitTestIndex::invalidate);
+    connect(workspace(), &Workspace::internalClientRemoved, this, &HitTestIndex::invalidate);
+    connect(workspace(), &Workspace::deletedRemoved, this, &HitTestIndex::invalidate);
+    connect(VirtualDesktopManager::self(), &VirtualDesktopManager::currentChanged, this, &HitTestIndex::invalidate);
+#ifdef KWIN_BUILD_ACTIVITIES
+    if (Activities::self()) {
+        connect(Activities::self(), &Activities::currentChanged, this, &HitTestIndex::invalidate);
+    }
+#endif
+    connect(screens(), &Screens::changed, this, &HitTestIndex::invalidate);
+}
+
+HitTestIndex::~HitTestIndex()
+{
+}
+
+void HitTestIndex::invalidate()
+{
+    m_valid = false;
+}
+
+void HitTestIndex::watch(Toplevel *toplevel)
+{
+    if (m_watched.contains(toplevel)) {
+        return;
+    }
+    m_watched.insert(toplevel);
+
+    connect(toplevel, &QObject::destroyed, this, [this, toplevel] {
+        m_watched.remove(toplevel);
+        remove(toplevel);
+    });
+    auto updateToplevel = [this, toplevel] {
+        update(toplevel);
+    };
+    connect(toplevel, &Toplevel::frameGeometryChanged, this, updateToplevel);
+    connect(toplevel, &Toplevel::bufferGeometryChanged, this, updateToplevel);
+    connect(toplevel, &Toplevel::windowShown, this, updateToplevel);
+    connect(toplevel, &Toplevel::windowHidden, this, updateToplevel);
+
+    auto watchSurface = [this, toplevel, updateToplevel] {
+        if (KWaylandServer::SurfaceInterface *surface = toplevel->surface()) {
+            // Windows with sub-surfaces are listed in every cell, see cellsFor().
+            connect(surface, &KWaylandServer::SurfaceInterface::childSubSurfaceAdded, this, updateToplevel);
+            connect(surface, &KWaylandServer::SurfaceInterface::childSubSurfaceRemoved, this, updateToplevel);
+        }
+    };
+    connect(toplevel, &Toplevel::surfaceChanged, this, [updateToplevel, watchSurface] {
+        updateToplevel();
+        watchSurface();
+    });
+    watchSurface();
+
+    if (AbstractClient *client = qobject_cast<AbstractClient *>(toplevel)) {
+        connect(client, &AbstractClient::desktopChanged, this, updateToplevel);
+        connect(client, &AbstractClient::activitiesChanged, this, updateToplevel);
+        connect(client, &AbstractClient::minimizedChanged, this, updateToplevel);
+    }
+}
+
+static bool canReceiveInput(Toplevel *toplevel)
+{
+    if (toplevel->isDeleted()) {
+        // a deleted window doesn't get mouse events
+        return false;
+    }
+    if (AbstractClient *c = qobject_cast<AbstractClient *>(toplevel)) {
+        if (!c->isOnCurrentActivity() || !c->isOnCurrentDesktop() || c->isMinimized() || c->isHiddenInternal()) {
+            return false;
+        }
+    }
+    return toplevel->readyForPainting();
+}
+
+QRect HitTestIndex::cellsFor(Toplevel *toplevel) const
+{
+    // Sub-surfaces can be moved around without the window noticing, so a window that has
+    // them is a candidate everywhere.
+    QRect rect;
+    KWaylandServer::SurfaceInterface *surface = toplevel->surface();
+    if (surface && !surface->childSubSurfaces().isEmpty()) {
+        rect = m_bounds;
+    } else {
+        rect = (toplevel->inputGeometry() | toplevel->bufferGeometry()) & m_bounds;
+    }
+    if (rect.isEmpty()) {
+        return QRect();
+    }
+
+    const int left = (rect.left() - m_bounds.left()) / s_cellSize;
+    const int right = (rect.right() - m_bounds.left()) / s_cellSize;
+    const int top = (rect.top() - m_bounds.top()) / s_cellSize;
+    const int bottom = (rect.bottom() - m_bounds.top()) / s_cellSize;
+    return QRect(QPoint(left, top), QPoint(right, bottom));
+}
+
+void HitTestIndex::insertSorted(QVector<Toplevel *> &list, Toplevel *toplevel) const
+{
+    // The lists are ordered topmost first.
+    const int position = m_entries.value(toplevel).stackingPosition;
+    auto it = std::find_if(list.begin(), list.end(), [this, position](Toplevel *other) {
+        return m_entries.value(other).stackingPosition < position;
+    });
+    list.insert(it, toplevel);
+}
+
+void HitTestIndex::rebuild()
+{
+    m_bounds = screens()->geometry();
+    m_columns = (m_bounds.width() + s_cellSize - 1) / s_cellSize;
+    m_rows = (m_bounds.height() + s_cellSize - 1) / s_cellSize;
+    m_cells.resize(m_columns * m_rows);
+    for (QVector<Toplevel *> &cell : m_cells) {
+        cell.clear();
+    }
+    m_candidates.clear();
+    m_entries.clear();
+
+    const QList<Toplevel *> &stacking = workspace()->stackingOrder();
+    for (int i = stacking.count() - 1; i >= 0; --i) {
+        Toplevel *toplevel = stacking.at(i);
+        watch(toplevel);
+
+        Entry &entry = m_entries[toplevel];
+        entry.stackingPosition = i;
+        if (!canReceiveInput(toplevel)) {
+            continue;
+        }
+        entry.candidate = true;
+        entry.cells = cellsFor(toplevel);
+        m_candidates.append(toplevel);
+
+        for (int row = entry.cells.top(); row <= entry.cells.bottom(); ++row) {
+            for (int column = entry.cells.left(); column <= entry.cells.right(); ++column) {
+                m_cells[row * m_columns + column].append(toplevel);
+            }
+        }
+    }
+
+    m_valid = true;
+}
+
+void HitTestIndex::update(Toplevel *toplevel)
+{
+    if (!m_valid) {
+        return;
+    }
+    auto it = m_entries.find(toplevel);
+    if (it == m_entries.end()) {
+        // The window is not in the stacking order yet, its position is unknown.
+        invalidate();
+        return;
+    }
+    Entry &entry = *it;
+
+    const bool candidate = canReceiveInput(toplevel);
+    if (candidate != entry.candidate) {
+        if (candidate) {
+            insertSorted(m_candidates, toplevel);
+        } else {
+            m_candidates.removeOne(toplevel);
+        }
+        entry.candidate = candidate;
+    }
+
+    const QRect cells = candidate ? cellsFor(toplevel) : QRect();
+    if (cells == entry.cells) {
+        return;
+    }
+    for (int row = entry.cells.top(); row <= entry.cells.bottom(); ++row) {
+        for (int column = entry.cells.left(); column <= entry.cells.right(); ++column) {
+            if (!cells.contains(column, row)) {
+                m_cells[row * m_columns + column].removeOne(toplevel);
+            }
+        }
+    }
+    for (int row = cells.top(); row <= cells.bottom(); ++row) {
+        for (int column = cells.left(); column <= cells.right(); ++column) {
+            if (!entry.cells.contains(column, row)) {
+                insertSorted(m_cells[row * m_columns + column], toplevel);
+            }
+        }
+    }
+    entry.cells = cells;
+}
+
+void HitTestIndex::remove(Toplevel *toplevel)
+{
+    // The window is being destroyed, it must not be dereferenced.
+    if (!m_valid) {
+        return;
+    }
+    const Entry entry = m_entries.take(toplevel);
+    if (!entry.candidate) {
+        return;
+    }
+    m_candidates.removeOne(toplevel);
+    for (int row = entry.cells.top(); row <= entry.cells.bottom(); ++row) {
+        for (int column = entry.cells.left(); column <= entry.cells.right(); ++column) {
+            m_cells[row * m_columns + column].removeOne(toplevel);
+        }
+    }
+}
+
+const QVector<Toplevel *> &HitTestIndex::candidatesAt(const QPoint &pos)
+{
+    if (!m_valid) {
+        rebuild();
+    }
+    if (!m_bounds.contains(pos)) {
+        // e.g. during a drag that leaves the outputs, fall back to all windows
+        return m_candidates;
+    }
+    const int column = (pos.x() - m_bounds.x()) / s_cellSize;
+    const int row = (pos.y() - m_bounds.y()) / s_cellSize;
+    return m_cells.at(row * m_columns + column);
+}
+
+} // namespace KWin
@@ -0,0 +1,86 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include <kwinglobals.h>
+
+#include <QHash>
+#include <QObject>
+#include <QRect>
+#include <QSet>
+#include <QVector>
+
+namespace KWin
+{
+
+class Toplevel;
+
+/**
+ * The HitTestIndex class helps finding the window under a point without walking the whole
+ * stacking order.
+ *
+ * The outputs are divided into a uniform grid. Each cell lists the windows that can receive
+ * input within it, topmost first. Windows that are not on the current virtual desktop or
+ * activity, that are minimized or hidden, are not listed at all. The index is rebuilt lazily
+ * after the stacking order, the current virtual desktop or activity, or the outputs have changed.
+ * When a single window is moved, resized, shown or hidden, only the cells it left and entered
+ * are updated.
+ *
+ * The candidates are not hit tested, and the caller still has to check whether they accept
+ * input, e.g. while the screen is locked.
+ */
+class KWIN_EXPORT HitTestIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit HitTestIndex(QObject *parent = nullptr);
+    ~HitTestIndex() override;
+
+    /**
+     * Returns the windows that may accept input at @a pos, topmost first.
+     */
+    const QVector<Toplevel *> &candidatesAt(const QPoint &pos);
+
+    /**
+     * Marks the index as outdated, it will be rebuilt on the next lookup.
+     */
+    void invalidate();
+
+private:
+    struct Entry
+    {
+        /** Higher positions are stacked above lower ones */
+        int stackingPosition = 0;
+        /** The columns and rows of the cells the window is listed in */
+        QRect cells;
+        bool candidate = false;
+    };
+
+    void rebuild();
+    void update(Toplevel *toplevel);
+    void remove(Toplevel *toplevel);
+    void watch(Toplevel *toplevel);
+    QRect cellsFor(Toplevel *toplevel) const;
+    void insertSorted(QVector<Toplevel *> &list, Toplevel *toplevel) const;
+
+    static const int s_cellSize = 256;
+
+    QRect m_bounds;
+    int m_columns = 0;
+    int m_rows = 0;
+    QVector<QVector<Toplevel *>> m_cells;
+    QVector<Toplevel *> m_candidates;
+    QHash<Toplevel *, Entry> m_entries;
+    QSet<Toplevel *> m_watched;
+    bool m_valid = false;
+};
+
+} // namespace KWin
@@ -12,6 +12,7 @@
 #include "effects.h"
 #include "gestures.h"
 #include "globalshortcuts.h"
+#include "hittestindex.h"
 #include "input_event.h"
 #include "input_event_spy.h"
 #include "keyboard_input.h"
@@ -2313,7 +2314,7 @@ void InputRedirection::setupLibInput()
         connect(conn, &LibInput::Connection::eventsRead, this,
             [this] {
                 m_libInput->processEvents();
-            }, Qt::QueuedConnection
+            }
         );
         conn->setup();
         connect(conn, &LibInput::Connection::pointerButtonChanged, m_pointer, &PointerInputRedirection::processButton);
@@ -2614,15 +2615,12 @@ Toplevel *InputRedirection::findManagedToplevel(const QPoint &pos)
     if (!Workspace::self()) {
         return nullptr;
     }
-    const bool isScreenLocked = waylandServer() && waylandServer()->isScreenLocked();
-    const QList<Toplevel *> &stacking = Workspace::self()->stackingOrder();
-    if (stacking.isEmpty()) {
-        return nullptr;
+    if (!m_hitTestIndex) {
+        m_hitTestIndex = new HitTestIndex(Workspace::self());
     }
-    auto it = stacking.end();
-    do {
-        --it;
-        Toplevel *t = (*it);
+    const bool isScreenLocked = waylandServer() && waylandServer()->isScreenLocked();
+    const QVector<Toplevel *> &candidates = m_hitTestIndex->candidatesAt(pos);
+    for (Toplevel *t : candidates) {
         if (t->isDeleted()) {
             // a deleted window doesn't get mouse events
             continue;
@@ -2643,7 +2641,7 @@ Toplevel *InputRedirection::findManagedToplevel(const QPoint &pos)
         if (t->hitTest(pos)) {
             return t;
         }
-    } while (it != stacking.begin());
+    }
     return nullptr;
 }
 
@@ -32,6 +32,7 @@ class QWheelEvent;
 namespace KWin
 {
 class GlobalShortcutsManager;
+class HitTestIndex;
 class Toplevel;
 class InputEventFilter;
 class InputEventSpy;
@@ -329,6 +330,8 @@ private:
 
     WindowSelectorFilter *m_windowSelector = nullptr;
 
+    QPointer<HitTestIndex> m_hitTestIndex;
+
     QVector<InputEventFilter*> m_filters;
     QVector<InputEventSpy*> m_spies;
     KConfigWatcher::Ptr m_inputConfigWatcher;
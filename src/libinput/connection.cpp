@@ -141,8 +141,14 @@ Connection *Connection::create(QObject *parent)
             return nullptr;
         }
     }
-    Connection::createThread();
     s_self = new Connection(s_context);
+    if (s_self->m_eventRing.fileDescriptor() == -1) {
+        // Without the eventfd, the main thread can't be woken up for new events.
+        qCWarning(KWIN_LIBINPUT) << "Failed to set up the event ring";
+        delete s_self;
+        return nullptr;
+    }
+    Connection::createThread();
     s_self->moveToThread(s_thread);
     QObject::connect(s_thread, &QThread::finished, s_self, &QObject::deleteLater);
     QObject::connect(s_thread, &QThread::finished, s_thread, &QObject::deleteLater);
@@ -150,6 +156,15 @@ Connection *Connection::create(QObject *parent)
     if (!s_adaptor) {
         s_adaptor = new ConnectionAdaptor(s_self);
     }
+    // The notifier has to live in the main thread, that's where the events are processed.
+    QSocketNotifier *notifier = new QSocketNotifier(s_self->m_eventRing.fileDescriptor(), QSocketNotifier::Read, parent);
+    QObject::connect(notifier, &QSocketNotifier::activated, notifier, [] {
+        if (s_self) {
+            s_self->m_eventRing.acknowledge();
+            emit s_self->eventsRead();
+        }
+    });
+    s_self->m_eventRingNotifier = notifier;
 
     return s_self;
 }
@@ -170,6 +185,7 @@ Connection::Connection(Context *input, QObject *parent)
 
 Connection::~Connection()
 {
+    delete m_overflowEvent;
     delete s_adaptor;
     s_adaptor = nullptr;
     s_self = nullptr;
@@ -225,18 +241,34 @@ void Connection::deactivate()
 
 void Connection::handleEvent()
 {
-    QMutexLocker locker(&m_mutex);
-    const bool wasEmpty = m_eventQueue.isEmpty();
+    bool pushed = false;
+    if (m_overflowEvent) {
+        if (!m_eventRing.push(m_overflowEvent)) {
+            return;
+        }
+        m_overflowEvent = nullptr;
+        m_notifier->setEnabled(true);
+        pushed = true;
+    }
     do {
         m_input->dispatch();
         Event *event = m_input->event();
         if (!event) {
             break;
         }
-        m_eventQueue << event;
+        if (!m_eventRing.push(event)) {
+            // The main thread is far behind. The remaining events stay in the libinput queue,
+            // the main thread will ask for them once it has caught up. The notifier is level
+            // triggered, so it must not fire until then.
+            m_overflowEvent = event;
+            m_notifier->setEnabled(false);
+            pushed = true; // make sure the main thread wakes up and drains the ring
+            break;
+        }
+        pushed = true;
     } while (true);
-    if (wasEmpty && !m_eventQueue.isEmpty()) {
-        emit eventsRead();
+    if (pushed) {
+        m_eventRing.notify();
     }
 }
 
@@ -329,14 +361,18 @@ KWin::TabletToolId createTabletId(libinput_tablet_tool *tool, void *userData)
 
 void Connection::processEvents()
 {
-    QMutexLocker locker(&m_mutex);
-    while (!m_eventQueue.isEmpty()) {
-        QScopedPointer<Event> event(m_eventQueue.takeFirst());
+    // The events are handed over without a lock. The mutex only guards the list of devices,
+    // which the slots running in the libinput thread iterate.
+    while (Event *nextEvent = m_eventRing.pop()) {
+        QScopedPointer<Event> event(nextEvent);
         switch (event->type()) {
             case LIBINPUT_EVENT_DEVICE_ADDED: {
                 auto device = new Device(event->nativeDevice());
                 device->moveToThread(s_thread);
-                m_devices << device;
+                {
+                    QMutexLocker locker(&m_mutex);
+                    m_devices << device;
+                }
                 if (device->isKeyboard()) {
                     m_keyboard++;
                     if (device->isAlphaNumericKeyboard()) {
@@ -377,6 +413,7 @@ void Connection::processEvents()
                 break;
             }
             case LIBINPUT_EVENT_DEVICE_REMOVED: {
+                QMutexLocker locker(&m_mutex);
                 auto it = std::find_if(m_devices.begin(), m_devices.end(), [&event] (Device *d) { return event->device() == d; } );
                 if (it == m_devices.end()) {
                     // we don't know this device
@@ -384,6 +421,7 @@ void Connection::processEvents()
                 }
                 auto device = *it;
                 m_devices.erase(it);
+                locker.unlock();
                 emit deviceRemoved(device);
 
                 if (device->isKeyboard()) {
@@ -444,18 +482,16 @@ void Connection::processEvents()
                 auto deltaNonAccel = pe->deltaUnaccelerated();
                 quint32 latestTime = pe->time();
                 quint64 latestTimeUsec = pe->timeMicroseconds();
-                auto it = m_eventQueue.begin();
-                while (it != m_eventQueue.end()) {
-                    if ((*it)->type() == LIBINPUT_EVENT_POINTER_MOTION) {
-                        QScopedPointer<PointerEvent> p(static_cast<PointerEvent*>(*it));
-                        delta += p->delta();
-                        deltaNonAccel += p->deltaUnaccelerated();
-                        latestTime = p->time();
-                        latestTimeUsec = p->timeMicroseconds();
-                        it = m_eventQueue.erase(it);
-                    } else {
+                // If the main thread has fallen behind, merge the queued motion events.
+                while (Event *next = m_eventRing.peek()) {
+                    if (next->type() != LIBINPUT_EVENT_POINTER_MOTION) {
                         break;
                     }
+                    QScopedPointer<PointerEvent> p(static_cast<PointerEvent*>(m_eventRing.pop()));
+                    delta += p->delta();
+                    deltaNonAccel += p->deltaUnaccelerated();
+                    latestTime = p->time();
+                    latestTimeUsec = p->timeMicroseconds();
                 }
                 emit pointerMotion(delta, deltaNonAccel, latestTime, latestTimeUsec, pe->device());
                 break;
@@ -625,6 +661,10 @@ void Connection::processEvents()
                 break;
         }
     }
+    if (m_eventRing.takeOverflow()) {
+        // The libinput thread stopped reading events because the ring was full.
+        QMetaObject::invokeMethod(this, &Connection::handleEvent, Qt::QueuedConnection);
+    }
     if (wasSuspended) {
         if (m_keyboardBeforeSuspend && !m_keyboard) {
             emit hasKeyboardChanged(false);
@@ -744,6 +784,7 @@ void Connection::slotKGlobalSettingsNotifyChange(int type, int arg)
 {
     if (type == 3 /**SettingsChanged**/ && arg == 0 /** SETTINGS_MOUSE */) {
         m_config->reparseConfiguration();
+        QMutexLocker locker(&m_mutex);
         for (auto it = m_devices.constBegin(), end = m_devices.constEnd(); it != end; ++it) {
             if ((*it)->isPointer()) {
                 applyDeviceConfig(*it);
@@ -756,6 +797,7 @@ void Connection::toggleTouchpads()
 {
     bool changed = false;
     m_touchpadsEnabled = !m_touchpadsEnabled;
+    QMutexLocker locker(&m_mutex);
     for (auto it = m_devices.constBegin(); it != m_devices.constEnd(); ++it) {
         auto device = *it;
         if (!device->isTouchpad()) {
@@ -804,6 +846,7 @@ void Connection::updateLEDs(Xkb::LEDs leds)
     m_leds = leds;
     // update on devices
     const libinput_led l = static_cast<libinput_led>(toLibinputLEDS(leds));
+    QMutexLocker locker(&m_mutex);
     for (auto it = m_devices.constBegin(), end = m_devices.constEnd(); it != end; ++it) {
         libinput_device_led_update((*it)->device(), l);
     }
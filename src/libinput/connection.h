@@ -11,6 +11,7 @@
 
 #include <kwinglobals.h>
 
+#include "eventring.h"
 #include "input.h"
 #include "keyboard_input.h"
 
@@ -155,7 +156,11 @@ private:
     bool m_touchBeforeSuspend = false;
     bool m_tabletModeSwitchBeforeSuspend = false;
     QMutex m_mutex;
-    QVector<Event*> m_eventQueue;
+    EventRing m_eventRing;
+    // lives in the main thread, owned by the parent passed to create()
+    QPointer<QSocketNotifier> m_eventRingNotifier;
+    // an event that didn't fit into the ring, only accessed in the libinput thread
+    Event *m_overflowEvent = nullptr;
     bool wasSuspended = false;
     QVector<Device*> m_devices;
     KSharedConfigPtr m_config;
@@ -0,0 +1,110 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "eventring.h"
+#include "events.h"
+#include "libinput_logging.h"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace KWin
+{
+namespace LibInput
+{
+
+EventRing::EventRing(int capacity)
+    : m_slots(capacity, nullptr)
+    , m_mask(capacity - 1)
+{
+    Q_ASSERT(capacity > 0 && (capacity & (capacity - 1)) == 0);
+    m_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (m_fd == -1) {
+        qCWarning(KWIN_LIBINPUT) << "Failed to create an eventfd for the event ring";
+    }
+}
+
+EventRing::~EventRing()
+{
+    while (Event *event = pop()) {
+        delete event;
+    }
+    if (m_fd != -1) {
+        close(m_fd);
+    }
+}
+
+int EventRing::fileDescriptor() const
+{
+    return m_fd;
+}
+
+int EventRing::capacity() const
+{
+    return int(m_slots.size());
+}
+
+bool EventRing::push(Event *event)
+{
+    const quint32 tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_head.load(std::memory_order_acquire) == quint32(m_slots.size())) {
+        m_overflow.store(true);
+        return false;
+    }
+    m_slots[tail & m_mask] = event;
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+void EventRing::notify()
+{
+    if (m_fd != -1) {
+        const quint64 value = 1;
+        if (write(m_fd, &value, sizeof(value)) == -1) {
+            // The counter can only overflow if the consumer is gone.
+            qCWarning(KWIN_LIBINPUT) << "Failed to notify about new events";
+        }
+    }
+}
+
+Event *EventRing::pop()
+{
+    const quint32 head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tail.load(std::memory_order_acquire)) {
+        return nullptr;
+    }
+    Event *event = m_slots[head & m_mask];
+    m_head.store(head + 1, std::memory_order_release);
+    return event;
+}
+
+Event *EventRing::peek() const
+{
+    const quint32 head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tail.load(std::memory_order_acquire)) {
+        return nullptr;
+    }
+    return m_slots[head & m_mask];
+}
+
+void EventRing::acknowledge()
+{
+    if (m_fd != -1) {
+        quint64 value;
+        while (read(m_fd, &value, sizeof(value)) > 0) {
+        }
+    }
+}
+
+bool EventRing::takeOverflow()
+{
+    return m_overflow.exchange(false);
+}
+
+}
+}
@@ -0,0 +1,98 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#ifndef KWIN_LIBINPUT_EVENTRING_H
+#define KWIN_LIBINPUT_EVENTRING_H
+
+#include <QtGlobal>
+
+#include <atomic>
+#include <vector>
+
+namespace KWin
+{
+namespace LibInput
+{
+
+class Event;
+
+/**
+ * The EventRing class passes events from the libinput thread to the main thread.
+ *
+ * It's a bounded queue with a single producer and a single consumer. The slots are allocated
+ * upfront, and neither side ever takes a lock. The producer wakes up the consumer through an
+ * eventfd once it has pushed a batch of events.
+ */
+class EventRing
+{
+public:
+    /**
+     * Creates a ring with room for @a capacity events, which must be a power of two.
+     */
+    explicit EventRing(int capacity = 4096);
+    ~EventRing();
+
+    /**
+     * Returns the eventfd that becomes readable when notify() is called, or -1 if it could
+     * not be created.
+     */
+    int fileDescriptor() const;
+
+    int capacity() const;
+
+    /**
+     * Adds the @a event at the end of the ring and takes ownership of it. Returns @c false
+     * if the ring is full, in which case the ring is flagged as overflowed and the caller
+     * keeps the ownership. Must be called only from the producer thread.
+     */
+    bool push(Event *event);
+
+    /**
+     * Wakes up the consumer. Must be called only from the producer thread.
+     */
+    void notify();
+
+    /**
+     * Removes the first event from the ring and returns it, or @c nullptr if the ring is
+     * empty. The caller takes ownership of the event. Must be called only from the consumer
+     * thread.
+     */
+    Event *pop();
+
+    /**
+     * Returns the first event without removing it, or @c nullptr if the ring is empty. Must
+     * be called only from the consumer thread.
+     */
+    Event *peek() const;
+
+    /**
+     * Resets the wakeup, so the eventfd becomes readable only after the next notify(). Must
+     * be called only from the consumer thread.
+     */
+    void acknowledge();
+
+    /**
+     * Returns @c true if a push failed since the last call, i.e. whether the producer is
+     * waiting for the consumer to catch up. Must be called only from the consumer thread.
+     */
+    bool takeOverflow();
+
+private:
+    std::vector<Event *> m_slots;
+    const quint32 m_mask;
+    // the consumer owns m_head, the producer owns m_tail
+    alignas(64) std::atomic<quint32> m_head{0};
+    alignas(64) std::atomic<quint32> m_tail{0};
+    std::atomic<bool> m_overflow{false};
+    int m_fd = -1;
+};
+
+}
+}
+
+#endif
@@ -217,8 +217,10 @@ quint64 AnimationEffect::p_animate( EffectWindow *w, Attribute a, uint meta, int
                 this, &AnimationEffect::_windowExpandedGeometryChanged);
     }
     AniMap::iterator it = d->m_animations.find(w);
-    if (it == d->m_animations.end())
+    if (it == d->m_animations.end()) {
         it = d->m_animations.insert(w, QPair<QList<AniData>, QRect>(QList<AniData>(), QRect()));
+        addAffectedWindow(w);
+    }
 
     FullScreenEffectLockPtr fullscreen;
     if (fullScreenEffect) {
@@ -375,7 +377,9 @@ bool AnimationEffect::cancel(quint64 animationId)
             if (anim->id == animationId) {
                 entry->first.erase(anim); // remove the animation
                 if (entry->first.isEmpty()) { // no other animations on the window, release it.
+                    EffectWindow *window = entry.key();
                     d->m_animations.erase(entry);
+                    removeAffectedWindow(window);
                 }
                 if (d->m_animations.isEmpty())
                     disconnectGeometryChanges();
@@ -450,7 +454,9 @@ void AnimationEffect::prePaintScreen( ScreenPrePaintData& data, std::chrono::mil
         if (entry->first.isEmpty()) {
             data.paint |= entry->second;
 //             d->m_damageDirty = true; // TODO likely no longer required
+            EffectWindow *window = entry.key();
             entry = d->m_animations.erase(entry);
+            removeAffectedWindow(window);
             mapEnd = d->m_animations.end();
         } else {
             if (invalidateLayerRect)
@@ -1005,6 +1011,7 @@ void AnimationEffect::_windowDeleted( EffectWindow* w )
 {
     Q_D(AnimationEffect);
     d->m_animations.remove( w );
+    removeAffectedWindow(w);
 }
 
 
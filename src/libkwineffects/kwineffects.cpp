@@ -219,6 +219,7 @@ public:
     qreal brightness;
     int screen;
     qreal crossFadeProgress;
+    int thumbnailRefreshInterval;
     QMatrix4x4 pMatrix;
     QMatrix4x4 mvMatrix;
     QMatrix4x4 screenProjectionMatrix;
@@ -241,6 +242,7 @@ WindowPaintData::WindowPaintData(EffectWindow* w, const QMatrix4x4 &screenProjec
     setBrightness(1.0);
     setScreen(0);
     setCrossFadeProgress(1.0);
+    setThumbnailRefreshInterval(0);
 }
 
 WindowPaintData::WindowPaintData(const WindowPaintData &other)
@@ -261,6 +263,7 @@ WindowPaintData::WindowPaintData(const WindowPaintData &other)
     setBrightness(other.brightness());
     setScreen(other.screen());
     setCrossFadeProgress(other.crossFadeProgress());
+    setThumbnailRefreshInterval(other.thumbnailRefreshInterval());
     setProjectionMatrix(other.projectionMatrix());
     setModelViewMatrix(other.modelViewMatrix());
     d->screenProjectionMatrix = other.d->screenProjectionMatrix;
@@ -321,6 +324,16 @@ void WindowPaintData::setCrossFadeProgress(qreal factor)
     d->crossFadeProgress = qBound(qreal(0.0), factor, qreal(1.0));
 }
 
+int WindowPaintData::thumbnailRefreshInterval() const
+{
+    return d->thumbnailRefreshInterval;
+}
+
+void WindowPaintData::setThumbnailRefreshInterval(int interval)
+{
+    d->thumbnailRefreshInterval = qMax(0, interval);
+}
+
 qreal WindowPaintData::multiplyOpacity(qreal factor)
 {
     d->opacity *= factor;
@@ -703,6 +716,26 @@ bool Effect::blocksDirectScanout() const
     return true;
 }
 
+bool Effect::isWindowScoped() const
+{
+    return effects->isEffectWindowScoped(this);
+}
+
+void Effect::setWindowScoped(bool scoped)
+{
+    effects->setEffectWindowScoped(this, scoped);
+}
+
+void Effect::addAffectedWindow(EffectWindow *w)
+{
+    effects->addAffectedWindow(this, w);
+}
+
+void Effect::removeAffectedWindow(EffectWindow *w)
+{
+    effects->removeAffectedWindow(this, w);
+}
+
 //****************************************
 // EffectFactory
 //****************************************
@@ -1001,119 +1034,13 @@ WindowQuadList WindowQuadList::splitAtY(double y) const
 
 WindowQuadList WindowQuadList::makeGrid(int maxQuadSize) const
 {
-    if (empty())
-        return *this;
-
-    // Find the bounding rectangle
-    double left   = first().left();
-    double right  = first().right();
-    double top    = first().top();
-    double bottom = first().bottom();
-
-    foreach (const WindowQuad &quad, *this) {
-#if !defined(QT_NO_DEBUG)
-        if (quad.isTransformed())
-            qFatal("Splitting quads is allowed only in pre-paint calls!");
-#endif
-        left   = qMin(left,   quad.left());
-        right  = qMax(right,  quad.right());
-        top    = qMin(top,    quad.top());
-        bottom = qMax(bottom, quad.bottom());
-    }
-
-    WindowQuadList ret;
-
-    for (const WindowQuad &quad : *this) {
-        const double quadLeft   = quad.left();
-        const double quadRight  = quad.right();
-        const double quadTop    = quad.top();
-        const double quadBottom = quad.bottom();
-
-        // sanity check, see BUG 390953
-        if (quadLeft == quadRight || quadTop == quadBottom) {
-            ret.append(quad);
-            continue;
-        }
-
-        // Compute the top-left corner of the first intersecting grid cell
-        const double xBegin = left + qFloor((quadLeft - left) / maxQuadSize) * maxQuadSize;
-        const double yBegin = top  + qFloor((quadTop  - top)  / maxQuadSize) * maxQuadSize;
-
-        // Loop over all intersecting cells and add sub-quads
-        for (double y = yBegin; y < quadBottom; y += maxQuadSize) {
-            const double y0 = qMax(y, quadTop);
-            const double y1 = qMin(quadBottom, y + maxQuadSize);
-
-            for (double x = xBegin; x < quadRight; x += maxQuadSize) {
-                const double x0 = qMax(x, quadLeft);
-                const double x1 = qMin(quadRight, x + maxQuadSize);
-
-                ret.append(quad.makeSubQuad(x0, y0, x1, y1));
-            }
-        }
-    }
-
-    return ret;
+    // The sub-quads are computed four vertices at a time, in single precision.
+    return WindowQuadArray(*this).makeGrid(maxQuadSize).toList();
 }
 
 WindowQuadList WindowQuadList::makeRegularGrid(int xSubdivisions, int ySubdivisions) const
 {
-    if (empty())
-        return *this;
-
-    // Find the bounding rectangle
-    double left   = first().left();
-    double right  = first().right();
-    double top    = first().top();
-    double bottom = first().bottom();
-
-    for (const WindowQuad &quad : *this) {
-#if !defined(QT_NO_DEBUG)
-        if (quad.isTransformed())
-            qFatal("Splitting quads is allowed only in pre-paint calls!");
-#endif
-        left   = qMin(left,   quad.left());
-        right  = qMax(right,  quad.right());
-        top    = qMin(top,    quad.top());
-        bottom = qMax(bottom, quad.bottom());
-    }
-
-    double xIncrement = (right - left) / xSubdivisions;
-    double yIncrement = (bottom - top) / ySubdivisions;
-
-    WindowQuadList ret;
-
-    for (const WindowQuad &quad : *this) {
-        const double quadLeft   = quad.left();
-        const double quadRight  = quad.right();
-        const double quadTop    = quad.top();
-        const double quadBottom = quad.bottom();
-
-        // sanity check, see BUG 390953
-        if (quadLeft == quadRight || quadTop == quadBottom) {
-            ret.append(quad);
-            continue;
-        }
-
-        // Compute the top-left corner of the first intersecting grid cell
-        const double xBegin = left + qFloor((quadLeft - left) / xIncrement) * xIncrement;
-        const double yBegin = top  + qFloor((quadTop  - top)  / yIncrement) * yIncrement;
-
-        // Loop over all intersecting cells and add sub-quads
-        for (double y = yBegin; y < quadBottom; y += yIncrement) {
-            const double y0 = qMax(y, quadTop);
-            const double y1 = qMin(quadBottom, y + yIncrement);
-
-            for (double x = xBegin; x < quadRight; x += xIncrement) {
-                const double x0 = qMax(x, quadLeft);
-                const double x1 = qMin(quadRight, x + xIncrement);
-
-                ret.append(quad.makeSubQuad(x0, y0, x1, y1));
-            }
-        }
-    }
-
-    return ret;
+    return WindowQuadArray(*this).makeRegularGrid(xSubdivisions, ySubdivisions).toList();
 }
 
 #ifndef GL_TRIANGLES
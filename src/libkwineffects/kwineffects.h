@@ -175,7 +175,7 @@ X-KDE-Library=kwin4_effect_cooleffect
 
 #define KWIN_EFFECT_API_MAKE_VERSION( major, minor ) (( major ) << 8 | ( minor ))
 #define KWIN_EFFECT_API_VERSION_MAJOR 0
-#define KWIN_EFFECT_API_VERSION_MINOR 233
+#define KWIN_EFFECT_API_VERSION_MINOR 234
 #define KWIN_EFFECT_API_VERSION KWIN_EFFECT_API_MAKE_VERSION( \
         KWIN_EFFECT_API_VERSION_MAJOR, KWIN_EFFECT_API_VERSION_MINOR )
 
@@ -670,6 +670,15 @@ public:
      */
     virtual bool blocksDirectScanout() const;
 
+    /**
+     * Returns @c true if the effect is only asked to paint the windows it has declared
+     * with addAffectedWindow(); otherwise @c false.
+     *
+     * @see setWindowScoped
+     * @since 5.22
+     */
+    bool isWindowScoped() const;
+
 public Q_SLOTS:
     virtual bool borderActivated(ElectricBorder border);
 
@@ -684,6 +693,35 @@ protected:
      */
     template <typename T>
     void initConfig();
+
+    /**
+     * Sets whether the effect only wants to paint the windows it has declared with
+     * addAffectedWindow().
+     *
+     * By default an effect is part of the window paint chain of every window, that is
+     * prePaintWindow(), paintWindow(), postPaintWindow() and drawWindow() are called for
+     * every window while the effect is active, even if the effect just passes the call
+     * on. An effect that only changes a few windows can set this to @c true so that all
+     * other windows skip it. The screen paint methods and buildQuads() are not affected.
+     *
+     * @since 5.22
+     */
+    void setWindowScoped(bool scoped);
+    /**
+     * Declares that the window @a w needs to be painted through this effect. This has
+     * only an effect if the effect is window scoped.
+     *
+     * @see removeAffectedWindow
+     * @since 5.22
+     */
+    void addAffectedWindow(EffectWindow *w);
+    /**
+     * Declares that the window @a w doesn't need to be painted through this effect anymore.
+     *
+     * @see addAffectedWindow
+     * @since 5.22
+     */
+    void removeAffectedWindow(EffectWindow *w);
 };
 
 
@@ -1388,6 +1426,27 @@ public:
     virtual EffectScreen *findScreen(const QString &name) const = 0;
     virtual EffectScreen *findScreen(int screenId) const = 0;
 
+    /**
+     * @internal
+     * @see Effect::setWindowScoped
+     */
+    virtual void setEffectWindowScoped(Effect *effect, bool scoped) = 0;
+    /**
+     * @internal
+     * @see Effect::isWindowScoped
+     */
+    virtual bool isEffectWindowScoped(const Effect *effect) const = 0;
+    /**
+     * @internal
+     * @see Effect::addAffectedWindow
+     */
+    virtual void addAffectedWindow(Effect *effect, EffectWindow *w) = 0;
+    /**
+     * @internal
+     * @see Effect::removeAffectedWindow
+     */
+    virtual void removeAffectedWindow(Effect *effect, EffectWindow *w) = 0;
+
 Q_SIGNALS:
     /**
      * This signal is emitted whenever a new @a screen is added to the system.
@@ -2651,6 +2710,91 @@ public:
     bool isTransformed() const;
 };
 
+/**
+ * @short Window quads stored as a structure of arrays.
+ *
+ * WindowQuadArray holds the same data as a WindowQuadList, but every vertex attribute is
+ * kept in its own array of floats, with the four vertices of a quad next to each other.
+ * The vertex @c j of the quad @c i is stored at the index @c 4 * i + j. This allows to
+ * split quads and to fill vertex buffers with SIMD instructions, one quad at a time.
+ *
+ * Effects that generate many quads, e.g. to deform a window, should prefer this class
+ * over a WindowQuadList. Both can be converted into each other. WindowQuadList::makeGrid()
+ * and WindowQuadList::makeRegularGrid() are implemented with this class.
+ *
+ * @since 5.22
+ */
+class KWINEFFECTS_EXPORT WindowQuadArray
+{
+public:
+    WindowQuadArray();
+    explicit WindowQuadArray(const WindowQuadList &quads);
+
+    int count() const;
+    bool isEmpty() const;
+    /**
+     * Allocates memory for at least @a count quads, without changing count().
+     */
+    void reserve(int count);
+    void clear();
+    void append(const WindowQuad &quad);
+
+    /**
+     * Returns a copy of the quad at @a index.
+     */
+    WindowQuad at(int index) const;
+    WindowQuadList toList() const;
+
+    WindowQuadType type(int index) const;
+    int id(int index) const;
+    bool uvAxisSwapped(int index) const;
+
+    float *x();
+    const float *x() const;
+    float *y();
+    const float *y() const;
+    const float *originalX() const;
+    const float *originalY() const;
+    const float *textureX() const;
+    const float *textureY() const;
+
+    WindowQuadArray splitAtX(double x) const;
+    WindowQuadArray splitAtY(double y) const;
+    WindowQuadArray makeGrid(int maxQuadSize) const;
+    WindowQuadArray makeRegularGrid(int xSubdivisions, int ySubdivisions) const;
+
+    /**
+     * Moves all vertices by @a dx and @a dy.
+     */
+    void translate(double dx, double dy);
+    /**
+     * Multiplies the coordinates of all vertices by @a xScale and @a yScale.
+     */
+    void scale(double xScale, double yScale);
+
+    void makeInterleavedArrays(unsigned int type, GLVertex2D *vertices, const QMatrix4x4 &matrix) const;
+
+private:
+    struct SubQuadSource;
+    void resize(int count);
+    int allocate(const WindowQuadArray &other, int index);
+    void appendCopy(const WindowQuadArray &other, int index);
+    void appendSubQuad(const SubQuadSource &source, double x1, double y1, double x2, double y2);
+    QRectF boundingRect() const;
+    WindowQuadArray subdivide(const QRectF &bounds, double xIncrement, double yIncrement) const;
+    bool isTransformed(int index) const;
+
+    QVector<float> m_x;
+    QVector<float> m_y;
+    QVector<float> m_originalX;
+    QVector<float> m_originalY;
+    QVector<float> m_textureX;
+    QVector<float> m_textureY;
+    QVector<WindowQuadType> m_types;
+    QVector<int> m_ids;
+    QVector<bool> m_uvAxisSwapped;
+};
+
 class KWINEFFECTS_EXPORT WindowPrePaintData
 {
 public:
@@ -2977,6 +3121,20 @@ public:
      * @see setCrossFadeProgress
      */
     qreal crossFadeProgress() const;
+    /**
+     * Sets the minimum time in milliseconds between two updates of a cached, downscaled
+     * copy of the window, as it is kept for windows painted with PAINT_WINDOW_LANCZOS.
+     * Until the @p interval has passed, damage to the window is not shown.
+     *
+     * By default the copy is updated whenever the window is painted after it got damaged.
+     * @since 5.22
+     */
+    void setThumbnailRefreshInterval(int interval);
+    /**
+     * @see setThumbnailRefreshInterval
+     * @since 5.22
+     */
+    int thumbnailRefreshInterval() const;
 
     /**
      * Sets the projection matrix that will be used when painting the window.
@@ -132,6 +132,38 @@ bool checkGLError(const char* txt)
     return hasError;
 }
 
+QMatrix4x4 yuvToRgbMatrix(YuvColorSpace colorSpace, YuvRange range)
+{
+    // The luma and chroma coefficients of the red and blue channels.
+    const double kr = colorSpace == YuvColorSpace::Bt709 ? 0.2126 : 0.299;
+    const double kb = colorSpace == YuvColorSpace::Bt709 ? 0.0722 : 0.114;
+    const double kg = 1.0 - kr - kb;
+
+    // Expand the values to [0, 1] for the luma and [-0.5, 0.5] for the chroma.
+    double lumaScale, lumaOffset, chromaScale, chromaOffset;
+    if (range == YuvRange::Limited) {
+        lumaScale = 255.0 / 219.0;
+        lumaOffset = -16.0 / 219.0;
+        chromaScale = 255.0 / 224.0;
+        chromaOffset = -128.0 / 224.0;
+    } else {
+        lumaScale = 1.0;
+        lumaOffset = 0.0;
+        chromaScale = 1.0;
+        chromaOffset = -128.0 / 255.0;
+    }
+
+    const double rv = 2.0 * (1.0 - kr);
+    const double gu = 2.0 * kb * (1.0 - kb) / kg;
+    const double gv = 2.0 * kr * (1.0 - kr) / kg;
+    const double bu = 2.0 * (1.0 - kb);
+
+    return QMatrix4x4(lumaScale, 0, rv * chromaScale, lumaOffset + rv * chromaOffset,
+                      lumaScale, -gu * chromaScale, -gv * chromaScale, lumaOffset - (gu + gv) * chromaOffset,
+                      lumaScale, bu * chromaScale, 0, lumaOffset + bu * chromaOffset,
+                      0, 0, 0, 1);
+}
+
 //****************************************
 // GLShader
 //****************************************
@@ -325,6 +357,7 @@ void GLShader::resolveLocations()
     mMatrixLocation[ModelViewProjectionMatrix]  = uniformLocation("modelViewProjectionMatrix");
     mMatrixLocation[WindowTransformation]       = uniformLocation("windowTransformation");
     mMatrixLocation[ScreenTransformation]       = uniformLocation("screenTransformation");
+    mMatrixLocation[YuvToRgbMatrix]             = uniformLocation("yuvToRgbMatrix");
 
     mVec2Location[Offset] = uniformLocation("offset");
 
@@ -843,9 +876,17 @@ QByteArray ShaderManager::generateFragmentSource(ShaderTraits traits) const
         output        = glsl_es_300 ? QByteArrayLiteral("fragColor")  : QByteArrayLiteral("gl_FragColor");
     }
 
+    const ShaderTraits yuvTraits = traits & (ShaderTrait::YuvSemiPlanar | ShaderTrait::YuvPlanar | ShaderTrait::YuvPacked);
+
     if (traits & ShaderTrait::MapTexture) {
         stream << "uniform sampler2D sampler;\n";
 
+        if (yuvTraits) {
+            stream << "uniform sampler2D sampler1;\n";
+            if (traits & ShaderTrait::YuvPlanar)
+                stream << "uniform sampler2D sampler2;\n";
+            stream << "uniform mat4 yuvToRgbMatrix;\n";
+        }
         if (traits & ShaderTrait::Modulate)
             stream << "uniform vec4 modulation;\n";
         if (traits & ShaderTrait::AdjustSaturation)
@@ -872,7 +913,22 @@ QByteArray ShaderManager::generateFragmentSource(ShaderTraits traits) const
             stream << "texcoordC.y = clamp(texcoordC.y, textureClamp.y, textureClamp.w);\n";
         }
 
-        if (traits & (ShaderTrait::Modulate | ShaderTrait::AdjustSaturation)) {
+        if (yuvTraits) {
+            stream << "    vec4 yuv = vec4(" << textureLookup << "(sampler, texcoordC).r, ";
+            if (traits & ShaderTrait::YuvSemiPlanar)
+                stream << textureLookup << "(sampler1, texcoordC).rg, 1.0);\n";
+            else if (traits & ShaderTrait::YuvPlanar)
+                stream << textureLookup << "(sampler1, texcoordC).r, " << textureLookup << "(sampler2, texcoordC).r, 1.0);\n";
+            else
+                stream << textureLookup << "(sampler1, texcoordC).ga, 1.0);\n";
+            stream << "    vec4 texel = vec4((yuvToRgbMatrix * yuv).rgb, 1.0);\n";
+            if (traits & ShaderTrait::Modulate)
+                stream << "    texel *= modulation;\n";
+            if (traits & ShaderTrait::AdjustSaturation)
+                stream << "    texel.rgb = mix(vec3(dot(texel.rgb, vec3(0.2126, 0.7152, 0.0722))), texel.rgb, saturation);\n";
+
+            stream << "    " << output << " = texel;\n";
+        } else if (traits & (ShaderTrait::Modulate | ShaderTrait::AdjustSaturation)) {
             stream << "    vec4 texel = " << textureLookup << "(sampler, texcoordC);\n";
             if (traits & ShaderTrait::Modulate)
                 stream << "    texel *= modulation;\n";
@@ -917,6 +973,18 @@ GLShader *ShaderManager::generateCustomShader(ShaderTraits traits, const QByteAr
     shader->bindFragDataLocation("fragColor", 0);
 
     shader->link();
+
+    if (shader->isValid() && (traits & (ShaderTrait::YuvSemiPlanar | ShaderTrait::YuvPlanar | ShaderTrait::YuvPacked))) {
+        // the chroma planes are bound to the texture units following the luma plane
+        shader->bind();
+        shader->setUniform("sampler1", 1);
+        shader->setUniform("sampler2", 2);
+        if (GLShader *boundShader = getBoundShader()) {
+            boundShader->bind();
+        } else {
+            shader->unbind();
+        }
+    }
     return shader;
 }
 
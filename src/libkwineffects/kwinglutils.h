@@ -108,6 +108,7 @@ public:
         ModelViewProjectionMatrix,
         WindowTransformation,
         ScreenTransformation,
+        YuvToRgbMatrix,
         MatrixCount
     };
 
@@ -177,10 +178,49 @@ enum class ShaderTrait {
     Modulate         = (1 << 2),
     AdjustSaturation = (1 << 3),
     ClampTexture     = (1 << 4),
+    /**
+     * The texture holds the luma of a YUV image and the interleaved chroma is bound to the next
+     * texture unit, as with NV12. Requires MapTexture.
+     */
+    YuvSemiPlanar    = (1 << 5),
+    /**
+     * The texture holds the luma of a YUV image and the two chroma planes are bound to the next
+     * texture units, as with YUV420. Requires MapTexture.
+     */
+    YuvPlanar        = (1 << 6),
+    /**
+     * The texture holds the luma of a packed YUV image in the red channel, and the same image
+     * bound to the next texture unit with half the width holds the chroma in the green and
+     * alpha channels, as with YUYV. Requires MapTexture.
+     */
+    YuvPacked        = (1 << 7),
 };
 
 Q_DECLARE_FLAGS(ShaderTraits, ShaderTrait)
 
+/**
+ * The color spaces of YUV images.
+ */
+enum class YuvColorSpace {
+    Bt601,
+    Bt709,
+};
+
+/**
+ * The value ranges of YUV images. Limited range images use 16 to 235 for the luma and 16 to
+ * 240 for the chroma.
+ */
+enum class YuvRange {
+    Limited,
+    Full,
+};
+
+/**
+ * Returns the matrix that converts the vector (Y, U, V, 1) of a YUV pixel with the given
+ * @a colorSpace and @a range to RGB, for GLShader::YuvToRgbMatrix.
+ */
+QMatrix4x4 KWINGLUTILS_EXPORT yuvToRgbMatrix(YuvColorSpace colorSpace, YuvRange range);
+
 
 /**
  * @short Manager for Shaders.
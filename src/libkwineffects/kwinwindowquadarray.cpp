@@ -0,0 +1,647 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "kwineffects.h"
+
+#include <QMatrix4x4>
+#include <QtMath>
+
+#include <algorithm>
+
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#  include <arm_neon.h>
+#endif
+
+#ifndef GL_TRIANGLES
+#  define GL_TRIANGLES      0x0004
+#endif
+
+#ifndef GL_QUADS
+#  define GL_QUADS          0x0007
+#endif
+
+namespace KWin
+{
+
+namespace
+{
+
+// The four vertices of a quad fit in one vector, so every kernel below processes a whole
+// quad with a handful of instructions. Vec4 wraps the native vector type of the target.
+#if defined(__SSE2__)
+
+struct Vec4
+{
+    __m128 v;
+};
+
+inline Vec4 load(const float *p) { return {_mm_loadu_ps(p)}; }
+inline void store(float *p, Vec4 a) { _mm_storeu_ps(p, a.v); }
+inline Vec4 broadcast(float f) { return {_mm_set1_ps(f)}; }
+inline Vec4 make(float a, float b, float c, float d) { return {_mm_setr_ps(a, b, c, d)}; }
+inline Vec4 operator+(Vec4 a, Vec4 b) { return {_mm_add_ps(a.v, b.v)}; }
+inline Vec4 operator-(Vec4 a, Vec4 b) { return {_mm_sub_ps(a.v, b.v)}; }
+inline Vec4 operator*(Vec4 a, Vec4 b) { return {_mm_mul_ps(a.v, b.v)}; }
+
+inline float horizontalMin(Vec4 a)
+{
+    __m128 m = _mm_min_ps(a.v, _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(2, 3, 0, 1)));
+    m = _mm_min_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+    return _mm_cvtss_f32(m);
+}
+
+inline float horizontalMax(Vec4 a)
+{
+    __m128 m = _mm_max_ps(a.v, _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(2, 3, 0, 1)));
+    m = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+    return _mm_cvtss_f32(m);
+}
+
+inline bool equal(Vec4 a, Vec4 b)
+{
+    return _mm_movemask_ps(_mm_cmpeq_ps(a.v, b.v)) == 0xf;
+}
+
+inline void transpose(Vec4 &a, Vec4 &b, Vec4 &c, Vec4 &d)
+{
+    _MM_TRANSPOSE4_PS(a.v, b.v, c.v, d.v);
+}
+
+// The vertex buffer is write-combined memory, bypass the cache if possible.
+inline void storeVertex(GLVertex2D *p, Vec4 a, bool aligned)
+{
+    if (aligned) {
+        _mm_stream_ps(reinterpret_cast<float *>(p), a.v);
+    } else {
+        _mm_storeu_ps(reinterpret_cast<float *>(p), a.v);
+    }
+}
+
+inline void finishVertices()
+{
+    _mm_sfence();
+}
+
+#elif defined(__ARM_NEON)
+
+struct Vec4
+{
+    float32x4_t v;
+};
+
+inline Vec4 load(const float *p) { return {vld1q_f32(p)}; }
+inline void store(float *p, Vec4 a) { vst1q_f32(p, a.v); }
+inline Vec4 broadcast(float f) { return {vdupq_n_f32(f)}; }
+inline Vec4 make(float a, float b, float c, float d)
+{
+    const float values[4] = {a, b, c, d};
+    return {vld1q_f32(values)};
+}
+inline Vec4 operator+(Vec4 a, Vec4 b) { return {vaddq_f32(a.v, b.v)}; }
+inline Vec4 operator-(Vec4 a, Vec4 b) { return {vsubq_f32(a.v, b.v)}; }
+inline Vec4 operator*(Vec4 a, Vec4 b) { return {vmulq_f32(a.v, b.v)}; }
+
+inline float horizontalMin(Vec4 a)
+{
+    const float32x2_t m = vpmin_f32(vget_low_f32(a.v), vget_high_f32(a.v));
+    return vget_lane_f32(vpmin_f32(m, m), 0);
+}
+
+inline float horizontalMax(Vec4 a)
+{
+    const float32x2_t m = vpmax_f32(vget_low_f32(a.v), vget_high_f32(a.v));
+    return vget_lane_f32(vpmax_f32(m, m), 0);
+}
+
+inline bool equal(Vec4 a, Vec4 b)
+{
+    const uint32x4_t mask = vceqq_f32(a.v, b.v);
+    const uint32x2_t folded = vand_u32(vget_low_u32(mask), vget_high_u32(mask));
+    return (vget_lane_u32(folded, 0) & vget_lane_u32(folded, 1)) == 0xffffffff;
+}
+
+inline void transpose(Vec4 &a, Vec4 &b, Vec4 &c, Vec4 &d)
+{
+    const float32x4x2_t ab = vtrnq_f32(a.v, b.v);
+    const float32x4x2_t cd = vtrnq_f32(c.v, d.v);
+    a.v = vcombine_f32(vget_low_f32(ab.val[0]), vget_low_f32(cd.val[0]));
+    b.v = vcombine_f32(vget_low_f32(ab.val[1]), vget_low_f32(cd.val[1]));
+    c.v = vcombine_f32(vget_high_f32(ab.val[0]), vget_high_f32(cd.val[0]));
+    d.v = vcombine_f32(vget_high_f32(ab.val[1]), vget_high_f32(cd.val[1]));
+}
+
+inline void storeVertex(GLVertex2D *p, Vec4 a, bool)
+{
+    vst1q_f32(reinterpret_cast<float *>(p), a.v);
+}
+
+inline void finishVertices()
+{
+}
+
+#else
+
+struct Vec4
+{
+    float v[4];
+};
+
+inline Vec4 load(const float *p) { return {{p[0], p[1], p[2], p[3]}}; }
+inline void store(float *p, Vec4 a) { std::copy(a.v, a.v + 4, p); }
+inline Vec4 broadcast(float f) { return {{f, f, f, f}}; }
+inline Vec4 make(float a, float b, float c, float d) { return {{a, b, c, d}}; }
+inline Vec4 operator+(Vec4 a, Vec4 b) { return {{a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]}}; }
+inline Vec4 operator-(Vec4 a, Vec4 b) { return {{a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3]}}; }
+inline Vec4 operator*(Vec4 a, Vec4 b) { return {{a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3]}}; }
+
+inline float horizontalMin(Vec4 a)
+{
+    return std::min(std::min(a.v[0], a.v[1]), std::min(a.v[2], a.v[3]));
+}
+
+inline float horizontalMax(Vec4 a)
+{
+    return std::max(std::max(a.v[0], a.v[1]), std::max(a.v[2], a.v[3]));
+}
+
+inline bool equal(Vec4 a, Vec4 b)
+{
+    return a.v[0] == b.v[0] && a.v[1] == b.v[1] && a.v[2] == b.v[2] && a.v[3] == b.v[3];
+}
+
+inline void transpose(Vec4 &a, Vec4 &b, Vec4 &c, Vec4 &d)
+{
+    std::swap(a.v[1], b.v[0]);
+    std::swap(a.v[2], c.v[0]);
+    std::swap(a.v[3], d.v[0]);
+    std::swap(b.v[2], c.v[1]);
+    std::swap(b.v[3], d.v[1]);
+    std::swap(c.v[3], d.v[2]);
+}
+
+inline void storeVertex(GLVertex2D *p, Vec4 a, bool)
+{
+    std::copy(a.v, a.v + 4, reinterpret_cast<float *>(p));
+}
+
+inline void finishVertices()
+{
+}
+
+#endif
+
+} // namespace
+
+/**
+ * Everything that makeSubQuad() computes for each sub-quad of a quad, so it's done only once
+ * when a quad is split into many sub-quads.
+ */
+struct WindowQuadArray::SubQuadSource
+{
+    SubQuadSource(const WindowQuadArray &array, int index);
+
+    const WindowQuadArray &array;
+    int index;
+    bool swapped;
+    double left;
+    double right;
+    double top;
+    double bottom;
+    Vec4 origin[2];
+    Vec4 reciprocal[2];
+    Vec4 textureX[4];
+    Vec4 textureY[4];
+};
+
+WindowQuadArray::SubQuadSource::SubQuadSource(const WindowQuadArray &array, int index)
+    : array(array)
+    , index(index)
+{
+    const Vec4 x = load(array.m_x.constData() + 4 * index);
+    const Vec4 y = load(array.m_y.constData() + 4 * index);
+    left = horizontalMin(x);
+    right = horizontalMax(x);
+    top = horizontalMin(y);
+    bottom = horizontalMax(y);
+
+    // With swapped axes, the weights are taken from the other coordinate, and the texture
+    // coordinates of the top-right and the bottom-left corner trade places.
+    swapped = array.m_uvAxisSwapped[index];
+    origin[0] = broadcast(swapped ? top : left);
+    origin[1] = broadcast(swapped ? left : top);
+    reciprocal[0] = broadcast(swapped ? 1 / (bottom - top) : 1 / (right - left));
+    reciprocal[1] = broadcast(swapped ? 1 / (right - left) : 1 / (bottom - top));
+
+    static const int order[2][4] = {{0, 1, 2, 3}, {0, 3, 2, 1}};
+    for (int i = 0; i < 4; ++i) {
+        const int vertex = 4 * index + order[swapped][i];
+        textureX[i] = broadcast(array.m_textureX[vertex]);
+        textureY[i] = broadcast(array.m_textureY[vertex]);
+    }
+}
+
+WindowQuadArray::WindowQuadArray()
+{
+}
+
+WindowQuadArray::WindowQuadArray(const WindowQuadList &quads)
+{
+    reserve(quads.count());
+    for (const WindowQuad &quad : quads) {
+        append(quad);
+    }
+}
+
+int WindowQuadArray::count() const
+{
+    return m_types.count();
+}
+
+bool WindowQuadArray::isEmpty() const
+{
+    return m_types.isEmpty();
+}
+
+void WindowQuadArray::reserve(int count)
+{
+    m_x.reserve(4 * count);
+    m_y.reserve(4 * count);
+    m_originalX.reserve(4 * count);
+    m_originalY.reserve(4 * count);
+    m_textureX.reserve(4 * count);
+    m_textureY.reserve(4 * count);
+    m_types.reserve(count);
+    m_ids.reserve(count);
+    m_uvAxisSwapped.reserve(count);
+}
+
+void WindowQuadArray::resize(int count)
+{
+    // Shrinking keeps the capacity, so clear() followed by appending doesn't allocate.
+    m_x.resize(4 * count);
+    m_y.resize(4 * count);
+    m_originalX.resize(4 * count);
+    m_originalY.resize(4 * count);
+    m_textureX.resize(4 * count);
+    m_textureY.resize(4 * count);
+    m_types.resize(count);
+    m_ids.resize(count);
+    m_uvAxisSwapped.resize(count);
+}
+
+void WindowQuadArray::clear()
+{
+    resize(0);
+}
+
+void WindowQuadArray::append(const WindowQuad &quad)
+{
+    const int index = count();
+    resize(index + 1);
+    for (int i = 0; i < 4; ++i) {
+        const int vertex = 4 * index + i;
+        m_x[vertex] = quad[i].x();
+        m_y[vertex] = quad[i].y();
+        m_originalX[vertex] = quad[i].originalX();
+        m_originalY[vertex] = quad[i].originalY();
+        m_textureX[vertex] = quad[i].textureX();
+        m_textureY[vertex] = quad[i].textureY();
+    }
+    m_types[index] = quad.type();
+    m_ids[index] = quad.id();
+    m_uvAxisSwapped[index] = quad.uvAxisSwapped();
+}
+
+WindowQuad WindowQuadArray::at(int index) const
+{
+    Q_ASSERT(index >= 0 && index < count());
+    WindowQuad quad(m_types[index], m_ids[index]);
+    for (int i = 0; i < 4; ++i) {
+        const int vertex = 4 * index + i;
+        quad[i] = WindowVertex(m_originalX[vertex], m_originalY[vertex], m_textureX[vertex], m_textureY[vertex]);
+        quad[i].move(m_x[vertex], m_y[vertex]);
+    }
+    quad.setUVAxisSwapped(m_uvAxisSwapped[index]);
+    return quad;
+}
+
+WindowQuadList WindowQuadArray::toList() const
+{
+    WindowQuadList list;
+    list.reserve(count());
+    for (int i = 0; i < count(); ++i) {
+        list.append(at(i));
+    }
+    return list;
+}
+
+WindowQuadType WindowQuadArray::type(int index) const
+{
+    return m_types[index];
+}
+
+int WindowQuadArray::id(int index) const
+{
+    return m_ids[index];
+}
+
+bool WindowQuadArray::uvAxisSwapped(int index) const
+{
+    return m_uvAxisSwapped[index];
+}
+
+float *WindowQuadArray::x()
+{
+    return m_x.data();
+}
+
+const float *WindowQuadArray::x() const
+{
+    return m_x.constData();
+}
+
+float *WindowQuadArray::y()
+{
+    return m_y.data();
+}
+
+const float *WindowQuadArray::y() const
+{
+    return m_y.constData();
+}
+
+const float *WindowQuadArray::originalX() const
+{
+    return m_originalX.constData();
+}
+
+const float *WindowQuadArray::originalY() const
+{
+    return m_originalY.constData();
+}
+
+const float *WindowQuadArray::textureX() const
+{
+    return m_textureX.constData();
+}
+
+const float *WindowQuadArray::textureY() const
+{
+    return m_textureY.constData();
+}
+
+bool WindowQuadArray::isTransformed(int index) const
+{
+    const int vertex = 4 * index;
+    return !equal(load(m_x.constData() + vertex), load(m_originalX.constData() + vertex))
+        || !equal(load(m_y.constData() + vertex), load(m_originalY.constData() + vertex));
+}
+
+int WindowQuadArray::allocate(const WindowQuadArray &other, int index)
+{
+    const int target = count();
+    resize(target + 1);
+    m_types[target] = other.m_types[index];
+    m_ids[target] = other.m_ids[index];
+    m_uvAxisSwapped[target] = other.m_uvAxisSwapped[index];
+    return target;
+}
+
+void WindowQuadArray::appendCopy(const WindowQuadArray &other, int index)
+{
+    const int source = 4 * index;
+    const int target = 4 * allocate(other, index);
+    store(m_x.data() + target, load(other.m_x.constData() + source));
+    store(m_y.data() + target, load(other.m_y.constData() + source));
+    store(m_originalX.data() + target, load(other.m_originalX.constData() + source));
+    store(m_originalY.data() + target, load(other.m_originalY.constData() + source));
+    store(m_textureX.data() + target, load(other.m_textureX.constData() + source));
+    store(m_textureY.data() + target, load(other.m_textureY.constData() + source));
+}
+
+void WindowQuadArray::appendSubQuad(const SubQuadSource &source, double x1, double y1, double x2, double y2)
+{
+    const int vertex = 4 * allocate(source.array, source.index);
+
+    // vertices are clockwise starting from topleft
+    const Vec4 x = make(x1, x2, x2, x1);
+    const Vec4 y = make(y1, y1, y2, y2);
+    store(m_x.data() + vertex, x);
+    store(m_y.data() + vertex, y);
+    // original x/y are supposed to be the same, no transforming is done here
+    store(m_originalX.data() + vertex, x);
+    store(m_originalY.data() + vertex, y);
+
+    // Use bilinear interpolation to compute the texture coords.
+    const Vec4 one = broadcast(1);
+    const Vec4 w1 = ((source.swapped ? y : x) - source.origin[0]) * source.reciprocal[0];
+    const Vec4 w2 = ((source.swapped ? x : y) - source.origin[1]) * source.reciprocal[1];
+    const Vec4 weight0 = (one - w1) * (one - w2);
+    const Vec4 weight1 = w1 * (one - w2);
+    const Vec4 weight2 = w1 * w2;
+    const Vec4 weight3 = (one - w1) * w2;
+
+    store(m_textureX.data() + vertex,
+          weight0 * source.textureX[0] + weight1 * source.textureX[1]
+              + weight2 * source.textureX[2] + weight3 * source.textureX[3]);
+    store(m_textureY.data() + vertex,
+          weight0 * source.textureY[0] + weight1 * source.textureY[1]
+              + weight2 * source.textureY[2] + weight3 * source.textureY[3]);
+}
+
+WindowQuadArray WindowQuadArray::splitAtX(double x) const
+{
+    WindowQuadArray ret;
+    ret.reserve(count());
+    for (int i = 0; i < count(); ++i) {
+#if !defined(QT_NO_DEBUG)
+        if (isTransformed(i))
+            qFatal("Splitting quads is allowed only in pre-paint calls!");
+#endif
+        const SubQuadSource source(*this, i);
+        const bool wholeLeft = source.right <= x;
+        const bool wholeRight = source.left >= x;
+        const bool empty = source.top == source.bottom || source.left == source.right;
+        if (wholeLeft || wholeRight || empty) {
+            ret.appendCopy(*this, i);
+            continue;
+        }
+        ret.appendSubQuad(source, source.left, source.top, x, source.bottom);
+        ret.appendSubQuad(source, x, source.top, source.right, source.bottom);
+    }
+    return ret;
+}
+
+WindowQuadArray WindowQuadArray::splitAtY(double y) const
+{
+    WindowQuadArray ret;
+    ret.reserve(count());
+    for (int i = 0; i < count(); ++i) {
+#if !defined(QT_NO_DEBUG)
+        if (isTransformed(i))
+            qFatal("Splitting quads is allowed only in pre-paint calls!");
+#endif
+        const SubQuadSource source(*this, i);
+        const bool wholeTop = source.bottom <= y;
+        const bool wholeBottom = source.top >= y;
+        const bool empty = source.top == source.bottom || source.left == source.right;
+        if (wholeTop || wholeBottom || empty) {
+            ret.appendCopy(*this, i);
+            continue;
+        }
+        ret.appendSubQuad(source, source.left, source.top, source.right, y);
+        ret.appendSubQuad(source, source.left, y, source.right, source.bottom);
+    }
+    return ret;
+}
+
+QRectF WindowQuadArray::boundingRect() const
+{
+    float left = horizontalMin(load(m_x.constData()));
+    float right = horizontalMax(load(m_x.constData()));
+    float top = horizontalMin(load(m_y.constData()));
+    float bottom = horizontalMax(load(m_y.constData()));
+    for (int i = 4; i < 4 * count(); i += 4) {
+        const Vec4 x = load(m_x.constData() + i);
+        const Vec4 y = load(m_y.constData() + i);
+        left = std::min(left, horizontalMin(x));
+        right = std::max(right, horizontalMax(x));
+        top = std::min(top, horizontalMin(y));
+        bottom = std::max(bottom, horizontalMax(y));
+    }
+    return QRectF(QPointF(left, top), QPointF(right, bottom));
+}
+
+WindowQuadArray WindowQuadArray::subdivide(const QRectF &bounds, double xIncrement, double yIncrement) const
+{
+    const double left = bounds.left();
+    const double top = bounds.top();
+
+    WindowQuadArray ret;
+    ret.reserve(qCeil(bounds.width() / xIncrement) * qCeil(bounds.height() / yIncrement) + count());
+
+    for (int i = 0; i < count(); ++i) {
+#if !defined(QT_NO_DEBUG)
+        if (isTransformed(i))
+            qFatal("Splitting quads is allowed only in pre-paint calls!");
+#endif
+        const SubQuadSource source(*this, i);
+
+        // sanity check, see BUG 390953
+        if (source.left == source.right || source.top == source.bottom) {
+            ret.appendCopy(*this, i);
+            continue;
+        }
+
+        // Compute the top-left corner of the first intersecting grid cell
+        const double xBegin = left + qFloor((source.left - left) / xIncrement) * xIncrement;
+        const double yBegin = top + qFloor((source.top - top) / yIncrement) * yIncrement;
+
+        // Loop over all intersecting cells and add sub-quads
+        for (double y = yBegin; y < source.bottom; y += yIncrement) {
+            const double y0 = qMax(y, source.top);
+            const double y1 = qMin(source.bottom, y + yIncrement);
+
+            for (double x = xBegin; x < source.right; x += xIncrement) {
+                const double x0 = qMax(x, source.left);
+                const double x1 = qMin(source.right, x + xIncrement);
+
+                ret.appendSubQuad(source, x0, y0, x1, y1);
+            }
+        }
+    }
+
+    return ret;
+}
+
+WindowQuadArray WindowQuadArray::makeGrid(int maxQuadSize) const
+{
+    if (isEmpty()) {
+        return *this;
+    }
+    return subdivide(boundingRect(), maxQuadSize, maxQuadSize);
+}
+
+WindowQuadArray WindowQuadArray::makeRegularGrid(int xSubdivisions, int ySubdivisions) const
+{
+    if (isEmpty()) {
+        return *this;
+    }
+    const QRectF bounds = boundingRect();
+    return subdivide(bounds, bounds.width() / xSubdivisions, bounds.height() / ySubdivisions);
+}
+
+void WindowQuadArray::translate(double dx, double dy)
+{
+    const Vec4 xOffset = broadcast(dx);
+    const Vec4 yOffset = broadcast(dy);
+    float *x = m_x.data();
+    float *y = m_y.data();
+    for (int i = 0; i < 4 * count(); i += 4) {
+        store(x + i, load(x + i) + xOffset);
+        store(y + i, load(y + i) + yOffset);
+    }
+}
+
+void WindowQuadArray::scale(double xScale, double yScale)
+{
+    const Vec4 xFactor = broadcast(xScale);
+    const Vec4 yFactor = broadcast(yScale);
+    float *x = m_x.data();
+    float *y = m_y.data();
+    for (int i = 0; i < 4 * count(); i += 4) {
+        store(x + i, load(x + i) * xFactor);
+        store(y + i, load(y + i) * yFactor);
+    }
+}
+
+void WindowQuadArray::makeInterleavedArrays(unsigned int type, GLVertex2D *vertices, const QMatrix4x4 &textureMatrix) const
+{
+    // Since we know that the texture matrix just scales and translates
+    // we can use this information to optimize the transformation
+    const Vec4 xCoeff = broadcast(textureMatrix(0, 0));
+    const Vec4 yCoeff = broadcast(textureMatrix(1, 1));
+    const Vec4 xOffset = broadcast(textureMatrix(0, 3));
+    const Vec4 yOffset = broadcast(textureMatrix(1, 3));
+
+    Q_ASSERT(type == GL_QUADS || type == GL_TRIANGLES);
+    const bool aligned = !(intptr_t(vertices) & 0xf);
+
+    GLVertex2D *vertex = vertices;
+    for (int i = 0; i < 4 * count(); i += 4) {
+        // Turn the x, y, u and v of the four vertices into four GLVertex2D
+        Vec4 v0 = load(m_x.constData() + i);
+        Vec4 v1 = load(m_y.constData() + i);
+        Vec4 v2 = load(m_textureX.constData() + i) * xCoeff + xOffset;
+        Vec4 v3 = load(m_textureY.constData() + i) * yCoeff + yOffset;
+        transpose(v0, v1, v2, v3);
+
+        if (type == GL_QUADS) {
+            storeVertex(vertex++, v0, aligned); // Top-left
+            storeVertex(vertex++, v1, aligned); // Top-right
+            storeVertex(vertex++, v2, aligned); // Bottom-right
+            storeVertex(vertex++, v3, aligned); // Bottom-left
+        } else {
+            // First triangle
+            storeVertex(vertex++, v1, aligned); // Top-right
+            storeVertex(vertex++, v0, aligned); // Top-left
+            storeVertex(vertex++, v3, aligned); // Bottom-left
+
+            // Second triangle
+            storeVertex(vertex++, v3, aligned); // Bottom-left
+            storeVertex(vertex++, v2, aligned); // Bottom-right
+            storeVertex(vertex++, v1, aligned); // Top-right
+        }
+    }
+    finishVertices();
+}
+
+} // namespace KWin
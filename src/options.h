@@ -51,6 +51,11 @@ enum LatencyPolicy {
     LatencyMedium,
     LatencyHigh,
     LatencyExtremelyHigh,
+    /**
+     * The render time budget is not fixed but learned from how long it actually takes
+     * to render frames and how often the deadline has been missed.
+     */
+    LatencyAdaptive,
 };
 
 /**
@@ -60,6 +65,10 @@ enum RenderTimeEstimator {
     RenderTimeEstimatorMinimum,
     RenderTimeEstimatorMaximum,
     RenderTimeEstimatorAverage,
+    RenderTimeEstimatorPercentile50,
+    RenderTimeEstimatorPercentile90,
+    RenderTimeEstimatorPercentile99,
+    RenderTimeEstimatorExponentialAverage,
 };
 
 class Settings;
@@ -23,6 +23,8 @@
 #include <QTextStream>
 #include <QTimer>
 
+#include <algorithm>
+
 namespace KWin
 {
 
@@ -183,6 +185,174 @@ static inline bool isIrrelevant(const AbstractClient *client, const AbstractClie
     return false;
 }
 
+/**
+ * The windows smart placement has to keep clear of, indexed so that the overlap of a
+ * candidate position and the next candidate can be found without walking over all windows.
+ *
+ * The overlap of the candidates in one row is the integral of the weighted heights of the
+ * windows crossing the row, which is precomputed once per row at the window edges.
+ */
+class SmartPlacementIndex
+{
+public:
+    SmartPlacementIndex(const AbstractClient *c, int desktop, int cw, int ch);
+
+    /**
+     * Returns the weighted overlap of the windows with the candidate at @a x, @a y.
+     */
+    qint64 overlap(int x, int y);
+    /**
+     * Returns the first x after @a x where the candidate could fit next to a window in the
+     * row at @a y, but not further than @a possible.
+     */
+    int nextX(int x, int y, int possible);
+    /**
+     * Returns the first y after @a y where the candidate could fit above or below a window,
+     * but not further than @a possible.
+     */
+    int nextY(int y, int possible) const;
+
+private:
+    struct Window {
+        int left;
+        int right;
+        int top;
+        int bottom;
+        int weight;
+    };
+    void selectRow(int y);
+    qint64 integral(int x) const;
+    static int firstAfter(const QVector<int> &sorted, int value, int possible);
+
+    QVector<Window> m_windows;
+    QVector<int> m_bottoms;
+    QVector<int> m_topsAbove;
+    int m_cw;
+    int m_ch;
+
+    // the row of candidates the following members are valid for
+    int m_row;
+    bool m_rowValid = false;
+    QVector<int> m_edges;
+    QVector<qint64> m_integrals;
+    QVector<qint64> m_heights;
+    QVector<int> m_rights;
+    QVector<int> m_leftsBefore;
+};
+
+SmartPlacementIndex::SmartPlacementIndex(const AbstractClient *c, int desktop, int cw, int ch)
+    : m_cw(cw)
+    , m_ch(ch)
+{
+    const auto &stackingOrder = workspace()->stackingOrder();
+    for (Toplevel *toplevel : stackingOrder) {
+        AbstractClient *client = qobject_cast<AbstractClient*>(toplevel);
+        if (isIrrelevant(client, c, desktop)) {
+            continue;
+        }
+        Window window;
+        window.left = client->x();
+        window.right = window.left + client->width();
+        window.top = client->y();
+        window.bottom = window.top + client->height();
+        if (client->keepAbove()) {
+            window.weight = 16;
+        } else if (client->keepBelow() && !client->isDock()) {
+            // ignore KeepBelow windows for placement (see X11Client::belongsToLayer() for Dock)
+            window.weight = 0;
+        } else {
+            window.weight = 1;
+        }
+        m_windows.append(window);
+        m_bottoms.append(window.bottom);
+        m_topsAbove.append(window.top - ch);
+    }
+    std::sort(m_bottoms.begin(), m_bottoms.end());
+    std::sort(m_topsAbove.begin(), m_topsAbove.end());
+}
+
+void SmartPlacementIndex::selectRow(int y)
+{
+    if (m_rowValid && m_row == y) {
+        return;
+    }
+    m_row = y;
+    m_rowValid = true;
+    m_rights.clear();
+    m_leftsBefore.clear();
+
+    // the weighted height of every window crossing the row starts at its left edge and ends
+    // at its right edge
+    QVector<QPair<int, qint64>> steps;
+    for (const Window &window : qAsConst(m_windows)) {
+        if (window.bottom <= y || window.top >= y + m_ch) {
+            continue;
+        }
+        m_rights.append(window.right);
+        m_leftsBefore.append(window.left - m_cw);
+        const qint64 height = qint64(window.weight) * (qMin(y + m_ch, window.bottom) - qMax(y, window.top));
+        steps.append(qMakePair(window.left, height));
+        steps.append(qMakePair(window.right, -height));
+    }
+    std::sort(m_rights.begin(), m_rights.end());
+    std::sort(m_leftsBefore.begin(), m_leftsBefore.end());
+    std::sort(steps.begin(), steps.end(), [](const QPair<int, qint64> &a, const QPair<int, qint64> &b) {
+        return a.first < b.first;
+    });
+
+    m_edges.clear();
+    m_integrals.clear();
+    m_heights.clear();
+    qint64 height = 0;
+    for (const auto &step : qAsConst(steps)) {
+        if (m_edges.isEmpty() || m_edges.last() != step.first) {
+            m_integrals.append(m_edges.isEmpty() ? 0 : m_integrals.last() + height * (step.first - m_edges.last()));
+            m_edges.append(step.first);
+            m_heights.append(0);
+        }
+        height += step.second;
+        m_heights.last() = height;
+    }
+}
+
+qint64 SmartPlacementIndex::integral(int x) const
+{
+    const auto it = std::upper_bound(m_edges.constBegin(), m_edges.constEnd(), x);
+    if (it == m_edges.constBegin()) {
+        return 0;
+    }
+    const int i = std::distance(m_edges.constBegin(), it) - 1;
+    return m_integrals[i] + m_heights[i] * (x - m_edges[i]);
+}
+
+qint64 SmartPlacementIndex::overlap(int x, int y)
+{
+    selectRow(y);
+    return integral(x + m_cw) - integral(x);
+}
+
+int SmartPlacementIndex::firstAfter(const QVector<int> &sorted, int value, int possible)
+{
+    const auto it = std::upper_bound(sorted.constBegin(), sorted.constEnd(), value);
+    if (it != sorted.constEnd() && *it < possible) {
+        return *it;
+    }
+    return possible;
+}
+
+int SmartPlacementIndex::nextX(int x, int y, int possible)
+{
+    selectRow(y);
+    possible = firstAfter(m_rights, x, possible);
+    return firstAfter(m_leftsBefore, x, possible);
+}
+
+int SmartPlacementIndex::nextY(int y, int possible) const
+{
+    possible = firstAfter(m_bottoms, y, possible);
+    return firstAfter(m_topsAbove, y, possible);
+}
+
 /**
  * Place the client \a c according to a really smart placement algorithm :-)
  */
@@ -204,15 +374,11 @@ void Placement::placeSmart(AbstractClient* c, const QRect& area, Policy /*next*/
     }
 
     const int none = 0, h_wrong = -1, w_wrong = -2; // overlap types
-    long int overlap, min_overlap = 0;
+    qint64 overlap, min_overlap = 0;
     int x_optimal, y_optimal;
     int possible;
     int desktop = c->desktop() == 0 || c->isOnAllDesktops() ? VirtualDesktopManager::self()->current() : c->desktop();
 
-    int cxl, cxr, cyt, cyb;     //temp coords
-    int  xl, xr, yt, yb;     //temp coords
-    int basket;                 //temp holder
-
     // get the maximum allowed windows space
     int x = area.left();
     int y = area.top();
@@ -222,6 +388,8 @@ void Placement::placeSmart(AbstractClient* c, const QRect& area, Policy /*next*/
     int ch = c->height() - 1;
     int cw = c->width()  - 1;
 
+    SmartPlacementIndex index(c, desktop, cw, ch);
+
     bool first_pass = true; //CT lame flag. Don't like it. What else would do?
 
     //loop over possible positions
@@ -232,31 +400,8 @@ void Placement::placeSmart(AbstractClient* c, const QRect& area, Policy /*next*/
         } else if (x + cw > area.right()) {
             overlap = w_wrong;
         } else {
-            overlap = none; //initialize
-
-            cxl = x; cxr = x + cw;
-            cyt = y; cyb = y + ch;
-            for (auto l = workspace()->stackingOrder().constBegin(); l != workspace()->stackingOrder().constEnd() ; ++l) {
-                AbstractClient *client = qobject_cast<AbstractClient*>(*l);
-                if (isIrrelevant(client, c, desktop)) {
-                    continue;
-                }
-                xl = client->x();          yt = client->y();
-                xr = xl + client->width(); yb = yt + client->height();
-
-                //if windows overlap, calc the overall overlapping
-                if ((cxl < xr) && (cxr > xl) &&
-                        (cyt < yb) && (cyb > yt)) {
-                    xl = qMax(cxl, xl); xr = qMin(cxr, xr);
-                    yt = qMax(cyt, yt); yb = qMin(cyb, yb);
-                    if (client->keepAbove())
-                        overlap += 16 * (xr - xl) * (yb - yt);
-                    else if (client->keepBelow() && !client->isDock()) // ignore KeepBelow windows
-                        overlap += 0; // for placement (see X11Client::belongsToLayer() for Dock)
-                    else
-                        overlap += (xr - xl) * (yb - yt);
-                }
-            }
+            //calc the overall overlapping with the other windows
+            overlap = index.overlap(x, y);
         }
 
         //CT first time we get no overlap we stop.
@@ -283,27 +428,9 @@ void Placement::placeSmart(AbstractClient* c, const QRect& area, Policy /*next*/
             possible = area.right();
             if (possible - cw > x) possible -= cw;
 
-            // compare to the position of each client on the same desk
-            for (auto l = workspace()->stackingOrder().constBegin(); l != workspace()->stackingOrder().constEnd() ; ++l) {
-                AbstractClient *client = qobject_cast<AbstractClient*>(*l);
-                if (isIrrelevant(client, c, desktop)) {
-                    continue;
-                }
-
-                xl = client->x();          yt = client->y();
-                xr = xl + client->width(); yb = yt + client->height();
-
-                // if not enough room above or under the current tested client
-                // determine the first non-overlapped x position
-                if ((y < yb) && (yt < ch + y)) {
-
-                    if ((xr > x) && (possible > xr)) possible = xr;
-
-                    basket = xl - cw;
-                    if ((basket > x) && (possible > basket)) possible = basket;
-                }
-            }
-            x = possible;
+            // if not enough room above or under the windows in this row
+            // determine the first non-overlapped x position
+            x = index.nextX(x, y, possible);
         }
 
         // ... else ==> not enough x dimension (overlap was wrong on horizontal)
@@ -313,24 +440,9 @@ void Placement::placeSmart(AbstractClient* c, const QRect& area, Policy /*next*/
 
             if (possible - ch > y) possible -= ch;
 
-            //test the position of each window on the desk
-            for (auto l = workspace()->stackingOrder().constBegin(); l != workspace()->stackingOrder().constEnd() ; ++l) {
-                AbstractClient *client = qobject_cast<AbstractClient*>(*l);
-                if (isIrrelevant(client, c, desktop)) {
-                    continue;
-                }
-
-                xl = client->x();          yt = client->y();
-                xr = xl + client->width(); yb = yt + client->height();
-
-                // if not enough room to the left or right of the current tested client
-                // determine the first non-overlapped y position
-                if ((yb > y) && (possible > yb)) possible = yb;
-
-                basket = yt - ch;
-                if ((basket > y) && (possible > basket)) possible = basket;
-            }
-            y = possible;
+            // if not enough room to the left or right of the windows
+            // determine the first non-overlapped y position
+            y = index.nextY(y, possible);
         }
     } while ((overlap != none) && (overlap != h_wrong) && (y < area.bottom()));
 
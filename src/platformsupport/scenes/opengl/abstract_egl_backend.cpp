@@ -7,6 +7,7 @@
     SPDX-License-Identifier: GPL-2.0-or-later
 */
 #include "abstract_egl_backend.h"
+#include "drm_fourcc.h"
 #include "egl_dmabuf.h"
 #include "kwineglext.h"
 #include "composite.h"
@@ -14,6 +15,7 @@
 #include "options.h"
 #include "platform.h"
 #include "scene.h"
+#include "textureupload.h"
 #include "wayland_server.h"
 #include "abstract_wayland_output.h"
 #include <KWaylandServer/buffer_interface.h>
@@ -27,6 +29,7 @@
 #include <QOpenGLContext>
 #include <QOpenGLFramebufferObject>
 
+#include <deque>
 #include <memory>
 
 namespace KWin
@@ -114,8 +117,144 @@ void AbstractEglBackend::teardown()
     destroyGlobalShareContext();
 }
 
+/**
+ * The PixelUploadBuffer class is a ring buffer in a persistently mapped pixel buffer object
+ * that is used to stream the contents of shared memory buffers to textures. The pixels are
+ * copied into the ring buffer and the GPU fetches them asynchronously. Fences tell when a
+ * range of the ring buffer can be reused.
+ */
+class PixelUploadBuffer
+{
+public:
+    PixelUploadBuffer();
+    ~PixelUploadBuffer();
+
+    static bool isSupported();
+
+    /**
+     * Uploads the @a rects of the @a image to the texture that is currently bound to the
+     * @a target. Returns @c false if the pixels don't fit in the buffer, in which case the
+     * caller has to upload them by other means.
+     */
+    bool upload(GLenum target, GLenum format, const QImage &image, const QVector<QRect> &rects);
+
+private:
+    struct Fence
+    {
+        GLsync sync;
+        quint64 end;
+    };
+
+    void retireFences(quint64 end);
+
+    static const qsizetype s_bufferSize = 16 * 1024 * 1024;
+
+    GLuint m_buffer = 0;
+    uchar *m_map = nullptr;
+    // Positions are monotonic, the offset in the buffer is the position modulo its size.
+    quint64 m_head = 0;
+    quint64 m_tail = 0;
+    std::deque<Fence> m_fences;
+};
+
+PixelUploadBuffer::PixelUploadBuffer()
+{
+    const GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, s_bufferSize, nullptr, access);
+    m_map = static_cast<uchar *>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, s_bufferSize, access));
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if (!m_map) {
+        qCWarning(KWIN_OPENGL) << "Failed to map the pixel upload buffer";
+    }
+}
+
+PixelUploadBuffer::~PixelUploadBuffer()
+{
+    for (const Fence &fence : m_fences) {
+        glDeleteSync(fence.sync);
+    }
+    // This also unmaps the buffer.
+    glDeleteBuffers(1, &m_buffer);
+}
+
+bool PixelUploadBuffer::isSupported()
+{
+    if (qgetenv("KWIN_PERSISTENT_PBO") == QByteArrayLiteral("0")) {
+        return false;
+    }
+    if (GLPlatform::instance()->isGLES()) {
+        return hasGLVersion(3, 0) && hasGLExtension(QByteArrayLiteral("GL_EXT_buffer_storage"));
+    }
+    const bool haveBufferStorage = hasGLVersion(4, 4) || hasGLExtension(QByteArrayLiteral("GL_ARB_buffer_storage"));
+    const bool haveSyncFences = hasGLVersion(3, 2) || hasGLExtension(QByteArrayLiteral("GL_ARB_sync"));
+    return haveBufferStorage && haveSyncFences;
+}
+
+void PixelUploadBuffer::retireFences(quint64 end)
+{
+    // A range can be reused once the GPU is done with everything that was written to the
+    // same offsets during the previous lap around the buffer.
+    while (!m_fences.empty()) {
+        const Fence &fence = m_fences.front();
+        GLint status;
+        glGetSynciv(fence.sync, GL_SYNC_STATUS, 1, nullptr, &status);
+        if (status != GL_SIGNALED) {
+            if (m_tail + s_bufferSize >= end) {
+                break;
+            }
+            qCDebug(KWIN_OPENGL) << "Stalling on pixel upload buffer fence";
+            glClientWaitSync(fence.sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        }
+        m_tail = fence.end;
+        glDeleteSync(fence.sync);
+        m_fences.pop_front();
+    }
+    if (m_fences.empty()) {
+        m_tail = m_head;
+    }
+}
+
+bool PixelUploadBuffer::upload(GLenum target, GLenum format, const QImage &image, const QVector<QRect> &rects)
+{
+    const qsizetype size = packedRectsSize(rects);
+    if (!m_map || size > s_bufferSize) {
+        return false;
+    }
+
+    // The pixels of an upload must not wrap around the end of the buffer.
+    quint64 start = m_head;
+    const qsizetype startOffset = start % s_bufferSize;
+    if (startOffset + size > s_bufferSize) {
+        start += s_bufferSize - startOffset;
+    }
+    const quint64 end = start + size;
+    retireFences(end);
+
+    qsizetype offset = start % s_bufferSize;
+    packRects(image, rects, m_map + offset);
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+    for (const QRect &rect : rects) {
+        glTexSubImage2D(target, 0, rect.x(), rect.y(), rect.width(), rect.height(),
+                        format, GL_UNSIGNED_BYTE, reinterpret_cast<const GLvoid *>(offset));
+        offset += qsizetype(rect.width()) * rect.height() * 4;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    m_head = end;
+    m_fences.push_back(Fence{glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), end});
+
+    return true;
+}
+
 void AbstractEglBackend::cleanup()
 {
+    delete m_pixelUploadBuffer;
+    m_pixelUploadBuffer = nullptr;
     cleanupGL();
     doneCurrent();
     eglDestroyContext(m_display, m_context);
@@ -377,6 +516,18 @@ void AbstractEglBackend::setSurface(const EGLSurface &surface)
     m_surface = surface;
 }
 
+PixelUploadBuffer *AbstractEglBackend::pixelUploadBuffer()
+{
+    if (!m_pixelUploadBuffer && !m_pixelUploadBufferFailed) {
+        if (PixelUploadBuffer::isSupported()) {
+            m_pixelUploadBuffer = new PixelUploadBuffer();
+        } else {
+            m_pixelUploadBufferFailed = true;
+        }
+    }
+    return m_pixelUploadBuffer;
+}
+
 QSharedPointer<GLTexture> AbstractEglBackend::textureForOutput(AbstractOutput *requestedOutput) const
 {
     QSharedPointer<GLTexture> texture(new GLTexture(GL_RGBA8, requestedOutput->pixelSize()));
@@ -409,6 +560,29 @@ OpenGLBackend *AbstractEglTexture::backend()
     return m_backend;
 }
 
+static ShaderTraits yuvShaderTraits(uint32_t format)
+{
+    switch (format) {
+    case DRM_FORMAT_NV12:
+        return ShaderTrait::MapTexture | ShaderTrait::YuvSemiPlanar;
+    case DRM_FORMAT_YUV420:
+    case DRM_FORMAT_YVU420:
+    case DRM_FORMAT_YUV444:
+        return ShaderTrait::MapTexture | ShaderTrait::YuvPlanar;
+    case DRM_FORMAT_YUYV:
+        return ShaderTrait::MapTexture | ShaderTrait::YuvPacked;
+    default:
+        return ShaderTrait::MapTexture;
+    }
+}
+
+static QMatrix4x4 defaultYuvToRgbMatrix(const QSize &size)
+{
+    // Clients can't tell the color space of their buffers yet. Assume what video decoders
+    // usually produce, BT.709 for HD content and BT.601 otherwise, both in limited range.
+    return yuvToRgbMatrix(size.height() >= 720 ? YuvColorSpace::Bt709 : YuvColorSpace::Bt601, YuvRange::Limited);
+}
+
 bool AbstractEglTexture::loadTexture(WindowPixmap *pixmap)
 {
     // FIXME: Refactor this method.
@@ -449,8 +623,9 @@ void AbstractEglTexture::updateTexture(WindowPixmap *pixmap, const QRegion &regi
     auto s = pixmap->surface();
     if (EglDmabufBuffer *dmabuf = static_cast<EglDmabufBuffer *>(buffer->linuxDmabufBuffer())) {
         q->bind();
-        glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, (GLeglImageOES) dmabuf->images()[0]);   //TODO
+        glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, (GLeglImageOES) dmabuf->images()[0]);
         q->unbind();
+        attachDmabufChromaPlanes(dmabuf);
         if (m_image != EGL_NO_IMAGE_KHR) {
             eglDestroyImageKHR(m_backend->eglDisplay(), m_image);
         }
@@ -460,6 +635,16 @@ void AbstractEglTexture::updateTexture(WindowPixmap *pixmap, const QRegion &regi
         q->setYInverted(!(dmabuf->flags() & KWaylandServer::LinuxDmabufUnstableV1Interface::YInverted));
         return;
     }
+    if (m_shaderTraits != ShaderTrait::MapTexture) {
+        // The previous buffer was a YUV dmabuf, its luma texture has a single channel.
+        setChromaPlaneCount(0);
+        m_shaderTraits = ShaderTrait::MapTexture;
+        if (buffer->shmBuffer()) {
+            q->discard();
+            createTextureImage(buffer->data());
+            return;
+        }
+    }
     if (!buffer->shmBuffer()) {
         q->bind();
         EGLImageKHR image = attach(buffer);
@@ -493,6 +678,7 @@ bool AbstractEglTexture::createTextureImage(const QImage &image)
     glGenTextures(1, &m_texture);
     q->setFilter(GL_LINEAR);
     q->setWrapMode(GL_CLAMP_TO_EDGE);
+    m_forceOpaqueAlpha = false;
 
     const QSize &size = image.size();
     q->bind();
@@ -509,10 +695,14 @@ bool AbstractEglTexture::createTextureImage(const QImage &image)
         return false;
     }
     if (GLPlatform::instance()->isGLES()) {
-        if (s_supportsARGB32 && format == GL_RGBA8) {
-            const QImage im = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        if (s_supportsARGB32 && (format == GL_RGBA8 || format == GL_RGB8)) {
+            // The memory layout of QImage::Format_RGB32 already matches GL_BGRA_EXT, but the
+            // padding byte of a client buffer is undefined and must not be sampled as alpha.
+            const bool keepRgb32 = image.format() == QImage::Format_RGB32 && GLTexture::supportsSwizzle();
+            const QImage im = keepRgb32 ? image : image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
             glTexImage2D(m_target, 0, GL_BGRA_EXT, im.width(), im.height(),
                          0, GL_BGRA_EXT, GL_UNSIGNED_BYTE, im.bits());
+            updateAlphaSwizzle(image);
         } else {
             const QImage im = image.convertToFormat(QImage::Format_RGBA8888_Premultiplied);
             glTexImage2D(m_target, 0, GL_RGBA, im.width(), im.height(),
@@ -531,31 +721,102 @@ bool AbstractEglTexture::createTextureImage(const QImage &image)
 
 void AbstractEglTexture::createTextureSubImage(const QImage &image, const QRegion &damage)
 {
+    const QVector<QRect> rects = coalesceUploadRects(damage & image.rect(), uploadCoalesceThreshold());
+    if (rects.isEmpty()) {
+        return;
+    }
+
+    // QImage::Format_ARGB32_Premultiplied and QImage::Format_RGB32 are equivalent to
+    // GL_BGRA/GL_UNSIGNED_BYTE on little-endian systems, so the pixels can be uploaded
+    // as they are if the GPU can sample BGRA textures. On GLES the texture keeps the
+    // padding byte of QImage::Format_RGB32, so it has to be swizzled to an opaque alpha.
+    const bool isGLES = GLPlatform::instance()->isGLES();
+    const bool isBgra = image.format() == QImage::Format_ARGB32_Premultiplied
+            || (image.format() == QImage::Format_RGB32 && (!isGLES || GLTexture::supportsSwizzle()));
+    GLenum format;
+    QImage::Format convertedFormat;
+    if (!isGLES) {
+        format = GL_BGRA;
+        convertedFormat = QImage::Format_ARGB32_Premultiplied;
+    } else if (s_supportsARGB32 && (isBgra || image.format() == QImage::Format_ARGB32 || image.format() == QImage::Format_RGB32)) {
+        format = GL_BGRA_EXT;
+        convertedFormat = QImage::Format_ARGB32_Premultiplied;
+    } else {
+        format = GL_RGBA;
+        convertedFormat = QImage::Format_RGBA8888_Premultiplied;
+    }
+    const bool needsConversion = !isBgra || format == GL_RGBA;
+
     q->bind();
-    if (GLPlatform::instance()->isGLES()) {
-        if (s_supportsARGB32 && (image.format() == QImage::Format_ARGB32 || image.format() == QImage::Format_ARGB32_Premultiplied)) {
-            const QImage im = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
-            for (const QRect &rect : damage) {
-                glTexSubImage2D(m_target, 0, rect.x(), rect.y(), rect.width(), rect.height(),
-                                GL_BGRA_EXT, GL_UNSIGNED_BYTE, im.copy(rect).bits());
-            }
-        } else {
-            const QImage im = image.convertToFormat(QImage::Format_RGBA8888_Premultiplied);
-            for (const QRect &rect : damage) {
-                glTexSubImage2D(m_target, 0, rect.x(), rect.y(), rect.width(), rect.height(),
-                                GL_RGBA, GL_UNSIGNED_BYTE, im.copy(rect).bits());
-            }
+    if (format == GL_BGRA_EXT) {
+        updateAlphaSwizzle(image);
+    }
+    if (needsConversion) {
+        for (const QRect &rect : rects) {
+            const QImage im = image.copy(rect).convertToFormat(convertedFormat);
+            glTexSubImage2D(m_target, 0, rect.x(), rect.y(), rect.width(), rect.height(),
+                            format, GL_UNSIGNED_BYTE, im.constBits());
         }
     } else {
-        const QImage im = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
-        for (const QRect &rect : damage) {
-            glTexSubImage2D(m_target, 0, rect.x(), rect.y(), rect.width(), rect.height(),
-                            GL_BGRA, GL_UNSIGNED_BYTE, im.copy(rect).bits());
+        PixelUploadBuffer *uploadBuffer = m_backend->pixelUploadBuffer();
+        if (!uploadBuffer || !uploadBuffer->upload(m_target, format, image, rects)) {
+            // Let the GL read the rects straight from the image if it knows its stride.
+            const bool useUnpack = s_supportsUnpack && image.bytesPerLine() % 4 == 0;
+            if (useUnpack) {
+                glPixelStorei(GL_UNPACK_ROW_LENGTH, image.bytesPerLine() / 4);
+            }
+            for (const QRect &rect : rects) {
+                if (useUnpack || rect.width() * 4 == image.bytesPerLine()) {
+                    glTexSubImage2D(m_target, 0, rect.x(), rect.y(), rect.width(), rect.height(),
+                                    format, GL_UNSIGNED_BYTE, image.constScanLine(rect.y()) + rect.x() * 4);
+                } else {
+                    const QImage im = image.copy(rect);
+                    glTexSubImage2D(m_target, 0, rect.x(), rect.y(), rect.width(), rect.height(),
+                                    format, GL_UNSIGNED_BYTE, im.constBits());
+                }
+            }
+            if (useUnpack) {
+                glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+            }
         }
     }
     q->unbind();
 }
 
+void AbstractEglTexture::updateAlphaSwizzle(const QImage &image)
+{
+    // Only GLES keeps the padding byte of QImage::Format_RGB32 in a GL_BGRA_EXT texture.
+    if (!GLPlatform::instance()->isGLES() || !GLTexture::supportsSwizzle()) {
+        return;
+    }
+    const bool opaque = image.format() == QImage::Format_RGB32;
+    if (opaque == m_forceOpaqueAlpha) {
+        return;
+    }
+    q->setSwizzle(GL_RED, GL_GREEN, GL_BLUE, opaque ? GL_ONE : GL_ALPHA);
+    m_forceOpaqueAlpha = opaque;
+}
+
+void AbstractEglTexture::setChromaPlaneCount(int count)
+{
+    if (m_chromaPlanes.count() > count) {
+        glDeleteTextures(m_chromaPlanes.count() - count, m_chromaPlanes.constData() + count);
+        m_chromaPlanes.resize(count);
+    }
+    while (m_chromaPlanes.count() < count) {
+        // The chroma usually has a lower resolution than the luma, it's always interpolated.
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        m_chromaPlanes.append(texture);
+    }
+}
+
 bool AbstractEglTexture::loadShmTexture(const QPointer< KWaylandServer::BufferInterface > &buffer)
 {
     return createTextureImage(buffer->data());
@@ -603,6 +864,7 @@ bool AbstractEglTexture::loadDmabufTexture(const QPointer< KWaylandServer::Buffe
     q->bind();
     glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, (GLeglImageOES) dmabuf->images()[0]);
     q->unbind();
+    attachDmabufChromaPlanes(dmabuf);
 
     m_size = dmabuf->size();
     q->setYInverted(!(dmabuf->flags() & KWaylandServer::LinuxDmabufUnstableV1Interface::YInverted));
@@ -611,6 +873,21 @@ bool AbstractEglTexture::loadDmabufTexture(const QPointer< KWaylandServer::Buffe
     return true;
 }
 
+void AbstractEglTexture::attachDmabufChromaPlanes(EglDmabufBuffer *dmabuf)
+{
+    // YUV buffers are imported with an image per plane, see EglDmabuf::yuvImport()
+    const QVector<EGLImage> images = dmabuf->images();
+    setChromaPlaneCount(images.count() - 1);
+    for (int i = 1; i < images.count(); ++i) {
+        glBindTexture(GL_TEXTURE_2D, m_chromaPlanes[i - 1]);
+        glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, (GLeglImageOES) images[i]);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    m_shaderTraits = images.count() > 1 ? yuvShaderTraits(dmabuf->format()) : ShaderTrait::MapTexture;
+    m_yuvToRgbMatrix = defaultYuvToRgbMatrix(dmabuf->size());
+}
+
 bool AbstractEglTexture::loadInternalImageObject(WindowPixmap *pixmap)
 {
     return createTextureImage(pixmap->internalImage());
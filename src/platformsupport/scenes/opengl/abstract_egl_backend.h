@@ -25,7 +25,9 @@ namespace KWin
 {
 
 class EglDmabuf;
+class EglDmabufBuffer;
 class AbstractOutput;
+class PixelUploadBuffer;
 
 class KWIN_EXPORT AbstractEglBackend : public QObject, public OpenGLBackend
 {
@@ -61,6 +63,12 @@ public:
         return this == s_primaryBackend;
     }
 
+    /**
+     * Returns the buffer that is used to stream pixels to textures, or @c nullptr if the
+     * OpenGL implementation doesn't support persistently mapped buffers.
+     */
+    PixelUploadBuffer *pixelUploadBuffer();
+
 protected:
     AbstractEglBackend();
     void setEglDisplay(const EGLDisplay &display);
@@ -86,6 +94,8 @@ private:
     EGLConfig m_config = nullptr;
     // note: m_dmaBuf is nullptr if this is not the primary backend
     EglDmabuf *m_dmaBuf = nullptr;
+    PixelUploadBuffer *m_pixelUploadBuffer = nullptr;
+    bool m_pixelUploadBufferFailed = false;
     QList<QByteArray> m_clientExtensions;
 
     static AbstractEglBackend * s_primaryBackend;
@@ -114,9 +124,12 @@ protected:
 private:
     void createTextureSubImage(const QImage &image, const QRegion &damage);
     bool createTextureImage(const QImage &image);
+    void updateAlphaSwizzle(const QImage &image);
     bool loadShmTexture(const QPointer<KWaylandServer::BufferInterface> &buffer);
     bool loadEglTexture(const QPointer<KWaylandServer::BufferInterface> &buffer);
     bool loadDmabufTexture(const QPointer< KWaylandServer::BufferInterface > &buffer);
+    void attachDmabufChromaPlanes(EglDmabufBuffer *dmabuf);
+    void setChromaPlaneCount(int count);
     bool loadInternalImageObject(WindowPixmap *pixmap);
     EGLImageKHR attach(const QPointer<KWaylandServer::BufferInterface> &buffer);
     bool updateFromFBO(const QSharedPointer<QOpenGLFramebufferObject> &fbo);
@@ -124,6 +137,7 @@ private:
     SceneOpenGLTexture *q;
     AbstractEglBackend *m_backend;
     EGLImageKHR m_image;
+    bool m_forceOpaqueAlpha = false;
 };
 
 }
@@ -15,6 +15,8 @@
 
 #include <unistd.h>
 
+#include <algorithm>
+
 namespace KWin
 {
 
@@ -121,6 +123,16 @@ YuvFormat yuvFormats[] = {
     }
 };
 
+static const YuvFormat *findYuvFormat(uint32_t format)
+{
+    for (const YuvFormat &yuvFormat : yuvFormats) {
+        if (yuvFormat.format == format) {
+            return &yuvFormat;
+        }
+    }
+    return nullptr;
+}
+
 EglDmabufBuffer::EglDmabufBuffer(EGLImage image,
                                  const QVector<Plane> &planes,
                                  uint32_t format,
@@ -255,16 +267,18 @@ KWaylandServer::LinuxDmabufUnstableV1Buffer* EglDmabuf::importBuffer(const QVect
 {
     Q_ASSERT(planes.count() > 0);
 
-    // Try first to import as a single image
+    // YUV buffers are imported with an image per plane and converted to RGB by the scene's
+    // shader. Drivers can import some of them as a single image, but only as external textures.
+    if (findYuvFormat(format)) {
+        if (auto *buffer = yuvImport(planes, format, size, flags)) {
+            return buffer;
+        }
+    }
+
     if (auto *img = createImage(planes, format, size)) {
         return new EglDmabufBuffer(img, planes, format, size, flags, this);
     }
 
-    // TODO: to enable this we must be able to store multiple textures per window pixmap
-    //       and when on window draw do yuv to rgb transformation per shader (see Weston)
-//    // not a single image, try yuv import
-//    return yuvImport(planes, format, size, flags);
-
     return nullptr;
 }
 
@@ -273,44 +287,46 @@ KWaylandServer::LinuxDmabufUnstableV1Buffer* EglDmabuf::yuvImport(const QVector<
                                                                     const QSize &size,
                                                                     Flags flags)
 {
-    YuvFormat yuvFormat;
-    for (YuvFormat f : yuvFormats) {
-        if (f.format == format) {
-            yuvFormat = f;
-            break;
-        }
-    }
-    if (yuvFormat.format == 0) {
+    const YuvFormat *yuvFormat = findYuvFormat(format);
+    if (!yuvFormat || planes.count() != yuvFormat->inputPlanes) {
         return nullptr;
     }
-    if (planes.count() != yuvFormat.inputPlanes) {
+
+    auto *buf = new EglDmabufBuffer(planes, format, size, flags, this);
+    if (!importYuvPlanes(buf)) {
+        delete buf;
         return nullptr;
     }
+    return buf;
+}
 
-    auto *buf = new EglDmabufBuffer(planes, format, size, flags, this);
+bool EglDmabuf::importYuvPlanes(EglDmabufBuffer *buffer)
+{
+    const YuvFormat *yuvFormat = findYuvFormat(buffer->format());
+    const QVector<Plane> planes = buffer->planes();
+    const QSize size = buffer->size();
 
-    for (int i = 0; i < yuvFormat.outputPlanes; i++) {
-        int planeIndex = yuvFormat.planes[i].planeIndex;
+    for (int i = 0; i < yuvFormat->outputPlanes; i++) {
+        int planeIndex = yuvFormat->planes[i].planeIndex;
         Plane plane = {
             planes[planeIndex].fd,
             planes[planeIndex].offset,
             planes[planeIndex].stride,
             planes[planeIndex].modifier
         };
-        const auto planeFormat = yuvFormat.planes[i].format;
-        const auto planeSize = QSize(size.width() / yuvFormat.planes[i].widthDivisor,
-                                     size.height() / yuvFormat.planes[i].heightDivisor);
+        const auto planeFormat = yuvFormat->planes[i].format;
+        const auto planeSize = QSize(size.width() / yuvFormat->planes[i].widthDivisor,
+                                     size.height() / yuvFormat->planes[i].heightDivisor);
         auto *image = createImage(QVector<Plane>(1, plane),
                                   planeFormat,
                                   planeSize);
         if (!image) {
-            delete buf;
-            return nullptr;
+            buffer->removeImages();
+            return false;
         }
-        buf->addImage(image);
+        buffer->addImage(image);
     }
-    // TODO: add buf import properties
-    return buf;
+    return true;
 }
 
 EglDmabuf* EglDmabuf::factory(AbstractEglBackend *backend)
@@ -339,6 +355,9 @@ EglDmabuf::EglDmabuf(AbstractEglBackend *backend)
     for (auto *buffer : prevBuffersSet) {
         auto *buf = static_cast<EglDmabufBuffer*>(buffer);
         buf->setInterfaceImplementation(this);
+        if (findYuvFormat(buf->format()) && importYuvPlanes(buf)) {
+            continue;
+        }
         buf->addImage(createImage(buf->planes(), buf->format(), buf->size()));
     }
     setSupportedFormatsAndModifiers();
@@ -413,9 +432,23 @@ void EglDmabuf::setSupportedFormatsAndModifiers()
         return;
     }
 
+    // The YUV formats that are imported plane by plane only need the formats of their planes.
+    QVector<uint32_t> yuvFormatsToAdvertise;
+    for (const YuvFormat &yuvFormat : yuvFormats) {
+        const bool planesSupported = std::all_of(yuvFormat.planes, yuvFormat.planes + yuvFormat.outputPlanes, [&formats](const YuvPlane &plane) {
+            return formats.contains(plane.format);
+        });
+        if (planesSupported) {
+            yuvFormatsToAdvertise << yuvFormat.format;
+        }
+    }
+
     filterFormatsWithMultiplePlanes(formats);
 
     QHash<uint32_t, QSet<uint64_t> > set;
+    for (uint32_t format : qAsConst(yuvFormatsToAdvertise)) {
+        set.insert(format, QSet<uint64_t>());
+    }
 
     for (auto format : qAsConst(formats)) {
         if (eglQueryDmaBufModifiersEXT != nullptr) {
@@ -82,6 +82,7 @@ private:
                                                              uint32_t format,
                                                              const QSize &size,
                                                              Flags flags);
+    bool importYuvPlanes(EglDmabufBuffer *buffer);
 
     void setSupportedFormatsAndModifiers();
 
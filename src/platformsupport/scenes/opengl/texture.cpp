@@ -47,10 +47,94 @@ bool SceneOpenGLTexture::load(WindowPixmap *pixmap)
     return d->loadTexture(pixmap);
 }
 
+ShaderTraits SceneOpenGLTexture::shaderTraits() const
+{
+    Q_D(const SceneOpenGLTexture);
+    return d->m_shaderTraits;
+}
+
+QMatrix4x4 SceneOpenGLTexture::yuvToRgbMatrix() const
+{
+    Q_D(const SceneOpenGLTexture);
+    return d->m_yuvToRgbMatrix;
+}
+
+void SceneOpenGLTexture::bindChromaPlanes()
+{
+    Q_D(SceneOpenGLTexture);
+    for (int i = 0; i < d->m_chromaPlanes.count(); ++i) {
+        glActiveTexture(GL_TEXTURE1 + i);
+        glBindTexture(GL_TEXTURE_2D, d->m_chromaPlanes[i]);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void SceneOpenGLTexture::unbindChromaPlanes()
+{
+    Q_D(SceneOpenGLTexture);
+    for (int i = 0; i < d->m_chromaPlanes.count(); ++i) {
+        glActiveTexture(GL_TEXTURE1 + i);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+GLTexture *SceneOpenGLTexture::rgbTexture()
+{
+    Q_D(SceneOpenGLTexture);
+    if (d->m_shaderTraits == ShaderTrait::MapTexture || !GLRenderTarget::supported()) {
+        return nullptr;
+    }
+    if (!d->m_rgbTextureDirty) {
+        return d->m_rgbTexture.data();
+    }
+    if (!d->m_rgbTexture || d->m_rgbTexture->size() != size()) {
+        d->m_rgbTexture.reset(new GLTexture(GL_RGBA8, size()));
+        d->m_rgbTexture->setFilter(GL_LINEAR);
+        d->m_rgbTexture->setWrapMode(GL_CLAMP_TO_EDGE);
+    }
+    d->m_rgbTexture->setYInverted(isYInverted());
+
+    // Every texel is converted in place, so the converted texture can be sampled with the
+    // texture coordinates of the YUV one.
+    GLRenderTarget renderTarget(*d->m_rgbTexture);
+    GLRenderTarget::pushRenderTarget(&renderTarget);
+
+    QMatrix4x4 mvp;
+    mvp.ortho(0, 1, 0, 1, -1, 1);
+    GLShader *shader = ShaderManager::instance()->pushShader(d->m_shaderTraits);
+    shader->setUniform(GLShader::ModelViewProjectionMatrix, mvp);
+    shader->setUniform(GLShader::YuvToRgbMatrix, d->m_yuvToRgbMatrix);
+
+    const float coordinates[] = {
+        1.0, 0.0,
+        0.0, 0.0,
+        0.0, 1.0,
+        0.0, 1.0,
+        1.0, 1.0,
+        1.0, 0.0,
+    };
+    bind();
+    bindChromaPlanes();
+    GLVertexBuffer *vbo = GLVertexBuffer::streamingBuffer();
+    vbo->reset();
+    vbo->setData(6, 2, coordinates, coordinates);
+    vbo->render(GL_TRIANGLES);
+    unbindChromaPlanes();
+    unbind();
+
+    ShaderManager::instance()->popShader();
+    GLRenderTarget::popRenderTarget();
+
+    d->m_rgbTextureDirty = false;
+    return d->m_rgbTexture.data();
+}
+
 void SceneOpenGLTexture::updateFromPixmap(WindowPixmap *pixmap, const QRegion &region)
 {
     Q_D(SceneOpenGLTexture);
     d->updateTexture(pixmap, region);
+    d->m_rgbTextureDirty = true;
 }
 
 SceneOpenGLTexturePrivate::SceneOpenGLTexturePrivate()
@@ -59,6 +143,9 @@ SceneOpenGLTexturePrivate::SceneOpenGLTexturePrivate()
 
 SceneOpenGLTexturePrivate::~SceneOpenGLTexturePrivate()
 {
+    if (!m_chromaPlanes.isEmpty()) {
+        glDeleteTextures(m_chromaPlanes.count(), m_chromaPlanes.constData());
+    }
 }
 
 void SceneOpenGLTexturePrivate::updateTexture(WindowPixmap *pixmap, const QRegion &region)
@@ -11,6 +11,9 @@
 
 #include <kwingltexture.h>
 #include <kwingltexture_p.h>
+#include <kwinglutils.h>
+
+#include <QMatrix4x4>
 
 namespace KWin
 {
@@ -29,6 +32,27 @@ public:
 
     void discard() override final;
 
+    /**
+     * Returns the traits of the shader that samples the texture. A YUV texture holds the luma
+     * and needs a shader that converts it to RGB together with the chroma planes.
+     */
+    ShaderTraits shaderTraits() const;
+    /**
+     * Returns the matrix that converts the pixels of a YUV texture to RGB.
+     */
+    QMatrix4x4 yuvToRgbMatrix() const;
+    /**
+     * Binds the chroma planes of a YUV texture to the texture units following the first one.
+     */
+    void bindChromaPlanes();
+    void unbindChromaPlanes();
+    /**
+     * Returns the content of a YUV texture converted to RGB, for shaders that can't sample
+     * the chroma planes. It has the size and orientation of the texture. Returns @c nullptr if
+     * the conversion failed.
+     */
+    GLTexture *rgbTexture();
+
 private:
     SceneOpenGLTexture(SceneOpenGLTexturePrivate& dd);
 
@@ -49,6 +73,14 @@ public:
     virtual void updateTexture(WindowPixmap *pixmap, const QRegion &region);
     virtual OpenGLBackend *backend() = 0;
 
+    // A YUV texture holds the luma, the chroma planes are textures of their own.
+    ShaderTraits m_shaderTraits = ShaderTrait::MapTexture;
+    QVector<GLuint> m_chromaPlanes;
+    QMatrix4x4 m_yuvToRgbMatrix;
+    // the YUV texture converted to RGB, valid until the texture is updated
+    QScopedPointer<GLTexture> m_rgbTexture;
+    bool m_rgbTextureDirty = true;
+
 protected:
     SceneOpenGLTexturePrivate();
 
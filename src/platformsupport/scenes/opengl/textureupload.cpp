@@ -0,0 +1,92 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "textureupload.h"
+
+#include <cstring>
+
+namespace KWin
+{
+
+static qsizetype area(const QRect &rect)
+{
+    return qsizetype(rect.width()) * rect.height();
+}
+
+QVector<QRect> coalesceUploadRects(const QRegion &damage, int threshold)
+{
+    QVector<QRect> rects;
+    rects.reserve(damage.rectCount());
+
+    if (threshold < 0) {
+        for (const QRect &rect : damage) {
+            rects.append(rect);
+        }
+        return rects;
+    }
+
+    // The rects of a QRegion are sorted from top to bottom and from left to right, so
+    // rects that are close to each other usually come one after another.
+    QRect current;
+    qsizetype currentArea = 0;
+    for (const QRect &rect : damage) {
+        if (current.isEmpty()) {
+            current = rect;
+            currentArea = area(rect);
+            continue;
+        }
+        const QRect united = current | rect;
+        const qsizetype damagedArea = currentArea + area(rect);
+        if (area(united) - damagedArea <= threshold) {
+            current = united;
+            currentArea = damagedArea;
+        } else {
+            rects.append(current);
+            current = rect;
+            currentArea = area(rect);
+        }
+    }
+    if (!current.isEmpty()) {
+        rects.append(current);
+    }
+
+    return rects;
+}
+
+int uploadCoalesceThreshold()
+{
+    // Issuing an upload costs about as much as copying a couple of thousand pixels.
+    static const int threshold = qEnvironmentVariableIsSet("KWIN_GL_UPLOAD_COALESCE_THRESHOLD")
+        ? qEnvironmentVariableIntValue("KWIN_GL_UPLOAD_COALESCE_THRESHOLD")
+        : 4096;
+    return threshold;
+}
+
+qsizetype packedRectsSize(const QVector<QRect> &rects)
+{
+    qsizetype size = 0;
+    for (const QRect &rect : rects) {
+        size += area(rect) * 4;
+    }
+    return size;
+}
+
+void packRects(const QImage &image, const QVector<QRect> &rects, uchar *destination)
+{
+    Q_ASSERT(image.depth() == 32);
+
+    for (const QRect &rect : rects) {
+        const qsizetype rowSize = qsizetype(rect.width()) * 4;
+        for (int y = rect.top(); y <= rect.bottom(); ++y) {
+            std::memcpy(destination, image.constScanLine(y) + rect.x() * 4, rowSize);
+            destination += rowSize;
+        }
+    }
+}
+
+} // namespace KWin
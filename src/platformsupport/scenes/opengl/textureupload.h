@@ -0,0 +1,45 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#pragma once
+
+#include <kwinglobals.h>
+
+#include <QImage>
+#include <QRegion>
+#include <QVector>
+
+namespace KWin
+{
+
+/**
+ * Returns the rects of the @a damage that have to be uploaded to a texture. Each upload has
+ * a fixed cost, so neighbouring rects are merged if the bounding rect contains at most
+ * @a threshold pixels that are not damaged. A negative @a threshold disables merging.
+ */
+KWIN_EXPORT QVector<QRect> coalesceUploadRects(const QRegion &damage, int threshold);
+
+/**
+ * Returns the merge threshold for coalesceUploadRects(). It can be tuned with the
+ * KWIN_GL_UPLOAD_COALESCE_THRESHOLD environment variable.
+ */
+KWIN_EXPORT int uploadCoalesceThreshold();
+
+/**
+ * Returns the number of bytes needed to store the @a rects of an image with 32 bits
+ * per pixel tightly packed.
+ */
+KWIN_EXPORT qsizetype packedRectsSize(const QVector<QRect> &rects);
+
+/**
+ * Copies the @a rects of the @a image, which must have 32 bits per pixel, tightly packed
+ * one after another to @a destination.
+ */
+KWIN_EXPORT void packRects(const QImage &image, const QVector<QRect> &rects, uchar *destination);
+
+} // namespace KWin
@@ -0,0 +1,54 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "damagejournal.h"
+
+namespace KWin
+{
+
+int DamageJournal::capacity() const
+{
+    return m_capacity;
+}
+
+void DamageJournal::setCapacity(int capacity)
+{
+    m_capacity = capacity;
+    while (m_log.count() > m_capacity) {
+        m_log.removeLast();
+    }
+}
+
+void DamageJournal::add(const QRegion &region)
+{
+    while (m_log.count() >= m_capacity) {
+        m_log.removeLast();
+    }
+    m_log.prepend(region);
+}
+
+void DamageJournal::clear()
+{
+    m_log.clear();
+}
+
+QRegion DamageJournal::accumulate(int bufferAge, const QRegion &fallback) const
+{
+    if (bufferAge <= 0 || bufferAge > m_log.count() + 1) {
+        return fallback;
+    }
+
+    // A buffer of age 1 holds the previous frame, so it's already up to date.
+    QRegion region;
+    for (int i = 0; i < bufferAge - 1; ++i) {
+        region |= m_log[i];
+    }
+    return region;
+}
+
+} // namespace KWin
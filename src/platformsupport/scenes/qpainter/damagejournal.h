@@ -0,0 +1,56 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#ifndef KWIN_DAMAGEJOURNAL_H
+#define KWIN_DAMAGEJOURNAL_H
+
+#include <QList>
+#include <QRegion>
+
+namespace KWin
+{
+
+/**
+ * The DamageJournal class keeps track of the damage of the last few frames rendered on an
+ * output. It is used to determine what has to be repainted to bring a reused back buffer
+ * up to date.
+ */
+class DamageJournal
+{
+public:
+    /**
+     * Returns the maximum number of frames whose damage is remembered.
+     */
+    int capacity() const;
+    void setCapacity(int capacity);
+
+    /**
+     * Adds the damage of a rendered frame to the journal.
+     */
+    void add(const QRegion &region);
+
+    /**
+     * Forgets the damage of all frames, e.g. after the output has been resized.
+     */
+    void clear();
+
+    /**
+     * Returns the damage that has accumulated since a buffer of the given @a bufferAge was
+     * rendered. If the age is 0, i.e. the contents of the buffer are undefined, or the
+     * journal doesn't go back far enough, the @a fallback region is returned.
+     */
+    QRegion accumulate(int bufferAge, const QRegion &fallback) const;
+
+private:
+    QList<QRegion> m_log;
+    int m_capacity = 10;
+};
+
+} // namespace KWin
+
+#endif
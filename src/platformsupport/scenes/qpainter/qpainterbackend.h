@@ -22,7 +22,16 @@ class QPainterBackend
 public:
     virtual ~QPainterBackend();
     virtual void endFrame(int screenId, int mask, const QRegion &damage) = 0;
-    virtual void beginFrame(int screenId) = 0;
+    /**
+     * @brief Prepares the back buffer of the given screen for rendering.
+     *
+     * The back buffer may hold the contents of an older frame. The returned region has to be
+     * repainted in addition to the damage of the current frame in order to bring it up to date.
+     *
+     * @param screenId The id of the screen as used in Screens
+     * @return QRegion The region of the back buffer that is out of date
+     */
+    virtual QRegion beginFrame(int screenId) = 0;
     /**
      * @brief React on screen geometry changes.
      *
@@ -49,7 +58,6 @@ public:
      * @todo Get a better identifier for screen then a counter variable
      */
     virtual QImage *bufferForScreen(int screenId) = 0;
-    virtual bool needsFullRepaint(int screenId) const = 0;
 
 protected:
     QPainterBackend();
@@ -68,6 +68,8 @@ void DrmQPainterBackend::initOutput(DrmOutput *output)
             };
             initBuffer(0);
             initBuffer(1);
+            it->bufferAge[0] = it->bufferAge[1] = 0;
+            it->damageJournal.clear();
         }
     );
     initBuffer(0);
@@ -82,26 +84,30 @@ QImage *DrmQPainterBackend::bufferForScreen(int screenId)
     return o.buffer[o.index]->image();
 }
 
-bool DrmQPainterBackend::needsFullRepaint(int screenId) const
-{
-    Q_UNUSED(screenId)
-    return true;
-}
-
-void DrmQPainterBackend::beginFrame(int screenId)
+QRegion DrmQPainterBackend::beginFrame(int screenId)
 {
     Output &rendererOutput = m_outputs[screenId];
     rendererOutput.index = (rendererOutput.index + 1) % 2;
+
+    const int bufferAge = rendererOutput.bufferAge[rendererOutput.index];
+    return rendererOutput.damageJournal.accumulate(bufferAge, rendererOutput.output->geometry());
 }
 
 void DrmQPainterBackend::endFrame(int screenId, int mask, const QRegion &damage)
 {
     Q_UNUSED(mask)
-    Q_UNUSED(damage)
 
-    const Output &rendererOutput = m_outputs[screenId];
+    Output &rendererOutput = m_outputs[screenId];
     DrmOutput *drmOutput = rendererOutput.output;
 
+    rendererOutput.damageJournal.add(damage);
+    for (int &bufferAge : rendererOutput.bufferAge) {
+        if (bufferAge > 0) {
+            bufferAge++;
+        }
+    }
+    rendererOutput.bufferAge[rendererOutput.index] = 1;
+
     if (!drmOutput->present(rendererOutput.buffer[rendererOutput.index])) {
         RenderLoopPrivate *renderLoopPrivate = RenderLoopPrivate::get(drmOutput->renderLoop());
         renderLoopPrivate->notifyFrameFailed();
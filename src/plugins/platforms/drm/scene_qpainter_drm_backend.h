@@ -8,6 +8,7 @@
 */
 #ifndef KWIN_SCENE_QPAINTER_DRM_BACKEND_H
 #define KWIN_SCENE_QPAINTER_DRM_BACKEND_H
+#include "damagejournal.h"
 #include "qpainterbackend.h"
 
 #include <QObject>
@@ -29,14 +30,15 @@ public:
     DrmQPainterBackend(DrmBackend *backend, DrmGpu *gpu);
 
     QImage *bufferForScreen(int screenId) override;
-    bool needsFullRepaint(int screenId) const override;
-    void beginFrame(int screenId) override;
+    QRegion beginFrame(int screenId) override;
     void endFrame(int screenId, int mask, const QRegion &damage) override;
 
 private:
     void initOutput(DrmOutput *output);
     struct Output {
         QSharedPointer<DrmDumbBuffer> buffer[2];
+        int bufferAge[2] = {0, 0};
+        DamageJournal damageJournal;
         DrmOutput *output;
         int index = 0;
     };
@@ -13,6 +13,7 @@
 #include "main.h"
 #include "platform.h"
 #include "renderloop.h"
+#include "screens.h"
 #include "session.h"
 #include "vsyncmonitor.h"
 // Qt
@@ -47,6 +48,9 @@ FramebufferQPainterBackend::FramebufferQPainterBackend(FramebufferBackend *backe
 
 void FramebufferQPainterBackend::reactivate()
 {
+    // The contents of the framebuffer have been lost while another session was active.
+    m_needsFullRepaint = true;
+
     const QVector<AbstractOutput *> outputs = m_backend->outputs();
     for (AbstractOutput *output : outputs) {
         output->renderLoop()->uninhibit();
@@ -70,34 +74,41 @@ QImage* FramebufferQPainterBackend::bufferForScreen(int screenId)
     return &m_renderBuffer;
 }
 
-bool FramebufferQPainterBackend::needsFullRepaint(int screenId) const
-{
-    Q_UNUSED(screenId)
-    return m_needsFullRepaint;
-}
-
-void FramebufferQPainterBackend::beginFrame(int screenId)
+QRegion FramebufferQPainterBackend::beginFrame(int screenId)
 {
-    Q_UNUSED(screenId)
-    m_needsFullRepaint = true;
+    // The render buffer is never handed over to the device, it always holds the last frame.
+    if (m_needsFullRepaint) {
+        return screens()->geometry(screenId);
+    }
+    return QRegion();
 }
 
 void FramebufferQPainterBackend::endFrame(int screenId, int mask, const QRegion &damage)
 {
-    Q_UNUSED(screenId)
     Q_UNUSED(mask)
-    Q_UNUSED(damage)
 
     if (!kwinApp()->platform()->session()->isActive()) {
         return;
     }
-    m_needsFullRepaint = false;
 
     FramebufferOutput *output = static_cast<FramebufferOutput *>(m_backend->findOutput(screenId));
     output->vsyncMonitor()->arm();
 
+    // Only copy what has changed, unless the framebuffer has to be brought up to date.
+    const QRect geometry = screens()->geometry(screenId);
+    const QRegion dirty = m_needsFullRepaint ? QRegion(geometry) : damage.intersected(geometry);
+    m_needsFullRepaint = false;
+
     QPainter p(&m_backBuffer);
-    p.drawImage(QPoint(0, 0), m_backend->isBGR() ? m_renderBuffer.rgbSwapped() : m_renderBuffer);
+    p.setCompositionMode(QPainter::CompositionMode_Source);
+    for (const QRect &rect : dirty) {
+        const QRect source = rect.translated(-geometry.topLeft());
+        if (m_backend->isBGR()) {
+            p.drawImage(source.topLeft(), m_renderBuffer.copy(source).rgbSwapped());
+        } else {
+            p.drawImage(source.topLeft(), m_renderBuffer, source);
+        }
+    }
 }
 
 }
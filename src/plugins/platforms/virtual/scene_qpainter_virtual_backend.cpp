@@ -29,40 +29,40 @@ VirtualQPainterBackend::~VirtualQPainterBackend() = default;
 
 QImage *VirtualQPainterBackend::bufferForScreen(int screen)
 {
-    return &m_backBuffers[screen];
+    return &m_outputs[screen].buffer;
 }
 
-bool VirtualQPainterBackend::needsFullRepaint(int screenId) const
+QRegion VirtualQPainterBackend::beginFrame(int screenId)
 {
-    Q_UNUSED(screenId)
-    return true;
-}
-
-void VirtualQPainterBackend::beginFrame(int screenId)
-{
-    Q_UNUSED(screenId)
+    const Output &output = m_outputs[screenId];
+    return output.damageJournal.accumulate(output.bufferAge, screens()->geometry(screenId));
 }
 
 void VirtualQPainterBackend::createOutputs()
 {
-    m_backBuffers.clear();
+    m_outputs.clear();
     for (int i = 0; i < screens()->count(); ++i) {
-        QImage buffer(screens()->size(i) * screens()->scale(i), QImage::Format_RGB32);
-        buffer.fill(Qt::black);
-        m_backBuffers << buffer;
+        Output output;
+        output.buffer = QImage(screens()->size(i) * screens()->scale(i), QImage::Format_RGB32);
+        output.buffer.fill(Qt::black);
+        m_outputs << output;
     }
 }
 
 void VirtualQPainterBackend::endFrame(int screenId, int mask, const QRegion &damage)
 {
     Q_UNUSED(mask)
-    Q_UNUSED(damage)
+
+    // There is no scanout, the same buffer is rendered to over and over again.
+    Output &rendererOutput = m_outputs[screenId];
+    rendererOutput.damageJournal.add(damage);
+    rendererOutput.bufferAge = 1;
 
     VirtualOutput *output = static_cast<VirtualOutput *>(m_backend->findOutput(screenId));
     output->vsyncMonitor()->arm();
 
     if (m_backend->saveFrames()) {
-        m_backBuffers[screenId].save(QStringLiteral("%1/screen%2-%3.png").arg(m_backend->screenshotDirPath(), QString::number(screenId), QString::number(m_frameCounter++)));
+        rendererOutput.buffer.save(QStringLiteral("%1/screen%2-%3.png").arg(m_backend->screenshotDirPath(), QString::number(screenId), QString::number(m_frameCounter++)));
     }
 }
 
@@ -9,6 +9,7 @@
 #ifndef KWIN_SCENE_QPAINTER_VIRTUAL_BACKEND_H
 #define KWIN_SCENE_QPAINTER_VIRTUAL_BACKEND_H
 
+#include "damagejournal.h"
 #include "qpainterbackend.h"
 
 #include <QObject>
@@ -27,14 +28,18 @@ public:
     ~VirtualQPainterBackend() override;
 
     QImage *bufferForScreen(int screenId) override;
-    bool needsFullRepaint(int screenId) const override;
-    void beginFrame(int screenId) override;
+    QRegion beginFrame(int screenId) override;
     void endFrame(int screenId, int mask, const QRegion &damage) override;
 
 private:
     void createOutputs();
 
-    QVector<QImage> m_backBuffers;
+    struct Output {
+        QImage buffer;
+        DamageJournal damageJournal;
+        int bufferAge = 0;
+    };
+    QVector<Output> m_outputs;
     VirtualBackend *m_backend;
     int m_frameCounter = 0;
 };
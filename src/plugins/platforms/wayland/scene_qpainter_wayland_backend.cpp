@@ -18,6 +18,7 @@
 #include <KWayland/Client/shm_pool.h>
 #include <KWayland/Client/surface.h>
 
+#include <algorithm>
 #include <cmath>
 
 namespace KWin
@@ -33,19 +34,7 @@ WaylandQPainterOutput::WaylandQPainterOutput(WaylandOutput *output, QObject *par
 
 WaylandQPainterOutput::~WaylandQPainterOutput()
 {
-    if (m_buffer) {
-        m_buffer.toStrongRef()->setUsed(false);
-    }
-}
-
-bool WaylandQPainterOutput::needsFullRepaint() const
-{
-    return m_needsFullRepaint;
-}
-
-void WaylandQPainterOutput::setNeedsFullRepaint(bool set)
-{
-    m_needsFullRepaint = set;
+    releaseSlots();
 }
 
 bool WaylandQPainterOutput::init(KWayland::Client::ShmPool *pool)
@@ -59,13 +48,25 @@ bool WaylandQPainterOutput::init(KWayland::Client::ShmPool *pool)
     return true;
 }
 
+void WaylandQPainterOutput::releaseSlots()
+{
+    for (const Slot &slot : qAsConst(m_slots)) {
+        if (auto b = slot.buffer.toStrongRef()) {
+            b->setUsed(false);
+        }
+    }
+    m_slots.clear();
+    m_backIndex = -1;
+    m_damageJournal.clear();
+}
+
 void WaylandQPainterOutput::remapBuffer()
 {
-    if (!m_buffer) {
+    if (m_backIndex == -1) {
         return;
     }
-    auto b = m_buffer.toStrongRef();
-    if (!b->isUsed()){
+    auto b = m_slots[m_backIndex].buffer.toStrongRef();
+    if (!b || !b->isUsed()){
         return;
     }
     const QSize size = m_backBuffer.size();
@@ -76,51 +77,90 @@ void WaylandQPainterOutput::remapBuffer()
 void WaylandQPainterOutput::updateSize(const QSize &size)
 {
     Q_UNUSED(size)
-    if (!m_buffer) {
-        return;
-    }
-    m_buffer.toStrongRef()->setUsed(false);
-    m_buffer.clear();
+    releaseSlots();
 }
 
 void WaylandQPainterOutput::present(const QRegion &damage)
 {
+    Q_ASSERT(m_backIndex != -1);
+    for (Slot &slot : m_slots) {
+        if (slot.age > 0) {
+            slot.age++;
+        }
+    }
+    m_slots[m_backIndex].age = 1;
+
     auto s = m_waylandOutput->surface();
-    s->attachBuffer(m_buffer);
+    s->attachBuffer(m_slots[m_backIndex].buffer);
     s->damage(damage);
     s->setScale(std::ceil(m_waylandOutput->scale()));
     s->commit();
 }
 
+QRegion WaylandQPainterOutput::repaintRegion() const
+{
+    const int bufferAge = m_backIndex != -1 ? m_slots[m_backIndex].age : 0;
+    return m_damageJournal.accumulate(bufferAge, m_waylandOutput->geometry());
+}
+
 void WaylandQPainterOutput::prepareRenderingFrame()
 {
-    if (m_buffer) {
-        auto b = m_buffer.toStrongRef();
-        if (b->isReleased()) {
-            // we can re-use this buffer
-            b->setReleased(false);
-            return;
-        } else {
-            // buffer is still in use, get a new one
-            b->setUsed(false);
+    // Up to this many buffers are kept around, which is enough to render a new frame while the
+    // compositor still holds on to the previous one.
+    static const int maxSlotCount = 3;
+
+    m_slots.erase(std::remove_if(m_slots.begin(), m_slots.end(), [](const Slot &slot) {
+        return slot.buffer.isNull();
+    }), m_slots.end());
+
+    // Reuse the released buffer with the most recent contents, it needs the fewest repaints.
+    m_backIndex = -1;
+    for (int i = 0; i < m_slots.count(); ++i) {
+        auto b = m_slots[i].buffer.toStrongRef();
+        if (!b || !b->isReleased()) {
+            continue;
+        }
+        if (m_backIndex == -1 || m_slots[i].age < m_slots[m_backIndex].age) {
+            m_backIndex = i;
         }
     }
-    m_buffer.clear();
 
     const QSize nativeSize(m_waylandOutput->geometry().size() * m_waylandOutput->scale());
 
-    m_buffer = m_pool->getBuffer(nativeSize, nativeSize.width() * 4);
-    if (!m_buffer) {
+    if (m_backIndex != -1) {
+        auto b = m_slots[m_backIndex].buffer.toStrongRef();
+        b->setReleased(false);
+        m_backBuffer = QImage(b->address(), nativeSize.width(), nativeSize.height(), QImage::Format_RGB32);
+        return;
+    }
+
+    if (m_slots.count() == maxSlotCount) {
+        // All buffers are still in use, give up the one with the oldest contents.
+        auto oldest = std::max_element(m_slots.begin(), m_slots.end(), [](const Slot &a, const Slot &b) {
+            return a.age < b.age;
+        });
+        if (auto b = oldest->buffer.toStrongRef()) {
+            b->setUsed(false);
+        }
+        m_slots.erase(oldest);
+    }
+
+    Slot slot;
+    slot.buffer = m_pool->getBuffer(nativeSize, nativeSize.width() * 4);
+    if (!slot.buffer) {
         qCDebug(KWIN_WAYLAND_BACKEND) << "Did not get a new Buffer from Shm Pool";
         m_backBuffer = QImage();
         return;
     }
 
-    auto b = m_buffer.toStrongRef();
+    auto b = slot.buffer.toStrongRef();
     b->setUsed(true);
 
     m_backBuffer = QImage(b->address(), nativeSize.width(), nativeSize.height(), QImage::Format_RGB32);
     m_backBuffer.fill(Qt::transparent);
+
+    m_slots.append(slot);
+    m_backIndex = m_slots.count() - 1;
 //    qCDebug(KWIN_WAYLAND_BACKEND) << "Created a new back buffer for output surface" << m_waylandOutput->surface();
 }
 
@@ -173,7 +213,7 @@ void WaylandQPainterBackend::endFrame(int screenId, int mask, const QRegion &dam
     WaylandQPainterOutput *rendererOutput = m_outputs.value(screenId);
     Q_ASSERT(rendererOutput);
 
-    rendererOutput->setNeedsFullRepaint(false);
+    rendererOutput->m_damageJournal.add(damage);
     rendererOutput->present(rendererOutput->mapToLocal(damage));
 }
 
@@ -183,20 +223,13 @@ QImage *WaylandQPainterBackend::bufferForScreen(int screenId)
     return &output->m_backBuffer;
 }
 
-void WaylandQPainterBackend::beginFrame(int screenId)
+QRegion WaylandQPainterBackend::beginFrame(int screenId)
 {
     WaylandQPainterOutput *rendererOutput = m_outputs.value(screenId);
     Q_ASSERT(rendererOutput);
 
     rendererOutput->prepareRenderingFrame();
-    rendererOutput->setNeedsFullRepaint(true);
-}
-
-bool WaylandQPainterBackend::needsFullRepaint(int screenId) const
-{
-    const WaylandQPainterOutput *rendererOutput = m_outputs.value(screenId);
-    Q_ASSERT(rendererOutput);
-    return rendererOutput->needsFullRepaint();
+    return rendererOutput->repaintRegion();
 }
 
 }
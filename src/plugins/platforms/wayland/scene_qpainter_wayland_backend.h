@@ -10,6 +10,7 @@
 #ifndef KWIN_SCENE_QPAINTER_WAYLAND_BACKEND_H
 #define KWIN_SCENE_QPAINTER_WAYLAND_BACKEND_H
 
+#include "damagejournal.h"
 #include "qpainterbackend.h"
 
 #include <QObject>
@@ -48,18 +49,28 @@ public:
     void prepareRenderingFrame();
     void present(const QRegion &damage);
 
-    bool needsFullRepaint() const;
-    void setNeedsFullRepaint(bool set);
+    /**
+     * Returns the region of the back buffer that is out of date.
+     */
+    QRegion repaintRegion() const;
 
     QRegion mapToLocal(const QRegion &region) const;
 
 private:
+    struct Slot {
+        QWeakPointer<KWayland::Client::Buffer> buffer;
+        int age = 0;
+    };
+
+    void releaseSlots();
+
     WaylandOutput *m_waylandOutput;
     KWayland::Client::ShmPool *m_pool;
 
-    QWeakPointer<KWayland::Client::Buffer> m_buffer;
+    QVector<Slot> m_slots;
+    int m_backIndex = -1;
     QImage m_backBuffer;
-    bool m_needsFullRepaint = true;
+    DamageJournal m_damageJournal;
 
     friend class WaylandQPainterBackend;
 };
@@ -74,9 +85,7 @@ public:
     QImage *bufferForScreen(int screenId) override;
 
     void endFrame(int screenId, int mask, const QRegion& damage) override;
-    void beginFrame(int screenId) override;
-
-    bool needsFullRepaint(int screenId) const override;
+    QRegion beginFrame(int screenId) override;
 
 private:
     void createOutput(AbstractOutput *waylandOutput);
@@ -49,16 +49,14 @@ QImage *X11WindowedQPainterBackend::bufferForScreen(int screen)
     return &m_outputs.at(screen)->buffer;
 }
 
-bool X11WindowedQPainterBackend::needsFullRepaint(int screenId) const
+QRegion X11WindowedQPainterBackend::beginFrame(int screenId)
 {
     const Output *rendererOutput = m_outputs.value(screenId);
     Q_ASSERT(rendererOutput);
-    return rendererOutput->needsFullRepaint;
-}
-
-void X11WindowedQPainterBackend::beginFrame(int screenId)
-{
-    Q_UNUSED(screenId)
+    if (rendererOutput->needsFullRepaint) {
+        return screens()->geometry(screenId);
+    }
+    return QRegion();
 }
 
 void X11WindowedQPainterBackend::endFrame(int screenId, int mask, const QRegion &damage)
@@ -30,8 +30,7 @@ public:
     ~X11WindowedQPainterBackend() override;
 
     QImage *bufferForScreen(int screenId) override;
-    bool needsFullRepaint(int screenId) const override;
-    void beginFrame(int screenId) override;
+    QRegion beginFrame(int screenId) override;
     void endFrame(int screenId, int mask, const QRegion &damage) override;
 
 private:
@@ -24,14 +24,26 @@
 
 #include <kwineffects.h>
 
+#include <KWaylandServer/surface_interface.h>
+
 #include <QFile>
 #include <QtMath>
 
+#include <algorithm>
 #include <cmath>
 
 namespace KWin
 {
 
+// How many sizes of a window are cached at most
+static const int s_maxCacheEntries = 4;
+// Cache textures are sized in steps of 2^(1/8), about 9%, so a thumbnail which is animated
+// or resized a little is painted from the same texture instead of being filtered again
+static const qreal s_cacheSizeStep = 1.0 / 8;
+// A throttled update which is due within about a frame is done right away, otherwise it
+// would be missed by the repaint the consumer scheduled for the end of the interval
+static const int s_refreshSlack = 20;
+
 LanczosFilter::LanczosFilter(Scene *parent)
     : QObject(parent)
     , m_offscreenTex(nullptr)
@@ -42,12 +54,18 @@ LanczosFilter::LanczosFilter(Scene *parent)
     , m_uKernel(0)
     , m_scene(parent)
 {
+    m_clock.start();
 }
 
 LanczosFilter::~LanczosFilter()
 {
     delete m_offscreenTarget;
     delete m_offscreenTex;
+    for (const QVector<CacheEntry> &entries : qAsConst(m_cache)) {
+        for (const CacheEntry &entry : entries) {
+            delete entry.texture;
+        }
+    }
 }
 
 void LanczosFilter::init()
@@ -131,15 +149,21 @@ static float lanczos(float x, float a)
     return sinc(x) * sinc(x / a);
 }
 
-void LanczosFilter::createKernel(float delta, int *size)
-{
-    const float a = 2.0;
+static const float s_lanczosRadius = 2.0;
 
+static int lanczosKernelSize(float delta)
+{
     // The two outermost samples always fall at points where the lanczos
     // function returns 0, so we'll skip them.
-    const int sampleCount = qBound(3, qCeil(delta * a) * 2 + 1 - 2, 29);
+    const int sampleCount = qBound(3, qCeil(delta * s_lanczosRadius) * 2 + 1 - 2, 29);
     const int center = sampleCount / 2;
-    const int kernelSize = center + 1;
+    return center + 1;
+}
+
+void LanczosFilter::createKernel(float delta, int *size)
+{
+    const float a = s_lanczosRadius;
+    const int kernelSize = lanczosKernelSize(delta);
     const float factor = 1.0 / delta;
 
     QVector<float> values(kernelSize);
@@ -171,6 +195,18 @@ void LanczosFilter::createOffsets(int count, float width, Qt::Orientation direct
     }
 }
 
+static int cacheBucket(int size, int sourceSize)
+{
+    const qreal steps = std::ceil(std::log2(qMax(size, 1)) / s_cacheSizeStep);
+    return qMin(qCeil(std::exp2(steps * s_cacheSizeStep)), sourceSize);
+}
+
+static QSize cacheBucket(const QSize &size, const QSize &sourceSize)
+{
+    return QSize(cacheBucket(size.width(), sourceSize.width()),
+                 cacheBucket(size.height(), sourceSize.height()));
+}
+
 void LanczosFilter::performPaint(EffectWindowImpl* w, int mask, QRegion region, WindowPaintData& data)
 {
     if (data.xScale() < 0.9 || data.yScale() < 0.9) {
@@ -191,193 +227,271 @@ void LanczosFilter::performPaint(EffectWindowImpl* w, int mask, QRegion region,
             int tw = width * data.xScale();
             int th = height * data.yScale();
             const QRect textureRect(tx, ty, tw, th);
-            const bool hardwareClipping = !(QRegion(textureRect)-region).isEmpty();
-
-            int sw = width;
-            int sh = height;
-
-            GLTexture *cachedTexture = static_cast< GLTexture*>(w->data(LanczosCacheRole).value<void*>());
-            if (cachedTexture) {
-                if (cachedTexture->width() == tw && cachedTexture->height() == th) {
-                    cachedTexture->bind();
-                    if (hardwareClipping) {
-                        glEnable(GL_SCISSOR_TEST);
-                    }
-
-                    glEnable(GL_BLEND);
-                    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
-
-                    const qreal rgb = data.brightness() * data.opacity();
-                    const qreal a = data.opacity();
-
-                    ShaderBinder binder(ShaderTrait::MapTexture | ShaderTrait::Modulate | ShaderTrait::AdjustSaturation);
-                    GLShader *shader = binder.shader();
-                    QMatrix4x4 mvp = data.screenProjectionMatrix();
-                    mvp.translate(textureRect.x(), textureRect.y());
-                    shader->setUniform(GLShader::ModelViewProjectionMatrix, mvp);
-                    shader->setUniform(GLShader::ModulationConstant, QVector4D(rgb, rgb, rgb, a));
-                    shader->setUniform(GLShader::Saturation, data.saturation());
-
-                    cachedTexture->render(region, textureRect, hardwareClipping);
-
-                    glDisable(GL_BLEND);
-                    if (hardwareClipping) {
-                        glDisable(GL_SCISSOR_TEST);
-                    }
-                    cachedTexture->unbind();
-                    m_timer.start(5000, this);
-                    return;
-                } else {
-                    // offscreen texture not matching - delete
-                    delete cachedTexture;
-                    cachedTexture = nullptr;
-                    w->setData(LanczosCacheRole, QVariant());
-                }
+            const QSize sourceSize(int(width), int(height));
+            const QSize cacheSize = cacheBucket(textureRect.size(), sourceSize);
+
+            CacheEntry *entry = cacheEntry(w, sourceSize, cacheSize);
+            if (!entry) {
+                entry = createCacheEntry(w, sourceSize, cacheSize);
+                updateCacheEntry(w, mask, data, winGeo.topLeft(), entry);
+                ++m_cacheMisses;
+            } else if (!entry->damage.isEmpty() &&
+                       m_clock.elapsed() - entry->lastUpdate + s_refreshSlack >= data.thumbnailRefreshInterval()) {
+                updateCacheEntry(w, mask, data, winGeo.topLeft(), entry);
+                ++m_cacheUpdates;
+            } else {
+                ++m_cacheHits;
             }
+            entry->lastUse = m_clock.elapsed();
+            paintCacheEntry(entry, region, textureRect, data);
 
-            WindowPaintData thumbData = data;
-            thumbData.setXScale(1.0);
-            thumbData.setYScale(1.0);
-            thumbData.setXTranslation(-w->x() - left);
-            thumbData.setYTranslation(-w->y() - top);
-            thumbData.setBrightness(1.0);
-            thumbData.setOpacity(1.0);
-            thumbData.setSaturation(1.0);
-
-            // Bind the offscreen FBO and draw the window on it unscaled
-            updateOffscreenSurfaces();
-            GLRenderTarget::pushRenderTarget(m_offscreenTarget);
-
-            QMatrix4x4 modelViewProjectionMatrix;
-            modelViewProjectionMatrix.ortho(0, m_offscreenTex->width(), m_offscreenTex->height(), 0 , 0, 65535);
-            thumbData.setProjectionMatrix(modelViewProjectionMatrix);
-
-            glClearColor(0.0, 0.0, 0.0, 0.0);
-            glClear(GL_COLOR_BUFFER_BIT);
-            w->sceneWindow()->performPaint(mask, infiniteRegion(), thumbData);
-
-            // Create a scratch texture and copy the rendered window into it
-            GLTexture tex(GL_RGBA8, sw, sh);
-            tex.setFilter(GL_LINEAR);
-            tex.setWrapMode(GL_CLAMP_TO_EDGE);
-            tex.bind();
-
-            glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, m_offscreenTex->height() - sh, sw, sh);
-
-            // Set up the shader for horizontal scaling
-            float dx = sw / float(tw);
-            int kernelSize;
-            createKernel(dx, &kernelSize);
-            createOffsets(kernelSize, sw, Qt::Horizontal);
-
-            ShaderManager::instance()->pushShader(m_shader.data());
-            m_shader->setUniform(GLShader::ModelViewProjectionMatrix, modelViewProjectionMatrix);
-            setUniforms();
-
-            // Draw the window back into the FBO, this time scaled horizontally
-            glClear(GL_COLOR_BUFFER_BIT);
-            QVector<float> verts;
-            QVector<float> texCoords;
-            verts.reserve(12);
-            texCoords.reserve(12);
-
-            texCoords << 1.0 << 0.0; verts << tw  << 0.0; // Top right
-            texCoords << 0.0 << 0.0; verts << 0.0 << 0.0; // Top left
-            texCoords << 0.0 << 1.0; verts << 0.0 << sh;  // Bottom left
-            texCoords << 0.0 << 1.0; verts << 0.0 << sh;  // Bottom left
-            texCoords << 1.0 << 1.0; verts << tw  << sh;  // Bottom right
-            texCoords << 1.0 << 0.0; verts << tw  << 0.0; // Top right
-            GLVertexBuffer *vbo = GLVertexBuffer::streamingBuffer();
-            vbo->reset();
-            vbo->setData(6, 2, verts.constData(), texCoords.constData());
-            vbo->render(GL_TRIANGLES);
-
-            // At this point we don't need the scratch texture anymore
-            tex.unbind();
-            tex.discard();
-
-            // create scratch texture for second rendering pass
-            GLTexture tex2(GL_RGBA8, tw, sh);
-            tex2.setFilter(GL_LINEAR);
-            tex2.setWrapMode(GL_CLAMP_TO_EDGE);
-            tex2.bind();
-
-            glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, m_offscreenTex->height() - sh, tw, sh);
-
-            // Set up the shader for vertical scaling
-            float dy = sh / float(th);
-            createKernel(dy, &kernelSize);
-            createOffsets(kernelSize, m_offscreenTex->height(), Qt::Vertical);
-            setUniforms();
-
-            // Now draw the horizontally scaled window in the FBO at the right
-            // coordinates on the screen, while scaling it vertically and blending it.
-            glClear(GL_COLOR_BUFFER_BIT);
-
-            verts.clear();
-
-            verts << tw  << 0.0; // Top right
-            verts << 0.0 << 0.0; // Top left
-            verts << 0.0 << th;  // Bottom left
-            verts << 0.0 << th;  // Bottom left
-            verts << tw  << th;  // Bottom right
-            verts << tw  << 0.0; // Top right
-            vbo->setData(6, 2, verts.constData(), texCoords.constData());
-            vbo->render(GL_TRIANGLES);
-
-            tex2.unbind();
-            tex2.discard();
-            ShaderManager::instance()->popShader();
-
-            // create cache texture
-            GLTexture *cache = new GLTexture(GL_RGBA8, tw, th);
-
-            cache->setFilter(GL_LINEAR);
-            cache->setWrapMode(GL_CLAMP_TO_EDGE);
-            cache->bind();
-            glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, m_offscreenTex->height() - th, tw, th);
-            GLRenderTarget::popRenderTarget();
-
-            if (hardwareClipping) {
-                glEnable(GL_SCISSOR_TEST);
-            }
+            connect(effects, &EffectsHandler::windowDamaged,
+                    this, &LanczosFilter::addCacheDamage,
+                    Qt::UniqueConnection);
+
+            // Delete the offscreen surface and the cache textures after 5 seconds
+            m_timer.start(5000, this);
+            return;
+        }
+    } // if ( effects->compositingType() == KWin::OpenGLCompositing )
+    w->sceneWindow()->performPaint(mask, region, data);
+} // End of function
+
+LanczosFilter::CacheEntry *LanczosFilter::cacheEntry(EffectWindow *w, const QSize &sourceSize, const QSize &size)
+{
+    auto it = m_cache.find(w);
+    if (it == m_cache.end()) {
+        return nullptr;
+    }
+    for (CacheEntry &entry : *it) {
+        if (entry.sourceSize == sourceSize && entry.texture->size() == size) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
 
-            glEnable(GL_BLEND);
-            glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+LanczosFilter::CacheEntry *LanczosFilter::createCacheEntry(EffectWindow *w, const QSize &sourceSize, const QSize &size)
+{
+    QVector<CacheEntry> &entries = m_cache[w];
+    if (entries.count() == s_maxCacheEntries) {
+        // make room by dropping the size which wasn't painted for the longest time
+        auto oldest = std::min_element(entries.begin(), entries.end(), [](const CacheEntry &a, const CacheEntry &b) {
+            return a.lastUse < b.lastUse;
+        });
+        delete oldest->texture;
+        entries.erase(oldest);
+    }
+    connect(w, &QObject::destroyed, this, &LanczosFilter::windowDestroyed, Qt::UniqueConnection);
+
+    CacheEntry entry;
+    entry.texture = new GLTexture(GL_RGBA8, size.width(), size.height());
+    entry.texture->setFilter(GL_LINEAR);
+    entry.texture->setWrapMode(GL_CLAMP_TO_EDGE);
+    entry.sourceSize = sourceSize;
+    entry.damage = QRect(QPoint(0, 0), sourceSize);
+    entries.append(entry);
+    return &entries.last();
+}
 
-            const qreal rgb = data.brightness() * data.opacity();
-            const qreal a = data.opacity();
+void LanczosFilter::updateCacheEntry(EffectWindowImpl *w, int mask, const WindowPaintData &data, const QPoint &offset, CacheEntry *entry)
+{
+    const int sw = entry->sourceSize.width();
+    const int sh = entry->sourceSize.height();
+    const int tw = entry->texture->width();
+    const int th = entry->texture->height();
+    const float dx = sw / float(tw);
+    const float dy = sh / float(th);
+
+    // Only the texels whose kernel reaches into the damage have to be filtered again, and
+    // those need the window pixels covered by their kernel. Add one pixel for the bilinear
+    // sampling of the offsets.
+    const int rx = lanczosKernelSize(dx) + 1;
+    const int ry = lanczosKernelSize(dy) + 1;
+    const QRect damage = entry->damage.boundingRect();
+    QRect target;
+    target.setCoords(qFloor((damage.left() - rx) / dx), qFloor((damage.top() - ry) / dy),
+                     qCeil((damage.right() + 1 + rx) / dx), qCeil((damage.bottom() + 1 + ry) / dy));
+    target &= QRect(0, 0, tw, th);
+    QRect source;
+    source.setCoords(qFloor(target.left() * dx) - rx, qFloor(target.top() * dy) - ry,
+                     qCeil((target.right() + 1) * dx) + rx, qCeil((target.bottom() + 1) * dy) + ry);
+    source &= QRect(0, 0, sw, sh);
+
+    entry->damage = QRegion();
+    entry->lastUpdate = m_clock.elapsed();
+    if (target.isEmpty() || source.isEmpty()) {
+        return;
+    }
 
-            ShaderBinder binder(ShaderTrait::MapTexture | ShaderTrait::Modulate | ShaderTrait::AdjustSaturation);
-            GLShader *shader = binder.shader();
-            QMatrix4x4 mvp = data.screenProjectionMatrix();
-            mvp.translate(textureRect.x(), textureRect.y());
-            shader->setUniform(GLShader::ModelViewProjectionMatrix, mvp);
-            shader->setUniform(GLShader::ModulationConstant, QVector4D(rgb, rgb, rgb, a));
-            shader->setUniform(GLShader::Saturation, data.saturation());
+    WindowPaintData thumbData = data;
+    thumbData.setXScale(1.0);
+    thumbData.setYScale(1.0);
+    thumbData.setXTranslation(-w->x() - offset.x());
+    thumbData.setYTranslation(-w->y() - offset.y());
+    thumbData.setBrightness(1.0);
+    thumbData.setOpacity(1.0);
+    thumbData.setSaturation(1.0);
+
+    // Bind the offscreen FBO and draw the damaged part of the window on it unscaled
+    updateOffscreenSurfaces();
+    GLRenderTarget::pushRenderTarget(m_offscreenTarget);
+
+    // All passes draw in the top left corner of the FBO, whereas its rows start at the bottom
+    const int fboHeight = m_offscreenTex->height();
+    auto setScissor = [fboHeight](const QRect &rect) {
+        glScissor(rect.x(), fboHeight - rect.y() - rect.height(), rect.width(), rect.height());
+    };
+    auto copyToTexture = [fboHeight](const QRect &rect, int textureHeight) {
+        glCopyTexSubImage2D(GL_TEXTURE_2D, 0, rect.x(), textureHeight - rect.y() - rect.height(),
+                            rect.x(), fboHeight - rect.y() - rect.height(), rect.width(), rect.height());
+    };
+    glEnable(GL_SCISSOR_TEST);
+
+    QMatrix4x4 modelViewProjectionMatrix;
+    modelViewProjectionMatrix.ortho(0, m_offscreenTex->width(), m_offscreenTex->height(), 0 , 0, 65535);
+    thumbData.setProjectionMatrix(modelViewProjectionMatrix);
+
+    setScissor(source);
+    glClearColor(0.0, 0.0, 0.0, 0.0);
+    glClear(GL_COLOR_BUFFER_BIT);
+    w->sceneWindow()->performPaint(mask, infiniteRegion(), thumbData);
+
+    // Create a scratch texture and copy the rendered window into it
+    GLTexture tex(GL_RGBA8, sw, sh);
+    tex.setFilter(GL_LINEAR);
+    tex.setWrapMode(GL_CLAMP_TO_EDGE);
+    tex.bind();
+
+    copyToTexture(source, sh);
+
+    // Set up the shader for horizontal scaling
+    int kernelSize;
+    createKernel(dx, &kernelSize);
+    createOffsets(kernelSize, sw, Qt::Horizontal);
+
+    ShaderManager::instance()->pushShader(m_shader.data());
+    m_shader->setUniform(GLShader::ModelViewProjectionMatrix, modelViewProjectionMatrix);
+    setUniforms();
+
+    // Draw the window back into the FBO, this time scaled horizontally
+    const QRect horizontal(target.x(), source.y(), target.width(), source.height());
+    setScissor(horizontal);
+    glClear(GL_COLOR_BUFFER_BIT);
+    QVector<float> verts;
+    QVector<float> texCoords;
+    verts.reserve(12);
+    texCoords.reserve(12);
+
+    texCoords << 1.0 << 0.0; verts << tw  << 0.0; // Top right
+    texCoords << 0.0 << 0.0; verts << 0.0 << 0.0; // Top left
+    texCoords << 0.0 << 1.0; verts << 0.0 << sh;  // Bottom left
+    texCoords << 0.0 << 1.0; verts << 0.0 << sh;  // Bottom left
+    texCoords << 1.0 << 1.0; verts << tw  << sh;  // Bottom right
+    texCoords << 1.0 << 0.0; verts << tw  << 0.0; // Top right
+    GLVertexBuffer *vbo = GLVertexBuffer::streamingBuffer();
+    vbo->reset();
+    vbo->setData(6, 2, verts.constData(), texCoords.constData());
+    vbo->render(GL_TRIANGLES);
+
+    // At this point we don't need the scratch texture anymore
+    tex.unbind();
+    tex.discard();
+
+    // create scratch texture for second rendering pass
+    GLTexture tex2(GL_RGBA8, tw, sh);
+    tex2.setFilter(GL_LINEAR);
+    tex2.setWrapMode(GL_CLAMP_TO_EDGE);
+    tex2.bind();
+
+    copyToTexture(horizontal, sh);
+
+    // Set up the shader for vertical scaling
+    createKernel(dy, &kernelSize);
+    createOffsets(kernelSize, m_offscreenTex->height(), Qt::Vertical);
+    setUniforms();
+
+    // Now draw the horizontally scaled window in the FBO at the right
+    // coordinates on the screen, while scaling it vertically and blending it.
+    setScissor(target);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    verts.clear();
+
+    verts << tw  << 0.0; // Top right
+    verts << 0.0 << 0.0; // Top left
+    verts << 0.0 << th;  // Bottom left
+    verts << 0.0 << th;  // Bottom left
+    verts << tw  << th;  // Bottom right
+    verts << tw  << 0.0; // Top right
+    vbo->setData(6, 2, verts.constData(), texCoords.constData());
+    vbo->render(GL_TRIANGLES);
+
+    tex2.unbind();
+    tex2.discard();
+    ShaderManager::instance()->popShader();
+
+    // update the damaged part of the cache texture
+    entry->texture->bind();
+    copyToTexture(target, th);
+    entry->texture->unbind();
+
+    glDisable(GL_SCISSOR_TEST);
+    GLRenderTarget::popRenderTarget();
+}
 
-            cache->render(region, textureRect, hardwareClipping);
+void LanczosFilter::paintCacheEntry(const CacheEntry *entry, const QRegion &region, const QRect &textureRect, const WindowPaintData &data)
+{
+    const bool hardwareClipping = !(QRegion(textureRect)-region).isEmpty();
 
-            glDisable(GL_BLEND);
+    entry->texture->bind();
+    if (hardwareClipping) {
+        glEnable(GL_SCISSOR_TEST);
+    }
 
-            if (hardwareClipping) {
-                glDisable(GL_SCISSOR_TEST);
-            }
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
 
-            cache->unbind();
-            w->setData(LanczosCacheRole, QVariant::fromValue(static_cast<void*>(cache)));
+    const qreal rgb = data.brightness() * data.opacity();
+    const qreal a = data.opacity();
 
-            connect(effects, &EffectsHandler::windowDamaged,
-                    this, &LanczosFilter::safeDiscardCacheTexture,
-                    Qt::UniqueConnection);
+    ShaderBinder binder(ShaderTrait::MapTexture | ShaderTrait::Modulate | ShaderTrait::AdjustSaturation);
+    GLShader *shader = binder.shader();
+    QMatrix4x4 mvp = data.screenProjectionMatrix();
+    mvp.translate(textureRect.x(), textureRect.y());
+    shader->setUniform(GLShader::ModelViewProjectionMatrix, mvp);
+    shader->setUniform(GLShader::ModulationConstant, QVector4D(rgb, rgb, rgb, a));
+    shader->setUniform(GLShader::Saturation, data.saturation());
 
-            // Delete the offscreen surface after 5 seconds
-            m_timer.start(5000, this);
-            return;
+    entry->texture->render(region, textureRect, hardwareClipping);
+
+    glDisable(GL_BLEND);
+    if (hardwareClipping) {
+        glDisable(GL_SCISSOR_TEST);
+    }
+    entry->texture->unbind();
+}
+
+void LanczosFilter::addCacheDamage(EffectWindow *w, const QRegion &damage)
+{
+    auto it = m_cache.find(w);
+    if (it == m_cache.end()) {
+        return;
+    }
+    // The damage is in the coordinates of the surface which got damaged. Only the position
+    // of the main surface is known, so damage to a window with sub-surfaces affects it all.
+    const Toplevel *toplevel = static_cast<EffectWindowImpl *>(w)->window();
+    const bool hasSubSurfaces = toplevel->surface() && !toplevel->surface()->childSubSurfaces().isEmpty();
+    const QPoint offset = toplevel->bufferGeometry().topLeft() - toplevel->expandedGeometry().topLeft();
+    for (CacheEntry &entry : *it) {
+        const QRect sourceRect(QPoint(0, 0), entry.sourceSize);
+        if (hasSubSurfaces) {
+            entry.damage = sourceRect;
+        } else {
+            entry.damage += damage.translated(offset) & sourceRect;
         }
-    } // if ( effects->compositingType() == KWin::OpenGLCompositing )
-    w->sceneWindow()->performPaint(mask, region, data);
-} // End of function
+    }
+}
 
 void LanczosFilter::timerEvent(QTimerEvent *event)
 {
@@ -385,7 +499,10 @@ void LanczosFilter::timerEvent(QTimerEvent *event)
         m_timer.stop();
 
         disconnect(effects, &EffectsHandler::windowDamaged,
-                   this, &LanczosFilter::safeDiscardCacheTexture);
+                   this, &LanczosFilter::addCacheDamage);
+
+        qCDebug(KWIN_OPENGL) << "Discarding the lanczos cache," << m_cacheHits << "hits,"
+                             << m_cacheUpdates << "partial updates," << m_cacheMisses << "misses";
 
         m_scene->makeOpenGLContextCurrent();
 
@@ -394,9 +511,10 @@ void LanczosFilter::timerEvent(QTimerEvent *event)
         m_offscreenTarget = nullptr;
         m_offscreenTex = nullptr;
 
-        workspace()->forEachToplevel([this](Toplevel *toplevel) {
-            discardCacheTexture(toplevel->effectWindow());
-        });
+        const QList<EffectWindow *> windows = m_cache.keys();
+        for (EffectWindow *window : windows) {
+            discardCacheTexture(window);
+        }
 
         m_scene->doneOpenGLContextCurrent();
     }
@@ -404,23 +522,26 @@ void LanczosFilter::timerEvent(QTimerEvent *event)
 
 void LanczosFilter::discardCacheTexture(EffectWindow *w)
 {
-    QVariant cachedTextureVariant = w->data(LanczosCacheRole);
-    if (cachedTextureVariant.isValid()) {
-        delete static_cast< GLTexture*>(cachedTextureVariant.value<void*>());
-        w->setData(LanczosCacheRole, QVariant());
+    const QVector<CacheEntry> entries = m_cache.take(w);
+    for (const CacheEntry &entry : entries) {
+        delete entry.texture;
     }
 }
 
 void LanczosFilter::safeDiscardCacheTexture(EffectWindow *w)
 {
-    QVariant cachedTextureVariant = w->data(LanczosCacheRole);
-    if (cachedTextureVariant.isValid()) {
+    if (m_cache.contains(w)) {
         m_scene->makeOpenGLContextCurrent();
-        delete static_cast< GLTexture*>(cachedTextureVariant.value<void*>());
-        w->setData(LanczosCacheRole, QVariant());
+        discardCacheTexture(w);
     }
 }
 
+void LanczosFilter::windowDestroyed(QObject *object)
+{
+    // the window is gone, only its address is still good for the lookup
+    safeDiscardCacheTexture(static_cast<EffectWindow *>(object));
+}
+
 void LanczosFilter::setUniforms()
 {
     glUniform2fv(m_uOffsets, m_offsets.size(), (const GLfloat*)m_offsets.data());
@@ -13,6 +13,10 @@
 
 #include <QObject>
 #include <QBasicTimer>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QRegion>
+#include <QSize>
 #include <QVector>
 #include <QVector2D>
 #include <QVector4D>
@@ -41,11 +45,31 @@ public:
 protected:
     void timerEvent(QTimerEvent*) override;
 private:
+    /**
+     * A filtered copy of a window at one thumbnail size bucket.
+     */
+    struct CacheEntry
+    {
+        GLTexture *texture = nullptr;
+        QSize sourceSize;
+        // the part of the window which changed since the texture was filtered
+        QRegion damage;
+        qint64 lastUpdate = 0;
+        qint64 lastUse = 0;
+    };
+
+    CacheEntry *cacheEntry(EffectWindow *w, const QSize &sourceSize, const QSize &size);
+    CacheEntry *createCacheEntry(EffectWindow *w, const QSize &sourceSize, const QSize &size);
+    void updateCacheEntry(EffectWindowImpl *w, int mask, const WindowPaintData &data, const QPoint &offset, CacheEntry *entry);
+    void paintCacheEntry(const CacheEntry *entry, const QRegion &region, const QRect &textureRect, const WindowPaintData &data);
+    void addCacheDamage(EffectWindow *w, const QRegion &damage);
+
     void init();
     void updateOffscreenSurfaces();
     void setUniforms();
     void discardCacheTexture(EffectWindow *w);
     void safeDiscardCacheTexture(EffectWindow *w);
+    void windowDestroyed(QObject *object);
 
     void createKernel(float delta, int *kernelSize);
     void createOffsets(int count, float width, Qt::Orientation direction);
@@ -59,6 +83,11 @@ private:
     std::array<QVector2D, 16> m_offsets;
     std::array<QVector4D, 16> m_kernel;
     Scene *m_scene;
+    QHash<EffectWindow *, QVector<CacheEntry>> m_cache;
+    QElapsedTimer m_clock;
+    quint64 m_cacheHits = 0;
+    quint64 m_cacheMisses = 0;
+    quint64 m_cacheUpdates = 0;
 };
 
 } // namespace
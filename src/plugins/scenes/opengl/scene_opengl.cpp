@@ -56,6 +56,7 @@
 #include <QGraphicsScale>
 #include <QPainter>
 #include <QStringList>
+#include <QtConcurrent>
 #include <QVector2D>
 #include <QVector4D>
 #include <QMatrix4x4>
@@ -294,6 +295,101 @@ bool SyncManager::updateFences()
 }
 
 
+// -----------------------------------------------------------------------
+
+
+
+/**
+ * RenderTimeQuery measures how long it takes the GPU to execute the rendering
+ * commands of a frame using GL_TIMESTAMP queries. The results are collected
+ * once they become available, usually a couple of frames later, so reading
+ * them never stalls the pipeline.
+ */
+class RenderTimeQuery
+{
+public:
+    enum { MaxQueries = 3 };
+
+    RenderTimeQuery();
+    ~RenderTimeQuery();
+
+    void begin();
+    void end();
+    void collect(RenderLoop *renderLoop);
+
+private:
+    std::array<GLuint, MaxQueries> m_beginQueries;
+    std::array<GLuint, MaxQueries> m_endQueries;
+    std::array<bool, MaxQueries> m_pending;
+    int m_next;
+    bool m_active;
+};
+
+RenderTimeQuery::RenderTimeQuery()
+    : m_next(0)
+    , m_active(false)
+{
+    glGenQueries(MaxQueries, m_beginQueries.data());
+    glGenQueries(MaxQueries, m_endQueries.data());
+    m_pending.fill(false);
+}
+
+RenderTimeQuery::~RenderTimeQuery()
+{
+    glDeleteQueries(MaxQueries, m_beginQueries.data());
+    glDeleteQueries(MaxQueries, m_endQueries.data());
+}
+
+void RenderTimeQuery::begin()
+{
+    // If the GPU is lagging behind so much that all queries are still in flight,
+    // don't measure this frame.
+    if (m_pending[m_next]) {
+        return;
+    }
+    glQueryCounter(m_beginQueries[m_next], GL_TIMESTAMP);
+    m_active = true;
+}
+
+void RenderTimeQuery::end()
+{
+    if (!m_active) {
+        return;
+    }
+    glQueryCounter(m_endQueries[m_next], GL_TIMESTAMP);
+    m_pending[m_next] = true;
+    m_next = (m_next + 1) % MaxQueries;
+    m_active = false;
+}
+
+void RenderTimeQuery::collect(RenderLoop *renderLoop)
+{
+    // Go from the oldest query to the newest one, the results become available in order.
+    for (int i = 0; i < MaxQueries; i++) {
+        const int index = (m_next + i) % MaxQueries;
+        if (!m_pending[index]) {
+            continue;
+        }
+
+        GLint available = 0;
+        glGetQueryObjectiv(m_endQueries[index], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            break;
+        }
+
+        GLuint64 beginTimestamp = 0;
+        GLuint64 endTimestamp = 0;
+        glGetQueryObjectui64v(m_beginQueries[index], GL_QUERY_RESULT, &beginTimestamp);
+        glGetQueryObjectui64v(m_endQueries[index], GL_QUERY_RESULT, &endTimestamp);
+        m_pending[index] = false;
+
+        if (endTimestamp >= beginTimestamp) {
+            renderLoop->addGpuRenderTime(std::chrono::nanoseconds(endTimestamp - beginTimestamp));
+        }
+    }
+}
+
+
 // -----------------------------------------------------------------------
 
 /************************************************
@@ -350,6 +446,10 @@ SceneOpenGL::SceneOpenGL(OpenGLBackend *backend, QObject *parent)
             qCDebug(KWIN_OPENGL) << "Explicit synchronization with the X command stream disabled by environment variable";
         }
     }
+
+    // Timer queries are used to measure how long it takes the GPU to render a frame.
+    m_supportsTimerQuery = !glPlatform->isGLES()
+        && (hasGLVersion(3, 3) || hasGLExtension("GL_ARB_timer_query"));
 }
 
 SceneOpenGL::~SceneOpenGL()
@@ -358,8 +458,10 @@ SceneOpenGL::~SceneOpenGL()
         makeOpenGLContextCurrent();
     }
     SceneOpenGL::EffectFrame::cleanup();
+    m_decorationAtlas.reset();
 
     delete m_syncManager;
+    qDeleteAll(m_renderTimeQueries);
 
     // backend might be still needed for a different scene
     delete m_backend;
@@ -614,6 +716,23 @@ static SurfaceItem *findTopMostSurface(SurfaceItem *item)
     }
 }
 
+RenderTimeQuery *SceneOpenGL::renderTimeQuery(RenderLoop *renderLoop)
+{
+    if (!m_supportsTimerQuery) {
+        return nullptr;
+    }
+
+    RenderTimeQuery *&query = m_renderTimeQueries[renderLoop];
+    if (!query) {
+        query = new RenderTimeQuery;
+        connect(renderLoop, &QObject::destroyed, this, [this, renderLoop]() {
+            makeOpenGLContextCurrent();
+            delete m_renderTimeQueries.take(renderLoop);
+        });
+    }
+    return query;
+}
+
 void SceneOpenGL::paint(int screenId, const QRegion &damage, const QList<Toplevel *> &toplevels,
                         RenderLoop *renderLoop)
 {
@@ -685,6 +804,12 @@ void SceneOpenGL::paint(int screenId, const QRegion &damage, const QList<Topleve
             // prepare rendering makescontext current on the output
             repaint = m_backend->beginFrame(screenId);
 
+            RenderTimeQuery *timeQuery = renderTimeQuery(renderLoop);
+            if (timeQuery) {
+                timeQuery->collect(renderLoop);
+                timeQuery->begin();
+            }
+
             GLVertexBuffer::setVirtualScreenGeometry(geo);
             GLRenderTarget::setVirtualScreenGeometry(geo);
             GLVertexBuffer::setVirtualScreenScale(scaling);
@@ -712,6 +837,9 @@ void SceneOpenGL::paint(int screenId, const QRegion &damage, const QList<Topleve
                 }
             }
 
+            if (timeQuery) {
+                timeQuery->end();
+            }
             renderLoop->endFrame();
 
             GLVertexBuffer::streamingBuffer()->endOfFrame();
@@ -907,7 +1035,10 @@ Shadow *SceneOpenGL::createShadow(Toplevel *toplevel)
 
 Decoration::Renderer *SceneOpenGL::createDecorationRenderer(Decoration::DecoratedClientImpl *impl)
 {
-    return new SceneOpenGLDecorationRenderer(impl);
+    if (!m_decorationAtlas) {
+        m_decorationAtlas.reset(new SceneOpenGLDecorationAtlas);
+    }
+    return new SceneOpenGLDecorationRenderer(impl, m_decorationAtlas.data());
 }
 
 bool SceneOpenGL::animationsSupported() const
@@ -1200,7 +1331,7 @@ void OpenGLWindow::endRenderWindow()
     }
 }
 
-GLTexture *OpenGLWindow::getDecorationTexture() const
+const SceneOpenGLDecorationRenderer *OpenGLWindow::decorationRenderer() const
 {
     if (AbstractClient *client = dynamic_cast<AbstractClient *>(toplevel)) {
         if (!client->isDecorated()) {
@@ -1208,16 +1339,14 @@ GLTexture *OpenGLWindow::getDecorationTexture() const
         }
         if (SceneOpenGLDecorationRenderer *renderer = static_cast<SceneOpenGLDecorationRenderer*>(client->decoratedClient()->renderer())) {
             renderer->render();
-            return renderer->texture();
+            return renderer;
         }
     } else if (toplevel->isDeleted()) {
         Deleted *deleted = static_cast<Deleted *>(toplevel);
         if (!deleted->wasDecorated()) {
             return nullptr;
         }
-        if (const SceneOpenGLDecorationRenderer *renderer = static_cast<const SceneOpenGLDecorationRenderer*>(deleted->decorationRenderer())) {
-            return renderer->texture();
-        }
+        return static_cast<const SceneOpenGLDecorationRenderer*>(deleted->decorationRenderer());
     }
     return nullptr;
 }
@@ -1278,6 +1407,11 @@ static bool bindSurfaceTexture(SurfaceItem *surfaceItem)
     return true;
 }
 
+static SceneOpenGLTexture *asYuvTexture(SceneOpenGLTexture *texture)
+{
+    return texture->shaderTraits() != ShaderTrait::MapTexture ? texture : nullptr;
+}
+
 void OpenGLWindow::initializeRenderContext(RenderContext &context, const WindowPaintData &data)
 {
     context.shadowOffset = 0;
@@ -1323,7 +1457,10 @@ void OpenGLWindow::initializeRenderContext(RenderContext &context, const WindowP
 
     RenderNode &decorationRenderNode = renderNodes[context.decorationOffset];
     if (!decorationRenderNode.quads.isEmpty()) {
-        decorationRenderNode.texture = getDecorationTexture();
+        if (const SceneOpenGLDecorationRenderer *renderer = decorationRenderer()) {
+            decorationRenderNode.texture = renderer->texture();
+            decorationRenderNode.textureOffset = renderer->textureOffset();
+        }
         decorationRenderNode.opacity = data.opacity();
         decorationRenderNode.hasAlpha = true;
         decorationRenderNode.coordinateType = UnnormalizedCoordinates;
@@ -1359,6 +1496,7 @@ void OpenGLWindow::initializeRenderContext(RenderContext &context, const WindowP
 
             RenderNode &contentRenderNode = renderNodes[context.contentOffset + i++];
             contentRenderNode.texture = windowPixmap->texture();
+            contentRenderNode.yuvTexture = asYuvTexture(windowPixmap->texture());
             contentRenderNode.hasAlpha = windowPixmap->hasAlphaChannel();
             contentRenderNode.opacity = contentOpacity;
             contentRenderNode.coordinateType = UnnormalizedCoordinates;
@@ -1402,6 +1540,7 @@ void OpenGLWindow::initializeRenderContext(RenderContext &context, const WindowP
                 }
 
                 previousContentRenderNode.texture = previous->texture();
+                previousContentRenderNode.yuvTexture = asYuvTexture(previous->texture());
                 previousContentRenderNode.hasAlpha = previous->hasAlphaChannel();
                 previousContentRenderNode.opacity = data.opacity() * (1.0 - data.crossFadeProgress());
                 previousContentRenderNode.coordinateType = NormalizedCoordinates;
@@ -1450,6 +1589,7 @@ void OpenGLWindow::performPaint(int mask, const QRegion &region, const WindowPai
     bool useX11TextureClamp = false;
 
     GLShader *shader = data.shader;
+    ShaderTraits traits = ShaderTrait::MapTexture;
     GLenum filter;
 
     if (waylandServer()) {
@@ -1466,7 +1606,6 @@ void OpenGLWindow::performPaint(int mask, const QRegion &region, const WindowPai
     }
 
     if (!shader) {
-        ShaderTraits traits = ShaderTrait::MapTexture;
         if (useX11TextureClamp) {
             traits |= ShaderTrait::ClampTexture;
         }
@@ -1486,6 +1625,19 @@ void OpenGLWindow::performPaint(int mask, const QRegion &region, const WindowPai
     RenderContext renderContext;
     initializeRenderContext(renderContext, data);
 
+    if (data.shader) {
+        // Custom shaders of effects can't sample the chroma planes of YUV buffers, they get
+        // the buffers converted to RGB instead.
+        for (RenderNode &renderNode : renderContext.renderNodes) {
+            if (renderNode.yuvTexture) {
+                if (GLTexture *rgbTexture = renderNode.yuvTexture->rgbTexture()) {
+                    renderNode.texture = rgbTexture;
+                }
+                renderNode.yuvTexture = nullptr;
+            }
+        }
+    }
+
     const bool indexedQuads = GLVertexBuffer::supportsIndexedQuads();
     const GLenum primitiveType = indexedQuads ? GL_QUADS : GL_TRIANGLES;
     const int verticesPerQuad = indexedQuads ? 4 : 6;
@@ -1503,7 +1655,8 @@ void OpenGLWindow::performPaint(int mask, const QRegion &region, const WindowPai
         renderNode.firstVertex = v;
         renderNode.vertexCount = renderNode.quads.count() * verticesPerQuad;
 
-        const QMatrix4x4 matrix = renderNode.texture->matrix(renderNode.coordinateType);
+        QMatrix4x4 matrix = renderNode.texture->matrix(renderNode.coordinateType);
+        matrix.translate(renderNode.textureOffset.x(), renderNode.textureOffset.y());
 
         renderNode.quads.makeInterleavedArrays(primitiveType, &map[v], matrix);
         v += renderNode.quads.count() * verticesPerQuad;
@@ -1516,12 +1669,26 @@ void OpenGLWindow::performPaint(int mask, const QRegion &region, const WindowPai
     glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
 
     float opacity = -1.0;
+    ShaderTraits shaderTraits = traits;
 
     for (int i = 0; i < renderContext.renderNodes.count(); i++) {
         const RenderNode &renderNode = renderContext.renderNodes[i];
         if (renderNode.vertexCount == 0)
             continue;
 
+        SceneOpenGLTexture *yuvTexture = renderNode.yuvTexture;
+        if (!data.shader) {
+            const ShaderTraits nodeTraits = yuvTexture ? traits | yuvTexture->shaderTraits() : traits;
+            if (nodeTraits != shaderTraits) {
+                ShaderManager::instance()->popShader();
+                shader = ShaderManager::instance()->pushShader(nodeTraits);
+                shader->setUniform(GLShader::ModelViewProjectionMatrix, mvpMatrix);
+                shader->setUniform(GLShader::Saturation, data.saturation());
+                shaderTraits = nodeTraits;
+                opacity = -1.0;
+            }
+        }
+
         setBlendEnabled(renderNode.hasAlpha || renderNode.opacity < 1.0);
 
         if (opacity != renderNode.opacity) {
@@ -1553,8 +1720,17 @@ void OpenGLWindow::performPaint(int mask, const QRegion &region, const WindowPai
             shader->setUniform(GLShader::TextureClamp, QVector4D({0, 0, 1, 1}));
         }
 
+        if (yuvTexture) {
+            shader->setUniform(GLShader::YuvToRgbMatrix, yuvTexture->yuvToRgbMatrix());
+            yuvTexture->bindChromaPlanes();
+        }
+
         vbo->draw(region, primitiveType, renderNode.firstVertex,
                   renderNode.vertexCount, m_hardwareClipping);
+
+        if (yuvTexture) {
+            yuvTexture->unbindChromaPlanes();
+        }
     }
 
     vbo->unbindArrays();
@@ -1576,7 +1752,8 @@ QSharedPointer<GLTexture> OpenGLWindow::windowTexture()
         frame = static_cast<OpenGLWindowPixmap *>(item->windowPixmap());
     }
 
-    if (frame && item->childItems().isEmpty()) {
+    // The texture of a YUV buffer has only the luma, it has to be converted like the other cases.
+    if (frame && item->childItems().isEmpty() && frame->texture()->shaderTraits() == ShaderTrait::MapTexture) {
         return QSharedPointer<GLTexture>(new GLTexture(*frame->texture()));
     } else {
         auto effectWindow = window()->effectWindow();
@@ -1601,6 +1778,9 @@ QSharedPointer<GLTexture> OpenGLWindow::windowTexture()
         GLRenderTarget::popRenderTarget();
         GLVertexBuffer::setVirtualScreenGeometry(renderVSG);
         GLRenderTarget::setVirtualScreenGeometry(renderVSG);
+
+        // The projection puts the top of the window in the first row.
+        texture->setYInverted(true);
         return texture;
     }
 }
@@ -2504,11 +2684,89 @@ bool SceneOpenGLShadow::prepareBackend()
     return true;
 }
 
-SceneOpenGLDecorationRenderer::SceneOpenGLDecorationRenderer(Decoration::DecoratedClientImpl *client)
+SceneOpenGLDecorationAtlas::SceneOpenGLDecorationAtlas(QObject *parent)
+    : QObject(parent)
+{
+}
+
+SceneOpenGLDecorationAtlas::~SceneOpenGLDecorationAtlas()
+{
+}
+
+GLTexture *SceneOpenGLDecorationAtlas::texture() const
+{
+    return m_texture.data();
+}
+
+QRect SceneOpenGLDecorationAtlas::allocate(const QSize &size)
+{
+    QRect rect = m_allocator.allocate(size);
+    if (rect.isNull() && grow(size)) {
+        rect = m_allocator.allocate(size);
+    }
+    return rect;
+}
+
+bool SceneOpenGLDecorationAtlas::resize(QRect *rect, const QSize &size)
+{
+    return m_allocator.resize(rect, size);
+}
+
+void SceneOpenGLDecorationAtlas::release(const QRect &rect)
+{
+    m_allocator.release(rect);
+}
+
+bool SceneOpenGLDecorationAtlas::grow(const QSize &size)
+{
+    if (!m_maximumSize) {
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &m_maximumSize);
+    }
+
+    // The first texture has room for a few dozen decorations.
+    const QSize oldSize = m_allocator.size();
+    const QSize newSize = m_allocator.sizeToFit(size, QSize(1024, 1024), m_maximumSize);
+    if (!newSize.isValid()) {
+        qCWarning(KWIN_OPENGL) << "The decoration atlas can't grow beyond" << oldSize << "to fit" << size;
+        return false;
+    }
+
+    GLTexture *texture = new GLTexture(GL_RGBA8, newSize.width(), newSize.height());
+    texture->setYInverted(true);
+    texture->setWrapMode(GL_CLAMP_TO_EDGE);
+    texture->clear();
+
+    if (m_texture) {
+        if (GLRenderTarget::supported()) {
+            GLRenderTarget renderTarget(*m_texture);
+            GLRenderTarget::pushRenderTarget(&renderTarget);
+            texture->bind();
+            glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, oldSize.width(), oldSize.height());
+            texture->unbind();
+            GLRenderTarget::popRenderTarget();
+        } else {
+            emit contentLost();
+        }
+    }
+
+    qCDebug(KWIN_OPENGL) << "Resized the decoration atlas to" << newSize;
+    m_texture.reset(texture);
+    m_allocator.grow(newSize);
+    return true;
+}
+
+SceneOpenGLDecorationRenderer::SceneOpenGLDecorationRenderer(Decoration::DecoratedClientImpl *client, SceneOpenGLDecorationAtlas *atlas)
     : Renderer(client)
-    , m_texture()
+    , m_atlas(atlas)
 {
     connect(this, &Renderer::renderScheduled, client->client(), static_cast<void (AbstractClient::*)(const QRect&)>(&AbstractClient::addRepaint));
+    connect(atlas, &SceneOpenGLDecorationAtlas::contentLost, this, [this]() {
+        m_contentValid = false;
+        discardPendingParts();
+        if (client()) {
+            schedule(client()->client()->rect());
+        }
+    });
 }
 
 SceneOpenGLDecorationRenderer::~SceneOpenGLDecorationRenderer()
@@ -2516,6 +2774,23 @@ SceneOpenGLDecorationRenderer::~SceneOpenGLDecorationRenderer()
     if (Scene *scene = Compositor::self()->scene()) {
         scene->makeOpenGLContextCurrent();
     }
+    discardPendingParts();
+    if (m_atlas && !m_allocation.isNull()) {
+        m_atlas->release(m_allocation);
+    }
+}
+
+GLTexture *SceneOpenGLDecorationRenderer::texture() const
+{
+    if (!m_atlas || m_allocation.isNull()) {
+        return nullptr;
+    }
+    return m_atlas->texture();
+}
+
+QPoint SceneOpenGLDecorationRenderer::textureOffset() const
+{
+    return m_allocation.topLeft();
 }
 
 // Rotates the given source rect 90° counter-clockwise,
@@ -2589,8 +2864,32 @@ static void clamp(QImage &image, const QRect &viewport)
     }
 }
 
+static void finishPart(SceneOpenGLDecorationRenderer::PartImage &part)
+{
+    clamp(part.image, part.viewport);
+
+    if (part.rotated) {
+        // TODO: get this done directly when rendering to the image
+        part.image = rotate(part.image, QRect(QPoint(), part.size));
+    }
+}
+
+static QVector<SceneOpenGLDecorationRenderer::PartImage> rasterizeParts(QVector<SceneOpenGLDecorationRenderer::PartImage> parts)
+{
+    TiledRasterizer rasterizer(1);
+    for (SceneOpenGLDecorationRenderer::PartImage &part : parts) {
+        part.image.fill(Qt::transparent);
+        rasterizer.rasterize(part.paintList, &part.image);
+        part.paintList = PaintList();
+        finishPart(part);
+    }
+    return parts;
+}
+
 void SceneOpenGLDecorationRenderer::render()
 {
+    uploadFinishedParts();
+
     const QRegion scheduled = getScheduled();
     if (scheduled.isEmpty()) {
         return;
@@ -2600,7 +2899,7 @@ void SceneOpenGLDecorationRenderer::render()
         resetImageSizesDirty();
     }
 
-    if (!m_texture) {
+    if (m_allocation.isNull()) {
         // for invalid sizes we get no texture, see BUG 361551
         return;
     }
@@ -2610,8 +2909,15 @@ void SceneOpenGLDecorationRenderer::render()
 
     // We pad each part in the decoration atlas in order to avoid texture bleeding.
     const int padding = 1;
-
-    auto renderPart = [=](const QRect &geo, const QRect &partRect, const QPoint &position, bool rotated = false) {
+    const qreal devicePixelRatio = client()->client()->screenScale();
+
+    // The decoration paints on the main thread, but only into a recorder. The recorded
+    // commands are rasterized later on a worker thread. After a layout change, e.g. during an
+    // interactive resize, there is no previous decoration that could be shown until the worker
+    // is done, so the decoration paints straight into the images, without recording.
+    const bool direct = !m_contentValid;
+    QVector<PartImage> parts;
+    auto recordPart = [&](const QRect &geo, const QRect &partRect, const QPoint &position, bool rotated = false) {
         if (!geo.isValid()) {
             return;
         }
@@ -2635,30 +2941,41 @@ void SceneOpenGLDecorationRenderer::render()
         }
 
         QRect viewport = geo.translated(-rect.x(), -rect.y());
-        const qreal devicePixelRatio = client()->client()->screenScale();
 
-        QImage image(rect.size() * devicePixelRatio, QImage::Format_ARGB32_Premultiplied);
-        image.setDevicePixelRatio(devicePixelRatio);
-        image.fill(Qt::transparent);
+        PartImage part;
+        part.image = QImage(rect.size() * devicePixelRatio, QImage::Format_ARGB32_Premultiplied);
+        part.image.setDevicePixelRatio(devicePixelRatio);
+
+        auto paint = [&](QPaintDevice *device) {
+            QPainter painter(device);
+            painter.setRenderHint(QPainter::Antialiasing);
+            painter.setViewport(QRect(viewport.topLeft(), viewport.size() * devicePixelRatio));
+            painter.setWindow(QRect(geo.topLeft(), geo.size() * devicePixelRatio));
+            painter.setClipRect(geo);
+            renderToPainter(&painter, geo);
+        };
 
-        QPainter painter(&image);
-        painter.setRenderHint(QPainter::Antialiasing);
-        painter.setViewport(QRect(viewport.topLeft(), viewport.size() * devicePixelRatio));
-        painter.setWindow(QRect(geo.topLeft(), geo.size() * devicePixelRatio));
-        painter.setClipRect(geo);
-        renderToPainter(&painter, geo);
-        painter.end();
+        part.viewport = QRect(viewport.topLeft(), viewport.size() * devicePixelRatio);
+        part.size = rect.size();
+        part.rotated = rotated;
 
-        clamp(image, QRect(viewport.topLeft(), viewport.size() * devicePixelRatio));
+        if (direct) {
+            part.image.fill(Qt::transparent);
+            paint(&part.image);
+            finishPart(part);
+        } else {
+            PaintRecorder recorder(part.image);
+            paint(&recorder);
+            part.paintList = recorder.paintList();
+        }
 
         if (rotated) {
-            // TODO: get this done directly when rendering to the image
-            image = rotate(image, QRect(QPoint(), rect.size()));
             viewport = QRect(viewport.y(), viewport.x(), viewport.height(), viewport.width());
         }
 
         const QPoint dirtyOffset = geo.topLeft() - partRect.topLeft();
-        m_texture->update(image, (position + dirtyOffset - viewport.topLeft()) * image.devicePixelRatio());
+        part.position = (position + dirtyOffset - viewport.topLeft()) * devicePixelRatio;
+        parts.append(part);
     };
 
     const QRect geometry = scheduled.boundingRect();
@@ -2668,10 +2985,53 @@ void SceneOpenGLDecorationRenderer::render()
     const QPoint leftPosition(padding, bottomPosition.y() + bottom.height() + 2 * padding);
     const QPoint rightPosition(padding, leftPosition.y() + left.width() + 2 * padding);
 
-    renderPart(left.intersected(geometry), left, leftPosition, true);
-    renderPart(top.intersected(geometry), top, topPosition);
-    renderPart(right.intersected(geometry), right, rightPosition, true);
-    renderPart(bottom.intersected(geometry), bottom, bottomPosition);
+    recordPart(left.intersected(geometry), left, leftPosition, true);
+    recordPart(top.intersected(geometry), top, topPosition);
+    recordPart(right.intersected(geometry), right, rightPosition, true);
+    recordPart(bottom.intersected(geometry), bottom, bottomPosition);
+
+    if (direct) {
+        discardPendingParts();
+        uploadParts(parts);
+        m_contentValid = true;
+        return;
+    }
+
+    auto watcher = new QFutureWatcher<QVector<PartImage>>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, geometry]() {
+        // upload the parts with the next frame
+        emit renderScheduled(geometry);
+    });
+    watcher->setFuture(QtConcurrent::run(rasterizeParts, parts));
+    m_pendingParts.append(watcher);
+}
+
+void SceneOpenGLDecorationRenderer::uploadParts(const QVector<PartImage> &parts)
+{
+    GLTexture *texture = this->texture();
+    if (!texture) {
+        return;
+    }
+    for (const PartImage &part : parts) {
+        texture->update(part.image, m_allocation.topLeft() + part.position);
+    }
+}
+
+void SceneOpenGLDecorationRenderer::uploadFinishedParts()
+{
+    // The parts must be uploaded in order, later ones may cover earlier ones.
+    while (!m_pendingParts.isEmpty() && m_pendingParts.first()->future().isFinished()) {
+        QFutureWatcher<QVector<PartImage>> *watcher = m_pendingParts.takeFirst();
+        uploadParts(watcher->result());
+        delete watcher;
+    }
+}
+
+void SceneOpenGLDecorationRenderer::discardPendingParts()
+{
+    // The workers own everything they touch, they can finish on their own.
+    qDeleteAll(m_pendingParts);
+    m_pendingParts.clear();
 }
 
 static int align(int value, int align)
@@ -2695,25 +3055,47 @@ void SceneOpenGLDecorationRenderer::resizeTexture()
     size.rwidth() += 2 * padding;
     size.rheight() += 4 * 2 * padding;
 
-    size.rwidth() = align(size.width(), 128);
-
     size *= client()->client()->screenScale();
-    if (m_texture && m_texture->size() == size)
+
+    // The parts moved, what the allocation shows is no longer valid.
+    m_contentValid = false;
+    discardPendingParts();
+
+    if (!m_atlas) {
+        return;
+    }
+    if (size.isEmpty()) {
+        if (!m_allocation.isNull()) {
+            m_atlas->release(m_allocation);
+            m_allocation = QRect();
+        }
         return;
+    }
 
-    if (!size.isEmpty()) {
-        m_texture.reset(new GLTexture(GL_RGBA8, size.width(), size.height()));
-        m_texture->setYInverted(true);
-        m_texture->setWrapMode(GL_CLAMP_TO_EDGE);
-        m_texture->clear();
-    } else {
-        m_texture.reset();
+    // Leave room for the window to grow, so that an interactive resize doesn't need a new
+    // allocation at every step. Don't hold on to more than twice the needed width, though.
+    const QSize allocationSize(align(size.width() + size.width() / 4, 128), size.height());
+    if (!m_allocation.isNull()) {
+        if (size.width() <= m_allocation.width() && size.width() * 2 > m_allocation.width() &&
+                size.height() == m_allocation.height()) {
+            return;
+        }
+        if (m_atlas->resize(&m_allocation, allocationSize)) {
+            return;
+        }
+        m_atlas->release(m_allocation);
     }
+    m_allocation = m_atlas->allocate(allocationSize);
 }
 
 void SceneOpenGLDecorationRenderer::reparent(Deleted *deleted)
 {
     render();
+    // Nothing renders the decoration of a closed window anymore.
+    for (QFutureWatcher<QVector<PartImage>> *watcher : qAsConst(m_pendingParts)) {
+        watcher->waitForFinished();
+    }
+    uploadFinishedParts();
     Renderer::reparent(deleted);
 }
 
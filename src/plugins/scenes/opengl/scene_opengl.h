@@ -15,15 +15,22 @@
 
 #include "scene.h"
 #include "shadow.h"
+#include "shelfallocator.h"
+#include "tiledrasterizer.h"
 
 #include "kwinglutils.h"
 
 #include "decorations/decorationrenderer.h"
 
+#include <QFutureWatcher>
+#include <QPointer>
+
 namespace KWin
 {
 class LanczosFilter;
 class OpenGLBackend;
+class RenderTimeQuery;
+class SceneOpenGLDecorationAtlas;
 class SyncManager;
 class SyncObject;
 
@@ -89,13 +96,17 @@ protected:
     bool init_ok;
 private:
     bool viewportLimitsMatched(const QSize &size) const;
+    RenderTimeQuery *renderTimeQuery(RenderLoop *renderLoop);
 
 private:
     bool m_resetOccurred = false;
     bool m_debug;
+    bool m_supportsTimerQuery = false;
     OpenGLBackend *m_backend;
     SyncManager *m_syncManager;
     SyncObject *m_currentFence;
+    QHash<RenderLoop *, RenderTimeQuery *> m_renderTimeQueries;
+    QScopedPointer<SceneOpenGLDecorationAtlas> m_decorationAtlas;
 };
 
 class SceneOpenGL2 : public SceneOpenGL
@@ -135,6 +146,7 @@ private:
 };
 
 class OpenGLWindowPixmap;
+class SceneOpenGLDecorationRenderer;
 
 class OpenGLWindow final : public Scene::Window
 {
@@ -152,6 +164,7 @@ public:
     {
         RenderNode()
             : texture(nullptr)
+            , yuvTexture(nullptr)
             , firstVertex(0)
             , vertexCount(0)
             , opacity(1.0)
@@ -161,6 +174,10 @@ public:
         }
 
         GLTexture *texture;
+        // set if the texture holds the luma of a YUV buffer, the shader samples its other planes
+        SceneOpenGLTexture *yuvTexture;
+        // added to the texture coordinates of the quads, for textures shared by several windows
+        QPoint textureOffset;
         WindowQuadList quads;
         int firstVertex;
         int vertexCount;
@@ -189,7 +206,7 @@ public:
 
 private:
     QMatrix4x4 transformation(int mask, const WindowPaintData &data) const;
-    GLTexture *getDecorationTexture() const;
+    const SceneOpenGLDecorationRenderer *decorationRenderer() const;
     QMatrix4x4 modelViewProjectionMatrix(int mask, const WindowPaintData &data) const;
     QVector4D modulate(float opacity, float brightness) const;
     void setBlendEnabled(bool enabled);
@@ -275,6 +292,48 @@ private:
     QSharedPointer<GLTexture> m_texture;
 };
 
+/**
+ * The texture shared by the decorations of all windows.
+ *
+ * Every decoration renderer allocates a rectangle of the atlas with some room to grow, so that
+ * resizing a window only rarely needs another allocation. When the atlas is full, it gets a
+ * larger texture, and the decorations keep their place in it.
+ */
+class SceneOpenGLDecorationAtlas : public QObject
+{
+    Q_OBJECT
+public:
+    explicit SceneOpenGLDecorationAtlas(QObject *parent = nullptr);
+    ~SceneOpenGLDecorationAtlas() override;
+
+    GLTexture *texture() const;
+
+    /**
+     * Allocates a rectangle of the given @a size, in device pixels. Returns a null rectangle
+     * if the atlas can't grow large enough.
+     */
+    QRect allocate(const QSize &size);
+    /**
+     * Changes the size of the allocated @a rect without moving it, if possible.
+     */
+    bool resize(QRect *rect, const QSize &size);
+    void release(const QRect &rect);
+
+Q_SIGNALS:
+    /**
+     * Emitted when the atlas got a larger texture, but the content of the old texture couldn't
+     * be copied. The allocated rectangles keep their place.
+     */
+    void contentLost();
+
+private:
+    bool grow(const QSize &size);
+
+    ShelfAllocator m_allocator;
+    QScopedPointer<GLTexture> m_texture;
+    int m_maximumSize = 0;
+};
+
 class SceneOpenGLDecorationRenderer : public Decoration::Renderer
 {
     Q_OBJECT
@@ -286,22 +345,45 @@ public:
         Bottom,
         Count
     };
-    explicit SceneOpenGLDecorationRenderer(Decoration::DecoratedClientImpl *client);
+    SceneOpenGLDecorationRenderer(Decoration::DecoratedClientImpl *client, SceneOpenGLDecorationAtlas *atlas);
     ~SceneOpenGLDecorationRenderer() override;
 
     void render() override;
     void reparent(Deleted *deleted) override;
 
-    GLTexture *texture() {
-        return m_texture.data();
-    }
-    GLTexture *texture() const {
-        return m_texture.data();
-    }
+    GLTexture *texture() const;
+    /**
+     * Returns the position of the decoration in the texture, in device pixels.
+     */
+    QPoint textureOffset() const;
+
+    /**
+     * A dirty part of the decoration. It is recorded on the main thread and rasterized on a
+     * worker thread, unless the layout of the decoration has changed, see render().
+     */
+    struct PartImage
+    {
+        PaintList paintList;
+        QImage image;
+        // the area of the image covered by the part, the rest gets clamped to it
+        QRect viewport;
+        QSize size;
+        bool rotated = false;
+        // where the image goes in the allocation, in device pixels
+        QPoint position;
+    };
 
 private:
     void resizeTexture();
-    QScopedPointer<GLTexture> m_texture;
+    void uploadParts(const QVector<PartImage> &parts);
+    void uploadFinishedParts();
+    void discardPendingParts();
+
+    QPointer<SceneOpenGLDecorationAtlas> m_atlas;
+    QRect m_allocation;
+    // false until the allocation shows the decoration in its current layout
+    bool m_contentValid = false;
+    QVector<QFutureWatcher<QVector<PartImage>> *> m_pendingParts;
 };
 
 inline SceneOpenGLTexture* OpenGLWindowPixmap::texture() const
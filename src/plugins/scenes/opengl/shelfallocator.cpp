@@ -0,0 +1,235 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "shelfallocator.h"
+
+#include <algorithm>
+
+namespace KWin
+{
+
+// Shelf heights are rounded up, so that rectangles of similar height share a shelf.
+static const int s_shelfAlignment = 8;
+
+static int alignedHeight(int height)
+{
+    return (height + s_shelfAlignment - 1) / s_shelfAlignment * s_shelfAlignment;
+}
+
+ShelfAllocator::ShelfAllocator(const QSize &size)
+    : m_size(size)
+{
+}
+
+QSize ShelfAllocator::size() const
+{
+    return m_size;
+}
+
+void ShelfAllocator::grow(const QSize &size)
+{
+    const QSize grown = m_size.expandedTo(size);
+    if (grown.width() > m_size.width()) {
+        for (Shelf &shelf : m_shelves) {
+            releaseSpan(&shelf, m_size.width(), grown.width() - m_size.width());
+        }
+    }
+    m_size = grown;
+}
+
+QSize ShelfAllocator::sizeToFit(const QSize &size, const QSize &minimumSize, int maximumSize) const
+{
+    QSize candidate = m_size.expandedTo(minimumSize);
+    while (candidate.width() < size.width()) {
+        candidate.setWidth(candidate.width() * 2);
+    }
+
+    // A wider atlas only helps if some shelf has room next to its rectangles, more height
+    // gives room for a new shelf.
+    bool growWidth = false;
+    while (candidate.width() <= maximumSize && candidate.height() <= maximumSize) {
+        if (candidate != m_size) {
+            ShelfAllocator grown = *this;
+            grown.grow(candidate);
+            if (!grown.allocate(size).isNull()) {
+                return candidate;
+            }
+        }
+        if (growWidth && candidate.width() * 2 <= maximumSize) {
+            candidate.setWidth(candidate.width() * 2);
+        } else if (candidate.height() * 2 <= maximumSize) {
+            candidate.setHeight(candidate.height() * 2);
+        } else {
+            candidate.setWidth(candidate.width() * 2);
+        }
+        growWidth = !growWidth;
+    }
+    return QSize();
+}
+
+QRect ShelfAllocator::allocate(const QSize &size)
+{
+    if (size.isEmpty() || size.width() > m_size.width()) {
+        return QRect();
+    }
+    const int height = alignedHeight(size.height());
+
+    // Take the shelf with room whose height fits best, but don't waste more than a third of
+    // a shelf's height. Empty shelves are cut to the right height.
+    int shelfIndex = -1;
+    for (int i = 0; i < m_shelves.count(); ++i) {
+        const Shelf &shelf = m_shelves[i];
+        if (shelf.height < height || (shelf.count && shelf.height > height * 3 / 2)) {
+            continue;
+        }
+        if (shelfIndex != -1 && m_shelves[shelfIndex].height <= shelf.height) {
+            continue;
+        }
+        const bool fits = std::any_of(shelf.freeSpans.begin(), shelf.freeSpans.end(), [&size](const Span &candidate) {
+            return candidate.width >= size.width();
+        });
+        if (fits) {
+            shelfIndex = i;
+        }
+    }
+
+    Shelf *shelf = nullptr;
+    if (shelfIndex != -1) {
+        if (!m_shelves[shelfIndex].count && m_shelves[shelfIndex].height > height) {
+            Shelf rest = m_shelves[shelfIndex];
+            rest.y += height;
+            rest.height -= height;
+            m_shelves[shelfIndex].height = height;
+            m_shelves.insert(shelfIndex + 1, rest);
+        }
+        shelf = &m_shelves[shelfIndex];
+    } else {
+        shelf = insertShelf(height);
+        if (!shelf) {
+            return QRect();
+        }
+    }
+
+    auto span = std::find_if(shelf->freeSpans.begin(), shelf->freeSpans.end(), [&size](const Span &candidate) {
+        return candidate.width >= size.width();
+    });
+    const QRect rect(span->x, shelf->y, size.width(), size.height());
+    span->x += size.width();
+    span->width -= size.width();
+    if (!span->width) {
+        shelf->freeSpans.erase(span);
+    }
+    shelf->count++;
+    m_count++;
+    return rect;
+}
+
+bool ShelfAllocator::resize(QRect *rect, const QSize &size)
+{
+    Shelf *shelf = findShelf(rect->y());
+    if (!shelf || size.isEmpty() || size.height() > shelf->height) {
+        return false;
+    }
+
+    if (size.width() < rect->width()) {
+        releaseSpan(shelf, rect->x() + size.width(), rect->width() - size.width());
+    } else if (size.width() > rect->width()) {
+        const int right = rect->x() + rect->width();
+        const int extra = size.width() - rect->width();
+        auto span = std::find_if(shelf->freeSpans.begin(), shelf->freeSpans.end(), [right](const Span &candidate) {
+            return candidate.x == right;
+        });
+        if (span == shelf->freeSpans.end() || span->width < extra) {
+            return false;
+        }
+        span->x += extra;
+        span->width -= extra;
+        if (!span->width) {
+            shelf->freeSpans.erase(span);
+        }
+    }
+
+    rect->setSize(size);
+    return true;
+}
+
+void ShelfAllocator::release(const QRect &rect)
+{
+    Shelf *shelf = findShelf(rect.y());
+    if (!shelf) {
+        return;
+    }
+    releaseSpan(shelf, rect.x(), rect.width());
+    shelf->count--;
+    m_count--;
+    if (!shelf->count) {
+        dropEmptyShelves();
+    }
+}
+
+int ShelfAllocator::count() const
+{
+    return m_count;
+}
+
+ShelfAllocator::Shelf *ShelfAllocator::findShelf(int y)
+{
+    auto it = std::find_if(m_shelves.begin(), m_shelves.end(), [y](const Shelf &shelf) {
+        return shelf.y == y;
+    });
+    return it != m_shelves.end() ? &(*it) : nullptr;
+}
+
+ShelfAllocator::Shelf *ShelfAllocator::insertShelf(int height)
+{
+    const int y = m_shelves.isEmpty() ? 0 : m_shelves.last().y + m_shelves.last().height;
+    if (y + height > m_size.height()) {
+        return nullptr;
+    }
+    m_shelves.append(Shelf{y, height, 0, {Span{0, m_size.width()}}});
+    return &m_shelves.last();
+}
+
+void ShelfAllocator::releaseSpan(Shelf *shelf, int x, int width)
+{
+    QVector<Span> &spans = shelf->freeSpans;
+    auto next = std::find_if(spans.begin(), spans.end(), [x](const Span &span) {
+        return span.x > x;
+    });
+    const bool mergesWithPrevious = next != spans.begin() && (next - 1)->x + (next - 1)->width == x;
+    const bool mergesWithNext = next != spans.end() && x + width == next->x;
+
+    if (mergesWithPrevious && mergesWithNext) {
+        (next - 1)->width += width + next->width;
+        spans.erase(next);
+    } else if (mergesWithPrevious) {
+        (next - 1)->width += width;
+    } else if (mergesWithNext) {
+        next->x = x;
+        next->width += width;
+    } else {
+        spans.insert(next, Span{x, width});
+    }
+}
+
+void ShelfAllocator::dropEmptyShelves()
+{
+    // Neighbouring empty shelves become one, so that they can take a taller rectangle.
+    for (int i = m_shelves.count() - 1; i > 0; --i) {
+        if (!m_shelves[i].count && !m_shelves[i - 1].count) {
+            m_shelves[i - 1].height += m_shelves[i].height;
+            m_shelves.remove(i);
+        }
+    }
+    // The space below the last shelf is free for shelves of any height.
+    if (!m_shelves.isEmpty() && !m_shelves.last().count) {
+        m_shelves.removeLast();
+    }
+}
+
+} // namespace KWin
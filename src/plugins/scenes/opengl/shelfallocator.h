@@ -0,0 +1,92 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#ifndef KWIN_SHELFALLOCATOR_H
+#define KWIN_SHELFALLOCATOR_H
+
+#include <QRect>
+#include <QVector>
+
+namespace KWin
+{
+
+/**
+ * The ShelfAllocator class hands out rectangles of a texture atlas.
+ *
+ * The atlas is split into horizontal shelves, and every shelf stores rectangles of about the
+ * same height side by side. Rectangles can be grown and shrunk along their shelf, so a
+ * rectangle whose width changes often, such as the decoration of a window that is being
+ * resized, rarely has to move.
+ */
+class ShelfAllocator
+{
+public:
+    explicit ShelfAllocator(const QSize &size = QSize());
+
+    QSize size() const;
+    /**
+     * Enlarges the atlas to @a size. The allocated rectangles keep their place.
+     */
+    void grow(const QSize &size);
+    /**
+     * Returns the size the atlas has to grow to, so that a rectangle of the given @a size
+     * can be allocated. The atlas is made at least @a minimumSize large and then doubled in
+     * width and height alternately. Returns an invalid size if the atlas would have to grow
+     * beyond @a maximumSize in either dimension.
+     */
+    QSize sizeToFit(const QSize &size, const QSize &minimumSize, int maximumSize) const;
+
+    /**
+     * Allocates a rectangle of the given @a size. Returns a null rectangle if the atlas has
+     * no room for it.
+     */
+    QRect allocate(const QSize &size);
+    /**
+     * Changes the size of the allocated @a rect without moving it, if the shelf of the
+     * rectangle has room for the new @a size. Returns whether the rectangle was resized.
+     */
+    bool resize(QRect *rect, const QSize &size);
+    /**
+     * Returns the allocated @a rect to the atlas.
+     */
+    void release(const QRect &rect);
+
+    /**
+     * Returns the number of allocated rectangles.
+     */
+    int count() const;
+
+private:
+    struct Span
+    {
+        int x;
+        int width;
+    };
+
+    struct Shelf
+    {
+        int y;
+        int height;
+        int count;
+        // sorted by x, adjacent spans are merged
+        QVector<Span> freeSpans;
+    };
+
+    Shelf *findShelf(int y);
+    Shelf *insertShelf(int height);
+    void releaseSpan(Shelf *shelf, int x, int width);
+    void dropEmptyShelves();
+
+    QVector<Shelf> m_shelves;
+    QSize m_size;
+    int m_count = 0;
+};
+
+} // namespace KWin
+
+#endif
@@ -7,6 +7,8 @@
     SPDX-License-Identifier: GPL-2.0-or-later
 */
 #include "scene_qpainter.h"
+#include "scratchbufferpool.h"
+#include "tiledrasterizer.h"
 // KWin
 #include "abstract_client.h"
 #include "composite.h"
@@ -57,10 +59,14 @@ SceneQPainter::SceneQPainter(QPainterBackend *backend, QObject *parent)
     , m_backend(backend)
     , m_painter(new QPainter())
 {
+    if (const int threadCount = TiledRasterizer::configuredThreadCount()) {
+        m_rasterizer.reset(new TiledRasterizer(threadCount));
+    }
 }
 
 SceneQPainter::~SceneQPainter()
 {
+    qDeleteAll(m_scratchBuffers);
 }
 
 CompositingType SceneQPainter::compositingType() const
@@ -82,36 +88,45 @@ void SceneQPainter::paintGenericScreen(int mask, const ScreenPaintData &data)
     m_painter->restore();
 }
 
-void SceneQPainter::paint(int screenId, const QRegion &_damage, const QList<Toplevel *> &toplevels,
+void SceneQPainter::paint(int screenId, const QRegion &damage, const QList<Toplevel *> &toplevels,
                           RenderLoop *renderLoop)
 {
     Q_ASSERT(kwinApp()->platform()->isPerScreenRenderingEnabled());
     painted_screen = screenId;
 
     createStackingOrder(toplevels);
-    QRegion damage = _damage;
 
     int mask = 0;
 
-    m_backend->beginFrame(screenId);
-    const bool needsFullRepaint = m_backend->needsFullRepaint(screenId);
-    if (needsFullRepaint) {
-        mask |= Scene::PAINT_SCREEN_BACKGROUND_FIRST;
-        damage = screens()->geometry(screenId);
-    }
+    const QRegion repaint = m_backend->beginFrame(screenId);
     const QRect geometry = screens()->geometry(screenId);
     QImage *buffer = m_backend->bufferForScreen(screenId);
     if (buffer && !buffer->isNull()) {
         renderLoop->beginFrame();
-        m_painter->begin(buffer);
+
+        // With the tiled rasterizer, the scene is only recorded here and rasterized afterwards.
+        QScopedPointer<PaintRecorder> recorder;
+        if (m_rasterizer) {
+            recorder.reset(new PaintRecorder(*buffer));
+            m_painter->begin(recorder.data());
+        } else {
+            m_painter->begin(buffer);
+        }
         m_painter->setWindow(geometry);
 
         QRegion updateRegion, validRegion;
-        paintScreen(&mask, damage.intersected(geometry), QRegion(), &updateRegion, &validRegion,
-                    renderLoop);
-        paintCursor(updateRegion);
+        paintScreen(&mask, damage.intersected(geometry), repaint.intersected(geometry),
+                    &updateRegion, &validRegion, renderLoop);
+        paintCursor(validRegion);
 
         m_painter->end();
+        if (recorder) {
+            m_rasterizer->rasterize(recorder->paintList(), buffer);
+        }
+        // Every screen has its own pool, otherwise the screens would free each other's buffers.
+        if (ScratchBufferPool *scratchBuffers = m_scratchBuffers.value(screenId)) {
+            scratchBuffers->endFrame();
+        }
         renderLoop->endFrame();
         m_backend->endFrame(screenId, mask, updateRegion);
     }
@@ -122,9 +137,9 @@ void SceneQPainter::paint(int screenId, const QRegion &_damage, const QList<Topl
 
 void SceneQPainter::paintBackground(const QRegion &region)
 {
-    m_painter->setBrush(Qt::black);
+    // Don't use drawRect(), the outline would spill into pixels that are not repainted.
     for (const QRect &rect : region) {
-        m_painter->drawRect(rect);
+        m_painter->fillRect(rect, Qt::black);
     }
 }
 
@@ -175,6 +190,22 @@ void SceneQPainter::screenGeometryChanged(const QSize &size)
 {
     Scene::screenGeometryChanged(size);
     m_backend->screenGeometryChanged(size);
+    qDeleteAll(m_scratchBuffers);
+    m_scratchBuffers.clear();
+}
+
+bool SceneQPainter::usesTiledRasterizer() const
+{
+    return !m_rasterizer.isNull();
+}
+
+ScratchBufferPool *SceneQPainter::scratchBuffers()
+{
+    ScratchBufferPool *&scratchBuffers = m_scratchBuffers[painted_screen];
+    if (!scratchBuffers) {
+        scratchBuffers = new ScratchBufferPool();
+    }
+    return scratchBuffers;
 }
 
 QImage *SceneQPainter::qpainterRenderBuffer(int screenId) const
@@ -207,46 +238,73 @@ void SceneQPainter::Window::performPaint(int mask, const QRegion &_region, const
         return;
     }
 
-    QPainter *scenePainter = m_scene->scenePainter();
-    QPainter *painter = scenePainter;
+    QPainter *painter = m_scene->scenePainter();
     painter->save();
     painter->setClipRegion(region);
     painter->setClipping(true);
 
+    // Subsurfaces are stacked on top of their parents, so the window has to be flattened before
+    // the opacity can be applied. Otherwise, the opacity can be applied while painting.
+    const bool opaque = qFuzzyCompare(1.0, data.opacity());
+    if (opaque || surfaceItem()->childItems().isEmpty()) {
+        painter->setOpacity(data.opacity());
+        renderWindow(painter, mask, data);
+    } else {
+        renderOffscreen(painter, mask, region, data);
+    }
+
+    painter->restore();
+}
+
+void SceneQPainter::Window::renderWindow(QPainter *painter, int mask, const WindowPaintData &data)
+{
     painter->translate(x(), y());
     if (mask & PAINT_WINDOW_TRANSFORMED) {
         painter->translate(data.xTranslation(), data.yTranslation());
         painter->scale(data.xScale(), data.yScale());
     }
 
-    const bool opaque = qFuzzyCompare(1.0, data.opacity());
-    QImage tempImage;
-    QPainter tempPainter;
-    if (!opaque) {
-        // need a temp render target which we later on blit to the screen
-        tempImage = QImage(toplevel->visibleGeometry().size(), QImage::Format_ARGB32_Premultiplied);
-        tempImage.fill(Qt::transparent);
-        tempPainter.begin(&tempImage);
-        tempPainter.save();
-        tempPainter.translate(toplevel->frameGeometry().topLeft() - toplevel->visibleGeometry().topLeft());
-        painter = &tempPainter;
-    }
-    renderShadow(painter);
+    if (painter->opacity() < 1.0 && toplevel->shadow()) {
+        // The shadow must not shine through a translucent window.
+        painter->save();
+        painter->setClipRegion(toplevel->shadow()->shadowRegion(), Qt::IntersectClip);
+        renderShadow(painter);
+        painter->restore();
+    } else {
+        renderShadow(painter);
+    }
     renderWindowDecorations(painter);
     renderSurfaceItem(painter, surfaceItem());
+}
 
-    if (!opaque) {
-        tempPainter.restore();
-        tempPainter.setCompositionMode(QPainter::CompositionMode_DestinationIn);
-        QColor translucent(Qt::transparent);
-        translucent.setAlphaF(data.opacity());
-        tempPainter.fillRect(QRect(QPoint(0, 0), toplevel->visibleGeometry().size()), translucent);
-        tempPainter.end();
-        painter = scenePainter;
-        painter->drawImage(toplevel->visibleGeometry().topLeft() - toplevel->frameGeometry().topLeft(), tempImage);
+void SceneQPainter::Window::renderOffscreen(QPainter *painter, int mask, const QRegion &region, const WindowPaintData &data)
+{
+    // Only the damaged part of the window is rendered into the scratch buffer, in device pixels.
+    const QTransform deviceTransform = painter->combinedTransform();
+    const QRect deviceRect = deviceTransform.mapRect(QRectF(region.boundingRect())).toAlignedRect()
+            & QRect(0, 0, painter->device()->width(), painter->device()->height());
+
+    ScratchBufferPool *scratchBuffers = m_scene->scratchBuffers();
+    QImage scratch = scratchBuffers->acquire(deviceRect.size());
+    if (scratch.isNull()) {
+        return;
     }
 
-    painter->restore();
+    QPainter scratchPainter(&scratch);
+    scratchPainter.setTransform(deviceTransform * QTransform::fromTranslate(-deviceRect.x(), -deviceRect.y()));
+    scratchPainter.setClipRegion(region);
+    renderWindow(&scratchPainter, mask, data);
+    scratchPainter.end();
+
+    painter->setViewTransformEnabled(false);
+    painter->resetTransform();
+    painter->setOpacity(data.opacity());
+    painter->drawImage(deviceRect.topLeft(), scratch);
+
+    // The tiled rasterizer paints the scratch buffer at the end of the frame.
+    if (!m_scene->usesTiledRasterizer()) {
+        scratchBuffers->release(scratch);
+    }
 }
 
 void SceneQPainter::Window::renderSurfaceItem(QPainter *painter, SurfaceItem *surfaceItem)
@@ -259,17 +317,25 @@ void SceneQPainter::Window::renderSurfaceItem(QPainter *painter, SurfaceItem *su
 
     surfaceItem->resetDamage();
 
-    const QRegion shape = surfaceItem->shape();
-    for (const QRectF rect : shape) {
-        const QPointF windowTopLeft = surfaceItem->mapToWindow(rect.topLeft());
-        const QPointF windowBottomRight = surfaceItem->mapToWindow(rect.bottomRight());
-
-        const QPointF bufferTopLeft = surfaceItem->mapToBuffer(rect.topLeft());
-        const QPointF bufferBottomRight = surfaceItem->mapToBuffer(rect.bottomRight());
-
-        painter->drawImage(QRectF(windowTopLeft, windowBottomRight),
-                           windowPixmap->image(),
-                           QRectF(bufferTopLeft, bufferBottomRight));
+    // The image must go out of scope before the subsurfaces are painted, as it may keep the
+    // shared memory buffer of this surface mapped.
+    {
+        // The tiled rasterizer paints after all surfaces have been visited, so it can't be
+        // handed an image that refers to the memory of a client buffer.
+        const QImage image = m_scene->usesTiledRasterizer() ? windowPixmap->detachedImage()
+                                                            : windowPixmap->image();
+        const QRegion shape = surfaceItem->shape();
+        for (const QRectF rect : shape) {
+            const QPointF windowTopLeft = surfaceItem->mapToWindow(rect.topLeft());
+            const QPointF windowBottomRight = surfaceItem->mapToWindow(rect.bottomRight());
+
+            const QPointF bufferTopLeft = surfaceItem->mapToBuffer(rect.topLeft());
+            const QPointF bufferBottomRight = surfaceItem->mapToBuffer(rect.bottomRight());
+
+            painter->drawImage(QRectF(windowTopLeft, windowBottomRight),
+                               image,
+                               QRectF(bufferTopLeft, bufferBottomRight));
+        }
     }
 
     const QList<Item *> children = surfaceItem->childItems();
@@ -368,8 +434,7 @@ void QPainterWindowPixmap::create()
         m_image = internalImage();
         return;
     }
-    // performing deep copy, this could probably be improved
-    m_image = buffer()->data().copy();
+    setupBufferConnection();
 }
 
 void QPainterWindowPixmap::update()
@@ -383,14 +448,35 @@ void QPainterWindowPixmap::update()
         return;
     }
     if (!b) {
+        disconnect(m_bufferDestroyedConnection);
         m_image = QImage();
         return;
     }
     if (b == oldBuffer) {
         return;
     }
-    // perform deep copy
-    m_image = b->data().copy();
+    setupBufferConnection();
+}
+
+void QPainterWindowPixmap::setupBufferConnection()
+{
+    // The buffer is kept referenced while it is attached to the pixmap, so the client can't
+    // reuse it and we can paint straight from its mapping. If the client destroys it anyway,
+    // keep a copy so the window can still be painted, e.g. while it's being closed.
+    disconnect(m_bufferDestroyedConnection);
+    m_image = QImage();
+
+    KWaylandServer::BufferInterface *b = buffer();
+    if (!b) {
+        return;
+    }
+    m_bufferDestroyedConnection = connect(b, &KWaylandServer::BufferInterface::aboutToBeDestroyed, this,
+        [this, b]() {
+            if (m_image.isNull()) {
+                m_image = b->data().copy();
+            }
+        }
+    );
 }
 
 bool QPainterWindowPixmap::isValid() const
@@ -401,6 +487,22 @@ bool QPainterWindowPixmap::isValid() const
     return WindowPixmap::isValid();
 }
 
+QImage QPainterWindowPixmap::image() const
+{
+    if (m_image.isNull() && buffer()) {
+        return buffer()->data();
+    }
+    return m_image;
+}
+
+QImage QPainterWindowPixmap::detachedImage()
+{
+    if (m_image.isNull() && buffer()) {
+        m_image = buffer()->data().copy();
+    }
+    return m_image;
+}
+
 QPainterEffectFrame::QPainterEffectFrame(EffectFrameImpl *frame, SceneQPainter *scene)
     : Scene::EffectFrame(frame)
     , m_scene(scene)
@@ -18,6 +18,9 @@
 
 namespace KWin {
 
+class ScratchBufferPool;
+class TiledRasterizer;
+
 class KWIN_EXPORT SceneQPainter : public Scene
 {
     Q_OBJECT
@@ -46,6 +49,17 @@ public:
         return m_backend.data();
     }
 
+    /**
+     * Returns @c true if the scene is rasterized in tiles on several threads.
+     */
+    bool usesTiledRasterizer() const;
+
+    /**
+     * Returns the pool of temporary render targets for offscreen passes on the screen that
+     * is being painted. The buffers are released at the end of every frame of that screen.
+     */
+    ScratchBufferPool *scratchBuffers();
+
     static SceneQPainter *createScene(QObject *parent);
 
 protected:
@@ -58,6 +72,8 @@ private:
     explicit SceneQPainter(QPainterBackend *backend, QObject *parent = nullptr);
     QScopedPointer<QPainterBackend> m_backend;
     QScopedPointer<QPainter> m_painter;
+    QScopedPointer<TiledRasterizer> m_rasterizer;
+    QHash<int, ScratchBufferPool *> m_scratchBuffers;
     class Window;
 };
 
@@ -70,10 +86,24 @@ public:
     void update() override;
     bool isValid() const override;
 
-    const QImage &image();
+    /**
+     * Returns the contents of the pixmap. For shared memory buffers, the image refers to the
+     * memory of the client buffer. Only one shared memory buffer can be accessed at a time,
+     * so the returned image must be released as soon as the pixmap has been painted.
+     */
+    QImage image() const;
+
+    /**
+     * Returns the contents of the pixmap without referring to the memory of a client buffer.
+     * A copy of a shared memory buffer is made only once.
+     */
+    QImage detachedImage();
 
 private:
+    void setupBufferConnection();
+
     QImage m_image;
+    QMetaObject::Connection m_bufferDestroyedConnection;
 };
 
 class SceneQPainter::Window : public Scene::Window
@@ -88,6 +118,8 @@ protected:
     WindowPixmap *createWindowPixmap() override;
 private:
     void renderSurfaceItem(QPainter *painter, SurfaceItem *surfaceItem);
+    void renderWindow(QPainter *painter, int mask, const WindowPaintData &data);
+    void renderOffscreen(QPainter *painter, int mask, const QRegion &region, const WindowPaintData &data);
     void renderShadow(QPainter *painter);
     void renderWindowDecorations(QPainter *painter);
     SceneQPainter *m_scene;
@@ -176,12 +208,6 @@ QPainter* SceneQPainter::scenePainter() const
     return m_painter.data();
 }
 
-inline
-const QImage &QPainterWindowPixmap::image()
-{
-    return m_image;
-}
-
 } // KWin
 
 #endif // KWIN_SCENEQPAINTER_H
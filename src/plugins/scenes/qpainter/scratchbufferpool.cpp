@@ -0,0 +1,104 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "scratchbufferpool.h"
+
+namespace KWin
+{
+
+// Buffers are allocated in steps, so they can be reused when the damage changes a little.
+static const int s_sizeGranularity = 64;
+
+static int roundUp(int value)
+{
+    return (value + s_sizeGranularity - 1) / s_sizeGranularity * s_sizeGranularity;
+}
+
+ScratchBufferPool::ScratchBufferPool()
+{
+}
+
+ScratchBufferPool::~ScratchBufferPool()
+{
+}
+
+QImage ScratchBufferPool::acquire(const QSize &size)
+{
+    if (size.isEmpty()) {
+        return QImage();
+    }
+
+    Buffer *candidate = nullptr;
+    Buffer *smallest = nullptr;
+    for (Buffer &buffer : m_buffers) {
+        if (buffer.inUse) {
+            continue;
+        }
+        const QSize bufferSize = buffer.image.size();
+        if (bufferSize.width() >= size.width() && bufferSize.height() >= size.height()) {
+            if (!candidate || bufferSize.width() * bufferSize.height() < candidate->image.width() * candidate->image.height()) {
+                candidate = &buffer;
+            }
+        } else if (!smallest || bufferSize.width() * bufferSize.height() < smallest->image.width() * smallest->image.height()) {
+            smallest = &buffer;
+        }
+    }
+
+    if (!candidate) {
+        // Grow a buffer that is too small rather than adding another one.
+        if (!smallest) {
+            m_buffers.append(Buffer());
+            smallest = &m_buffers.last();
+        }
+        const QSize bufferSize(roundUp(qMax(size.width(), smallest->image.width())),
+                               roundUp(qMax(size.height(), smallest->image.height())));
+        smallest->image = QImage(bufferSize, QImage::Format_ARGB32_Premultiplied);
+        if (smallest->image.isNull()) {
+            return QImage();
+        }
+        candidate = smallest;
+    }
+
+    candidate->inUse = true;
+    candidate->used = true;
+
+    QImage image(candidate->image.bits(), size.width(), size.height(),
+                 candidate->image.bytesPerLine(), candidate->image.format());
+    image.fill(Qt::transparent);
+    return image;
+}
+
+void ScratchBufferPool::release(const QImage &image)
+{
+    for (Buffer &buffer : m_buffers) {
+        if (buffer.image.constBits() == image.constBits()) {
+            buffer.inUse = false;
+            return;
+        }
+    }
+}
+
+void ScratchBufferPool::endFrame()
+{
+    for (auto it = m_buffers.begin(); it != m_buffers.end();) {
+        if (!it->used) {
+            it = m_buffers.erase(it);
+        } else {
+            it->used = false;
+            it->inUse = false;
+            ++it;
+        }
+    }
+}
+
+int ScratchBufferPool::bufferCount() const
+{
+    return m_buffers.count();
+}
+
+} // namespace KWin
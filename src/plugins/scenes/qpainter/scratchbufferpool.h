@@ -0,0 +1,66 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#ifndef KWIN_SCRATCHBUFFERPOOL_H
+#define KWIN_SCRATCHBUFFERPOOL_H
+
+#include <QImage>
+#include <QVector>
+
+namespace KWin
+{
+
+/**
+ * The ScratchBufferPool class provides temporary render targets for offscreen passes.
+ *
+ * Buffers are kept across frames and handed out again if they are large enough, so an
+ * offscreen pass doesn't have to allocate a new image every frame. Buffers that have not been
+ * used during a frame are freed when the frame ends.
+ */
+class ScratchBufferPool
+{
+public:
+    ScratchBufferPool();
+    ~ScratchBufferPool();
+
+    /**
+     * Returns a transparent image of the given @a size that refers to the memory of a pooled
+     * buffer. The buffer is in use until it's released or the frame ends.
+     */
+    QImage acquire(const QSize &size);
+
+    /**
+     * Returns the buffer of the @a image, which must have been obtained with acquire(), to the
+     * pool. After that, the buffer can be handed out again within the same frame.
+     */
+    void release(const QImage &image);
+
+    /**
+     * Releases all buffers and frees the ones that have not been used since the last call.
+     */
+    void endFrame();
+
+    /**
+     * Returns the number of buffers in the pool.
+     */
+    int bufferCount() const;
+
+private:
+    struct Buffer
+    {
+        QImage image;
+        bool inUse = false;
+        bool used = false;
+    };
+
+    QVector<Buffer> m_buffers;
+};
+
+} // namespace KWin
+
+#endif
@@ -16,6 +16,7 @@
 #include "kwinscreencast_logging.h"
 #include "main.h"
 #include "pipewirecore.h"
+#include "pixelbufferreadback.h"
 #include "platform.h"
 #include "utils.h"
 
@@ -26,6 +27,8 @@
 
 #include <spa/buffer/meta.h>
 
+#include <cstring>
+
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <unistd.h>
@@ -87,9 +90,15 @@ void PipeWireStream::newStreamParams()
         (spa_pod*) spa_pod_builder_add_object (&pod_builder,
                                                SPA_TYPE_OBJECT_ParamMeta, SPA_PARAM_Meta,
                                                SPA_PARAM_META_type, SPA_POD_Id (SPA_META_Cursor),
-                                               SPA_PARAM_META_size, SPA_POD_Int (CURSOR_META_SIZE (cursorSize, cursorSize)))
+                                               SPA_PARAM_META_size, SPA_POD_Int (CURSOR_META_SIZE (cursorSize, cursorSize))),
+        (spa_pod*) spa_pod_builder_add_object (&pod_builder,
+                                               SPA_TYPE_OBJECT_ParamMeta, SPA_PARAM_Meta,
+                                               SPA_PARAM_META_type, SPA_POD_Id (SPA_META_VideoDamage),
+                                               SPA_PARAM_META_size, SPA_POD_CHOICE_RANGE_Int (sizeof (struct spa_meta_region) * 16,
+                                                                                              sizeof (struct spa_meta_region) * 1,
+                                                                                              sizeof (struct spa_meta_region) * 16))
     };
-    pw_stream_update_params(pwStream, params, 2);
+    pw_stream_update_params(pwStream, params, 3);
 }
 
 void PipeWireStream::onStreamParamChanged(void *data, uint32_t id, const struct spa_pod *format)
@@ -148,10 +157,12 @@ void PipeWireStream::onStreamAddBuffer(void *data, pw_buffer *buffer)
                               MAP_SHARED,
                               spa_data->fd,
                               spa_data->mapoffset);
-        if (spa_data->data == MAP_FAILED)
+        if (spa_data->data == MAP_FAILED) {
             qCCritical(KWIN_SCREENCAST) << "memfd: Failed to mmap memory";
-        else
+        } else {
             qCDebug(KWIN_SCREENCAST) << "memfd: created successfully" << spa_data->data << spa_data->maxsize;
+            stream->m_memfdDamageForPwBuffer.insert(buffer, QRect(QPoint(), stream->m_resolution));
+        }
 #endif
     }
 }
@@ -160,6 +171,7 @@ void PipeWireStream::onStreamRemoveBuffer(void *data, pw_buffer *buffer)
 {
     PipeWireStream *stream = static_cast<PipeWireStream *>(data);
     stream->m_dmabufDataForPwBuffer.remove(buffer);
+    stream->m_memfdDamageForPwBuffer.remove(buffer);
 
     struct spa_buffer *spa_buffer = buffer->buffer;
     struct spa_data *spa_data = spa_buffer->datas;
@@ -179,6 +191,15 @@ PipeWireStream::PipeWireStream(bool hasAlpha, const QSize &resolution, QObject *
     pwStreamEvents.remove_buffer = &PipeWireStream::onStreamRemoveBuffer;
     pwStreamEvents.state_changed = &PipeWireStream::onStreamStateChanged;
     pwStreamEvents.param_changed = &PipeWireStream::onStreamParamChanged;
+
+    m_frameTimer = new QTimer(this);
+    m_frameTimer->setSingleShot(true);
+    m_frameTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_frameTimer, &QTimer::timeout, this, [this]() {
+        if (!m_stopped && !m_pendingDamage.isEmpty()) {
+            Q_EMIT frameRequested();
+        }
+    });
 }
 
 PipeWireStream::~PipeWireStream()
@@ -230,7 +251,7 @@ bool PipeWireStream::createStream()
     uint8_t buffer[1024];
     spa_pod_builder podBuilder = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
     spa_fraction minFramerate = SPA_FRACTION(1, 1);
-    spa_fraction maxFramerate = SPA_FRACTION(25, 1);
+    spa_fraction maxFramerate = SPA_FRACTION(m_maxFramerate, 1);
     spa_fraction defaultFramerate = SPA_FRACTION(0, 1);
 
     spa_rectangle resolution = SPA_RECTANGLE(uint32_t(m_resolution.width()), uint32_t(m_resolution.height()));
@@ -298,13 +319,57 @@ static GLTexture *copyTexture(GLTexture *texture)
     return copy;
 }
 
+static void addDamage(spa_buffer *spa_buffer, const QRegion &damagedRegion)
+{
+    spa_meta *spa_meta = spa_buffer_find_meta(spa_buffer, SPA_META_VideoDamage);
+    if (!spa_meta) {
+        return;
+    }
+
+    spa_meta_region *regions = static_cast<spa_meta_region *>(spa_meta->data);
+    const int capacity = spa_meta->size / sizeof(spa_meta_region);
+    int count = 0;
+
+    auto addRect = [regions, &count](const QRect &rect) {
+        spa_region &region = regions[count++].region;
+        region.position.x = rect.x();
+        region.position.y = rect.y();
+        region.size.width = rect.width();
+        region.size.height = rect.height();
+    };
+
+    // If there are too many rects to describe the damage, report their bounding rect instead.
+    if (damagedRegion.rectCount() > capacity) {
+        if (capacity) {
+            addRect(damagedRegion.boundingRect());
+        }
+    } else {
+        for (const QRect &rect : damagedRegion) {
+            addRect(rect);
+        }
+    }
+
+    // The list of rects is terminated by an empty one, unless all entries are used.
+    if (count < capacity) {
+        addRect(QRect());
+    }
+}
+
 void PipeWireStream::recordFrame(GLTexture *frameTexture, const QRegion &damagedRegion)
 {
     Q_ASSERT(!m_stopped);
     Q_ASSERT(frameTexture);
 
+    // Changes that have not reached the consumer yet are carried over to this frame.
+    m_pendingDamage |= damagedRegion;
+    if (m_pendingDamage.isEmpty()) {
+        m_statistics.skippedFrames++;
+        return;
+    }
+
     if (m_pendingBuffer) {
         qCWarning(KWIN_SCREENCAST) << "Dropping a screencast frame because the compositor is slow";
+        m_statistics.droppedFrames++;
         return;
     }
 
@@ -323,12 +388,35 @@ void PipeWireStream::recordFrame(GLTexture *frameTexture, const QRegion &damaged
         return;
     }
 
+    if (throttleFrame()) {
+        m_statistics.skippedFrames++;
+        return;
+    }
+
+    // Reading back the frame synchronously would stall the graphics pipeline, so the pixels
+    // are copied into the memfd buffer once the GPU is done with them, see copyFrame().
+    if (!m_memfdDamageForPwBuffer.isEmpty() && PixelBufferReadback::isSupported()) {
+        if (!m_readback) {
+            m_readback.reset(new PixelBufferReadback);
+            connect(m_readback.data(), &PixelBufferReadback::finished, this, &PipeWireStream::copyFrame);
+        }
+        m_readback->read(frameTexture, m_hasAlpha ? GL_BGRA : GL_BGR, m_hasAlpha ? 4 : 3, m_pendingDamage);
+        m_lastFrameTimestamp = std::chrono::steady_clock::now().time_since_epoch();
+        m_pendingDamage = QRegion();
+        return;
+    }
+
     struct pw_buffer *buffer = pw_stream_dequeue_buffer(pwStream);
 
     if (!buffer) {
+        m_statistics.droppedFrames++;
         return;
     }
 
+    QRegion damage = m_pendingDamage;
+    m_lastFrameTimestamp = std::chrono::steady_clock::now().time_since_epoch();
+    m_pendingDamage = QRegion();
+
     struct spa_buffer *spa_buffer = buffer->buffer;
     struct spa_data *spa_data = spa_buffer->datas;
 
@@ -384,13 +472,13 @@ void PipeWireStream::recordFrame(GLTexture *frameTexture, const QRegion &damaged
         mvp.ortho(r);
         shader->setUniform(GLShader::ModelViewProjectionMatrix, mvp);
 
-        QRegion dr = damagedRegion;
+        // The dmabufs are recycled without knowing what changed since they were filled the
+        // last time, so each of them gets the whole frame.
+        frameTexture->render(r, r, true);
         if (m_cursor.texture) {
-            dr |= m_cursor.lastRect;
+            damage |= m_cursor.lastRect;
         }
 
-        frameTexture->render(damagedRegion, r, true);
-
         auto cursor = Cursors::self()->currentCursor();
         if (m_cursor.mode == KWaylandServer::ScreencastV1Interface::Embedded && m_cursor.viewport.contains(cursor->pos())) {
             if (!m_repainting) //We need to copy the last version of the stream to render the moved cursor on top
@@ -411,6 +499,7 @@ void PipeWireStream::recordFrame(GLTexture *frameTexture, const QRegion &damaged
             glDisable(GL_BLEND);
             m_cursor.texture->unbind();
             m_cursor.lastRect = cursorRect;
+            damage |= cursorRect;
         }
         ShaderManager::instance()->popShader();
 
@@ -422,10 +511,33 @@ void PipeWireStream::recordFrame(GLTexture *frameTexture, const QRegion &damaged
         sendCursorData(Cursors::self()->currentCursor(),
                         (spa_meta_cursor *) spa_buffer_find_meta_data (spa_buffer, SPA_META_Cursor, sizeof (spa_meta_cursor)));
     }
+    addDamage(spa_buffer, damage);
 
     tryEnqueue(buffer);
 }
 
+bool PipeWireStream::throttleFrame()
+{
+    if (!videoFormat.max_framerate.num) {
+        return false;
+    }
+
+    const std::chrono::nanoseconds frameInterval =
+        std::chrono::nanoseconds(std::chrono::seconds(1)) * videoFormat.max_framerate.denom / videoFormat.max_framerate.num;
+    const std::chrono::nanoseconds currentTime = std::chrono::steady_clock::now().time_since_epoch();
+    const std::chrono::nanoseconds nextFrameTimestamp = m_lastFrameTimestamp + frameInterval;
+    if (currentTime >= nextFrameTimestamp) {
+        return false;
+    }
+
+    // The damage is kept in m_pendingDamage. If nothing else is recorded until the consumer
+    // is ready for the next frame, ask for a repaint so the changes don't get stuck.
+    if (!m_frameTimer->isActive()) {
+        m_frameTimer->start(std::chrono::ceil<std::chrono::milliseconds>(nextFrameTimestamp - currentTime));
+    }
+    return true;
+}
+
 void PipeWireStream::tryEnqueue(pw_buffer *buffer)
 {
     m_pendingBuffer = buffer;
@@ -462,12 +574,92 @@ void PipeWireStream::enqueue()
     delete m_pendingNotifier;
 
     pw_stream_queue_buffer(pwStream, m_pendingBuffer);
+    m_statistics.producedFrames++;
 
     m_pendingBuffer = nullptr;
     m_pendingFence = nullptr;
     m_pendingNotifier = nullptr;
 }
 
+void PipeWireStream::copyFrame(const uchar *pixels, const QSize &size, int stride, const QRegion &damage)
+{
+    if (m_stopped || size != m_resolution) {
+        return;
+    }
+
+    // The memfd buffers are recycled, so every buffer has to catch up with the damage that
+    // has been accumulated since it was filled the last time.
+    for (QRegion &bufferDamage : m_memfdDamageForPwBuffer) {
+        bufferDamage |= damage;
+    }
+
+    if (pw_stream_get_state(pwStream, nullptr) != PW_STREAM_STATE_STREAMING) {
+        return;
+    }
+
+    struct pw_buffer *buffer = pw_stream_dequeue_buffer(pwStream);
+    if (!buffer) {
+        // The pixels are tracked by the memfd buffers, only the damage metadata needs the
+        // changes to be carried over to the next frame.
+        m_pendingDamage |= damage;
+        m_statistics.droppedFrames++;
+        return;
+    }
+
+    struct spa_buffer *spa_buffer = buffer->buffer;
+    struct spa_data *spa_data = spa_buffer->datas;
+
+    uint8_t *data = (uint8_t *) spa_data->data;
+    const uint bufferSize = stride * size.height();
+    if (!data || bufferSize > spa_data->maxsize || !m_memfdDamageForPwBuffer.contains(buffer)) {
+        qCWarning(KWIN_SCREENCAST) << "Failed to record frame: invalid buffer data";
+        pw_stream_queue_buffer(pwStream, buffer);
+        return;
+    }
+
+    const int bpp = m_hasAlpha ? 4 : 3;
+    QRegion &bufferDamage = m_memfdDamageForPwBuffer[buffer];
+    for (const QRect &rect : bufferDamage.intersected(QRect(QPoint(), size))) {
+        const int offset = rect.x() * bpp;
+        for (int y = rect.top(); y <= rect.bottom(); ++y) {
+            memcpy(data + y * stride + offset, pixels + y * stride + offset, rect.width() * bpp);
+        }
+    }
+    bufferDamage = QRegion();
+
+    spa_data->chunk->offset = 0;
+    spa_data->chunk->size = bufferSize;
+    spa_data->chunk->stride = stride;
+
+    // The area the cursor was painted over in the previous frame has changed as well.
+    QRegion frameDamage = damage | m_cursor.lastRect;
+    m_cursor.lastRect = QRect();
+
+    auto cursor = Cursors::self()->currentCursor();
+    if (m_cursor.mode == KWaylandServer::ScreencastV1Interface::Embedded && m_cursor.viewport.contains(cursor->pos())) {
+        QImage dest(data, size.width(), size.height(), stride,
+                    m_hasAlpha ? QImage::Format_ARGB32_Premultiplied : QImage::Format_BGR888);
+        QPainter painter(&dest);
+        const auto position = (cursor->pos() - m_cursor.viewport.topLeft() - cursor->hotspot()) * m_cursor.scale;
+        const QRect cursorRect(position, cursor->image().size());
+        painter.drawImage(cursorRect, cursor->image());
+
+        // The cursor is not part of the frame that has been read back, the pixels beneath
+        // it must be restored the next time this buffer is filled.
+        bufferDamage = cursorRect;
+        m_cursor.lastRect = cursorRect;
+        frameDamage |= cursorRect;
+    }
+
+    if (m_cursor.mode == KWaylandServer::ScreencastV1Interface::Metadata) {
+        sendCursorData(cursor, (spa_meta_cursor *) spa_buffer_find_meta_data (spa_buffer, SPA_META_Cursor, sizeof (spa_meta_cursor)));
+    }
+    addDamage(spa_buffer, frameDamage);
+
+    pw_stream_queue_buffer(pwStream, buffer);
+    m_statistics.producedFrames++;
+}
+
 QRect PipeWireStream::cursorGeometry(Cursor *cursor) const
 {
     const auto position = (cursor->pos() - m_cursor.viewport.topLeft() - cursor->hotspot()) * m_cursor.scale;
@@ -519,6 +711,11 @@ void PipeWireStream::sendCursorData(Cursor *cursor, spa_meta_cursor *spa_meta_cu
     painter.drawImage(QPoint(), image);
 }
 
+void PipeWireStream::setMaxFramerate(uint framerate)
+{
+    m_maxFramerate = qMax(framerate, 1u);
+}
+
 void PipeWireStream::setCursorMode(KWaylandServer::ScreencastV1Interface::CursorMode mode, qreal scale, const QRect &viewport)
 {
     m_cursor.mode = mode;
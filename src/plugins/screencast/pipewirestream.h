@@ -15,9 +15,13 @@
 
 #include <QHash>
 #include <QObject>
+#include <QRegion>
 #include <QSharedPointer>
 #include <QSize>
 #include <QSocketNotifier>
+#include <QTimer>
+
+#include <chrono>
 
 #include <pipewire/pipewire.h>
 #include <spa/param/format-utils.h>
@@ -32,11 +36,21 @@ class DmaBufTexture;
 class EGLNativeFence;
 class GLTexture;
 class PipeWireCore;
+class PixelBufferReadback;
 
 class KWIN_EXPORT PipeWireStream : public QObject
 {
     Q_OBJECT
 public:
+    struct Statistics {
+        /** Frames that have been handed over to the consumer */
+        quint64 producedFrames = 0;
+        /** Frames that have not been sent because nothing changed or the framerate is capped */
+        quint64 skippedFrames = 0;
+        /** Frames that have been lost because no buffer was available */
+        quint64 droppedFrames = 0;
+    };
+
     explicit PipeWireStream(bool hasAlpha, const QSize &resolution, QObject *parent);
     ~PipeWireStream();
 
@@ -49,16 +63,36 @@ public:
 
     void stop();
 
-    /** Renders @p frame into the current framebuffer into the stream */
+    /**
+     * Renders @p frame into the current framebuffer into the stream. The @p damagedRegion is
+     * in the pixels of the frame, in the order its rows are stored.
+     */
     void recordFrame(GLTexture *frame, const QRegion &damagedRegion);
 
     void setCursorMode(KWaylandServer::ScreencastV1Interface::CursorMode mode, qreal scale, const QRect &viewport);
 
+    /**
+     * Sets the highest framerate that is offered to the consumer. The consumer can negotiate
+     * any framerate up to it. This must be called before init().
+     */
+    void setMaxFramerate(uint framerate);
+
+    Statistics statistics() const {
+        return m_statistics;
+    }
+
 Q_SIGNALS:
     void streamReady(quint32 nodeId);
     void startStreaming();
     void stopStreaming();
 
+    /**
+     * Emitted when a frame has been held back to honor the negotiated framerate and no new
+     * frame has been recorded since then. The owner of the stream should schedule a repaint
+     * so the held back changes reach the consumer.
+     */
+    void frameRequested();
+
 private:
     static void onStreamParamChanged(void *data, uint32_t id, const struct spa_pod *format);
     static void onStreamStateChanged(void *data, pw_stream_state old, pw_stream_state state, const char *error_message);
@@ -72,6 +106,8 @@ private:
     void newStreamParams();
     void tryEnqueue(pw_buffer *buffer);
     void enqueue();
+    void copyFrame(const uchar *pixels, const QSize &size, int stride, const QRegion &damage);
+    bool throttleFrame();
 
     QSharedPointer<PipeWireCore> pwCore;
     struct pw_stream *pwStream = nullptr;
@@ -100,6 +136,14 @@ private:
     QRect cursorGeometry(Cursor *cursor) const;
 
     QHash<struct pw_buffer *, QSharedPointer<DmaBufTexture>> m_dmabufDataForPwBuffer;
+    QHash<struct pw_buffer *, QRegion> m_memfdDamageForPwBuffer;
+    QScopedPointer<PixelBufferReadback> m_readback;
+
+    uint m_maxFramerate = 60;
+    QRegion m_pendingDamage;
+    QTimer *m_frameTimer = nullptr;
+    std::chrono::nanoseconds m_lastFrameTimestamp = std::chrono::nanoseconds::zero();
+    Statistics m_statistics;
 
     pw_buffer *m_pendingBuffer = nullptr;
     QSocketNotifier *m_pendingNotifier = nullptr;
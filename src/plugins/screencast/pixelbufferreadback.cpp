@@ -0,0 +1,179 @@
+/*
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "pixelbufferreadback.h"
+#include "composite.h"
+#include "eglnativefence.h"
+#include "kwinglplatform.h"
+#include "kwingltexture.h"
+#include "kwinglutils.h"
+#include "kwinscreencast_logging.h"
+#include "main.h"
+#include "platform.h"
+#include "scene.h"
+
+#include <QSocketNotifier>
+
+#include <poll.h>
+
+namespace KWin
+{
+
+PixelBufferReadback::PixelBufferReadback(QObject *parent)
+    : QObject(parent)
+{
+    // Sync objects can't notify us when they get signaled, so they have to be polled.
+    m_pollTimer.setInterval(1);
+    m_pollTimer.setTimerType(Qt::PreciseTimer);
+    connect(&m_pollTimer, &QTimer::timeout, this, [this]() {
+        if (Compositor::self()->scene()->makeOpenGLContextCurrent()) {
+            collect();
+        }
+        if (!m_pendingCount) {
+            m_pollTimer.stop();
+        }
+    });
+}
+
+PixelBufferReadback::~PixelBufferReadback()
+{
+    if (!Compositor::self() || !Compositor::self()->scene()) {
+        return;
+    }
+    if (!Compositor::self()->scene()->makeOpenGLContextCurrent()) {
+        return;
+    }
+    for (Slot &slot : m_slots) {
+        release(slot);
+        if (slot.buffer) {
+            glDeleteBuffers(1, &slot.buffer);
+        }
+    }
+}
+
+bool PixelBufferReadback::isSupported()
+{
+    if (GLPlatform::instance()->isGLES()) {
+        return hasGLVersion(3, 0);
+    }
+    return hasGLVersion(3, 2);
+}
+
+void PixelBufferReadback::read(GLTexture *texture, GLenum format, int bytesPerPixel, const QRegion &damage)
+{
+    collect();
+
+    // All pixel buffers are busy, wait for the oldest readback rather than losing a frame.
+    if (m_pendingCount == slotCount) {
+        finish(m_slots[m_head]);
+    }
+
+    Slot &slot = m_slots[m_head];
+    slot.size = texture->size();
+    slot.stride = (slot.size.width() * bytesPerPixel + 3) & ~3;
+    slot.damage = damage;
+
+    const GLsizeiptr bufferSize = GLsizeiptr(slot.stride) * slot.size.height();
+    if (!slot.buffer) {
+        glGenBuffers(1, &slot.buffer);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    if (slot.bufferSize != bufferSize) {
+        glBufferData(GL_PIXEL_PACK_BUFFER, bufferSize, nullptr, GL_STREAM_READ);
+        slot.bufferSize = bufferSize;
+    }
+
+    // With a pixel buffer bound, the pointer arguments are offsets into the buffer and
+    // the calls return without waiting for the copy to finish.
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    texture->bind();
+    if (GLPlatform::instance()->isGLES()) {
+        glReadPixels(0, 0, slot.size.width(), slot.size.height(), format, GL_UNSIGNED_BYTE, nullptr);
+    } else {
+        glGetTextureImage(texture->texture(), 0, format, GL_UNSIGNED_BYTE, bufferSize, nullptr);
+    }
+    texture->unbind();
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    if (kwinApp()->platform()->supportsNativeFence()) {
+        slot.fence = new EGLNativeFence(kwinApp()->platform()->sceneEglDisplay());
+        if (slot.fence->isValid()) {
+            slot.notifier = new QSocketNotifier(slot.fence->fileDescriptor(), QSocketNotifier::Read, this);
+            connect(slot.notifier, &QSocketNotifier::activated, this, [this]() {
+                if (Compositor::self()->scene()->makeOpenGLContextCurrent()) {
+                    collect();
+                }
+            });
+        } else {
+            qCWarning(KWIN_SCREENCAST) << "Failed to create a native EGL fence";
+            delete slot.fence;
+            slot.fence = nullptr;
+        }
+    }
+    if (!slot.fence) {
+        slot.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+        m_pollTimer.start();
+    }
+
+    m_head = (m_head + 1) % slotCount;
+    m_pendingCount++;
+}
+
+void PixelBufferReadback::collect()
+{
+    while (m_pendingCount) {
+        Slot &oldest = m_slots[(m_head - m_pendingCount + slotCount) % slotCount];
+        if (!isSignaled(oldest)) {
+            break;
+        }
+        finish(oldest);
+    }
+}
+
+bool PixelBufferReadback::isSignaled(const Slot &slot) const
+{
+    if (slot.fence) {
+        pollfd pfd = {};
+        pfd.fd = slot.fence->fileDescriptor();
+        pfd.events = POLLIN;
+        return poll(&pfd, 1, 0) > 0;
+    }
+    const GLenum status = glClientWaitSync(slot.sync, 0, 0);
+    return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+}
+
+void PixelBufferReadback::finish(Slot &slot)
+{
+    // Mapping the buffer implicitly waits for the copy if it is still in flight.
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    const void *pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.bufferSize, GL_MAP_READ_BIT);
+    if (pixels) {
+        Q_EMIT finished(static_cast<const uchar *>(pixels), slot.size, slot.stride, slot.damage);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    } else {
+        qCWarning(KWIN_SCREENCAST) << "Failed to map a pixel buffer";
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    release(slot);
+    m_pendingCount--;
+}
+
+void PixelBufferReadback::release(Slot &slot)
+{
+    delete slot.notifier;
+    slot.notifier = nullptr;
+    delete slot.fence;
+    slot.fence = nullptr;
+    if (slot.sync) {
+        glDeleteSync(slot.sync);
+        slot.sync = nullptr;
+    }
+    slot.damage = QRegion();
+}
+
+} // namespace KWin
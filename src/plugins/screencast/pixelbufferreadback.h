@@ -0,0 +1,92 @@
+/*
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include <QObject>
+#include <QRegion>
+#include <QSize>
+#include <QTimer>
+
+#include <epoxy/gl.h>
+
+#include <array>
+
+class QSocketNotifier;
+
+namespace KWin
+{
+
+class EGLNativeFence;
+class GLTexture;
+
+/**
+ * The PixelBufferReadback class reads back the contents of textures asynchronously.
+ *
+ * The pixels are copied into a ring of pixel buffer objects. Once the GPU has finished
+ * copying a frame, which is usually the case one compositing cycle later, the pixels are
+ * mapped and handed over with the finished() signal. Thus, the compositor doesn't have to
+ * wait for the graphics pipeline to drain every time a frame is recorded.
+ */
+class PixelBufferReadback : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PixelBufferReadback(QObject *parent = nullptr);
+    ~PixelBufferReadback() override;
+
+    /**
+     * Returns @c true if the OpenGL implementation supports pixel buffer objects, sync
+     * objects and mapping buffer ranges.
+     */
+    static bool isSupported();
+
+    /**
+     * Schedules reading back the @a texture in the specified @a format. The @a damage
+     * is passed along to the finished() signal. If all pixel buffers are busy, this
+     * function will block until the oldest readback finishes.
+     */
+    void read(GLTexture *texture, GLenum format, int bytesPerPixel, const QRegion &damage);
+
+    /**
+     * Hands over all finished readbacks, without blocking.
+     */
+    void collect();
+
+Q_SIGNALS:
+    /**
+     * This signal is emitted when the pixels of a texture have been read back. The @a pixels
+     * are valid only during the signal emission. Rows are 4 byte aligned.
+     */
+    void finished(const uchar *pixels, const QSize &size, int stride, const QRegion &damage);
+
+private:
+    struct Slot
+    {
+        GLuint buffer = 0;
+        GLsizeiptr bufferSize = 0;
+        GLsync sync = nullptr;
+        EGLNativeFence *fence = nullptr;
+        QSocketNotifier *notifier = nullptr;
+        QSize size;
+        int stride = 0;
+        QRegion damage;
+    };
+
+    static const int slotCount = 3;
+
+    bool isSignaled(const Slot &slot) const;
+    void finish(Slot &slot);
+    void release(Slot &slot);
+
+    std::array<Slot, slotCount> m_slots;
+    QTimer m_pollTimer;
+    int m_head = 0;
+    int m_pendingCount = 0;
+};
+
+} // namespace KWin
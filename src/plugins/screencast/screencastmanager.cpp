@@ -13,6 +13,7 @@
 #include "deleted.h"
 #include "effects.h"
 #include "kwingltexture.h"
+#include "kwinscreencast_logging.h"
 #include "pipewirestream.h"
 #include "platform.h"
 #include "scene.h"
@@ -23,10 +24,37 @@
 
 #include <KWaylandServer/display.h>
 #include <KWaylandServer/output_interface.h>
+#include <KWaylandServer/surface_interface.h>
+
+#include <cmath>
 
 namespace KWin
 {
 
+/**
+ * Maps the @p region in global coordinates to the pixels of a frame of @p frameSize that
+ * shows the area starting at @p origin with the given @p scale. If the rows of the frame
+ * are stored @p bottomUp, the region is flipped as well.
+ */
+static QRegion mapToFrame(const QRegion &region, const QPoint &origin, qreal scale, const QSize &frameSize, bool bottomUp)
+{
+    QRegion mapped;
+    for (const QRect &rect : region) {
+        const QRect local = rect.translated(-origin);
+        // With fractional scales, the pixels on the edges are only partially covered.
+        const int left = std::floor(local.x() * scale);
+        const int top = std::floor(local.y() * scale);
+        const int right = std::ceil((local.x() + local.width()) * scale);
+        const int bottom = std::ceil((local.y() + local.height()) * scale);
+        if (bottomUp) {
+            mapped |= QRect(left, frameSize.height() - bottom, right - left, bottom - top);
+        } else {
+            mapped |= QRect(left, top, right - left, bottom - top);
+        }
+    }
+    return mapped.intersected(QRect(QPoint(), frameSize));
+}
+
 ScreencastManager::ScreencastManager(QObject *parent)
     : Plugin(parent)
     , m_screencast(new KWaylandServer::ScreencastV1Interface(waylandServer()->display(), this))
@@ -49,6 +77,7 @@ public:
         }
         connect(toplevel, &Toplevel::windowClosed, this, &PipeWireStream::stopStreaming);
         connect(this, &PipeWireStream::startStreaming, this, &WindowStream::startFeeding);
+        connect(this, &PipeWireStream::frameRequested, this, &WindowStream::requestFrame);
     }
 
 private:
@@ -57,7 +86,11 @@ private:
         connect(scene, &Scene::frameRendered, this, &WindowStream::bufferToStream);
 
         connect(m_toplevel, &Toplevel::damaged, this, &WindowStream::includeDamage);
-        m_damagedRegion = m_toplevel->visibleGeometry();
+        // The damage accumulated so far can't be mapped to the frame once the window moves.
+        connect(m_toplevel, &Toplevel::bufferGeometryChanged, this, [this] {
+            m_fullDamage = true;
+        });
+        m_fullDamage = true;
         m_toplevel->addRepaintFull();
     }
 
@@ -66,21 +99,44 @@ private:
         m_damagedRegion |= damage;
     }
 
+    void requestFrame() {
+        m_frameRequested = true;
+        m_toplevel->addRepaintFull();
+    }
+
     void bufferToStream () {
-        if (m_damagedRegion.isEmpty()) {
+        if (m_damagedRegion.isEmpty() && !m_frameRequested && !m_fullDamage) {
             return;
         }
         QSharedPointer<GLTexture> frameTexture(m_toplevel->effectWindow()->sceneWindow()->windowTexture());
         const bool wasYInverted = frameTexture->isYInverted();
-        frameTexture->setYInverted(false);
 
-        recordFrame(frameTexture.data(), m_damagedRegion);
-        frameTexture->setYInverted(wasYInverted);
+        // The frame is either the buffer of the window or the window rendered at the buffer
+        // scale. A buffer that is cropped, scaled or transformed is sent as a whole.
+        const QRect bufferGeometry = m_toplevel->bufferGeometry();
+        const qreal bufferScale = m_toplevel->bufferScale();
+        const QRect frame(QPoint(), frameTexture->size());
+        const bool isExact = frame.size() == bufferGeometry.size() * bufferScale
+            && (!m_toplevel->surface() || m_toplevel->surface()->bufferTransform() == KWaylandServer::OutputInterface::Transform::Normal);
+        QRegion damage;
+        if (m_frameRequested || m_fullDamage || !isExact) {
+            damage = frame;
+        } else {
+            damage = mapToFrame(m_damagedRegion, bufferGeometry.topLeft(), bufferScale, frame.size(), !wasYInverted);
+        }
+        m_frameRequested = false;
+        m_fullDamage = false;
         m_damagedRegion = {};
+
+        frameTexture->setYInverted(false);
+        recordFrame(frameTexture.data(), damage);
+        frameTexture->setYInverted(wasYInverted);
     }
 
     QRegion m_damagedRegion;
     Toplevel *m_toplevel;
+    bool m_frameRequested = false;
+    bool m_fullDamage = false;
 };
 
 void ScreencastManager::streamWindow(KWaylandServer::ScreencastStreamV1Interface *waylandStream, const QString &winid)
@@ -110,13 +166,30 @@ void ScreencastManager::streamOutput(KWaylandServer::ScreencastStreamV1Interface
     auto stream = new PipeWireStream(true, streamOutput->pixelSize(), this);
     stream->setObjectName(streamOutput->name());
     stream->setCursorMode(mode, streamOutput->scale(), streamOutput->geometry());
+    stream->setMaxFramerate(qRound(streamOutput->refreshRate() / 1000.0));
     connect(streamOutput, &QObject::destroyed, stream, &PipeWireStream::stopStreaming);
+    connect(stream, &PipeWireStream::frameRequested, stream, [streamOutput] {
+        Compositor::self()->addRepaint(streamOutput->geometry());
+    });
     auto bufferToStream = [streamOutput, stream] (const QRegion &damagedRegion) {
         auto scene = Compositor::self()->scene();
         auto texture = scene->textureForOutput(streamOutput);
+        if (!texture) {
+            return;
+        }
 
-        const QRect frame({}, streamOutput->modeSize());
-        const QRegion region = damagedRegion.isEmpty() || streamOutput->pixelSize() != streamOutput->modeSize() ? frame : damagedRegion.translated(-streamOutput->geometry().topLeft()).intersected(frame);
+        // An empty damage region means that nothing has changed, the stream will skip the frame.
+        // The backends hand out the output with the top row first, see textureForOutput(). A
+        // transformed output is sent as a whole.
+        const QRect frame({}, texture->size());
+        QRegion region;
+        if (damagedRegion.isEmpty()) {
+            region = QRegion();
+        } else if (streamOutput->pixelSize() != streamOutput->modeSize() || frame.size() != streamOutput->pixelSize()) {
+            region = frame;
+        } else {
+            region = mapToFrame(damagedRegion, streamOutput->geometry().topLeft(), streamOutput->scale(), frame.size(), false);
+        }
         stream->recordFrame(texture.data(), region);
     };
     connect(stream, &PipeWireStream::startStreaming, waylandStream, [streamOutput, stream, bufferToStream] {
@@ -130,10 +203,23 @@ void ScreencastManager::streamOutput(KWaylandServer::ScreencastStreamV1Interface
     integrateStreams(waylandStream, stream);
 }
 
+static void reportStatistics(PipeWireStream *stream)
+{
+    const PipeWireStream::Statistics statistics = stream->statistics();
+    qCDebug(KWIN_SCREENCAST) << "Stream" << stream->objectName() << "finished:"
+                             << statistics.producedFrames << "frames produced,"
+                             << statistics.skippedFrames << "skipped,"
+                             << statistics.droppedFrames << "dropped";
+}
+
 void ScreencastManager::integrateStreams(KWaylandServer::ScreencastStreamV1Interface *waylandStream, PipeWireStream *stream)
 {
-    connect(waylandStream, &KWaylandServer::ScreencastStreamV1Interface::finished, stream, &PipeWireStream::stop);
+    connect(waylandStream, &KWaylandServer::ScreencastStreamV1Interface::finished, stream, [stream] {
+        reportStatistics(stream);
+        stream->stop();
+    });
     connect(stream, &PipeWireStream::stopStreaming, waylandStream, [stream, waylandStream] {
+        reportStatistics(stream);
         waylandStream->sendClosed();
         stream->deleteLater();
     });
@@ -1318,7 +1318,6 @@ bool WaylandCursorImage::loadThemeCursor_helper(const QByteArray &name, Image *c
     }
 
     cursorImage->image = sprites.first().data();
-    cursorImage->image.setDevicePixelRatio(m_cursorTheme.devicePixelRatio());
 
     cursorImage->hotspot = sprites.first().hotspot();
 
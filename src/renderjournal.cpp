@@ -6,9 +6,93 @@
 
 #include "renderjournal.h"
 
+#include <cmath>
+
 namespace KWin
 {
 
+void RenderJournal::History::add(std::chrono::nanoseconds sample)
+{
+    m_samples[m_head] = sample;
+    m_head = (m_head + 1) % capacity;
+    m_count = std::min(m_count + 1, int(capacity));
+
+    // The weight of the new sample is 1/8, which smooths out the noise within a couple of
+    // dozen frames without lagging too much behind the actual render time.
+    if (m_count == 1) {
+        m_exponentialAverage = sample;
+    } else {
+        m_exponentialAverage += (sample - m_exponentialAverage) / 8;
+    }
+}
+
+std::chrono::nanoseconds RenderJournal::History::at(int index) const
+{
+    // Index 0 refers to the most recent sample.
+    return m_samples[(m_head - 1 - index + capacity) % capacity];
+}
+
+std::chrono::nanoseconds RenderJournal::History::minimum(int window) const
+{
+    const int count = std::min(window, m_count);
+    if (!count) {
+        return std::chrono::nanoseconds::zero();
+    }
+
+    std::chrono::nanoseconds result = at(0);
+    for (int i = 1; i < count; ++i) {
+        result = std::min(result, at(i));
+    }
+    return result;
+}
+
+std::chrono::nanoseconds RenderJournal::History::maximum(int window) const
+{
+    const int count = std::min(window, m_count);
+
+    std::chrono::nanoseconds result = std::chrono::nanoseconds::zero();
+    for (int i = 0; i < count; ++i) {
+        result = std::max(result, at(i));
+    }
+    return result;
+}
+
+std::chrono::nanoseconds RenderJournal::History::average(int window) const
+{
+    const int count = std::min(window, m_count);
+    if (!count) {
+        return std::chrono::nanoseconds::zero();
+    }
+
+    std::chrono::nanoseconds result = std::chrono::nanoseconds::zero();
+    for (int i = 0; i < count; ++i) {
+        result += at(i);
+    }
+    return result / count;
+}
+
+std::chrono::nanoseconds RenderJournal::History::percentile(qreal percentile) const
+{
+    if (!m_count) {
+        return std::chrono::nanoseconds::zero();
+    }
+
+    std::array<std::chrono::nanoseconds, capacity> samples;
+    std::copy_n(m_samples.begin(), m_count, samples.begin());
+
+    // Use the nearest-rank method, the result is always one of the recorded samples.
+    const int rank = std::ceil(qBound(0.0, percentile, 1.0) * m_count);
+    const auto nth = samples.begin() + qBound(0, rank - 1, m_count - 1);
+    std::nth_element(samples.begin(), nth, samples.begin() + m_count);
+
+    return *nth;
+}
+
+std::chrono::nanoseconds RenderJournal::History::exponentialAverage() const
+{
+    return m_exponentialAverage;
+}
+
 RenderJournal::RenderJournal()
 {
 }
@@ -20,37 +104,42 @@ void RenderJournal::beginFrame()
 
 void RenderJournal::endFrame()
 {
-    std::chrono::nanoseconds duration(m_timer.nsecsElapsed());
-    if (m_log.count() >= m_size) {
-        m_log.dequeue();
-    }
-    m_log.enqueue(duration);
+    add(std::chrono::nanoseconds(m_timer.nsecsElapsed()));
+}
+
+void RenderJournal::add(std::chrono::nanoseconds renderTime)
+{
+    m_cpuHistory.add(renderTime);
+}
+
+void RenderJournal::addGpuRenderTime(std::chrono::nanoseconds renderTime)
+{
+    m_gpuHistory.add(renderTime);
 }
 
 std::chrono::nanoseconds RenderJournal::minimum() const
 {
-    auto it = std::min_element(m_log.constBegin(), m_log.constEnd());
-    return it != m_log.constEnd() ? (*it) : std::chrono::nanoseconds::zero();
+    return std::max(m_cpuHistory.minimum(m_size), m_gpuHistory.minimum(m_size));
 }
 
 std::chrono::nanoseconds RenderJournal::maximum() const
 {
-    auto it = std::max_element(m_log.constBegin(), m_log.constEnd());
-    return it != m_log.constEnd() ? (*it) : std::chrono::nanoseconds::zero();
+    return std::max(m_cpuHistory.maximum(m_size), m_gpuHistory.maximum(m_size));
 }
 
 std::chrono::nanoseconds RenderJournal::average() const
 {
-    if (m_log.isEmpty()) {
-        return std::chrono::nanoseconds::zero();
-    }
+    return std::max(m_cpuHistory.average(m_size), m_gpuHistory.average(m_size));
+}
 
-    std::chrono::nanoseconds result = std::chrono::nanoseconds::zero();
-    for (const std::chrono::nanoseconds &entry : m_log) {
-        result += entry;
-    }
+std::chrono::nanoseconds RenderJournal::percentile(qreal percentile) const
+{
+    return std::max(m_cpuHistory.percentile(percentile), m_gpuHistory.percentile(percentile));
+}
 
-    return result / m_log.count();
+std::chrono::nanoseconds RenderJournal::exponentialAverage() const
+{
+    return std::max(m_cpuHistory.exponentialAverage(), m_gpuHistory.exponentialAverage());
 }
 
 } // namespace KWin
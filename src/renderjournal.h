@@ -9,7 +9,8 @@
 #include "kwinglobals.h"
 
 #include <QElapsedTimer>
-#include <QQueue>
+
+#include <array>
 
 namespace KWin
 {
@@ -17,6 +18,10 @@ namespace KWin
 /**
  * The RenderJournal class measures how long it takes to render frames and estimates how
  * long it will take to render the next frame.
+ *
+ * Both the time spent on the CPU and, if reported with addGpuRenderTime(), the time spent
+ * on the GPU are taken into account. A frame is not done until both have finished, so every
+ * estimate is the larger of the CPU and the GPU estimates.
  */
 class KWIN_EXPORT RenderJournal
 {
@@ -33,6 +38,17 @@ public:
      */
     void endFrame();
 
+    /**
+     * Records that it took @a renderTime to render a frame.
+     */
+    void add(std::chrono::nanoseconds renderTime);
+
+    /**
+     * Records that it took @a renderTime for the GPU to execute the rendering commands of
+     * a frame. GPU timings usually arrive a couple of frames after the frame was rendered.
+     */
+    void addGpuRenderTime(std::chrono::nanoseconds renderTime);
+
     /**
      * Returns the maximum estimated amount of time that it takes to render a single frame.
      */
@@ -48,9 +64,46 @@ public:
      */
     std::chrono::nanoseconds average() const;
 
+    /**
+     * Returns the render time that the specified @a percentile of recent frames, in the
+     * range from 0 to 1, did not exceed.
+     */
+    std::chrono::nanoseconds percentile(qreal percentile) const;
+
+    /**
+     * Returns the exponentially weighted moving average of the render time.
+     */
+    std::chrono::nanoseconds exponentialAverage() const;
+
 private:
+    /**
+     * The History class is a fixed-size ring buffer of render time samples.
+     */
+    class History
+    {
+    public:
+        static const int capacity = 128;
+
+        void add(std::chrono::nanoseconds sample);
+
+        std::chrono::nanoseconds minimum(int window) const;
+        std::chrono::nanoseconds maximum(int window) const;
+        std::chrono::nanoseconds average(int window) const;
+        std::chrono::nanoseconds percentile(qreal percentile) const;
+        std::chrono::nanoseconds exponentialAverage() const;
+
+    private:
+        std::chrono::nanoseconds at(int index) const;
+
+        std::array<std::chrono::nanoseconds, capacity> m_samples;
+        std::chrono::nanoseconds m_exponentialAverage = std::chrono::nanoseconds::zero();
+        int m_head = 0;
+        int m_count = 0;
+    };
+
     QElapsedTimer m_timer;
-    QQueue<std::chrono::nanoseconds> m_log;
+    History m_cpuHistory;
+    History m_gpuHistory;
     int m_size = 15;
 };
 
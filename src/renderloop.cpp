@@ -9,15 +9,121 @@
 #include "renderloop_p.h"
 #include "utils.h"
 
+#include <config-kwin.h>
+
+#if HAVE_TIMERFD
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <cstring>
+
 namespace KWin
 {
 
+// The adaptive scheduler never lets the safety margin go below this value.
+static const std::chrono::nanoseconds minimumAdaptiveSafetyMargin = std::chrono::microseconds(500);
+
 template <typename T>
 T alignTimestamp(const T &timestamp, const T &alignment)
 {
     return timestamp + ((alignment - (timestamp % alignment)) % alignment);
 }
 
+RenderLoopTimer::RenderLoopTimer(QObject *parent)
+    : QObject(parent)
+{
+#if HAVE_TIMERFD
+    m_fileDescriptor = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (m_fileDescriptor != -1) {
+        m_notifier = new QSocketNotifier(m_fileDescriptor, QSocketNotifier::Read, this);
+        connect(m_notifier, &QSocketNotifier::activated, this, &RenderLoopTimer::handleTimerActivated);
+        return;
+    }
+    qCWarning(KWIN_CORE, "Failed to create a timerfd, falling back to QTimer: %s", strerror(errno));
+#endif
+
+    m_fallbackTimer = new QTimer(this);
+    m_fallbackTimer->setSingleShot(true);
+    m_fallbackTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_fallbackTimer, &QTimer::timeout, this, &RenderLoopTimer::timeout);
+}
+
+RenderLoopTimer::~RenderLoopTimer()
+{
+#if HAVE_TIMERFD
+    if (m_fileDescriptor != -1) {
+        close(m_fileDescriptor);
+    }
+#endif
+}
+
+bool RenderLoopTimer::isActive() const
+{
+    if (m_fallbackTimer) {
+        return m_fallbackTimer->isActive();
+    }
+    return m_active;
+}
+
+void RenderLoopTimer::start(std::chrono::nanoseconds deadline)
+{
+    if (m_fallbackTimer) {
+        const std::chrono::nanoseconds currentTime(std::chrono::steady_clock::now().time_since_epoch());
+        const std::chrono::nanoseconds interval = std::max(deadline - currentTime, std::chrono::nanoseconds::zero());
+        m_fallbackTimer->start(std::chrono::ceil<std::chrono::milliseconds>(interval));
+        return;
+    }
+
+#if HAVE_TIMERFD
+    // A zero it_value disarms the timer, so make sure that an expired deadline still fires.
+    const std::chrono::nanoseconds expiration = std::max(deadline, std::chrono::nanoseconds(1));
+
+    itimerspec spec = {};
+    spec.it_value.tv_sec = std::chrono::duration_cast<std::chrono::seconds>(expiration).count();
+    spec.it_value.tv_nsec = (expiration % std::chrono::seconds(1)).count();
+
+    if (timerfd_settime(m_fileDescriptor, TFD_TIMER_ABSTIME, &spec, nullptr) == -1) {
+        qCWarning(KWIN_CORE, "Failed to arm the render loop timer: %s", strerror(errno));
+        return;
+    }
+    m_active = true;
+#endif
+}
+
+void RenderLoopTimer::stop()
+{
+    if (m_fallbackTimer) {
+        m_fallbackTimer->stop();
+        return;
+    }
+
+#if HAVE_TIMERFD
+    if (m_active) {
+        const itimerspec spec = {};
+        timerfd_settime(m_fileDescriptor, TFD_TIMER_ABSTIME, &spec, nullptr);
+        m_active = false;
+    }
+#endif
+}
+
+void RenderLoopTimer::handleTimerActivated()
+{
+#if HAVE_TIMERFD
+    uint64_t expirationCount;
+    if (read(m_fileDescriptor, &expirationCount, sizeof(expirationCount)) == -1) {
+        // The timer has been re-armed or disarmed after the notifier got activated.
+        return;
+    }
+#endif
+
+    if (m_active) {
+        m_active = false;
+        emit timeout();
+    }
+}
+
 RenderLoopPrivate *RenderLoopPrivate::get(RenderLoop *loop)
 {
     return loop->d.data();
@@ -26,8 +132,12 @@ RenderLoopPrivate *RenderLoopPrivate::get(RenderLoop *loop)
 RenderLoopPrivate::RenderLoopPrivate(RenderLoop *q)
     : q(q)
 {
-    compositeTimer.setSingleShot(true);
-    QObject::connect(&compositeTimer, &QTimer::timeout, q, [this]() { dispatch(); });
+    QObject::connect(&compositeTimer, &RenderLoopTimer::timeout, q, [this]() { dispatch(); });
+}
+
+std::chrono::nanoseconds RenderLoopPrivate::vblankInterval() const
+{
+    return std::chrono::nanoseconds(1'000'000'000'000ull / refreshRate);
 }
 
 void RenderLoopPrivate::scheduleRepaint()
@@ -37,7 +147,17 @@ void RenderLoopPrivate::scheduleRepaint()
     }
 
     const std::chrono::nanoseconds currentTime(std::chrono::steady_clock::now().time_since_epoch());
-    const std::chrono::nanoseconds vblankInterval(1'000'000'000'000ull / refreshRate);
+    const std::chrono::nanoseconds nextRenderTimestamp = computeNextRenderTimestamp(currentTime,
+                                                                                    options->latencyPolicy(),
+                                                                                    options->renderTimeEstimator());
+    compositeTimer.start(nextRenderTimestamp);
+}
+
+std::chrono::nanoseconds RenderLoopPrivate::computeNextRenderTimestamp(std::chrono::nanoseconds currentTime,
+                                                                       LatencyPolicy latencyPolicy,
+                                                                       RenderTimeEstimator renderTimeEstimator)
+{
+    const std::chrono::nanoseconds vblankInterval = this->vblankInterval();
 
     // Estimate when the next presentation will occur. Note that this is a prediction.
     nextPresentationTimestamp = lastPresentationTimestamp + vblankInterval;
@@ -47,10 +167,10 @@ void RenderLoopPrivate::scheduleRepaint()
     }
 
     // Estimate when it's a good time to perform the next compositing cycle.
-    const std::chrono::nanoseconds safetyMargin = std::chrono::milliseconds(3);
+    std::chrono::nanoseconds safetyMargin = std::chrono::milliseconds(3);
 
     std::chrono::nanoseconds renderTime;
-    switch (options->latencyPolicy()) {
+    switch (latencyPolicy) {
     case LatencyExteremelyLow:
         renderTime = std::chrono::nanoseconds(long(vblankInterval.count() * 0.1));
         break;
@@ -66,9 +186,14 @@ void RenderLoopPrivate::scheduleRepaint()
     case LatencyExtremelyHigh:
         renderTime = std::chrono::nanoseconds(long(vblankInterval.count() * 0.9));
         break;
+    case LatencyAdaptive:
+        // Rely only on the render journal and the margin learned from missed frames.
+        renderTime = std::chrono::nanoseconds::zero();
+        safetyMargin = adaptiveSafetyMargin;
+        break;
     }
 
-    switch (options->renderTimeEstimator()) {
+    switch (renderTimeEstimator) {
     case RenderTimeEstimatorMinimum:
         renderTime = std::max(renderTime, renderJournal.minimum());
         break;
@@ -78,6 +203,18 @@ void RenderLoopPrivate::scheduleRepaint()
     case RenderTimeEstimatorAverage:
         renderTime = std::max(renderTime, renderJournal.average());
         break;
+    case RenderTimeEstimatorPercentile50:
+        renderTime = std::max(renderTime, renderJournal.percentile(0.5));
+        break;
+    case RenderTimeEstimatorPercentile90:
+        renderTime = std::max(renderTime, renderJournal.percentile(0.9));
+        break;
+    case RenderTimeEstimatorPercentile99:
+        renderTime = std::max(renderTime, renderJournal.percentile(0.99));
+        break;
+    case RenderTimeEstimatorExponentialAverage:
+        renderTime = std::max(renderTime, renderJournal.exponentialAverage());
+        break;
     }
 
     std::chrono::nanoseconds nextRenderTimestamp = nextPresentationTimestamp - renderTime - safetyMargin;
@@ -87,8 +224,7 @@ void RenderLoopPrivate::scheduleRepaint()
         nextRenderTimestamp = currentTime;
     }
 
-    const std::chrono::nanoseconds waitInterval = nextRenderTimestamp - currentTime;
-    compositeTimer.start(std::chrono::duration_cast<std::chrono::milliseconds>(waitInterval));
+    return nextRenderTimestamp;
 }
 
 void RenderLoopPrivate::delayScheduleRepaint()
@@ -119,6 +255,17 @@ void RenderLoopPrivate::notifyFrameCompleted(std::chrono::nanoseconds timestamp)
     Q_ASSERT(pendingFrameCount > 0);
     pendingFrameCount--;
 
+    // If the frame has been presented later than predicted, it missed the deadline and
+    // the adaptive scheduler must start rendering earlier. Otherwise, slowly shrink the
+    // safety margin to bring the start of the compositing cycle closer to the vblank.
+    const std::chrono::nanoseconds vblankInterval = this->vblankInterval();
+    if (timestamp > nextPresentationTimestamp + vblankInterval / 2) {
+        adaptiveSafetyMargin = std::min(adaptiveSafetyMargin * 2, vblankInterval / 2);
+    } else {
+        adaptiveSafetyMargin = std::max(adaptiveSafetyMargin - adaptiveSafetyMargin / 32,
+                                        minimumAdaptiveSafetyMargin);
+    }
+
     if (lastPresentationTimestamp <= timestamp) {
         lastPresentationTimestamp = timestamp;
     } else {
@@ -195,6 +342,16 @@ void RenderLoop::endFrame()
     d->renderJournal.endFrame();
 }
 
+void RenderLoop::addGpuRenderTime(std::chrono::nanoseconds renderTime)
+{
+    d->renderJournal.addGpuRenderTime(renderTime);
+}
+
+const RenderJournal *RenderLoop::renderJournal() const
+{
+    return &d->renderJournal;
+}
+
 int RenderLoop::refreshRate() const
 {
     return d->refreshRate;
@@ -13,6 +13,7 @@
 namespace KWin
 {
 
+class RenderJournal;
 class RenderLoopPrivate;
 
 /**
@@ -57,6 +58,17 @@ public:
      */
     void endFrame();
 
+    /**
+     * Reports that it took @a renderTime for the GPU to execute the rendering commands of
+     * a previously rendered frame.
+     */
+    void addGpuRenderTime(std::chrono::nanoseconds renderTime);
+
+    /**
+     * Returns the journal that keeps track of how long it takes to render frames.
+     */
+    const RenderJournal *renderJournal() const;
+
     /**
      * Returns the refresh rate at which the output is being updated, in millihertz.
      */
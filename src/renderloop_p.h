@@ -6,14 +6,52 @@
 
 #pragma once
 
+#include "options.h"
 #include "renderloop.h"
 #include "renderjournal.h"
 
+#include <QSocketNotifier>
 #include <QTimer>
 
 namespace KWin
 {
 
+/**
+ * The RenderLoopTimer class provides a single-shot timer that fires at an absolute point
+ * in time on the monotonic clock with sub-millisecond precision.
+ *
+ * If the system doesn't support timerfd, the RenderLoopTimer falls back to a precise
+ * QTimer, which has millisecond resolution.
+ */
+class KWIN_EXPORT RenderLoopTimer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit RenderLoopTimer(QObject *parent = nullptr);
+    ~RenderLoopTimer() override;
+
+    bool isActive() const;
+
+    /**
+     * Starts or restarts the timer so it fires at the specified @a deadline. The deadline
+     * is sourced from the monotonic clock.
+     */
+    void start(std::chrono::nanoseconds deadline);
+    void stop();
+
+Q_SIGNALS:
+    void timeout();
+
+private:
+    void handleTimerActivated();
+
+    QTimer *m_fallbackTimer = nullptr;
+    QSocketNotifier *m_notifier = nullptr;
+    int m_fileDescriptor = -1;
+    bool m_active = false;
+};
+
 class KWIN_EXPORT RenderLoopPrivate
 {
 public:
@@ -27,13 +65,25 @@ public:
     void scheduleRepaint();
     void maybeScheduleRepaint();
 
+    /**
+     * Predicts when the next frame is going to be presented and returns the latest time
+     * when the compositor can start rendering it, given the @a currentTime. The predicted
+     * presentation timestamp is stored in nextPresentationTimestamp.
+     */
+    std::chrono::nanoseconds computeNextRenderTimestamp(std::chrono::nanoseconds currentTime,
+                                                        LatencyPolicy latencyPolicy,
+                                                        RenderTimeEstimator renderTimeEstimator);
+
     void notifyFrameFailed();
     void notifyFrameCompleted(std::chrono::nanoseconds timestamp);
 
+    std::chrono::nanoseconds vblankInterval() const;
+
     RenderLoop *q;
     std::chrono::nanoseconds lastPresentationTimestamp = std::chrono::nanoseconds::zero();
     std::chrono::nanoseconds nextPresentationTimestamp = std::chrono::nanoseconds::zero();
-    QTimer compositeTimer;
+    std::chrono::nanoseconds adaptiveSafetyMargin = std::chrono::milliseconds(1);
+    RenderLoopTimer compositeTimer;
     RenderJournal renderJournal;
     int refreshRate = 60000;
     int pendingFrameCount = 0;
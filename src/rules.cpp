@@ -11,13 +11,14 @@
 
 #include <kconfig.h>
 #include <KXMessages>
-#include <QRegExp>
 #include <QTemporaryFile>
 #include <QFile>
 #include <QFileInfo>
 #include <QDebug>
 #include <QDir>
 
+#include <algorithm>
+
 #ifndef KCMRULES
 #include "x11client.h"
 #include "client_machine.h"
@@ -173,6 +174,24 @@ void Rules::readFromSettings(const RuleSettings *settings)
     READ_SET_RULE(shortcut);
     READ_FORCE_RULE(disableglobalshortcuts,);
     READ_SET_RULE(desktopfile);
+
+    compileRegExps();
+}
+
+void Rules::compileRegExps()
+{
+    auto compile = [](QRegularExpression &regExp, StringMatch match, const QString &pattern) {
+        if (match == RegExpMatch) {
+            regExp.setPattern(pattern);
+            regExp.optimize();
+        } else {
+            regExp = QRegularExpression();
+        }
+    };
+    compile(wmclassregexp, wmclassmatch, QString::fromUtf8(wmclass));
+    compile(windowroleregexp, windowrolematch, QString::fromUtf8(windowrole));
+    compile(titleregexp, titlematch, title);
+    compile(clientmachineregexp, clientmachinematch, QString::fromUtf8(clientmachine));
 }
 
 #undef READ_MATCH_STRING
@@ -332,10 +351,9 @@ bool Rules::matchType(NET::WindowType match_type) const
 bool Rules::matchWMClass(const QByteArray& match_class, const QByteArray& match_name) const
 {
     if (wmclassmatch != UnimportantMatch) {
-        // TODO optimize?
         QByteArray cwmclass = wmclasscomplete
                               ? match_name + ' ' + match_class : match_class;
-        if (wmclassmatch == RegExpMatch && QRegExp(QString::fromUtf8(wmclass)).indexIn(QString::fromUtf8(cwmclass)) == -1)
+        if (wmclassmatch == RegExpMatch && !wmclassregexp.match(QString::fromUtf8(cwmclass)).hasMatch())
             return false;
         if (wmclassmatch == ExactMatch && wmclass != cwmclass)
             return false;
@@ -348,7 +366,7 @@ bool Rules::matchWMClass(const QByteArray& match_class, const QByteArray& match_
 bool Rules::matchRole(const QByteArray& match_role) const
 {
     if (windowrolematch != UnimportantMatch) {
-        if (windowrolematch == RegExpMatch && QRegExp(QString::fromUtf8(windowrole)).indexIn(QString::fromUtf8(match_role)) == -1)
+        if (windowrolematch == RegExpMatch && !windowroleregexp.match(QString::fromUtf8(match_role)).hasMatch())
             return false;
         if (windowrolematch == ExactMatch && windowrole != match_role)
             return false;
@@ -361,7 +379,7 @@ bool Rules::matchRole(const QByteArray& match_role) const
 bool Rules::matchTitle(const QString& match_title) const
 {
     if (titlematch != UnimportantMatch) {
-        if (titlematch == RegExpMatch && QRegExp(title).indexIn(match_title) == -1)
+        if (titlematch == RegExpMatch && !titleregexp.match(match_title).hasMatch())
             return false;
         if (titlematch == ExactMatch && title != match_title)
             return false;
@@ -379,7 +397,7 @@ bool Rules::matchClientMachine(const QByteArray& match_machine, bool local) cons
                 && matchClientMachine("localhost", true))
             return true;
         if (clientmachinematch == RegExpMatch
-                && QRegExp(QString::fromUtf8(clientmachine)).indexIn(QString::fromUtf8(match_machine)) == -1)
+                && !clientmachineregexp.match(QString::fromUtf8(match_machine)).hasMatch())
             return false;
         if (clientmachinematch == ExactMatch
                 && clientmachine != match_machine)
@@ -403,7 +421,7 @@ bool Rules::match(const AbstractClient* c) const
     if (!matchClientMachine(c->clientMachine()->hostName(), c->clientMachine()->isLocal()))
         return false;
     if (titlematch != UnimportantMatch) // track title changes to rematch rules
-        QObject::connect(c, &AbstractClient::captionChanged, c, &AbstractClient::evaluateWindowRules,
+        QObject::connect(c, &AbstractClient::captionChanged, c, &AbstractClient::evaluateTitleRules,
                          // QueuedConnection, because title may change before
                          // the client is ready (could segfault!)
                          static_cast<Qt::ConnectionType>(Qt::QueuedConnection|Qt::UniqueConnection));
@@ -623,6 +641,21 @@ bool Rules::isTemporary() const
     return temporary_state > 0;
 }
 
+bool Rules::matchesWMClassExactly() const
+{
+    return wmclassmatch == ExactMatch;
+}
+
+QByteArray Rules::wmClass() const
+{
+    return wmclass;
+}
+
+bool Rules::dependsOnTitle() const
+{
+    return titlematch != UnimportantMatch;
+}
+
 bool Rules::discardTemporary(bool force)
 {
     if (temporary_state == 0)   // not temporary
@@ -833,7 +866,7 @@ CHECK_RULE(DesktopFile, QString)
 
 void AbstractClient::setupWindowRules(bool ignore_temporary)
 {
-    disconnect(this, &AbstractClient::captionChanged, this, &AbstractClient::evaluateWindowRules);
+    disconnect(this, &AbstractClient::captionChanged, this, &AbstractClient::evaluateTitleRules);
     m_rules = RuleBook::self()->find(this, ignore_temporary);
     // check only after getting the rules, because there may be a rule forcing window type
 }
@@ -956,33 +989,89 @@ void RuleBook::deleteAll()
 {
     qDeleteAll(m_rules);
     m_rules.clear();
+    invalidateIndex();
+}
+
+void RuleBook::invalidateIndex()
+{
+    m_indexValid = false;
+}
+
+void RuleBook::buildIndex()
+{
+    m_wmClassIndex.clear();
+    m_unindexedRules.clear();
+    for (int i = 0; i < m_rules.count(); ++i) {
+        const Rules *rule = m_rules.at(i);
+        if (rule->matchesWMClassExactly()) {
+            m_wmClassIndex[rule->wmClass()].append(i);
+        } else {
+            m_unindexedRules.append(i);
+        }
+    }
+    m_indexValid = true;
 }
 
 WindowRules RuleBook::find(const AbstractClient* c, bool ignore_temporary)
 {
+    if (!m_indexValid) {
+        buildIndex();
+    }
+
+    // Rules that require an exact window class are only tried if the window has that class.
+    // The candidates are sorted, so the rules are still tried in the order of the rule book.
+    const QByteArray resourceClass = c->resourceClass();
+    QVector<int> candidates = m_unindexedRules;
+    candidates += m_wmClassIndex.value(resourceClass);
+    candidates += m_wmClassIndex.value(c->resourceName() + ' ' + resourceClass);
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
     QVector< Rules* > ret;
-    for (QList< Rules* >::Iterator it = m_rules.begin();
-            it != m_rules.end();
-       ) {
-        if (ignore_temporary && (*it)->isTemporary()) {
-            ++it;
+    QVector< Rules* > usedTemporary;
+    for (int index : qAsConst(candidates)) {
+        Rules* rule = m_rules.at(index);
+        if (ignore_temporary && rule->isTemporary()) {
             continue;
         }
-        if ((*it)->match(c)) {
-            Rules* rule = *it;
+        if (rule->match(c)) {
             qCDebug(KWIN_CORE) << "Rule found:" << rule << ":" << c;
             if (rule->isTemporary())
-                it = m_rules.erase(it);
-            else
-                ++it;
+                usedTemporary.append(rule);
             ret.append(rule);
-            continue;
         }
-        ++it;
+    }
+    if (!usedTemporary.isEmpty()) {
+        for (Rules *rule : qAsConst(usedTemporary)) {
+            m_rules.removeOne(rule);
+        }
+        invalidateIndex();
     }
     return WindowRules(ret);
 }
 
+bool RuleBook::updateTitleRules(const AbstractClient *c, WindowRules *rules)
+{
+    // The rules that don't depend on the title still apply, unless they have been removed
+    // from the rule book in the meantime. The others have to be matched again.
+    QVector< Rules* > ret;
+    for (Rules *rule : qAsConst(m_rules)) {
+        if (rule->isTemporary()) {
+            continue;
+        }
+        if (rule->dependsOnTitle() ? rule->match(c) : rules->contains(rule)) {
+            ret.append(rule);
+        }
+    }
+
+    const WindowRules updated(ret);
+    if (updated == *rules) {
+        return false;
+    }
+    *rules = updated;
+    return true;
+}
+
 void RuleBook::edit(AbstractClient* c, bool whole_app)
 {
     save();
@@ -1014,6 +1103,7 @@ void RuleBook::load()
         m_config->reparseConfiguration();
     }
     m_rules = RuleBookSettings(m_config).rules().toList();
+    invalidateIndex();
 }
 
 void RuleBook::save()
@@ -1044,6 +1134,7 @@ void RuleBook::temporaryRulesMessage(const QString& message)
             was_temporary = true;
     Rules* rule = new Rules(message, true);
     m_rules.prepend(rule);   // highest priority first
+    invalidateIndex();
     if (!was_temporary)
         QTimer::singleShot(60000, this, &RuleBook::cleanupTemporaryRules);
 }
@@ -1056,6 +1147,7 @@ void RuleBook::cleanupTemporaryRules()
        ) {
         if ((*it)->discardTemporary(false)) { // deletes (*it)
             it = m_rules.erase(it);
+            invalidateIndex();
         } else {
             if ((*it)->isTemporary())
                 has_temporary = true;
@@ -1081,6 +1173,7 @@ void RuleBook::discardUsed(AbstractClient* c, bool withdrawn)
                 Rules* r = *it;
                 it = m_rules.erase(it);
                 delete r;
+                invalidateIndex();
                 continue;
             }
         }
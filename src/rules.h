@@ -12,7 +12,9 @@
 
 
 #include <netwm_def.h>
+#include <QHash>
 #include <QRect>
+#include <QRegularExpression>
 #include <QVector>
 
 #include "placement.h"
@@ -78,10 +80,13 @@ public:
     QString checkShortcut(QString s, bool init = false) const;
     bool checkDisableGlobalShortcuts(bool disable) const;
     QString checkDesktopFile(QString desktopFile, bool init = false) const;
+    bool operator==(const WindowRules &other) const;
+    bool operator!=(const WindowRules &other) const;
 private:
     MaximizeMode checkMaximizeVert(MaximizeMode mode, bool init) const;
     MaximizeMode checkMaximizeHoriz(MaximizeMode mode, bool init) const;
     QVector< Rules* > rules;
+    friend class RuleBook;
 };
 
 #endif
@@ -134,6 +139,20 @@ public:
     bool match(const AbstractClient* c) const;
     bool update(AbstractClient*, int selection);
     bool isTemporary() const;
+    /**
+     * Returns @c true if the rule matches only windows whose window class is exactly wmClass().
+     */
+    bool matchesWMClassExactly() const;
+    /**
+     * Returns the window class that the rule matches. If the complete window class is matched,
+     * it consists of the resource name and the resource class separated by a space.
+     */
+    QByteArray wmClass() const;
+    /**
+     * Returns @c true if the rule matches the window title, i.e. whether it has to be checked
+     * again when the title changes.
+     */
+    bool dependsOnTitle() const;
     bool discardTemporary(bool force);   // removes if temporary and forced or too old
     bool applyPlacement(Placement::Policy& placement) const;
     bool applyGeometry(QRect& rect, bool init) const;
@@ -181,6 +200,7 @@ private:
     bool matchTitle(const QString& match_title) const;
     bool matchClientMachine(const QByteArray& match_machine, bool local) const;
     void readFromSettings(const RuleSettings *settings);
+    void compileRegExps();
     static ForceRule convertForceRule(int v);
     static QString getDecoColor(const QString &themeName);
 #ifndef KCMRULES
@@ -200,6 +220,11 @@ private:
     StringMatch titlematch;
     QByteArray clientmachine;
     StringMatch clientmachinematch;
+    // compiled once, so that matching doesn't have to parse the patterns again
+    QRegularExpression wmclassregexp;
+    QRegularExpression windowroleregexp;
+    QRegularExpression titleregexp;
+    QRegularExpression clientmachineregexp;
     NET::WindowTypes types; // types for matching
     Placement::Policy placement;
     ForceRule placementrule;
@@ -283,6 +308,12 @@ class KWIN_EXPORT RuleBook : public QObject
 public:
     ~RuleBook() override;
     WindowRules find(const AbstractClient*, bool);
+    /**
+     * Checks the rules that match the window title of @a c again, after the caption has
+     * changed. The other rules are taken over from @a rules. Returns @c true if the rules
+     * have changed, in which case @a rules is updated.
+     */
+    bool updateTitleRules(const AbstractClient *c, WindowRules *rules);
     void discardUsed(AbstractClient* c, bool withdraw);
     void setUpdatesDisabled(bool disable);
     bool areUpdatesDisabled() const;
@@ -303,9 +334,15 @@ private:
     void deleteAll();
     void initializeX11();
     void cleanupX11();
+    void invalidateIndex();
+    void buildIndex();
     QTimer *m_updateTimer;
     bool m_updatesDisabled;
     QList<Rules*> m_rules;
+    // positions in m_rules, so that find() doesn't have to try every rule
+    QHash<QByteArray, QVector<int>> m_wmClassIndex;
+    QVector<int> m_unindexedRules;
+    bool m_indexValid = false;
     QScopedPointer<KXMessages> m_temporaryRulesMessages;
     KSharedConfig::Ptr m_config;
 
@@ -370,6 +407,18 @@ void WindowRules::remove(Rules* rule)
     rules.removeOne(rule);
 }
 
+inline
+bool WindowRules::operator==(const WindowRules &other) const
+{
+    return rules == other.rules;
+}
+
+inline
+bool WindowRules::operator!=(const WindowRules &other) const
+{
+    return rules != other.rules;
+}
+
 #endif
 
 QDebug& operator<<(QDebug& stream, const Rules*);
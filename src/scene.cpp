@@ -564,6 +564,7 @@ void Scene::paintWindowThumbnails(Scene::Window *w, const QRegion &region, qreal
         thumbData.setOpacity(opacity);
         thumbData.setBrightness(brightness * item->brightness());
         thumbData.setSaturation(saturation * item->saturation());
+        thumbData.setThumbnailRefreshInterval(item->refreshInterval());
 
         const QRect visualThumbRect(thumb->expandedGeometry());
 
@@ -174,6 +174,8 @@ ScriptedEffect::ScriptedEffect()
     , m_chainPosition(0)
 {
     Q_ASSERT(effects);
+    // Scripted effects only paint windows through their animations.
+    setWindowScoped(true);
     connect(effects, &EffectsHandler::activeFullScreenEffectChanged, this, [this]() {
         Effect* fullScreenEffect = effects->activeFullScreenEffect();
         if (fullScreenEffect == m_activeFullScreenEffect) {
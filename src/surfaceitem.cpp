@@ -35,7 +35,7 @@ void SurfaceItem::addDamage(const QRegion &region)
     scheduleRepaint(region);
 
     Toplevel *toplevel = window()->window();
-    emit toplevel->damaged(toplevel, region);
+    emit toplevel->damaged(toplevel, mapToGlobal(region));
 }
 
 void SurfaceItem::resetDamage()
@@ -111,7 +111,11 @@ WindowThumbnailItem::WindowThumbnailItem(QQuickItem* parent)
     : AbstractThumbnailItem(parent)
     , m_wId(nullptr)
     , m_client(nullptr)
+    , m_refreshTimer(new QTimer(this))
 {
+    m_refreshTimer->setSingleShot(true);
+    m_refreshTimer->setInterval(0);
+    connect(m_refreshTimer, &QTimer::timeout, this, &WindowThumbnailItem::refreshTimeout);
 }
 
 WindowThumbnailItem::~WindowThumbnailItem()
@@ -162,10 +166,38 @@ void WindowThumbnailItem::paint(QPainter *painter)
                         pixmap);
 }
 
+void WindowThumbnailItem::setRefreshInterval(int interval)
+{
+    interval = qMax(0, interval);
+    if (m_refreshTimer->interval() == interval) {
+        return;
+    }
+    m_refreshTimer->setInterval(interval);
+    emit refreshIntervalChanged();
+}
+
 void WindowThumbnailItem::repaint(KWin::EffectWindow *w)
 {
-    if (static_cast<KWin::EffectWindowImpl*>(w)->window()->internalId() == m_wId) {
+    if (static_cast<KWin::EffectWindowImpl*>(w)->window()->internalId() != m_wId) {
+        return;
+    }
+    if (m_refreshTimer->interval() == 0) {
+        update();
+    } else if (m_refreshTimer->isActive()) {
+        // show the change once the interval is over
+        m_refreshPending = true;
+    } else {
+        update();
+        m_refreshTimer->start();
+    }
+}
+
+void WindowThumbnailItem::refreshTimeout()
+{
+    if (m_refreshPending) {
+        m_refreshPending = false;
         update();
+        m_refreshTimer->start();
     }
 }
 
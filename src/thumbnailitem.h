@@ -14,6 +14,7 @@
 #include <QUuid>
 #include <QWeakPointer>
 #include <QQuickPaintedItem>
+#include <QTimer>
 
 namespace KWin
 {
@@ -68,6 +69,11 @@ class WindowThumbnailItem : public AbstractThumbnailItem
     Q_OBJECT
     Q_PROPERTY(QUuid wId READ wId WRITE setWId NOTIFY wIdChanged SCRIPTABLE true)
     Q_PROPERTY(KWin::AbstractClient *client READ client WRITE setClient NOTIFY clientChanged)
+    /**
+     * The minimum time in milliseconds between two updates of the thumbnail while the
+     * window changes. The default of @c 0 updates the thumbnail with every change.
+     */
+    Q_PROPERTY(int refreshInterval READ refreshInterval WRITE setRefreshInterval NOTIFY refreshIntervalChanged)
 public:
     explicit WindowThumbnailItem(QQuickItem *parent = nullptr);
     ~WindowThumbnailItem() override;
@@ -78,15 +84,22 @@ public:
     void setWId(const QUuid &wId);
     AbstractClient *client() const;
     void setClient(AbstractClient *client);
+    int refreshInterval() const;
+    void setRefreshInterval(int interval);
     void paint(QPainter *painter) override;
 Q_SIGNALS:
     void wIdChanged(const QUuid &wid);
     void clientChanged();
+    void refreshIntervalChanged();
 protected Q_SLOTS:
     void repaint(KWin::EffectWindow* w) override;
 private:
+    void refreshTimeout();
+
     QUuid m_wId;
     AbstractClient *m_client;
+    QTimer *m_refreshTimer;
+    bool m_refreshPending = false;
 };
 
 class DesktopThumbnailItem : public AbstractThumbnailItem
@@ -134,6 +147,12 @@ AbstractClient *WindowThumbnailItem::client() const
     return m_client;
 }
 
+inline
+int WindowThumbnailItem::refreshInterval() const
+{
+    return m_refreshTimer->interval();
+}
+
 } // KWin
 
 #endif // KWIN_THUMBNAILITEM_H
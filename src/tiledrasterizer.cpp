@@ -0,0 +1,469 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "tiledrasterizer.h"
+
+#include <QRunnable>
+
+#include <atomic>
+#include <cmath>
+
+namespace KWin
+{
+
+class PaintRecorderEngine : public QPaintEngine
+{
+public:
+    explicit PaintRecorderEngine(const QSize &size);
+
+    bool begin(QPaintDevice *device) override;
+    bool end() override;
+    Type type() const override;
+    void updateState(const QPaintEngineState &state) override;
+
+    using QPaintEngine::drawPolygon;
+    using QPaintEngine::drawRects;
+    void drawRects(const QRectF *rects, int rectCount) override;
+    void drawPath(const QPainterPath &path) override;
+    void drawPolygon(const QPointF *points, int pointCount, PolygonDrawMode mode) override;
+    void drawPixmap(const QRectF &r, const QPixmap &pm, const QRectF &sr) override;
+    void drawImage(const QRectF &r, const QImage &pm, const QRectF &sr,
+                   Qt::ImageConversionFlags flags = Qt::AutoColor) override;
+    void drawTextItem(const QPointF &p, const QTextItem &textItem) override;
+
+    PaintList paintList;
+
+private:
+    void addClip(const PaintClip &clip);
+    QSharedPointer<const PaintState> currentState();
+    QRect deviceRect(const QRectF &rect, bool stroked) const;
+    void addCommand(PaintCommand &command, const QRectF &rect, bool stroked);
+
+    QRect m_deviceRect;
+    PaintState m_state;
+    QSharedPointer<const PaintState> m_sharedState;
+};
+
+PaintRecorderEngine::PaintRecorderEngine(const QSize &size)
+    : QPaintEngine(AllFeatures)
+    , m_deviceRect(QPoint(0, 0), size)
+{
+}
+
+bool PaintRecorderEngine::begin(QPaintDevice *device)
+{
+    Q_UNUSED(device)
+    m_state = PaintState();
+    m_sharedState.reset();
+    return true;
+}
+
+bool PaintRecorderEngine::end()
+{
+    return true;
+}
+
+QPaintEngine::Type PaintRecorderEngine::type() const
+{
+    return User;
+}
+
+void PaintRecorderEngine::updateState(const QPaintEngineState &state)
+{
+    const DirtyFlags flags = state.state();
+
+    // The painter replays its clip history on restore() by updating the transform along
+    // with each clip, so the transform has to be applied first.
+    if (flags & DirtyTransform) {
+        m_state.transform = state.transform();
+    }
+    if (flags & DirtyClipRegion) {
+        PaintClip clip;
+        clip.transform = m_state.transform;
+        clip.operation = state.clipOperation();
+        clip.region = state.clipRegion();
+        addClip(clip);
+    }
+    if (flags & DirtyClipPath) {
+        PaintClip clip;
+        clip.transform = m_state.transform;
+        clip.operation = state.clipOperation();
+        clip.path = state.clipPath();
+        clip.isPath = true;
+        addClip(clip);
+    }
+    if (flags & DirtyClipEnabled) {
+        m_state.clipEnabled = state.isClipEnabled() && !m_state.clips.isEmpty();
+    }
+    if (flags & DirtyPen) {
+        m_state.pen = state.pen();
+    }
+    if (flags & DirtyBrush) {
+        m_state.brush = state.brush();
+    }
+    if (flags & DirtyBrushOrigin) {
+        m_state.brushOrigin = state.brushOrigin();
+    }
+    if (flags & DirtyBackground) {
+        m_state.background = state.backgroundBrush();
+    }
+    if (flags & DirtyBackgroundMode) {
+        m_state.backgroundMode = state.backgroundMode();
+    }
+    if (flags & DirtyFont) {
+        m_state.font = state.font();
+    }
+    if (flags & DirtyHints) {
+        m_state.renderHints = state.renderHints();
+    }
+    if (flags & DirtyCompositionMode) {
+        m_state.compositionMode = state.compositionMode();
+    }
+    if (flags & DirtyOpacity) {
+        m_state.opacity = state.opacity();
+    }
+
+    m_sharedState.reset();
+}
+
+void PaintRecorderEngine::addClip(const PaintClip &clip)
+{
+    switch (clip.operation) {
+    case Qt::NoClip:
+        m_state.clips.clear();
+        m_state.clipEnabled = false;
+        m_state.clipBoundingRect = QRect();
+        return;
+    case Qt::ReplaceClip:
+        m_state.clips.clear();
+        m_state.clipBoundingRect = m_deviceRect;
+        break;
+    case Qt::IntersectClip:
+        if (m_state.clips.isEmpty()) {
+            m_state.clipBoundingRect = m_deviceRect;
+        }
+        break;
+    }
+
+    const QRectF bounds = clip.isPath ? clip.path.boundingRect() : QRectF(clip.region.boundingRect());
+    m_state.clipBoundingRect &= clip.transform.mapRect(bounds).toAlignedRect();
+    m_state.clips.append(clip);
+    m_state.clipEnabled = true;
+}
+
+QSharedPointer<const PaintState> PaintRecorderEngine::currentState()
+{
+    // Consecutive commands usually share the same state.
+    if (!m_sharedState) {
+        m_sharedState = QSharedPointer<const PaintState>::create(m_state);
+    }
+    return m_sharedState;
+}
+
+QRect PaintRecorderEngine::deviceRect(const QRectF &rect, bool stroked) const
+{
+    QRectF bounds = rect;
+    int margin = 2; // antialiasing and smooth transformations may touch neighbouring pixels
+    if (stroked && m_state.pen.style() != Qt::NoPen) {
+        const qreal penWidth = std::max<qreal>(m_state.pen.widthF(), 1);
+        if (m_state.pen.isCosmetic()) {
+            margin += std::ceil(penWidth);
+        } else {
+            bounds.adjust(-penWidth, -penWidth, penWidth, penWidth);
+        }
+    }
+
+    QRect result = m_state.transform.mapRect(bounds).toAlignedRect().adjusted(-margin, -margin, margin, margin);
+    if (m_state.clipEnabled) {
+        result &= m_state.clipBoundingRect;
+    }
+    return result & m_deviceRect;
+}
+
+void PaintRecorderEngine::addCommand(PaintCommand &command, const QRectF &rect, bool stroked)
+{
+    command.boundingRect = deviceRect(rect, stroked);
+    if (command.boundingRect.isEmpty()) {
+        return;
+    }
+    command.state = currentState();
+    paintList.bounds += command.boundingRect;
+    paintList.commands.append(command);
+}
+
+void PaintRecorderEngine::drawRects(const QRectF *rects, int rectCount)
+{
+    PaintCommand command;
+    command.type = PaintCommand::Type::Rects;
+    command.rects.reserve(rectCount);
+
+    QRectF bounds;
+    for (int i = 0; i < rectCount; ++i) {
+        command.rects.append(rects[i]);
+        bounds |= rects[i].normalized();
+    }
+    addCommand(command, bounds, true);
+}
+
+void PaintRecorderEngine::drawPath(const QPainterPath &path)
+{
+    PaintCommand command;
+    command.type = PaintCommand::Type::Path;
+    command.path = path;
+    addCommand(command, path.controlPointRect(), true);
+}
+
+void PaintRecorderEngine::drawPolygon(const QPointF *points, int pointCount, PolygonDrawMode mode)
+{
+    PaintCommand command;
+    command.type = PaintCommand::Type::Polygon;
+    command.polygon = QPolygonF(pointCount);
+    std::copy(points, points + pointCount, command.polygon.begin());
+    command.polygonMode = mode;
+    addCommand(command, command.polygon.boundingRect(), true);
+}
+
+void PaintRecorderEngine::drawPixmap(const QRectF &r, const QPixmap &pm, const QRectF &sr)
+{
+    // Pixmaps can't be used on other threads, raster pixmaps convert to images cheaply.
+    drawImage(r, pm.toImage(), sr);
+}
+
+void PaintRecorderEngine::drawImage(const QRectF &r, const QImage &pm, const QRectF &sr,
+                                    Qt::ImageConversionFlags flags)
+{
+    PaintCommand command;
+    command.type = PaintCommand::Type::Image;
+    command.image = pm;
+    command.target = r;
+    command.source = sr;
+    command.flags = flags;
+    addCommand(command, r, false);
+}
+
+void PaintRecorderEngine::drawTextItem(const QPointF &p, const QTextItem &textItem)
+{
+    PaintCommand command;
+    command.type = PaintCommand::Type::Text;
+    command.target = QRectF(p, QSizeF());
+    command.text = textItem.text();
+    command.font = textItem.font();
+    if (textItem.renderFlags() & QTextItem::RightToLeft) {
+        command.textDirection = Qt::RightToLeft;
+    }
+    // Glyphs may reach beyond the advance of the text, e.g. in italic fonts.
+    const qreal overhang = textItem.ascent();
+    addCommand(command, QRectF(p.x() - overhang, p.y() - textItem.ascent(),
+                               textItem.width() + 2 * overhang, textItem.ascent() + textItem.descent()), true);
+}
+
+PaintRecorder::PaintRecorder(const QImage &target)
+    : m_engine(new PaintRecorderEngine(target.size()))
+    , m_size(target.size())
+    , m_depth(target.depth())
+    , m_dpiX(target.logicalDpiX())
+    , m_dpiY(target.logicalDpiY())
+    , m_physicalDpiX(target.physicalDpiX())
+    , m_physicalDpiY(target.physicalDpiY())
+    , m_devicePixelRatio(target.devicePixelRatioF())
+{
+}
+
+PaintRecorder::~PaintRecorder()
+{
+}
+
+QPaintEngine *PaintRecorder::paintEngine() const
+{
+    return m_engine.data();
+}
+
+PaintList PaintRecorder::paintList() const
+{
+    return m_engine->paintList;
+}
+
+int PaintRecorder::metric(PaintDeviceMetric metric) const
+{
+    switch (metric) {
+    case PdmWidth:
+        return m_size.width();
+    case PdmHeight:
+        return m_size.height();
+    case PdmWidthMM:
+        return qRound(m_size.width() * 25.4 / m_dpiX);
+    case PdmHeightMM:
+        return qRound(m_size.height() * 25.4 / m_dpiY);
+    case PdmNumColors:
+        return 0;
+    case PdmDepth:
+        return m_depth;
+    case PdmDpiX:
+        return m_dpiX;
+    case PdmDpiY:
+        return m_dpiY;
+    case PdmPhysicalDpiX:
+        return m_physicalDpiX;
+    case PdmPhysicalDpiY:
+        return m_physicalDpiY;
+    case PdmDevicePixelRatio:
+        return m_devicePixelRatio;
+    case PdmDevicePixelRatioScaled:
+        return m_devicePixelRatio * devicePixelRatioFScale();
+    default:
+        return QPaintDevice::metric(metric);
+    }
+}
+
+static void applyState(QPainter *painter, const PaintState &state, const QTransform &tileTransform)
+{
+    painter->setClipping(false);
+    if (state.clipEnabled) {
+        for (const PaintClip &clip : state.clips) {
+            painter->setTransform(clip.transform * tileTransform);
+            if (clip.isPath) {
+                painter->setClipPath(clip.path, clip.operation);
+            } else {
+                painter->setClipRegion(clip.region, clip.operation);
+            }
+        }
+    }
+    painter->setTransform(state.transform * tileTransform);
+
+    painter->setPen(state.pen);
+    painter->setBrush(state.brush);
+    painter->setBrushOrigin(state.brushOrigin);
+    painter->setBackground(state.background);
+    painter->setBackgroundMode(state.backgroundMode);
+    painter->setFont(state.font);
+    painter->setRenderHints(~state.renderHints, false);
+    painter->setRenderHints(state.renderHints, true);
+    painter->setCompositionMode(state.compositionMode);
+    painter->setOpacity(state.opacity);
+}
+
+static void rasterizeTile(const PaintList &paintList, uchar *bits, int bytesPerLine,
+                          QImage::Format format, int bytesPerPixel, const QRect &tile)
+{
+    // The tile refers to the memory of the target image, nothing is copied.
+    QImage image(bits + tile.y() * bytesPerLine + tile.x() * bytesPerPixel,
+                 tile.width(), tile.height(), bytesPerLine, format);
+    QPainter painter(&image);
+
+    const QTransform tileTransform = QTransform::fromTranslate(-tile.x(), -tile.y());
+    const PaintState *currentState = nullptr;
+
+    for (const PaintCommand &command : paintList.commands) {
+        if (!command.boundingRect.intersects(tile)) {
+            continue;
+        }
+        if (command.state.data() != currentState) {
+            currentState = command.state.data();
+            applyState(&painter, *currentState, tileTransform);
+        }
+
+        switch (command.type) {
+        case PaintCommand::Type::Image:
+            painter.drawImage(command.target, command.image, command.source, command.flags);
+            break;
+        case PaintCommand::Type::Rects:
+            painter.drawRects(command.rects.constData(), command.rects.count());
+            break;
+        case PaintCommand::Type::Path:
+            painter.drawPath(command.path);
+            break;
+        case PaintCommand::Type::Polygon:
+            switch (command.polygonMode) {
+            case QPaintEngine::OddEvenMode:
+                painter.drawPolygon(command.polygon, Qt::OddEvenFill);
+                break;
+            case QPaintEngine::WindingMode:
+                painter.drawPolygon(command.polygon, Qt::WindingFill);
+                break;
+            case QPaintEngine::ConvexMode:
+                painter.drawConvexPolygon(command.polygon);
+                break;
+            case QPaintEngine::PolylineMode:
+                painter.drawPolyline(command.polygon);
+                break;
+            }
+            break;
+        case PaintCommand::Type::Text:
+            painter.setFont(command.font);
+            painter.setLayoutDirection(command.textDirection);
+            painter.drawText(command.target.topLeft(), command.text);
+            painter.setFont(currentState->font);
+            break;
+        }
+    }
+}
+
+TiledRasterizer::TiledRasterizer(int threadCount)
+    : m_threadCount(std::max(threadCount, 1))
+{
+    // The calling thread rasterizes tiles as well.
+    m_threadPool.setMaxThreadCount(std::max(m_threadCount - 1, 1));
+}
+
+TiledRasterizer::~TiledRasterizer()
+{
+    m_threadPool.waitForDone();
+}
+
+int TiledRasterizer::threadCount() const
+{
+    return m_threadCount;
+}
+
+int TiledRasterizer::configuredThreadCount()
+{
+    bool ok = false;
+    const int threadCount = qEnvironmentVariableIntValue("KWIN_QPAINTER_THREADS", &ok);
+    if (!ok || threadCount < 0) {
+        return 0;
+    }
+    return threadCount;
+}
+
+void TiledRasterizer::rasterize(const PaintList &paintList, QImage *target)
+{
+    QVector<QRect> tiles;
+    for (int y = 0; y < target->height(); y += s_tileSize) {
+        for (int x = 0; x < target->width(); x += s_tileSize) {
+            const QRect tile = QRect(x, y, s_tileSize, s_tileSize) & target->rect();
+            if (paintList.bounds.intersects(tile)) {
+                tiles.append(tile);
+            }
+        }
+    }
+    if (tiles.isEmpty()) {
+        return;
+    }
+
+    // Detach the image before the workers write to it.
+    uchar *bits = target->bits();
+    const int bytesPerLine = target->bytesPerLine();
+    const QImage::Format format = target->format();
+    const int bytesPerPixel = target->depth() / 8;
+
+    std::atomic<int> nextTile(0);
+    auto work = [&]() {
+        for (int i = nextTile++; i < tiles.count(); i = nextTile++) {
+            rasterizeTile(paintList, bits, bytesPerLine, format, bytesPerPixel, tiles[i]);
+        }
+    };
+
+    const int helperCount = std::min(m_threadCount - 1, tiles.count() - 1);
+    for (int i = 0; i < helperCount; ++i) {
+        m_threadPool.start(QRunnable::create(work));
+    }
+    work();
+    m_threadPool.waitForDone();
+}
+
+} // namespace KWin
@@ -0,0 +1,183 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#ifndef KWIN_TILEDRASTERIZER_H
+#define KWIN_TILEDRASTERIZER_H
+
+#include <kwin_export.h>
+
+#include <QBrush>
+#include <QFont>
+#include <QImage>
+#include <QPaintDevice>
+#include <QPaintEngine>
+#include <QPainter>
+#include <QPainterPath>
+#include <QPen>
+#include <QRegion>
+#include <QSharedPointer>
+#include <QThreadPool>
+#include <QTransform>
+#include <QVector>
+
+namespace KWin
+{
+
+class PaintRecorderEngine;
+
+/**
+ * A clip operation, in the coordinate system that was active when it was issued.
+ */
+struct PaintClip
+{
+    QTransform transform;
+    Qt::ClipOperation operation = Qt::ReplaceClip;
+    QRegion region;
+    QPainterPath path;
+    bool isPath = false;
+};
+
+/**
+ * The state of the painter at the time a command was recorded.
+ */
+struct PaintState
+{
+    QTransform transform;
+    QVector<PaintClip> clips;
+    bool clipEnabled = false;
+    QRect clipBoundingRect;
+    QPen pen;
+    QBrush brush;
+    QPointF brushOrigin;
+    QBrush background;
+    Qt::BGMode backgroundMode = Qt::TransparentMode;
+    QFont font;
+    QPainter::RenderHints renderHints;
+    QPainter::CompositionMode compositionMode = QPainter::CompositionMode_SourceOver;
+    qreal opacity = 1.0;
+};
+
+struct PaintCommand
+{
+    enum class Type {
+        Image,
+        Rects,
+        Path,
+        Polygon,
+        Text,
+    };
+
+    Type type;
+    QSharedPointer<const PaintState> state;
+    QRect boundingRect;
+
+    QImage image;
+    QRectF target;
+    QRectF source;
+    Qt::ImageConversionFlags flags;
+
+    QVector<QRectF> rects;
+    QPainterPath path;
+    QPolygonF polygon;
+    QPaintEngine::PolygonDrawMode polygonMode = QPaintEngine::OddEvenMode;
+
+    // the baseline origin of the text is stored in target
+    QString text;
+    QFont font;
+    Qt::LayoutDirection textDirection = Qt::LeftToRight;
+};
+
+/**
+ * An immutable list of painting commands, along with the device area they cover.
+ */
+struct PaintList
+{
+    QVector<PaintCommand> commands;
+    QRegion bounds;
+};
+
+/**
+ * The PaintRecorder class is a paint device that records the commands issued on it instead
+ * of rasterizing them. The recorded commands can be rasterized later, possibly on several
+ * threads, with the TiledRasterizer.
+ *
+ * The recorder keeps references to the images painted on it, so they must not refer to
+ * memory that becomes invalid before the commands are rasterized.
+ *
+ * Text is recorded as strings and laid out again when it's rasterized, so it gets the same
+ * hinting and antialiasing as text rasterized directly.
+ */
+class KWIN_EXPORT PaintRecorder : public QPaintDevice
+{
+public:
+    /**
+     * Creates a recorder with the same size and metrics as the @a target image. No reference
+     * to the image is kept.
+     */
+    explicit PaintRecorder(const QImage &target);
+    ~PaintRecorder() override;
+
+    QPaintEngine *paintEngine() const override;
+
+    /**
+     * Returns the commands recorded so far.
+     */
+    PaintList paintList() const;
+
+protected:
+    int metric(PaintDeviceMetric metric) const override;
+
+private:
+    QScopedPointer<PaintRecorderEngine> m_engine;
+    QSize m_size;
+    int m_depth;
+    int m_dpiX;
+    int m_dpiY;
+    int m_physicalDpiX;
+    int m_physicalDpiY;
+    qreal m_devicePixelRatio;
+};
+
+/**
+ * The TiledRasterizer class splits an image into tiles and rasterizes a paint list into them
+ * on a pool of threads. Every tile is painted with its own painter, so the result is the same
+ * no matter how many threads are used.
+ */
+class KWIN_EXPORT TiledRasterizer
+{
+public:
+    /**
+     * Creates a rasterizer that uses up to @a threadCount threads, including the calling one.
+     */
+    explicit TiledRasterizer(int threadCount);
+    ~TiledRasterizer();
+
+    int threadCount() const;
+
+    /**
+     * Returns the number of threads configured with the KWIN_QPAINTER_THREADS environment
+     * variable, or 0 if the QPainter scene should rasterize directly on the main thread.
+     */
+    static int configuredThreadCount();
+
+    /**
+     * Rasterizes the @a paintList into the @a target image. This function returns once all
+     * tiles have been rasterized.
+     */
+    void rasterize(const PaintList &paintList, QImage *target);
+
+private:
+    static const int s_tileSize = 128;
+
+    QThreadPool m_threadPool;
+    int m_threadCount;
+};
+
+} // namespace KWin
+
+#endif
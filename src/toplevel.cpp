@@ -145,7 +145,12 @@ QRect Toplevel::visibleGeometry() const
 
 Xcb::Property Toplevel::fetchWmClientLeader() const
 {
-    return Xcb::Property(false, window(), atoms->wm_client_leader, XCB_ATOM_WINDOW, 0, 10000);
+    return fetchWmClientLeader(window());
+}
+
+Xcb::Property Toplevel::fetchWmClientLeader(xcb_window_t window)
+{
+    return Xcb::Property(false, window, atoms->wm_client_leader, XCB_ATOM_WINDOW, 0, 10000);
 }
 
 void Toplevel::readWmClientLeader(Xcb::Property &prop)
@@ -583,7 +588,12 @@ xcb_window_t Toplevel::frameId() const
 
 Xcb::Property Toplevel::fetchSkipCloseAnimation() const
 {
-    return Xcb::Property(false, window(), atoms->kde_skip_close_animation, XCB_ATOM_CARDINAL, 0, 1);
+    return fetchSkipCloseAnimation(window());
+}
+
+Xcb::Property Toplevel::fetchSkipCloseAnimation(xcb_window_t window)
+{
+    return Xcb::Property(false, window, atoms->kde_skip_close_animation, XCB_ATOM_CARDINAL, 0, 1);
 }
 
 void Toplevel::readSkipCloseAnimation(Xcb::Property &property)
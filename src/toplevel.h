@@ -577,6 +577,10 @@ public:
 Q_SIGNALS:
     void markedAsZombie();
     void opacityChanged(KWin::Toplevel* toplevel, qreal oldOpacity);
+    /**
+     * This signal is emitted when the contents of a surface of the Toplevel change. The
+     * @p damage is in global coordinates.
+     */
     void damaged(KWin::Toplevel* toplevel, const QRegion& damage);
     void inputTransformationChanged();
     /**
@@ -675,6 +679,7 @@ protected:
     virtual void clientMessageEvent(xcb_client_message_event_t *e);
     void discardWindowPixmap();
     Xcb::Property fetchWmClientLeader() const;
+    static Xcb::Property fetchWmClientLeader(xcb_window_t window);
     void readWmClientLeader(Xcb::Property &p);
     void getWmClientLeader();
     void getWmClientMachine();
@@ -693,6 +698,7 @@ protected:
     void getResourceClass();
     void setResourceClass(const QByteArray &name, const QByteArray &className = QByteArray());
     Xcb::Property fetchSkipCloseAnimation() const;
+    static Xcb::Property fetchSkipCloseAnimation(xcb_window_t window);
     void readSkipCloseAnimation(Xcb::Property &prop);
     void getSkipCloseAnimation();
     void copyToDeleted(Toplevel* c);
@@ -59,7 +59,10 @@
 #include <KLocalizedString>
 #include <KStartupInfo>
 // Qt
+#include <QElapsedTimer>
 #include <QtConcurrentRun>
+// std
+#include <memory>
 
 namespace KWin
 {
@@ -379,6 +382,9 @@ void Workspace::initializeX11()
         // Begin updates blocker block
         StackingUpdatesBlocker blocker(this);
 
+        QElapsedTimer adoptionTimer;
+        adoptionTimer.start();
+
         Xcb::Tree tree(rootWindow());
         xcb_window_t *wins = xcb_query_tree_children(tree.data());
 
@@ -391,6 +397,10 @@ void Workspace::initializeX11()
             windowGeometries[i] = Xcb::WindowGeometry(wins[i]);
         }
 
+        // The requests of all clients are sent before the first client gets managed, so that
+        // adopting the existing windows doesn't take one round trip after another
+        std::vector<std::unique_ptr<X11ClientPrefetch>> prefetches;
+
         // Get the replies
         for (int i = 0; i < tree->children_len; i++) {
             Xcb::WindowAttributes attr(windowAttributes.at(i));
@@ -405,15 +415,26 @@ void Workspace::initializeX11()
                     // ### This will request the attributes again
                     createUnmanaged(wins[i]);
             } else if (attr->map_state != XCB_MAP_STATE_UNMAPPED) {
+                // The properties are read long after they are requested, select the events of
+                // a managed client right away so that changes in between are not lost.
+                const uint32_t eventMask = X11Client::clientEventMask();
+                xcb_change_window_attributes(connection(), wins[i], XCB_CW_EVENT_MASK, &eventMask);
                 if (Application::wasCrash()) {
                     fixPositionAfterCrash(wins[i], windowGeometries.at(i).data());
+                    // The window has been moved, its geometry needs to be requested again
+                    prefetches.emplace_back(new X11ClientPrefetch(wins[i]));
+                } else {
+                    prefetches.emplace_back(new X11ClientPrefetch(attr, windowGeometries.at(i)));
                 }
-
-                // ### This will request the attributes again
-                createClient(wins[i], true);
+                prefetches.back()->fetchProperties();
             }
         }
 
+        for (const auto &prefetch : prefetches) {
+            createClient(*prefetch, true);
+        }
+        qCDebug(KWIN_CORE) << "Adopted" << prefetches.size() << "existing windows in" << adoptionTimer.elapsed() << "ms";
+
         // Propagate clients, will really happen at the end of the updates blocker block
         updateStackingOrder(true);
 
@@ -540,6 +561,12 @@ void Workspace::setupClientConnections(AbstractClient *c)
 }
 
 X11Client *Workspace::createClient(xcb_window_t w, bool is_mapped)
+{
+    X11ClientPrefetch prefetch(w);
+    return createClient(prefetch, is_mapped);
+}
+
+X11Client *Workspace::createClient(X11ClientPrefetch &prefetch, bool is_mapped)
 {
     StackingUpdatesBlocker blocker(this);
     X11Client *c = nullptr;
@@ -553,7 +580,7 @@ X11Client *Workspace::createClient(xcb_window_t w, bool is_mapped)
         connect(c, &X11Client::blockingCompositingChanged, compositor, &X11Compositor::updateClientCompositeBlocking);
     }
     connect(c, &X11Client::clientFullScreenSet, ScreenEdges::self(), &ScreenEdges::checkBlocking);
-    if (!c->manage(w, is_mapped)) {
+    if (!c->manage(prefetch, is_mapped)) {
         X11Client::deleteClient(c);
         return nullptr;
     }
@@ -578,6 +605,23 @@ Unmanaged* Workspace::createUnmanaged(xcb_window_t w)
     return c;
 }
 
+template <typename T>
+static void insertIntoIndex(QHash<xcb_window_t, T *> &index, xcb_window_t window, T *toplevel)
+{
+    if (window != XCB_WINDOW_NONE) {
+        index.insert(window, toplevel);
+    }
+}
+
+template <typename T>
+static void removeFromIndex(QHash<xcb_window_t, T *> &index, xcb_window_t window, T *toplevel)
+{
+    auto it = index.find(window);
+    if (it != index.end() && *it == toplevel) {
+        index.erase(it);
+    }
+}
+
 void Workspace::addClient(X11Client *c)
 {
     Group* grp = findGroup(c->window());
@@ -595,6 +639,11 @@ void Workspace::addClient(X11Client *c)
     }
     clients.append(c);
     m_allClients.append(c);
+    insertIntoIndex(m_clientIndex[int(Predicate::WindowMatch)], c->window(), c);
+    insertIntoIndex(m_clientIndex[int(Predicate::WrapperIdMatch)], c->wrapperId(), c);
+    insertIntoIndex(m_clientIndex[int(Predicate::FrameIdMatch)], c->frameId(), c);
+    insertIntoIndex(m_clientIndex[int(Predicate::InputIdMatch)], c->inputId(), c);
+    m_toplevelIndex.insert(c->internalId(), c);
     if (!unconstrained_stacking_order.contains(c))
         unconstrained_stacking_order.append(c);   // Raise if it hasn't got any stacking position yet
     if (!stacking_order.contains(c))    // It'll be updated later, and updateToolWindows() requires
@@ -619,6 +668,8 @@ void Workspace::addClient(X11Client *c)
 void Workspace::addUnmanaged(Unmanaged* c)
 {
     m_unmanaged.append(c);
+    insertIntoIndex(m_unmanagedIndex, c->window(), c);
+    m_toplevelIndex.insert(c->internalId(), c);
     markXStackingOrderAsDirty();
 }
 
@@ -644,6 +695,11 @@ void Workspace::removeClient(X11Client *c)
     // TODO: if marked client is removed, notify the marked list
     clients.removeAll(c);
     m_allClients.removeAll(c);
+    removeFromIndex(m_clientIndex[int(Predicate::WindowMatch)], c->window(), c);
+    removeFromIndex(m_clientIndex[int(Predicate::WrapperIdMatch)], c->wrapperId(), c);
+    removeFromIndex(m_clientIndex[int(Predicate::FrameIdMatch)], c->frameId(), c);
+    removeFromIndex(m_clientIndex[int(Predicate::InputIdMatch)], c->inputId(), c);
+    m_toplevelIndex.remove(c->internalId());
     markXStackingOrderAsDirty();
     attention_chain.removeAll(c);
     Group* group = findGroup(c->window());
@@ -671,10 +727,23 @@ void Workspace::removeUnmanaged(Unmanaged* c)
 {
     Q_ASSERT(m_unmanaged.contains(c));
     m_unmanaged.removeAll(c);
+    removeFromIndex(m_unmanagedIndex, c->window(), c);
+    m_toplevelIndex.remove(c->internalId());
     emit unmanagedRemoved(c);
     markXStackingOrderAsDirty();
 }
 
+void Workspace::updateClientIndex(X11Client *client, Predicate predicate, xcb_window_t oldWindow, xcb_window_t newWindow)
+{
+    // Clients that are still being managed are not known to the workspace yet.
+    if (m_clientIndex[int(Predicate::WindowMatch)].value(client->window()) != client) {
+        return;
+    }
+    QHash<xcb_window_t, X11Client *> &index = m_clientIndex[int(predicate)];
+    removeFromIndex(index, oldWindow, client);
+    insertIntoIndex(index, newWindow, client);
+}
+
 void Workspace::addDeleted(Deleted* c, Toplevel *orig)
 {
     Q_ASSERT(!deleted.contains(c));
@@ -732,6 +801,7 @@ void Workspace::addShellClient(AbstractClient *client)
         }
     }
     m_allClients.append(client);
+    m_toplevelIndex.insert(client->internalId(), client);
     if (!unconstrained_stacking_order.contains(client)) {
         unconstrained_stacking_order.append(client); // Raise if it hasn't got any stacking position yet
     }
@@ -768,6 +838,7 @@ void Workspace::removeShellClient(AbstractClient *client)
 {
     clientHidden(client);
     m_allClients.removeAll(client);
+    m_toplevelIndex.remove(client->internalId());
     if (client == most_recently_raised) {
         most_recently_raised = nullptr;
     }
@@ -1703,32 +1774,15 @@ Unmanaged *Workspace::findUnmanaged(std::function<bool (const Unmanaged*)> func)
 
 Unmanaged *Workspace::findUnmanaged(xcb_window_t w) const
 {
-    return findUnmanaged([w](const Unmanaged *u) {
-        return u->window() == w;
-    });
+    return m_unmanagedIndex.value(w);
 }
 
 X11Client *Workspace::findClient(Predicate predicate, xcb_window_t w) const
 {
-    switch (predicate) {
-    case Predicate::WindowMatch:
-        return findClient([w](const X11Client *c) {
-            return c->window() == w;
-        });
-    case Predicate::WrapperIdMatch:
-        return findClient([w](const X11Client *c) {
-            return c->wrapperId() == w;
-        });
-    case Predicate::FrameIdMatch:
-        return findClient([w](const X11Client *c) {
-            return c->frameId() == w;
-        });
-    case Predicate::InputIdMatch:
-        return findClient([w](const X11Client *c) {
-            return c->inputId() == w;
-        });
+    if (w == XCB_WINDOW_NONE) {
+        return nullptr;
     }
-    return nullptr;
+    return m_clientIndex[int(predicate)].value(w);
 }
 
 Toplevel *Workspace::findToplevel(std::function<bool (const Toplevel*)> func) const
@@ -1747,9 +1801,7 @@ Toplevel *Workspace::findToplevel(std::function<bool (const Toplevel*)> func) co
 
 Toplevel *Workspace::findToplevel(const QUuid &internalId) const
 {
-    return findToplevel([internalId] (const KWin::Toplevel* l) -> bool {
-        return internalId == l->internalId();
-    });
+    return m_toplevelIndex.value(internalId);
 }
 
 void Workspace::forEachToplevel(std::function<void (Toplevel *)> func)
@@ -1834,6 +1886,7 @@ void Workspace::updateTabbox()
 void Workspace::addInternalClient(InternalClient *client)
 {
     m_internalClients.append(client);
+    m_toplevelIndex.insert(client->internalId(), client);
 
     setupClientConnections(client);
     client->updateLayer();
@@ -1853,6 +1906,7 @@ void Workspace::addInternalClient(InternalClient *client)
 void Workspace::removeInternalClient(InternalClient *client)
 {
     m_internalClients.removeOne(client);
+    m_toplevelIndex.remove(client->internalId());
 
     markXStackingOrderAsDirty();
     updateStackingOrder(true);
@@ -18,7 +18,9 @@
 #include "sm.h"
 #include "utils.h"
 // Qt
+#include <QHash>
 #include <QTimer>
+#include <QUuid>
 #include <QVector>
 // std
 #include <functional>
@@ -53,6 +55,7 @@ class Toplevel;
 class Unmanaged;
 class UserActionsMenu;
 class X11Client;
+class X11ClientPrefetch;
 class X11EventFilter;
 enum class Predicate;
 
@@ -318,6 +321,11 @@ public:
     bool showingDesktop() const;
 
     void removeClient(X11Client *);   // Only called from X11Client::destroyClient() or X11Client::releaseWindow()
+    /**
+     * Keeps the window id index used by findClient(Predicate, xcb_window_t) up to date when
+     * the window of the managed @p client that is matched by @p predicate has been replaced.
+     */
+    void updateClientIndex(X11Client *client, Predicate predicate, xcb_window_t oldWindow, xcb_window_t newWindow);
     void setActiveClient(AbstractClient*);
     Group* findGroup(xcb_window_t leader) const;
     void addGroup(Group* group);
@@ -545,6 +553,7 @@ private:
 
     /// This is the right way to create a new client
     X11Client *createClient(xcb_window_t w, bool is_mapped);
+    X11Client *createClient(X11ClientPrefetch &prefetch, bool is_mapped);
     void setupClientConnections(AbstractClient *client);
     void addClient(X11Client *c);
     Unmanaged* createUnmanaged(xcb_window_t w);
@@ -590,6 +599,11 @@ private:
     QList<Deleted *> deleted;
     QList<InternalClient *> m_internalClients;
 
+    // Lookup tables for the find functions, the client indices are indexed by Predicate.
+    QHash<xcb_window_t, X11Client *> m_clientIndex[4];
+    QHash<xcb_window_t, Unmanaged *> m_unmanagedIndex;
+    QHash<QUuid, Toplevel *> m_toplevelIndex;
+
     QList<Toplevel *> unconstrained_stacking_order; // Topmost last
     QList<Toplevel *> stacking_order; // Topmost last
     QVector<xcb_window_t> manual_overlays; //Topmost last
@@ -294,17 +294,63 @@ void X11Client::destroyClient()
     deleteClient(this);
 }
 
+/**
+ * Sends the requests for everything manage() needs to know about the @p window.
+ */
+X11ClientPrefetch::X11ClientPrefetch(xcb_window_t window)
+    : window(window)
+    , attributes(window)
+    , geometry(window)
+    , motifHints(atoms->motif_wm_hints)
+{
+}
+
+X11ClientPrefetch::X11ClientPrefetch(const Xcb::WindowAttributes &attributes, const Xcb::WindowGeometry &geometry)
+    : window(attributes.window())
+    , attributes(attributes)
+    , geometry(geometry)
+    , motifHints(atoms->motif_wm_hints)
+{
+}
+
+void X11ClientPrefetch::fetchProperties()
+{
+    if (m_propertiesFetched) {
+        return;
+    }
+    m_propertiesFetched = true;
+
+    geometryHints.init(window);
+    motifHints.init(window);
+    wmClientLeader = X11Client::fetchWmClientLeader(window);
+    skipCloseAnimation = X11Client::fetchSkipCloseAnimation(window);
+    showOnScreenEdge = X11Client::fetchShowOnScreenEdge(window);
+    preferredColorScheme = X11Client::fetchPreferredColorScheme(window);
+    firstInTabBox = X11Client::fetchFirstInTabBox(window);
+    transient = X11Client::fetchTransient(window);
+    activities = X11Client::fetchActivities(window);
+    applicationMenuServiceName = X11Client::fetchApplicationMenuServiceName(window);
+    applicationMenuObjectPath = X11Client::fetchApplicationMenuObjectPath(window);
+    syncRequestCounter = X11Client::fetchSyncCounter(window);
+}
+
 /**
  * Manages the clients. This means handling the very first maprequest:
  * reparenting, initial geometry, initial state, placement, etc.
  * Returns false if KWin is not going to manage this window.
  */
 bool X11Client::manage(xcb_window_t w, bool isMapped)
+{
+    X11ClientPrefetch prefetch(w);
+    return manage(prefetch, isMapped);
+}
+
+bool X11Client::manage(X11ClientPrefetch &prefetch, bool isMapped)
 {
     StackingUpdatesBlocker stacking_blocker(workspace());
 
-    Xcb::WindowAttributes attr(w);
-    Xcb::WindowGeometry windowGeometry(w);
+    Xcb::WindowAttributes &attr = prefetch.attributes;
+    Xcb::WindowGeometry &windowGeometry = prefetch.geometry;
     if (attr.isNull() || windowGeometry.isNull()) {
         return false;
     }
@@ -313,7 +359,9 @@ bool X11Client::manage(xcb_window_t w, bool isMapped)
     blockGeometryUpdates();
     setPendingGeometryUpdate(PendingGeometryForced); // Force update when finishing with geometry changes
 
-    embedClient(w, attr->visual, attr->colormap, windowGeometry->depth);
+    embedClient(prefetch.window, attr->visual, attr->colormap, windowGeometry->depth);
+    // Property changes are selected from now on, unless they have been selected already
+    prefetch.fetchProperties();
 
     m_visual = attr->visual;
     bit_depth = windowGeometry->depth;
@@ -350,18 +398,18 @@ bool X11Client::manage(xcb_window_t w, bool isMapped)
         NET::WM2DesktopFileName |
         NET::WM2GTKFrameExtents;
 
-    auto wmClientLeaderCookie = fetchWmClientLeader();
-    auto skipCloseAnimationCookie = fetchSkipCloseAnimation();
-    auto showOnScreenEdgeCookie = fetchShowOnScreenEdge();
-    auto colorSchemeCookie = fetchPreferredColorScheme();
-    auto firstInTabBoxCookie = fetchFirstInTabBox();
-    auto transientCookie = fetchTransient();
-    auto activitiesCookie = fetchActivities();
-    auto applicationMenuServiceNameCookie = fetchApplicationMenuServiceName();
-    auto applicationMenuObjectPathCookie = fetchApplicationMenuObjectPath();
-
-    m_geometryHints.init(window());
-    m_motif.init(window());
+    auto &wmClientLeaderCookie = prefetch.wmClientLeader;
+    auto &skipCloseAnimationCookie = prefetch.skipCloseAnimation;
+    auto &showOnScreenEdgeCookie = prefetch.showOnScreenEdge;
+    auto &colorSchemeCookie = prefetch.preferredColorScheme;
+    auto &firstInTabBoxCookie = prefetch.firstInTabBox;
+    auto &transientCookie = prefetch.transient;
+    auto &activitiesCookie = prefetch.activities;
+    auto &applicationMenuServiceNameCookie = prefetch.applicationMenuServiceName;
+    auto &applicationMenuObjectPathCookie = prefetch.applicationMenuObjectPath;
+
+    m_geometryHints = prefetch.geometryHints;
+    m_motif = prefetch.motifHints;
     info = new WinInfo(this, m_client, rootWindow(), properties, properties2);
 
     if (isDesktop() && bit_depth == 32) {
@@ -377,7 +425,7 @@ bool X11Client::manage(xcb_window_t w, bool isMapped)
     getResourceClass();
     readWmClientLeader(wmClientLeaderCookie);
     getWmClientMachine();
-    getSyncCounter();
+    getSyncCounter(prefetch.syncRequestCounter);
     // First only read the caption text, so that setupWindowRules() can use it for matching,
     // and only then really set the caption using setCaption(), which checks for duplicates etc.
     // and also relies on rules already existing
@@ -875,6 +923,14 @@ bool X11Client::manage(xcb_window_t w, bool isMapped)
 }
 
 // Called only from manage()
+uint32_t X11Client::clientEventMask()
+{
+    return XCB_EVENT_MASK_FOCUS_CHANGE | XCB_EVENT_MASK_PROPERTY_CHANGE |
+           XCB_EVENT_MASK_COLOR_MAP_CHANGE |
+           XCB_EVENT_MASK_ENTER_WINDOW | XCB_EVENT_MASK_LEAVE_WINDOW |
+           XCB_EVENT_MASK_KEY_PRESS | XCB_EVENT_MASK_KEY_RELEASE;
+}
+
 void X11Client::embedClient(xcb_window_t w, xcb_visualid_t visualid, xcb_colormap_t colormap, uint8_t depth)
 {
     Q_ASSERT(m_client == XCB_WINDOW_NONE);
@@ -889,7 +945,8 @@ void X11Client::embedClient(xcb_window_t w, xcb_visualid_t visualid, xcb_colorma
     // We don't want the window to be destroyed when we quit
     xcb_change_save_set(conn, XCB_SET_MODE_INSERT, m_client);
 
-    m_client.selectInput(zero_value);
+    // Property changes are still selected, the properties may have been requested already
+    m_client.selectInput(XCB_EVENT_MASK_PROPERTY_CHANGE);
     m_client.unmap();
     m_client.setBorderWidth(zero_value);
 
@@ -916,10 +973,7 @@ void X11Client::embedClient(xcb_window_t w, xcb_visualid_t visualid, xcb_colorma
     const uint32_t frame_event_mask   = common_event_mask | XCB_EVENT_MASK_PROPERTY_CHANGE | XCB_EVENT_MASK_VISIBILITY_CHANGE;
     const uint32_t wrapper_event_mask = common_event_mask | XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY;
 
-    const uint32_t client_event_mask = XCB_EVENT_MASK_FOCUS_CHANGE | XCB_EVENT_MASK_PROPERTY_CHANGE |
-                                       XCB_EVENT_MASK_COLOR_MAP_CHANGE |
-                                       XCB_EVENT_MASK_ENTER_WINDOW | XCB_EVENT_MASK_LEAVE_WINDOW |
-                                       XCB_EVENT_MASK_KEY_PRESS | XCB_EVENT_MASK_KEY_RELEASE;
+    const uint32_t client_event_mask = clientEventMask();
 
     // Create the frame window
     xcb_window_t frame = xcb_generate_id(conn);
@@ -970,6 +1024,7 @@ void X11Client::updateInputWindow()
     }
 
     if (region.isEmpty()) {
+        workspace()->updateClientIndex(this, Predicate::InputIdMatch, m_decoInputExtent, XCB_WINDOW_NONE);
         m_decoInputExtent.reset();
         return;
     }
@@ -993,6 +1048,7 @@ void X11Client::updateInputWindow()
             XCB_EVENT_MASK_POINTER_MOTION
         };
         m_decoInputExtent.create(bounds, XCB_WINDOW_CLASS_INPUT_ONLY, mask, values);
+        workspace()->updateClientIndex(this, Predicate::InputIdMatch, XCB_WINDOW_NONE, m_decoInputExtent);
         if (mapping_state == Mapped)
             m_decoInputExtent.map();
     } else {
@@ -1082,6 +1138,7 @@ void X11Client::destroyDecoration()
             emit geometryShapeChanged(this, oldgeom);
         }
     }
+    workspace()->updateClientIndex(this, Predicate::InputIdMatch, m_decoInputExtent, XCB_WINDOW_NONE);
     m_decoInputExtent.reset();
 }
 
@@ -2185,15 +2242,19 @@ bool X11Client::wantsSyncCounter() const
     return true;
 }
 
-void X11Client::getSyncCounter()
+Xcb::Property X11Client::fetchSyncCounter(xcb_window_t window)
+{
+    return Xcb::Property(false, window, atoms->net_wm_sync_request_counter, XCB_ATOM_CARDINAL, 0, 1);
+}
+
+void X11Client::getSyncCounter(Xcb::Property &property)
 {
     if (!Xcb::Extensions::self()->isSyncAvailable())
         return;
     if (!wantsSyncCounter())
         return;
 
-    Xcb::Property syncProp(false, window(), atoms->net_wm_sync_request_counter, XCB_ATOM_CARDINAL, 0, 1);
-    const xcb_sync_counter_t counter = syncProp.value<xcb_sync_counter_t>(XCB_NONE);
+    const xcb_sync_counter_t counter = property.value<xcb_sync_counter_t>(XCB_NONE);
     if (counter != XCB_NONE) {
         m_syncRequest.counter = counter;
         m_syncRequest.value.hi = 0;
@@ -2344,10 +2405,16 @@ void X11Client::updateAllowedActions(bool force)
 }
 
 Xcb::StringProperty X11Client::fetchActivities() const
+{
+    return fetchActivities(window());
+}
+
+Xcb::StringProperty X11Client::fetchActivities(xcb_window_t window)
 {
 #ifdef KWIN_BUILD_ACTIVITIES
-    return Xcb::StringProperty(window(), atoms->activities);
+    return Xcb::StringProperty(window, atoms->activities);
 #else
+    Q_UNUSED(window)
     return Xcb::StringProperty();
 #endif
 }
@@ -2423,7 +2490,12 @@ void X11Client::setSessionActivityOverride(bool needed)
 
 Xcb::Property X11Client::fetchFirstInTabBox() const
 {
-    return Xcb::Property(false, m_client, atoms->kde_first_in_window_list,
+    return fetchFirstInTabBox(window());
+}
+
+Xcb::Property X11Client::fetchFirstInTabBox(xcb_window_t window)
+{
+    return Xcb::Property(false, window, atoms->kde_first_in_window_list,
                          atoms->kde_first_in_window_list, 0, 1);
 }
 
@@ -2441,7 +2513,12 @@ void X11Client::updateFirstInTabBox()
 
 Xcb::StringProperty X11Client::fetchPreferredColorScheme() const
 {
-    return Xcb::StringProperty(m_client, atoms->kde_color_sheme);
+    return fetchPreferredColorScheme(window());
+}
+
+Xcb::StringProperty X11Client::fetchPreferredColorScheme(xcb_window_t window)
+{
+    return Xcb::StringProperty(window, atoms->kde_color_sheme);
 }
 
 QString X11Client::readPreferredColorScheme(Xcb::StringProperty &property) const
@@ -2588,7 +2665,12 @@ QMatrix4x4 X11Client::inputTransformation() const
 
 Xcb::Property X11Client::fetchShowOnScreenEdge() const
 {
-    return Xcb::Property(false, window(), atoms->kde_screen_edge_show, XCB_ATOM_CARDINAL, 0, 1);
+    return fetchShowOnScreenEdge(window());
+}
+
+Xcb::Property X11Client::fetchShowOnScreenEdge(xcb_window_t window)
+{
+    return Xcb::Property(false, window, atoms->kde_screen_edge_show, XCB_ATOM_CARDINAL, 0, 1);
 }
 
 void X11Client::readShowOnScreenEdge(Xcb::Property &property)
@@ -2688,7 +2770,12 @@ QSize X11Client::resizeIncrements() const
 
 Xcb::StringProperty X11Client::fetchApplicationMenuServiceName() const
 {
-    return Xcb::StringProperty(m_client, atoms->kde_net_wm_appmenu_service_name);
+    return fetchApplicationMenuServiceName(window());
+}
+
+Xcb::StringProperty X11Client::fetchApplicationMenuServiceName(xcb_window_t window)
+{
+    return Xcb::StringProperty(window, atoms->kde_net_wm_appmenu_service_name);
 }
 
 void X11Client::readApplicationMenuServiceName(Xcb::StringProperty &property)
@@ -2704,7 +2791,12 @@ void X11Client::checkApplicationMenuServiceName()
 
 Xcb::StringProperty X11Client::fetchApplicationMenuObjectPath() const
 {
-    return Xcb::StringProperty(m_client, atoms->kde_net_wm_appmenu_object_path);
+    return fetchApplicationMenuObjectPath(window());
+}
+
+Xcb::StringProperty X11Client::fetchApplicationMenuObjectPath(xcb_window_t window)
+{
+    return Xcb::StringProperty(window, atoms->kde_net_wm_appmenu_object_path);
 }
 
 void X11Client::readApplicationMenuObjectPath(Xcb::StringProperty &property)
@@ -2916,7 +3008,12 @@ bool X11Client::sameAppWindowRoleMatch(const X11Client *c1, const X11Client *c2,
 
 Xcb::TransientFor X11Client::fetchTransient() const
 {
-    return Xcb::TransientFor(window());
+    return fetchTransient(window());
+}
+
+Xcb::TransientFor X11Client::fetchTransient(xcb_window_t window)
+{
+    return Xcb::TransientFor(window);
 }
 
 void X11Client::readTransientProperty(Xcb::TransientFor &transientFor)
@@ -33,6 +33,51 @@ class KStartupInfoId;
 namespace KWin
 {
 
+/**
+ * @brief The requests X11Client::manage() needs answered to manage a window.
+ *
+ * The attributes and the geometry are requested when the object is constructed, the properties
+ * with fetchProperties(). The replies are only waited for when the window gets managed. This
+ * allows to send the requests for many windows at once, e.g. when adopting the existing windows
+ * at startup, and to wait for all replies in a single round trip.
+ */
+class X11ClientPrefetch
+{
+public:
+    explicit X11ClientPrefetch(xcb_window_t window);
+    /**
+     * Takes over the already requested @a attributes and @a geometry of the window.
+     */
+    X11ClientPrefetch(const Xcb::WindowAttributes &attributes, const Xcb::WindowGeometry &geometry);
+
+    /**
+     * Requests the properties of the window, unless they have been requested already. The
+     * caller must have selected property changes on the window, otherwise changes between
+     * the request and the time the window gets managed are lost.
+     */
+    void fetchProperties();
+
+    xcb_window_t window;
+    Xcb::WindowAttributes attributes;
+    Xcb::WindowGeometry geometry;
+    Xcb::GeometryHints geometryHints;
+    Xcb::MotifHints motifHints;
+    Xcb::Property wmClientLeader;
+    Xcb::Property skipCloseAnimation;
+    Xcb::Property showOnScreenEdge;
+    Xcb::StringProperty preferredColorScheme;
+    Xcb::Property firstInTabBox;
+    Xcb::TransientFor transient;
+    Xcb::StringProperty activities;
+    Xcb::StringProperty applicationMenuServiceName;
+    Xcb::StringProperty applicationMenuObjectPath;
+    Xcb::Property syncRequestCounter;
+
+private:
+    bool m_propertiesFetched = false;
+
+    Q_DISABLE_COPY(X11ClientPrefetch)
+};
 
 /**
  * @brief Defines Predicates on how to search for a Client.
@@ -118,6 +163,13 @@ public:
     NET::WindowType windowType(bool direct = false, int supported_types = 0) const override;
 
     bool manage(xcb_window_t w, bool isMapped);
+    bool manage(X11ClientPrefetch &prefetch, bool isMapped);
+
+    /**
+     * Returns the events selected on the windows of managed clients.
+     */
+    static uint32_t clientEventMask();
+
     void releaseWindow(bool on_shutdown = false);
     void destroyClient() override;
 
@@ -248,9 +300,11 @@ public:
     void layoutDecorationRects(QRect &left, QRect &top, QRect &right, QRect &bottom) const override;
 
     Xcb::Property fetchFirstInTabBox() const;
+    static Xcb::Property fetchFirstInTabBox(xcb_window_t window);
     void readFirstInTabBox(Xcb::Property &property);
     void updateFirstInTabBox();
     Xcb::StringProperty fetchPreferredColorScheme() const;
+    static Xcb::StringProperty fetchPreferredColorScheme(xcb_window_t window);
     QString readPreferredColorScheme(Xcb::StringProperty &property) const;
     QString preferredColorScheme() const override;
 
@@ -267,10 +321,12 @@ public:
     void showOnScreenEdge() override;
 
     Xcb::StringProperty fetchApplicationMenuServiceName() const;
+    static Xcb::StringProperty fetchApplicationMenuServiceName(xcb_window_t window);
     void readApplicationMenuServiceName(Xcb::StringProperty &property);
     void checkApplicationMenuServiceName();
 
     Xcb::StringProperty fetchApplicationMenuObjectPath() const;
+    static Xcb::StringProperty fetchApplicationMenuObjectPath(xcb_window_t window);
     void readApplicationMenuObjectPath(Xcb::StringProperty &property);
     void checkApplicationMenuObjectPath();
 
@@ -382,7 +438,8 @@ private:
     void configureRequest(int value_mask, int rx, int ry, int rw, int rh, int gravity, bool from_tool);
     NETExtendedStrut strut() const;
     int checkShadeGeometry(int w, int h);
-    void getSyncCounter();
+    static Xcb::Property fetchSyncCounter(xcb_window_t window);
+    void getSyncCounter(Xcb::Property &property);
     void sendSyncRequest();
     void leaveMoveResize() override;
     void positionGeometryTip() override;
@@ -422,6 +479,7 @@ private:
     void updateInputWindow();
 
     Xcb::Property fetchShowOnScreenEdge() const;
+    static Xcb::Property fetchShowOnScreenEdge(xcb_window_t window);
     void readShowOnScreenEdge(Xcb::Property &property);
     /**
      * Reads the property and creates/destroys the screen edge if required
@@ -450,6 +508,7 @@ private:
     MappingState mapping_state;
 
     Xcb::TransientFor fetchTransient() const;
+    static Xcb::TransientFor fetchTransient(xcb_window_t window);
     void readTransientProperty(Xcb::TransientFor &transientFor);
     void readTransient();
     xcb_window_t verifyTransientFor(xcb_window_t transient_for, bool set);
@@ -489,10 +548,12 @@ private:
     static bool check_active_modal; ///< \see X11Client::checkActiveModal()
     int sm_stacking_order;
     friend struct ResetupRulesProcedure;
+    friend class X11ClientPrefetch;
 
     friend bool performTransiencyCheck();
 
     Xcb::StringProperty fetchActivities() const;
+    static Xcb::StringProperty fetchActivities(xcb_window_t window);
     void readActivities(Xcb::StringProperty &property);
     void checkActivities();
     bool activitiesDefined; //whether the x property was actually set
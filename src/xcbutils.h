@@ -843,6 +843,7 @@ public:
 class TransientFor : public Property
 {
 public:
+    TransientFor() = default;
     explicit TransientFor(WindowId window)
         : Property(0, window, XCB_ATOM_WM_TRANSIENT_FOR, XCB_ATOM_WINDOW, 0, 1)
     {
@@ -7,8 +7,19 @@
 #include "xcursortheme.h"
 #include "3rdparty/xcursor.h"
 
-#include <QMap>
+#include <QCache>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QSaveFile>
 #include <QSharedData>
+#include <QStandardPaths>
+#include <QtConcurrentRun>
+
+#include <memory>
 
 namespace KWin
 {
@@ -24,8 +35,10 @@ public:
 class KXcursorThemePrivate : public QSharedData
 {
 public:
-    QMap<QByteArray, QVector<KXcursorSprite>> registry;
+    // maps cursor names to cursor files, the files are loaded when the cursor is used
+    QHash<QByteArray, QString> registry;
     qreal devicePixelRatio = 1;
+    int size = 0;
 };
 
 KXcursorSprite::KXcursorSprite()
@@ -72,11 +85,138 @@ std::chrono::milliseconds KXcursorSprite::delay() const
     return d->delay;
 }
 
-static void load_callback(XcursorImages *images, void *data)
+// Decoded cursors are shared by all themes, regardless of the scale they have been loaded for.
+// The cost of a cursor is the size of its images.
+using KXcursorSpriteCache = QCache<QString, QVector<KXcursorSprite>>;
+Q_GLOBAL_STATIC_WITH_ARGS(KXcursorSpriteCache, s_spriteCache, (8 * 1024 * 1024))
+
+static const quint32 s_diskCacheMagic = 0x4b584343; // "KXCC"
+static const quint32 s_diskCacheVersion = 1;
+static const int s_diskCacheHeaderSize = 3;
+static const int s_diskCacheSpriteSize = 5;
+static const qint64 s_diskCacheMaximumSize = 32 * 1024 * 1024;
+
+static QString diskCacheDirectory()
 {
-    KXcursorThemePrivate *themePrivate = static_cast<KXcursorThemePrivate *>(data);
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QLatin1String("/kwin/xcursor/");
+}
+
+static QString diskCacheFileName(const QString &key)
+{
+    if (qEnvironmentVariableIsSet("KWIN_XCURSOR_NO_DISK_CACHE")) {
+        return QString();
+    }
+    const QString directory = diskCacheDirectory();
+    if (!QDir().mkpath(directory)) {
+        return QString();
+    }
+    return directory + QString::fromLatin1(QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex());
+}
+
+static void releaseDiskCacheMapping(void *file)
+{
+    delete static_cast<std::shared_ptr<QFile> *>(file);
+}
+
+/**
+ * The disk cache stores the premultiplied sprites of a cursor as they are in memory. Images of
+ * cached cursors point right into the mapped file, so the pixels needn't be decoded again and
+ * can be paged out by the kernel. The mapping is private, writing to an image doesn't change
+ * the file.
+ */
+static QVector<KXcursorSprite> mapDiskCache(const QString &fileName)
+{
+    auto file = std::make_shared<QFile>(fileName);
+    if (!file->open(QIODevice::ReadOnly)) {
+        return {};
+    }
+    const qint64 fileSize = file->size();
+    if (fileSize < qint64(s_diskCacheHeaderSize * sizeof(quint32))) {
+        return {};
+    }
+    uchar *address = file->map(0, fileSize, QFileDevice::MapPrivateOption);
+    if (!address) {
+        return {};
+    }
+    // The files that have been used most recently are kept when the cache is pruned.
+    file->setFileTime(QDateTime::currentDateTimeUtc(), QFileDevice::FileModificationTime);
+
+    const quint32 *header = reinterpret_cast<const quint32 *>(address);
+    if (header[0] != s_diskCacheMagic || header[1] != s_diskCacheVersion) {
+        return {};
+    }
+    const quint32 count = header[2];
+    qint64 offset = (s_diskCacheHeaderSize + qint64(count) * s_diskCacheSpriteSize) * sizeof(quint32);
+    if (offset > fileSize) {
+        return {};
+    }
+
     QVector<KXcursorSprite> sprites;
+    for (quint32 i = 0; i < count; ++i) {
+        const quint32 *info = header + s_diskCacheHeaderSize + i * s_diskCacheSpriteSize;
+        const quint32 width = info[0];
+        const quint32 height = info[1];
+        const qint64 length = qint64(width) * height * sizeof(quint32);
+        if (!width || !height || offset + length > fileSize) {
+            return {};
+        }
+        const QImage data(address + offset, width, height, width * sizeof(quint32),
+                          QImage::Format_ARGB32_Premultiplied,
+                          releaseDiskCacheMapping, new std::shared_ptr<QFile>(file));
+        sprites.append(KXcursorSprite(data, QPoint(info[2], info[3]), std::chrono::milliseconds(info[4])));
+        offset += length;
+    }
+    return sprites;
+}
+
+/**
+ * Removes the least recently used files until the disk cache fits in s_diskCacheMaximumSize.
+ */
+static void pruneDiskCache()
+{
+    const QFileInfoList files = QDir(diskCacheDirectory()).entryInfoList(QDir::Files, QDir::Time);
+    qint64 size = 0;
+    for (const QFileInfo &fileInfo : files) {
+        size += fileInfo.size();
+        if (size > s_diskCacheMaximumSize) {
+            QFile::remove(fileInfo.filePath());
+        }
+    }
+}
+
+/**
+ * Stores the @a sprites in the disk cache. This runs in a worker thread, the sprites share
+ * their pixels with the main thread but are only read.
+ */
+static void writeDiskCache(const QString &fileName, const QVector<KXcursorSprite> &sprites)
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return;
+    }
+
+    QVector<quint32> header{s_diskCacheMagic, s_diskCacheVersion, quint32(sprites.count())};
+    for (const KXcursorSprite &sprite : sprites) {
+        header << sprite.data().width() << sprite.data().height()
+               << sprite.hotspot().x() << sprite.hotspot().y() << quint32(sprite.delay().count());
+    }
+    file.write(reinterpret_cast<const char *>(header.constData()), header.count() * sizeof(quint32));
+    for (const KXcursorSprite &sprite : sprites) {
+        file.write(reinterpret_cast<const char *>(sprite.data().constBits()), sprite.data().sizeInBytes());
+    }
+    if (file.commit()) {
+        pruneDiskCache();
+    }
+}
 
+static QVector<KXcursorSprite> decodeSprites(const QString &fileName, int size)
+{
+    XcursorImages *images = XcursorFilenameLoadImages(QFile::encodeName(fileName), size);
+    if (!images) {
+        return {};
+    }
+
+    QVector<KXcursorSprite> sprites;
     for (int i = 0; i < images->nimage; ++i) {
         const XcursorImage *nativeCursorImage = images->images[i];
         const QPoint hotspot(nativeCursorImage->xhot, nativeCursorImage->yhot);
@@ -85,11 +225,81 @@ static void load_callback(XcursorImages *images, void *data)
         QImage data(nativeCursorImage->width, nativeCursorImage->height, QImage::Format_ARGB32_Premultiplied);
         memcpy(data.bits(), nativeCursorImage->pixels, data.sizeInBytes());
 
-        sprites.append(KXcursorSprite(data, hotspot / themePrivate->devicePixelRatio, delay));
+        sprites.append(KXcursorSprite(data, hotspot, delay));
     }
 
-    themePrivate->registry.insert(images->name, sprites);
     XcursorImagesDestroy(images);
+    return sprites;
+}
+
+/**
+ * Returns the sprites of the cursor file @a fileName with the given @a size. The hotspots are in
+ * device pixels.
+ */
+static QVector<KXcursorSprite> loadSprites(const QString &fileName, int size)
+{
+    // Cursor themes alias shapes with symbolic links, they share the sprites.
+    const QFileInfo fileInfo(fileName);
+    const QString key = fileInfo.canonicalFilePath() + QLatin1Char(':') + QString::number(size)
+        + QLatin1Char(':') + QString::number(fileInfo.lastModified().toMSecsSinceEpoch());
+
+    if (const QVector<KXcursorSprite> *sprites = s_spriteCache->object(key)) {
+        return *sprites;
+    }
+
+    const QString diskCacheFile = diskCacheFileName(key);
+    QVector<KXcursorSprite> sprites;
+    if (!diskCacheFile.isEmpty()) {
+        sprites = mapDiskCache(diskCacheFile);
+    }
+    if (sprites.isEmpty()) {
+        sprites = decodeSprites(fileName, size);
+        if (sprites.isEmpty()) {
+            return {};
+        }
+        if (!diskCacheFile.isEmpty()) {
+            // QSaveFile syncs the file to the disk, that mustn't block the compositor.
+            QtConcurrent::run(writeDiskCache, diskCacheFile, sprites);
+        }
+    }
+
+    int cost = 0;
+    for (const KXcursorSprite &sprite : sprites) {
+        cost += sprite.data().sizeInBytes();
+    }
+    s_spriteCache->insert(key, new QVector<KXcursorSprite>(sprites), cost);
+    return sprites;
+}
+
+static void releaseSharedImage(void *image)
+{
+    delete static_cast<QImage *>(image);
+}
+
+/**
+ * Returns a view of the @a image with the given device pixel ratio. QImage::setDevicePixelRatio()
+ * would copy the pixels of the cached image, the view shares them instead.
+ */
+static QImage withDevicePixelRatio(const QImage &image, qreal devicePixelRatio)
+{
+    if (image.devicePixelRatio() == devicePixelRatio) {
+        return image;
+    }
+    QImage view(const_cast<uchar *>(image.constBits()), image.width(), image.height(),
+                image.bytesPerLine(), image.format(), releaseSharedImage, new QImage(image));
+    view.setDevicePixelRatio(devicePixelRatio);
+    return view;
+}
+
+static void index_callback(const char *name, const char *path, void *data)
+{
+    KXcursorThemePrivate *themePrivate = static_cast<KXcursorThemePrivate *>(data);
+
+    // The theme is indexed before the themes it inherits, the first file of a cursor wins.
+    const QByteArray cursorName(name);
+    if (!themePrivate->registry.contains(cursorName)) {
+        themePrivate->registry.insert(cursorName, QFile::decodeName(path));
+    }
 }
 
 KXcursorTheme::KXcursorTheme()
@@ -124,7 +334,22 @@ bool KXcursorTheme::isEmpty() const
 
 QVector<KXcursorSprite> KXcursorTheme::shape(const QByteArray &name) const
 {
-    return d->registry.value(name);
+    const QString fileName = d->registry.value(name);
+    if (fileName.isEmpty()) {
+        return {};
+    }
+
+    QVector<KXcursorSprite> sprites = loadSprites(fileName, d->size);
+    for (KXcursorSprite &sprite : sprites) {
+        sprite = KXcursorSprite(withDevicePixelRatio(sprite.data(), d->devicePixelRatio),
+                                sprite.hotspot() / d->devicePixelRatio, sprite.delay());
+    }
+    return sprites;
+}
+
+void KXcursorTheme::clearCache()
+{
+    s_spriteCache->clear();
 }
 
 KXcursorTheme KXcursorTheme::fromTheme(const QString &themeName, int size, qreal dpr)
@@ -132,9 +357,10 @@ KXcursorTheme KXcursorTheme::fromTheme(const QString &themeName, int size, qreal
     KXcursorTheme theme;
     KXcursorThemePrivate *themePrivate = theme.d;
     themePrivate->devicePixelRatio = dpr;
+    themePrivate->size = size * dpr;
 
     const QByteArray nativeThemeName = themeName.toUtf8();
-    xcursor_load_theme(nativeThemeName, size * dpr, load_callback, themePrivate);
+    xcursor_index_theme(nativeThemeName, index_callback, themePrivate);
 
     return theme;
 }
@@ -53,7 +53,8 @@ public:
     KXcursorSprite &operator=(const KXcursorSprite &other);
 
     /**
-     * Returns the image for this sprite.
+     * Returns the image for this sprite. The image shares its pixels with the cache of decoded
+     * cursors, it must not be modified.
      */
     QImage data() const;
 
@@ -111,14 +112,25 @@ public:
 
     /**
      * Returns the list of cursor sprites for the cursor with the given @a name.
+     *
+     * The cursor is decoded the first time it is used. Decoded cursors are cached in memory,
+     * shared by all themes, and on disk, unless KWIN_XCURSOR_NO_DISK_CACHE is set. The images
+     * of the sprites have the device pixel ratio of the theme.
      */
     QVector<KXcursorSprite> shape(const QByteArray &name) const;
 
     /**
      * Attempts to load the Xcursor theme with the given @a themeName and @a size.
+     *
+     * Only the cursor files of the theme are looked up, none of them is read.
      */
     static KXcursorTheme fromTheme(const QString &themeName, int size, qreal dpr);
 
+    /**
+     * Drops the decoded cursors that are cached in memory. The disk cache is kept.
+     */
+    static void clearCache();
+
 private:
     QSharedDataPointer<KXcursorThemePrivate> d;
 };
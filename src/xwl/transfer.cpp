@@ -29,6 +29,8 @@
 #include <xcb/xfixes.h>
 
 #include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
 
 #include <xwayland_logging.h>
@@ -89,6 +91,7 @@ TransferWltoX::TransferWltoX(xcb_atom_t selection, xcb_selection_request_event_t
                              qint32 fd, QObject *parent)
     : Transfer(selection, fd, 0, parent)
     , m_request(request)
+    , m_buffer(s_incrChunkSize)
 {
 }
 
@@ -111,30 +114,33 @@ void TransferWltoX::startTransferFromSource()
 
 int TransferWltoX::flushSourceData()
 {
-    Q_ASSERT(!m_chunks.isEmpty());
     xcb_connection_t *xcbConn = kwinApp()->x11Connection();
 
+    // the property is set straight from the buffer
+    const QByteArray chunk = m_buffer.front();
     xcb_change_property(xcbConn,
                         XCB_PROP_MODE_REPLACE,
                         m_request->requestor,
                         m_request->property,
                         m_request->target,
                         8,
-                        m_chunks.first().first.size(),
-                        m_chunks.first().first.data());
+                        chunk.size(),
+                        chunk.constData());
     xcb_flush(xcbConn);
 
     m_propertyIsSet = true;
     resetTimeout();
 
-    const auto rm = m_chunks.takeFirst();
-    return rm.first.size();
+    m_buffer.consume(chunk.size());
+    if (socketNotifier()) {
+        // there is room in the buffer again
+        socketNotifier()->setEnabled(true);
+    }
+    return chunk.size();
 }
 
 void TransferWltoX::startIncr()
 {
-    Q_ASSERT(m_chunks.size() == 1);
-
     xcb_connection_t *xcbConn = kwinApp()->x11Connection();
 
     uint32_t mask[] = { XCB_EVENT_MASK_PROPERTY_CHANGE };
@@ -162,33 +168,23 @@ void TransferWltoX::startIncr()
 
 void TransferWltoX::readWlSource()
 {
-    if (m_chunks.size() == 0 ||
-            m_chunks.last().second == s_incrChunkSize) {
-        // append new chunk
-        auto next = QPair<QByteArray, int>();
-        next.first.resize(s_incrChunkSize);
-        next.second = 0;
-        m_chunks.append(next);
-    }
-
-    const auto oldLen = m_chunks.last().second;
-    const auto avail = s_incrChunkSize - m_chunks.last().second;
-    Q_ASSERT(avail > 0);
-
-    ssize_t readLen = read(fd(), m_chunks.last().first.data() + oldLen, avail);
+    const qint64 readLen = m_buffer.readFrom(fd());
     if (readLen == -1) {
+        if (errno == EAGAIN || errno == EINTR) {
+            if (m_buffer.isFull()) {
+                socketNotifier()->setEnabled(false);
+            }
+            return;
+        }
         qCWarning(KWIN_XWL) << "Error reading in Wl data.";
 
         // TODO: cleanup X side?
         endTransfer();
         return;
     }
-    m_chunks.last().second = oldLen + readLen;
 
     if (readLen == 0) {
         // at the fd end - complete transfer now
-        m_chunks.last().first.resize(m_chunks.last().second);
-
         if (incr()) {
             // incremental transfer is to be completed now
             m_flushPropertyOnDelete = true;
@@ -204,18 +200,24 @@ void TransferWltoX::readWlSource()
             Q_EMIT selectionNotify(m_request, true);
             endTransfer();
         }
-    } else if (m_chunks.last().second == s_incrChunkSize) {
-        // first chunk full, but not yet at fd end -> go incremental
-        if (incr()) {
-            m_flushPropertyOnDelete = true;
-            if (!m_propertyIsSet) {
-                // flush if target's property is not set at the moment
-                flushSourceData();
-            }
-        } else {
-            // starting incremental transfer
-            startIncr();
+        return;
+    }
+
+    if (incr()) {
+        m_flushPropertyOnDelete = true;
+        if (!m_propertyIsSet) {
+            // flush if target's property is not set at the moment
+            flushSourceData();
         }
+    } else if (m_buffer.size() >= m_buffer.chunkSize()) {
+        // more than a chunk, but not yet at fd end -> go incremental
+        startIncr();
+    }
+
+    if (m_buffer.isFull()) {
+        // Stop reading until the requestor has taken a chunk, otherwise a large selection
+        // would end up in memory as a whole.
+        socketNotifier()->setEnabled(false);
     }
     resetTimeout();
 }
@@ -241,7 +243,7 @@ void TransferWltoX::handlePropertyDelete()
     m_propertyIsSet = false;
 
     if (m_flushPropertyOnDelete) {
-        if (!socketNotifier() && m_chunks.isEmpty()) {
+        if (!socketNotifier() && m_buffer.isEmpty()) {
             // transfer complete
             xcb_connection_t *xcbConn = kwinApp()->x11Connection();
 
@@ -259,7 +261,7 @@ void TransferWltoX::handlePropertyDelete()
             xcb_flush(xcbConn);
             m_flushPropertyOnDelete = false;
             endTransfer();
-        } else if (!m_chunks.isEmpty()) {
+        } else if (!m_buffer.isEmpty()) {
             flushSourceData();
         }
     }
@@ -269,7 +271,14 @@ TransferXtoWl::TransferXtoWl(xcb_atom_t selection, xcb_atom_t target, qint32 fd,
                              xcb_timestamp_t timestamp, xcb_window_t parentWindow,
                              QObject *parent)
     : Transfer(selection, fd, timestamp, parent)
+    , m_buffer(s_incrChunkSize)
 {
+    // The requestor may be slow to read, writing must not block the compositor.
+    const int flags = fcntl(fd, F_GETFL);
+    if (flags != -1) {
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    }
+
     // create transfer window
     xcb_connection_t *xcbConn = kwinApp()->x11Connection();
     m_window = xcb_generate_id(xcbConn);
@@ -412,15 +421,28 @@ void TransferXtoWl::getIncrChunk()
 
     if (xcb_get_property_value_length(reply) > 0) {
         // reply's ownership is transferred
+        m_propertyPending = true;
         m_receiver->transferFromProperty(reply);
         dataSourceWrite();
     } else {
-        // Transfer complete
+        // Transfer complete, once the buffered data has been written
         free(reply);
-        endTransfer();
+        m_sourceFinished = true;
+        dataSourceWrite();
     }
 }
 
+void TransferXtoWl::requestIncrChunk()
+{
+    // deleting the property makes the source send the next chunk
+    m_propertyPending = false;
+    xcb_connection_t *xcbConn = kwinApp()->x11Connection();
+    xcb_delete_property(xcbConn,
+                        m_window,
+                        atoms->wl_selection);
+    xcb_flush(xcbConn);
+}
+
 DataReceiver::~DataReceiver()
 {
     if (m_propertyReply) {
@@ -453,8 +475,7 @@ QByteArray DataReceiver::data() const
 void DataReceiver::partRead(int length)
 {
     m_propertyStart += length;
-    if (m_propertyStart == m_data.size()) {
-        Q_ASSERT(m_propertyReply);
+    if (m_propertyStart == m_data.size() && m_propertyReply) {
         free(m_propertyReply);
         m_propertyReply = nullptr;
     }
@@ -543,39 +564,40 @@ void MozUrlReceiver::setData(const char *value, int length)
 
 void TransferXtoWl::dataSourceWrite()
 {
-    QByteArray property = m_receiver->data();
+    // Take as much of the property as fits into the buffer. The rest stays in the property
+    // reply, and the next chunk isn't requested until the property has been taken entirely.
+    const QByteArray property = m_receiver->data();
+    if (!property.isEmpty()) {
+        m_receiver->partRead(m_buffer.append(property.constData(), property.size()));
+    }
+    const bool propertyTaken = m_receiver->data().isEmpty();
+    if (incr() && m_propertyPending && propertyTaken) {
+        // the source can prepare the next chunk while the buffer is written
+        requestIncrChunk();
+    }
 
-    ssize_t len = write(fd(), property.constData(), property.size());
-    if (len == -1) {
+    const qint64 len = m_buffer.writeTo(fd());
+    if (len == -1 && errno != EAGAIN && errno != EINTR) {
         qCWarning(KWIN_XWL) << "X11 to Wayland write error on fd:" << fd();
         endTransfer();
         return;
     }
 
-    m_receiver->partRead(len);
-    if (len == property.size()) {
-        // property completely transferred
-        if (incr()) {
-            clearSocketNotifier();
-            xcb_connection_t *xcbConn = kwinApp()->x11Connection();
-            xcb_delete_property(xcbConn,
-                                m_window,
-                                atoms->wl_selection);
-            xcb_flush(xcbConn);
-        } else {
+    if (m_buffer.isEmpty() && propertyTaken) {
+        clearSocketNotifier();
+        if (!incr() || m_sourceFinished) {
             // transfer complete
             endTransfer();
+            return;
         }
-    } else {
-        if (!socketNotifier()) {
-            createSocketNotifier(QSocketNotifier::Write);
-            connect(socketNotifier(), &QSocketNotifier::activated, this,
-                [this](int socket) {
-                    Q_UNUSED(socket);
-                    dataSourceWrite();
-                }
-            );
-        }
+    } else if (!socketNotifier()) {
+        createSocketNotifier(QSocketNotifier::Write);
+        connect(socketNotifier(), &QSocketNotifier::activated, this,
+            [this](int socket) {
+                Q_UNUSED(socket);
+                dataSourceWrite();
+            }
+        );
     }
     resetTimeout();
 }
@@ -9,6 +9,8 @@
 #ifndef KWIN_XWL_TRANSFER
 #define KWIN_XWL_TRANSFER
 
+#include "transferbuffer.h"
+
 #include <QObject>
 #include <QSocketNotifier>
 #include <QVector>
@@ -126,10 +128,8 @@ private:
 
     xcb_selection_request_event_t *m_request = nullptr;
 
-    /* contains all received data portioned in chunks
-     * TODO: explain second QPair component
-     */
-    QVector<QPair<QByteArray, int> > m_chunks;
+    // the data that has been read from the source, but not yet put into the property
+    TransferBuffer m_buffer;
 
     bool m_propertyIsSet = false;
     bool m_flushPropertyOnDelete = false;
@@ -147,7 +147,6 @@ public:
 
     void transferFromProperty(xcb_get_property_reply_t *reply);
 
-
     virtual void setData(const char *value, int length);
     QByteArray data() const;
 
@@ -206,10 +205,16 @@ private:
     void dataSourceWrite();
     void startTransfer();
     void getIncrChunk();
+    void requestIncrChunk();
 
     xcb_window_t m_window;
     DataReceiver *m_receiver = nullptr;
 
+    // the data that is waiting for the Wayland requestor to read it
+    TransferBuffer m_buffer;
+    bool m_propertyPending = false;
+    bool m_sourceFinished = false;
+
     Q_DISABLE_COPY(TransferXtoWl)
 };
 
@@ -0,0 +1,127 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "transferbuffer.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <sys/uio.h>
+
+namespace KWin
+{
+namespace Xwl
+{
+
+TransferBuffer::TransferBuffer(int chunkSize, int chunkCount)
+    : m_chunkSize(chunkSize)
+{
+    m_data.resize(chunkSize * chunkCount);
+}
+
+int TransferBuffer::chunkSize() const
+{
+    return m_chunkSize;
+}
+
+int TransferBuffer::capacity() const
+{
+    return m_data.size();
+}
+
+int TransferBuffer::size() const
+{
+    return m_size;
+}
+
+bool TransferBuffer::isEmpty() const
+{
+    return m_size == 0;
+}
+
+bool TransferBuffer::isFull() const
+{
+    return m_size == capacity();
+}
+
+int TransferBuffer::append(const char *data, int length)
+{
+    int copied = 0;
+    while (copied < length && !isFull()) {
+        const int end = (m_start + m_size) % capacity();
+        const int contiguous = std::min(length - copied, (end < m_start ? m_start : capacity()) - end);
+        memcpy(m_data.data() + end, data + copied, contiguous);
+        m_size += contiguous;
+        copied += contiguous;
+    }
+    return copied;
+}
+
+qint64 TransferBuffer::readFrom(int fd)
+{
+    // The free space wraps around the end of the ring at most once.
+    iovec vectors[2];
+    int count = 0;
+    const int end = (m_start + m_size) % capacity();
+    if (end >= m_start && !isFull()) {
+        vectors[count++] = {m_data.data() + end, size_t(capacity() - end)};
+        if (m_start > 0) {
+            vectors[count++] = {m_data.data(), size_t(m_start)};
+        }
+    } else if (!isFull()) {
+        vectors[count++] = {m_data.data() + end, size_t(m_start - end)};
+    }
+    if (!count) {
+        // a full buffer must not be mistaken for the end of the file
+        errno = EAGAIN;
+        return -1;
+    }
+
+    const ssize_t length = readv(fd, vectors, count);
+    if (length > 0) {
+        m_size += length;
+    }
+    return length;
+}
+
+qint64 TransferBuffer::writeTo(int fd)
+{
+    if (isEmpty()) {
+        return 0;
+    }
+    iovec vectors[2];
+    int count = 0;
+    const int firstLength = std::min(m_size, capacity() - m_start);
+    vectors[count++] = {m_data.data() + m_start, size_t(firstLength)};
+    if (firstLength < m_size) {
+        vectors[count++] = {m_data.data(), size_t(m_size - firstLength)};
+    }
+
+    const ssize_t length = writev(fd, vectors, count);
+    if (length > 0) {
+        consume(length);
+    }
+    return length;
+}
+
+QByteArray TransferBuffer::front() const
+{
+    const int length = std::min({m_size, capacity() - m_start, m_chunkSize});
+    return QByteArray::fromRawData(m_data.constData() + m_start, length);
+}
+
+void TransferBuffer::consume(int length)
+{
+    length = std::min(length, m_size);
+    m_size -= length;
+    // Start from the beginning of the ring when it is empty, so that reads aren't split.
+    m_start = m_size ? (m_start + length) % capacity() : 0;
+}
+
+} // namespace Xwl
+} // namespace KWin
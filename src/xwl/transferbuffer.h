@@ -0,0 +1,76 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2021 KWin developers
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#ifndef KWIN_XWL_TRANSFERBUFFER
+#define KWIN_XWL_TRANSFERBUFFER
+
+#include <QByteArray>
+
+namespace KWin
+{
+namespace Xwl
+{
+
+/**
+ * The TransferBuffer class holds the data of a selection transfer on its way from the source
+ * to the requestor.
+ *
+ * The buffer is a ring of a few chunks that is allocated once. A transfer stops reading from
+ * the source while the buffer is full, so a requestor that consumes the data slowly doesn't
+ * make the compositor buffer the whole selection. Data is read and written with readv() and
+ * writev(), straight from and into the ring.
+ */
+class TransferBuffer
+{
+public:
+    explicit TransferBuffer(int chunkSize, int chunkCount = 4);
+
+    int chunkSize() const;
+    int capacity() const;
+    int size() const;
+    bool isEmpty() const;
+    bool isFull() const;
+
+    /**
+     * Copies as much of the @a length bytes at @a data into the buffer as fits. Returns the
+     * number of copied bytes.
+     */
+    int append(const char *data, int length);
+    /**
+     * Reads as much as fits from @a fd. Returns the number of read bytes, 0 at the end of the
+     * file, or -1 on error, see errno. If the buffer is full, -1 is returned and errno is set
+     * to EAGAIN.
+     */
+    qint64 readFrom(int fd);
+    /**
+     * Writes as much as possible to @a fd. Returns the number of written bytes, or -1 on
+     * error, see errno.
+     */
+    qint64 writeTo(int fd);
+
+    /**
+     * Returns the oldest buffered data, at most one chunk. The returned byte array doesn't
+     * own the data, it's valid until the buffer is changed.
+     */
+    QByteArray front() const;
+    /**
+     * Drops the oldest @a length bytes.
+     */
+    void consume(int length);
+
+private:
+    QByteArray m_data;
+    int m_chunkSize;
+    int m_start = 0;
+    int m_size = 0;
+};
+
+} // namespace Xwl
+} // namespace KWin
+
+#endif